@@ -0,0 +1,63 @@
+#pragma once
+
+#include <iterator>
+#include <map>
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+
+namespace WAVM {
+	// Maps disjoint ranges of addresses to values. Finding the range that contains an address takes
+	// O(log N) time, where N is the number of ranges in the map.
+	template<typename Value> struct AddressRangeMap
+	{
+		// Adds the range [begin, end) to the map. The range must not overlap any range that is
+		// already in the map.
+		void addOrFail(Uptr begin, Uptr end, const Value& value)
+		{
+			WAVM_ASSERT(begin < end);
+			WAVM_ASSERT(!get(begin) && !get(end - 1));
+
+			auto insertResult = endToRangeMap.emplace(end, Range{begin, value});
+			WAVM_ASSERT(insertResult.second);
+			WAVM_SUPPRESS_UNUSED(insertResult);
+
+			// The new range must not contain the range that follows it.
+			WAVM_ASSERT(std::next(insertResult.first) == endToRangeMap.end()
+						|| std::next(insertResult.first)->second.begin >= end);
+		}
+
+		// Removes the range [begin, end) from the map. Returns false if the map didn't contain the
+		// range.
+		bool remove(Uptr begin, Uptr end)
+		{
+			auto it = endToRangeMap.find(end);
+			if(it == endToRangeMap.end() || it->second.begin != begin) { return false; }
+			endToRangeMap.erase(it);
+			return true;
+		}
+
+		// Finds the range that contains an address. If there is one, returns a pointer to its
+		// value, and writes the start of the range to outBegin. Otherwise, returns null.
+		const Value* get(Uptr address, Uptr* outBegin = nullptr) const
+		{
+			// Find the first range that ends after the address, and check that it starts at or
+			// before the address.
+			auto it = endToRangeMap.upper_bound(address);
+			if(it == endToRangeMap.end() || address < it->second.begin) { return nullptr; }
+
+			if(outBegin) { *outBegin = it->second.begin; }
+			return &it->second.value;
+		}
+
+		Uptr size() const { return endToRangeMap.size(); }
+
+	private:
+		struct Range
+		{
+			Uptr begin;
+			Value value;
+		};
+
+		std::map<Uptr, Range> endToRangeMap;
+	};
+}
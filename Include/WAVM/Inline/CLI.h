@@ -101,7 +101,11 @@ namespace WAVM {
 			   "\n"
 			   "  WAVM_OBJECT_CACHE_MAX_MB=<n>\n"
 			   "    Specifies the maximum amount of disk space that WAVM will use to\n"
-			   "    cache compiled object code.\n";
+			   "    cache compiled object code.\n"
+			   "\n"
+			   "  WAVM_OBJECT_CACHE_COMPRESSION_LEVEL=<n>\n"
+			   "    Compresses object code added to the cache with zstd level <n>.\n"
+			   "    If 0 (the default), object code is stored uncompressed.\n";
 	}
 
 	inline bool initLogFromEnvironment()
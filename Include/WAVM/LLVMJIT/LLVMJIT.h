@@ -58,14 +58,141 @@ namespace WAVM { namespace LLVMJIT {
 
 	WAVM_API Version getVersion();
 
+	// How much the compiler should optimize a module's code.
+	enum class OptimizationLevel
+	{
+		// Only promotes locals to registers, and generates machine code with the fast instruction
+		// selector. This compiles much faster, but the code runs slower.
+		none,
+
+		// Runs a short list of function-local optimization passes.
+		fast,
+
+		// Runs the LLVM -O2 pipeline, which adds inlining, loop optimizations, GVN, and
+		// vectorization.
+		balanced,
+
+		// Runs the LLVM -O3 pipeline, and generates machine code with aggressive optimization.
+		aggressive,
+	};
+
+	WAVM_API const char* asString(OptimizationLevel optimizationLevel);
+
+	// How the compiled code ensures that memory accesses can't access anything outside the memory.
+	// The modes differ in how much address space the runtime must reserve for each 32-bit memory.
+	enum class BoundsCheckMode
+	{
+		// 32-bit memories reserve 8GB of address space, which contains every address that a 32-bit
+		// index plus a 32-bit offset can produce, so accesses aren't checked: out-of-bounds
+		// accesses fault on the uncommitted pages after the end of the memory. 64-bit memories
+		// clamp addresses to the end of their reserved address space.
+		guardPages,
+
+		// 32-bit memories reserve 4GB of address space plus a guard region. Accesses with offsets
+		// smaller than the guard region aren't checked, and accesses with larger offsets are
+		// clamped to the end of the reserved address space. 64-bit memories are accessed as with
+		// guardPages.
+		reducedReservation,
+
+		// Memories only reserve address space for their maximum size, and every access is clamped
+		// to the end of the reserved address space.
+		clamp,
+
+		// Memories only reserve address space for their maximum size, and every access is compared
+		// to the memory's current size, calling a trap intrinsic if it is out of bounds.
+		explicitChecks,
+	};
+
+	WAVM_API const char* asString(BoundsCheckMode boundsCheckMode);
+
+	// Execution counts collected from a module compiled with CompileOptions::instrumentProfile.
+	struct ModuleProfile
+	{
+		// Identifies the module the profile was collected from: see getProfileModuleHash.
+		U64 moduleHash = 0;
+
+		// For each function definition: a counter of the calls to it, followed by a pair of
+		// counters for each if and br_if operator in it. The first counter of the pair counts the
+		// times the operator was executed, and the second counts the times its condition was true.
+		std::vector<U64> counters;
+	};
+
+	// Returns the number of profile counters that instrumented code for a module uses.
+	WAVM_API Uptr getNumProfileCounters(const IR::Module& irModule);
+
+	// Returns a hash of a module's function definitions that is used to match a profile to the
+	// module it was collected from.
+	WAVM_API U64 getProfileModuleHash(const IR::Module& irModule);
+
+	// Serializes a profile to bytes that may be written to a file or stored in an object cache.
+	WAVM_API std::vector<U8> serializeModuleProfile(const ModuleProfile& profile);
+	WAVM_API bool deserializeModuleProfile(const std::vector<U8>& bytes,
+										   ModuleProfile& outProfile);
+
+	// Options that control how a module is compiled to object code.
+	struct CompileOptions
+	{
+		// The number of threads to use for compiling the module. If 0, one thread is used per
+		// hardware thread. If greater than 1, the module's function definitions are partitioned
+		// and each partition is compiled to a separate object file on its own thread. The object
+		// files are combined into a single object code image that is loaded by loadModule as one
+		// module.
+		Uptr numThreads = 1;
+
+		// OptimizationLevel::none is the baseline tier for tiered compilation.
+		OptimizationLevel optimizationLevel = OptimizationLevel::fast;
+
+		// If true, the compiled code counts function calls and branches in a buffer that must be
+		// bound by loadModule's profileCounters parameter.
+		bool instrumentProfile = false;
+
+		// If non-null, the profile is used to set branch weights, function entry counts, and
+		// inlining hints. A profile that was collected from a different module is ignored.
+		std::shared_ptr<const ModuleProfile> profile;
+
+		// The code may only access memories that reserve the address space this mode requires:
+		// see Runtime::compileModule.
+		BoundsCheckMode boundsCheckMode = BoundsCheckMode::guardPages;
+
+		// If true, a call_indirect through a table that the module never mutates may be compiled
+		// to direct calls of the functions that the module's elem segments put in the table: a
+		// direct call if the element index is constant, or a switch between direct calls if the
+		// element index is known to be within a small range. This relies on the module's analysis
+		// of which tables it mutates, so it is disabled by default.
+		bool devirtualizeIndirectCalls = false;
+
+		// If true, the compiled code consumes the fuel in the ContextRuntimeData of the context
+		// it runs on, and traps with Runtime::ExceptionTypes::outOfFuel when it runs out: see
+		// Runtime::setContextFuel.
+		bool meterFuel = false;
+
+		// If true, each function counts its calls in its FunctionMutableData::tierUp, and calls the
+		// runtime every Runtime::FunctionTierUp::callInterval calls so it can replace the function
+		// with optimized code. Once the runtime installs optimized code for the function, calls to
+		// it are forwarded to the optimized code. This is intended for the baseline tier: see
+		// Runtime::optimizeModuleInBackground.
+		bool tierUp = false;
+	};
+
+	// Returns whether each of a module's tables is immutable after instantiation: it is defined by
+	// the module, isn't exported, and isn't mutated by the module's code. Compiled code assumes
+	// that an immutable table only contains the elements that the module's active elem segments
+	// write to it, so the runtime must not let the host mutate the table after instantiating it.
+	WAVM_API std::vector<bool> getImmutableTables(const IR::Module& irModule);
+
 	// Compile a module to object code with the host target spec.
 	// Cannot fail if validateTarget(targetSpec, irModule.featureSpec) == valid.
 	WAVM_API std::vector<U8> compileModule(const IR::Module& irModule,
-										   const TargetSpec& targetSpec);
+										   const TargetSpec& targetSpec,
+										   const CompileOptions& options = CompileOptions());
 
+	// Emits the LLVM IR that compileModule would compile the module to with the same options. If
+	// optimize is true, the IR is optimized with options.optimizationLevel. The module is always
+	// emitted as a single partition, regardless of options.numThreads.
 	WAVM_API std::string emitLLVMIR(const IR::Module& irModule,
 									const TargetSpec& targetSpec,
-									bool optimize);
+									bool optimize,
+									const CompileOptions& options = CompileOptions());
 
 	WAVM_API std::string disassembleObject(const TargetSpec& targetSpec,
 										   const std::vector<U8>& objectBytes);
@@ -113,9 +240,13 @@ namespace WAVM { namespace LLVMJIT {
 	};
 
 	// Loads a module from object code, and binds its undefined symbols to the provided bindings.
+	// wavmIntrinsicsExportMap is only referenced while the module is loaded, so the same map may be
+	// reused to load any number of modules. If the object code was compiled with
+	// CompileOptions::instrumentProfile, profileCounters must point to the module's
+	// getNumProfileCounters counters, and they must outlive the loaded module.
 	WAVM_API std::shared_ptr<Module> loadModule(
 		const std::vector<U8>& objectFileBytes,
-		HashMap<std::string, FunctionBinding>&& wavmIntrinsicsExportMap,
+		const HashMap<std::string, FunctionBinding>& wavmIntrinsicsExportMap,
 		std::vector<IR::FunctionType>&& types,
 		std::vector<FunctionBinding>&& functionImports,
 		std::vector<TableBinding>&& tables,
@@ -125,6 +256,7 @@ namespace WAVM { namespace LLVMJIT {
 		InstanceBinding instance,
 		Uptr tableReferenceBias,
 		const std::vector<Runtime::FunctionMutableData*>& functionDefMutableDatas,
+		U64* profileCounters,
 		std::string&& debugName);
 
 	struct InstructionSource
@@ -139,4 +271,7 @@ namespace WAVM { namespace LLVMJIT {
 
 	// Generates an invoke thunk for a specific function type.
 	WAVM_API Runtime::InvokeThunkPointer getInvokeThunk(IR::FunctionType functionType);
+
+	// Generates a thunk that invokes a function of a specific type many times in a loop.
+	WAVM_API Runtime::InvokeBatchThunkPointer getInvokeBatchThunk(IR::FunctionType functionType);
 }}
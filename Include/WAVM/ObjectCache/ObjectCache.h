@@ -19,8 +19,12 @@ namespace WAVM { namespace ObjectCache {
 		tooManyReaders,
 	};
 
+	// If compressionLevel is non-zero, object code added to the cache is compressed with zstd at
+	// that level: 1 is the fastest, and higher levels trade compression speed for smaller objects.
+	// Objects are read correctly whether or not they were compressed when they were added.
 	WAVM_API OpenResult open(const char* path,
 							 Uptr maxBytes,
 							 U64 codeKey,
-							 std::shared_ptr<Runtime::ObjectCacheInterface>& outObjectCache);
+							 std::shared_ptr<Runtime::ObjectCacheInterface>& outObjectCache,
+							 I32 compressionLevel = 0);
 }}
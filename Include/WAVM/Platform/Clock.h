@@ -15,7 +15,10 @@ namespace WAVM { namespace Platform {
 		monotonic,
 
 		// The amount of CPU time used by this process.
-		processCPUTime
+		processCPUTime,
+
+		// The amount of CPU time used by the calling thread.
+		threadCPUTime
 	};
 
 	WAVM_API Time getClockTime(Clock clock);
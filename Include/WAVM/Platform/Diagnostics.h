@@ -47,8 +47,10 @@ namespace WAVM { namespace Platform {
 		}
 	};
 
-	// Captures the execution context of the caller.
-	WAVM_API CallStack captureCallStack(Uptr numOmittedFramesFromTop = 0);
+	// Captures the execution context of the caller, with at most maxFrames frames. Unwinding the
+	// stack is expensive, so callers that don't need the whole call stack should limit it.
+	WAVM_API CallStack captureCallStack(Uptr numOmittedFramesFromTop = 0,
+										Uptr maxFrames = CallStack::maxFrames);
 
 	// Looks up the source of an instruction from a native module.
 	WAVM_API bool getInstructionSourceByAddress(Uptr ip, InstructionSource& outSource);
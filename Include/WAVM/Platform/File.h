@@ -2,7 +2,9 @@
 
 #include <string>
 #include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Time.h"
 #include "WAVM/Platform/Defines.h"
+#include "WAVM/Platform/Mutex.h"
 #include "WAVM/VFS/VFS.h"
 
 namespace WAVM { namespace Platform {
@@ -17,6 +19,60 @@ namespace WAVM { namespace Platform {
 	WAVM_API VFS::VFD* getStdFD(StdDevice device);
 	WAVM_API std::string getCurrentWorkingDirectory();
 
+	// Creates an anonymous pipe, and returns VFDs for its read and write ends.
+	WAVM_API VFS::Result createPipe(VFS::VFD*& outReadVFD, VFS::VFD*& outWriteVFD);
+
+	// A host FD to wait for, and the I/O readiness that waitForIO observed for it. The host FD of a
+	// VFD may be obtained with VFD::getHostFD.
+	struct IOWait
+	{
+		I32 hostFD = -1;
+		bool waitForRead = false;
+		bool waitForWrite = false;
+
+		// If the FD can't be waited for, result is set to the reason, and the IOWait is ready.
+		// numReadableBytes is the number of bytes that can be read without blocking, or 0 if that
+		// isn't known.
+		bool isReady = false;
+		VFS::Result result = VFS::Result::success;
+		bool isReadable = false;
+		bool isWritable = false;
+		bool isHungUp = false;
+		U64 numReadableBytes = 0;
+	};
+
+	// Allows other threads to interrupt a waitForIO call, e.g. to close one of the FDs it is
+	// waiting for. Once it has been interrupted, waitForIO calls that are passed it return
+	// immediately.
+	struct IOWaitInterrupt
+	{
+		IOWaitInterrupt() {}
+
+		// Don't allow copying or moving an IOWaitInterrupt.
+		IOWaitInterrupt(const IOWaitInterrupt&) = delete;
+		IOWaitInterrupt(IOWaitInterrupt&&) = delete;
+		void operator=(const IOWaitInterrupt&) = delete;
+		void operator=(IOWaitInterrupt&&) = delete;
+
+		WAVM_API void interrupt();
+
+	private:
+		friend struct IOWaitInterruptAccess;
+
+		Mutex mutex;
+		bool isInterrupted = false;
+		void* waiter = nullptr;
+	};
+
+	// Waits until at least one of the FDs is ready for the I/O it is waited for, the timeout has
+	// elapsed, or the wait is interrupted, and returns the number of ready IOWaits. If the timeout
+	// is infinite, waits until an FD is ready or the wait is interrupted. On Linux, the FDs are
+	// watched by a single epoll reactor thread, so threads that are waiting don't use any CPU time.
+	WAVM_API Uptr waitForIO(IOWait* waits,
+							Uptr numWaits,
+							Time timeout,
+							IOWaitInterrupt* interrupt = nullptr);
+
 	struct HostFS : VFS::FileSystem
 	{
 		// HostFS is intended to be a singleton, so prevent users from deleting it.
@@ -59,6 +59,33 @@ namespace WAVM { namespace Platform {
 										  Uptr numPages,
 										  Uptr alignmentLog2);
 
+	// An immutable copy of the contents of some virtual pages that can be mapped copy-on-write.
+	struct MemorySnapshot;
+
+	// Creates a snapshot of the contents of the specified committed virtual pages.
+	// Returns nullptr if the platform doesn't support snapshots, or the snapshot couldn't be
+	// allocated.
+	WAVM_API MemorySnapshot* createMemorySnapshot(const U8* baseVirtualAddress, Uptr numPages);
+
+	// Destroys a snapshot. Pages that were mapped from the snapshot remain mapped.
+	WAVM_API void destroyMemorySnapshot(MemorySnapshot* snapshot);
+
+	// Maps the first numPages pages of a snapshot copy-on-write to the specified virtual pages,
+	// replacing whatever was mapped to them. The pages are mapped with read-write access, and
+	// writes to them copy the written page instead of modifying the snapshot.
+	// baseVirtualAddress must be a multiple of the preferred page size.
+	// Returns false if the pages couldn't be mapped, in which case they are replaced with zeroed
+	// read-write pages.
+	WAVM_API bool mapMemorySnapshot(MemorySnapshot* snapshot,
+									U8* baseVirtualAddress,
+									Uptr numPages);
+
+	// Counts the specified virtual pages that were mapped from a snapshot and have since been
+	// copied because they were written. Returns false if the platform can't count them.
+	WAVM_API bool getNumCopiedSnapshotPages(U8* baseVirtualAddress,
+											Uptr numPages,
+											Uptr& outNumCopiedPages);
+
 	// Gets memory usage information for this process.
 	WAVM_API Uptr getPeakMemoryUsageBytes();
 }}
@@ -26,9 +26,22 @@ namespace WAVM { namespace Platform {
 		};
 	};
 
+	// Calls thunk, and if a signal occurs within it, calls filter with the signal and the call
+	// stack where it occurred. If filter returns true, returns true immediately. The call stack
+	// passed to the filters has at most the maxCallStackFrames of the innermost catchSignals.
 	WAVM_API bool catchSignals(void (*thunk)(void*),
 							   bool (*filter)(void*, Signal, CallStack&&),
-							   void* argument);
+							   void* argument,
+							   Uptr maxCallStackFrames = CallStack::maxFrames);
+
+	// If the innermost catchSignals on the calling thread was passed the given filter, returns the
+	// argument that was passed to it. Otherwise, returns null.
+	WAVM_API void* getInnermostCatchSignalsArgument(bool (*filter)(void*, Signal, CallStack&&));
+
+	// Makes the innermost catchSignals on the calling thread return true without calling its
+	// filter. The stack between the caller and the catchSignals is not unwound, so there must not
+	// be any frames with destructors or cleanups between them.
+	[[noreturn]] WAVM_API void jumpToInnermostCatchSignals();
 
 	WAVM_API void registerEHFrames(const U8* imageBase, const U8* ehFrames, Uptr numBytes);
 	WAVM_API void deregisterEHFrames(const U8* imageBase, const U8* ehFrames, Uptr numBytes);
@@ -18,6 +18,10 @@ namespace WAVM {
 	namespace WASM {
 		struct LoadError;
 	}
+	namespace LLVMJIT {
+		struct CompileOptions;
+		struct ModuleProfile;
+	}
 };
 
 // Declare the different kinds of objects. They are only declared as incomplete struct types here,
@@ -150,11 +154,28 @@ namespace WAVM { namespace Runtime {
 	// Frees any unreferenced objects owned by a compartment.
 	WAVM_API void collectCompartmentGarbage(Compartment* compartment);
 
+	// Frees unreferenced objects that were created in a compartment since its last garbage
+	// collection. Objects that survived a previous garbage collection are assumed to be referenced,
+	// so only the new objects and the old objects that may reference them are scanned, which keeps
+	// the compartment locked for less time than collectCompartmentGarbage. Unreferenced old objects
+	// are freed by the next call to collectCompartmentGarbage or tryCollectCompartment.
+	WAVM_API void collectCompartmentYoungGarbage(Compartment* compartment);
+
 	// Clears the given GC root reference to a compartment, and collects garbage for it. Returns
 	// true if the entire compartment was freed by the operation, or false if there are remaining
 	// root references that can reach it.
 	WAVM_API bool tryCollectCompartment(GCPointer<Compartment>&& compartment);
 
+	// Clears the given GC root reference to an instance, and frees the instance and the objects it
+	// defined if nothing else may reference them, without scanning the rest of its compartment.
+	// The runtime conservatively assumes that an instance may be referenced once any of its
+	// functions or objects is imported by another instance, stored in a table or global that it
+	// didn't define, or passed to a function that it didn't define; and that an instance whose
+	// code can pass references to imported code, or to functions in its tables, may be
+	// referenced. Returns true if the instance was freed, or false if it must be freed by
+	// collectCompartmentGarbage. None of the instance's functions may be executing.
+	WAVM_API bool tryCollectInstance(GCPointer<Instance>&& instance);
+
 	//
 	// Exception types
 	//
@@ -180,6 +201,8 @@ namespace WAVM { namespace Runtime {
 	visit(calledAbort);                                                                            \
 	visit(calledUnimplementedIntrinsic);                                                           \
 	visit(outOfMemory);                                                                            \
+	visit(outOfCPUTime);                                                                           \
+	visit(outOfFuel);                                                                              \
 	visit(misalignedAtomicMemoryAccess, WAVM::IR::ValueType::i64);                                 \
 	visit(waitOnUnsharedMemory, WAVM::IR::ValueType::externref);                                   \
 	visit(invalidArgument);
@@ -222,6 +245,25 @@ namespace WAVM { namespace Runtime {
 	WAVM_API Uptr getResourceQuotaCurrentMemoryPages(ResourceQuotaConstRefParam);
 	WAVM_API void setResourceQuotaMaxMemoryPages(ResourceQuotaRefParam, Uptr maxMemoryPages);
 
+	// The number of instances that may be instantiated with the quota at once.
+	WAVM_API Uptr getResourceQuotaMaxInstances(ResourceQuotaConstRefParam);
+	WAVM_API Uptr getResourceQuotaCurrentInstances(ResourceQuotaConstRefParam);
+	WAVM_API void setResourceQuotaMaxInstances(ResourceQuotaRefParam, Uptr maxInstances);
+
+	// The number of bytes of compiled code that may be loaded by the instances that use the quota.
+	WAVM_API Uptr getResourceQuotaMaxCodeBytes(ResourceQuotaConstRefParam);
+	WAVM_API Uptr getResourceQuotaCurrentCodeBytes(ResourceQuotaConstRefParam);
+	WAVM_API void setResourceQuotaMaxCodeBytes(ResourceQuotaRefParam, Uptr maxCodeBytes);
+
+	// The CPU time that may be used by invocations of the functions of instances that use the
+	// quota. Invoking a function once the quota's CPU time is used up throws an outOfCPUTime
+	// exception. The CPU time used by an invocation is only checked against the quota before it
+	// starts, so an invocation may run past the end of the quota.
+	WAVM_API U64 getResourceQuotaMaxCPUTimeNanoseconds(ResourceQuotaConstRefParam);
+	WAVM_API U64 getResourceQuotaCurrentCPUTimeNanoseconds(ResourceQuotaConstRefParam);
+	WAVM_API void setResourceQuotaMaxCPUTimeNanoseconds(ResourceQuotaRefParam,
+														U64 maxCPUTimeNanoseconds);
+
 	//
 	// Exceptions
 	//
@@ -247,6 +289,18 @@ namespace WAVM { namespace Runtime {
 	// Returns a specific argument of an exception.
 	WAVM_API IR::UntaggedValue getExceptionArgument(const Exception* exception, Uptr argIndex);
 
+	// Sets the maximum number of call stack frames that are captured for runtime exceptions,
+	// including the exceptions for WebAssembly traps. Capturing the call stack requires unwinding
+	// the stack, which dominates the cost of an exception that is caught and discarded without
+	// looking at its call stack. A depth of 0 doesn't capture any frames. The default is
+	// Platform::CallStack::maxFrames.
+	WAVM_API void setExceptionCallStackDepth(Uptr depth);
+	WAVM_API Uptr getExceptionCallStackDepth();
+
+	// Overrides the exception call stack depth for exceptions created while code is invoked on a
+	// context. Pass UINTPTR_MAX to use the global depth again.
+	WAVM_API void setExceptionCallStackDepth(Context* context, Uptr depth);
+
 	// Returns the call stack at the origin of an exception.
 	WAVM_API const Platform::CallStack& getExceptionCallStack(const Exception* exception);
 
@@ -316,6 +370,40 @@ namespace WAVM { namespace Runtime {
 								 const IR::UntaggedValue arguments[] = nullptr,
 								 IR::UntaggedValue results[] = nullptr);
 
+	// Like invokeFunction, but returns any runtime exception that occurs instead of throwing it, or
+	// null if the function returned normally. The caller takes ownership of the exception, and is
+	// responsible for calling destroyException. WebAssembly traps return here without throwing a
+	// C++ exception or unwinding the stack, which makes trapping calls much cheaper than with
+	// invokeFunction.
+	WAVM_API Exception* tryInvokeFunction(Context* context,
+										  const Function* function,
+										  IR::FunctionType invokeSig = IR::FunctionType(),
+										  const IR::UntaggedValue arguments[] = nullptr,
+										  IR::UntaggedValue results[] = nullptr);
+
+	// Invokes a Function numInvokes times. The arguments and results of each call are packed one
+	// after the other in the arrays, so they must have room for numInvokes times the number of
+	// arguments/results of the provided function type. The signature is checked and traps are
+	// caught once for the whole batch, and the calls are made in a loop in JIT code. If a call
+	// throws an exception, the following calls aren't made.
+	WAVM_API void invokeFunctionBatch(Context* context,
+									  const Function* function,
+									  IR::FunctionType invokeSig,
+									  Uptr numInvokes,
+									  const IR::UntaggedValue arguments[],
+									  IR::UntaggedValue results[]);
+
+	// Like invokeFunctionBatch, but returns any runtime exception that occurs instead of throwing
+	// it, as tryInvokeFunction does. If outNumCompletedInvokes is non-null, the number of calls
+	// that returned normally is written to it.
+	WAVM_API Exception* tryInvokeFunctionBatch(Context* context,
+											   const Function* function,
+											   IR::FunctionType invokeSig,
+											   Uptr numInvokes,
+											   const IR::UntaggedValue arguments[],
+											   IR::UntaggedValue results[],
+											   Uptr* outNumCompletedInvokes = nullptr);
+
 	// Returns the type of a Function.
 	WAVM_API IR::FunctionType getFunctionType(const Function* function);
 
@@ -336,6 +424,9 @@ namespace WAVM { namespace Runtime {
 
 	// Writes an element to the table, a returns the previous value of the element.
 	// Throws an outOfBoundsTableAccess exception if index is out-of-bounds.
+	// Throws an invalidArgument exception if the table is immutable: a table defined by an
+	// instance that doesn't export it or mutate it can't be written by the host, since the
+	// instance's code assumes it isn't mutated (see LLVMJIT::getImmutableTables).
 	WAVM_API Object* setTableElement(Table* table, Uptr index, Object* newValue);
 
 	// Gets the current size of the table.
@@ -345,6 +436,7 @@ namespace WAVM { namespace Runtime {
 	WAVM_API IR::TableType getTableType(const Table* table);
 
 	// Grows or shrinks the size of a table by numElements. Returns the previous size of the table.
+	// An immutable table (see setTableElement) can't grow: growing it returns outOfMaxSize.
 	WAVM_API GrowResult growTable(Table* table,
 								  Uptr numElements,
 								  Uptr* outOldNumElems = nullptr,
@@ -375,6 +467,44 @@ namespace WAVM { namespace Runtime {
 	// Unmaps a range of memory pages within the memory's address-space.
 	WAVM_API void unmapMemoryPages(Memory* memory, Uptr pageIndex, Uptr numPages);
 
+	// Statistics about a memory whose pages are mapped copy-on-write from a snapshot by
+	// cloneCompartment with MemoryCloneMode::copyOnWrite, either as the original memory or as a
+	// clone of it. The counts are in platform pages (see Platform::getBytesPerPage).
+	struct MemoryCopyOnWriteStats
+	{
+		// The number of pages that are mapped from the snapshot.
+		Uptr numSnapshotPages = 0;
+
+		// The number of those pages that have been copied because they were written, or
+		// UINTPTR_MAX if the platform couldn't count them.
+		Uptr numCopiedPages = 0;
+	};
+
+	WAVM_API MemoryCopyOnWriteStats getMemoryCopyOnWriteStats(const Memory* memory);
+
+	// 32-bit memories are allocated from a pool of address-space reservations. The pool's
+	// reservations are made the first time they are needed, and are reused when the memory that was
+	// allocated from them is freed. Memories that don't fit in the pool reserve their own address
+	// space.
+	struct MemoryPoolStats
+	{
+		// The maximum number of memories that can be allocated from the pool.
+		Uptr numSlots = 0;
+
+		// The number of memories currently allocated from the pool.
+		Uptr numAllocatedSlots = 0;
+
+		// The number of 32-bit memories that were and weren't allocated from the pool.
+		U64 numHits = 0;
+		U64 numMisses = 0;
+	};
+
+	WAVM_API MemoryPoolStats getMemoryPoolStats();
+
+	// Sets the maximum number of memories that can be allocated from the pool. 0 disables the pool.
+	// Returns false if there are memories allocated from the pool.
+	WAVM_API bool setMemoryPoolSize(Uptr numSlots);
+
 	// Validates that an offset range is wholly inside a Memory's virtual address range.
 	// Note that this returns an address range that may fault on access, though it's guaranteed not
 	// to be mapped by anything other than the given Memory.
@@ -430,7 +560,14 @@ namespace WAVM { namespace Runtime {
 	typedef const std::shared_ptr<const Module>& ModuleConstRefParam;
 
 	// Compiles an IR module to object code.
+	// Memories defined by the module reserve the address space that compileOptions.boundsCheckMode
+	// requires. Instantiating the module with an imported 32-bit memory fails if the module was
+	// compiled with the guardPages or reducedReservation mode, and the memory reserves less
+	// address space than that mode requires. Memories created by createMemory reserve enough
+	// address space for any mode.
 	WAVM_API ModuleRef compileModule(const IR::Module& irModule);
+	WAVM_API ModuleRef compileModule(const IR::Module& irModule,
+									 const LLVMJIT::CompileOptions& compileOptions);
 
 	// Load and compiles a binary module, returning either an error or a module.
 	// If true is returned, the load succeeded, and outModule contains the loaded module.
@@ -441,11 +578,42 @@ namespace WAVM { namespace Runtime {
 								   ModuleRef& outModule,
 								   const IR::FeatureSpec& featureSpec = IR::FeatureSpec(),
 								   WASM::LoadError* outError = nullptr);
+	WAVM_API bool loadBinaryModule(const U8* wasmBytes,
+								   Uptr numWASMBytes,
+								   ModuleRef& outModule,
+								   const IR::FeatureSpec& featureSpec,
+								   const LLVMJIT::CompileOptions& compileOptions,
+								   WASM::LoadError* outError = nullptr);
+
+	// Compiles optimized object code for a module on a background thread. If
+	// compileOptions.optimizationLevel is none, the default optimization level is used instead.
+	// This is intended for tiered compilation: the module may be compiled with the baseline tier so
+	// it can be instantiated immediately, and instances of the module created after the optimized
+	// object code is ready will use it. Instances created before then continue to use the baseline
+	// object code, unless the module was compiled with LLVMJIT::CompileOptions::tierUp: then the
+	// instances load the optimized object code and forward calls to their hot functions to it.
+	// If this hasn't been called, the optimization is started the first time a function becomes
+	// hot, with the options that the module was compiled with. Releasing the module doesn't wait
+	// for the optimization to finish, and skips it if it hasn't started yet.
+	WAVM_API void optimizeModuleInBackground(ModuleConstRefParam module,
+											 const LLVMJIT::CompileOptions& compileOptions);
+
+	// Reads the profile counters of a module that was compiled with
+	// LLVMJIT::CompileOptions::instrumentProfile. The counters are shared by all instances of the
+	// module, and may be read while they are running to get a snapshot of the profile. The profile
+	// can be passed to LLVMJIT::CompileOptions::profile to recompile the module with it. Returns
+	// false if the module wasn't compiled with profile instrumentation.
+	WAVM_API bool getModuleProfile(ModuleConstRefParam module, LLVMJIT::ModuleProfile& outProfile);
 
 	// Loads a previously compiled module from a combination of an IR module and the object code
-	// returned by getObjectCode for the previously compiled module.
+	// returned by getObjectCode for the previously compiled module. compileOptions must have the
+	// bounds-check mode, fuel metering, and profile instrumentation that the object code was
+	// compiled with. If the object code is instrumented, the module gets its own profile counters.
 	WAVM_API ModuleRef loadPrecompiledModule(const IR::Module& irModule,
 											 const std::vector<U8>& objectCode);
+	WAVM_API ModuleRef loadPrecompiledModule(const IR::Module& irModule,
+											 const std::vector<U8>& objectCode,
+											 const LLVMJIT::CompileOptions& compileOptions);
 
 	// Accesses the IR for a compiled module.
 	WAVM_API const IR::Module& getModuleIR(ModuleConstRefParam module);
@@ -461,7 +629,9 @@ namespace WAVM { namespace Runtime {
 	typedef std::vector<Object*> ImportBindings;
 
 	// Instantiates a module, bindings its imports to the specified objects. May throw a runtime
-	// exception for bad segment offsets.
+	// exception for bad segment offsets. Returns null if the instantiation fails: e.g. if the
+	// resource quota is exhausted, or an imported memory doesn't reserve the address space that the
+	// module's bounds-check mode requires.
 	WAVM_API Instance* instantiateModule(Compartment* compartment,
 										 ModuleConstRefParam module,
 										 ImportBindings&& imports,
@@ -509,8 +679,23 @@ namespace WAVM { namespace Runtime {
 
 	WAVM_API Compartment* createCompartment(std::string&& debugName = "");
 
+	// How cloneCompartment copies the contents of memories.
+	enum class MemoryCloneMode
+	{
+		// Copies the memory's contents to the cloned memory.
+		copy,
+
+		// Maps the cloned memory's contents copy-on-write from a snapshot of the original memory,
+		// so only the pages that the clone writes are copied. The original memory is remapped
+		// copy-on-write from the snapshot too, so later clones share the snapshot until a page of
+		// the original memory is written. The memories of the compartment must not be written
+		// while it is cloned. Falls back to copying on platforms that don't support snapshots.
+		copyOnWrite,
+	};
+
 	WAVM_API Compartment* cloneCompartment(const Compartment* compartment,
-										   std::string&& debugName = "");
+										   std::string&& debugName = "",
+										   MemoryCloneMode memoryCloneMode = MemoryCloneMode::copy);
 
 	WAVM_API Object* remapToClonedCompartment(const Object* object,
 											  const Compartment* newCompartment);
@@ -546,6 +731,17 @@ namespace WAVM { namespace Runtime {
 	// Creates a new context, initializing its mutable global state from the given context.
 	WAVM_API Context* cloneContext(const Context* context, Compartment* newCompartment);
 
+	// The fuel remaining in a context. Code compiled with LLVMJIT::CompileOptions::meterFuel
+	// consumes fuel as it runs on the context, and throws an outOfFuel exception once it has used
+	// more than is remaining. Code is charged one unit of fuel per operator, but only at function
+	// entries, loop headers and the ends of basic blocks, so it may run a few operators past the
+	// point where the fuel runs out. A new context has effectively unlimited fuel (INT64_MAX).
+	// The fuel may only be set or refilled while no code is running on the context. addContextFuel
+	// saturates at INT64_MIN and INT64_MAX.
+	WAVM_API I64 getContextFuel(const Context* context);
+	WAVM_API void setContextFuel(Context* context, I64 fuel);
+	WAVM_API void addContextFuel(Context* context, I64 fuel);
+
 	//
 	// Foreign objects
 	//
@@ -559,14 +755,71 @@ namespace WAVM { namespace Runtime {
 	// Object caching
 	//
 
+	struct ObjectCacheStats
+	{
+		// The number of modules whose object code was found in the cache, and the number that
+		// weren't. A miss that waited for another thread or process to compile the module is also
+		// counted as a deduplicated compile.
+		U64 numHits = 0;
+		U64 numMisses = 0;
+		U64 numDeduplicatedCompiles = 0;
+
+		// The number of cached objects that were evicted to make room for new objects.
+		U64 numEvictions = 0;
+
+		// The total time spent decompressing cached object code.
+		U64 decompressNanoseconds = 0;
+
+		// The objects currently in the cache: the size of their object code, and the number of
+		// bytes used to store it.
+		Uptr numCachedObjects = 0;
+		U64 numCachedObjectBytes = 0;
+		U64 numStoredObjectBytes = 0;
+	};
+
+	// Identifies a module's object code in an object cache.
+	struct ObjectCacheKey
+	{
+		// The module's WASM serialization.
+		const U8* wasmBytes = nullptr;
+		Uptr numWASMBytes = 0;
+
+		// A serialization of the compile options and feature spec that the object code depends on.
+		// Object code compiled with different options may not be safe to run with the module's
+		// options (e.g. code compiled for a different bounds-check mode), so the cache must only
+		// return object code that was compiled for the same configBytes.
+		std::vector<U8> configBytes;
+	};
+
 	struct ObjectCacheInterface
 	{
 		virtual ~ObjectCacheInterface() {}
 
-		virtual std::vector<U8> getCachedObject(const U8* wasmBytes,
-												Uptr numWASMBytes,
+		virtual std::vector<U8> getCachedObject(const ObjectCacheKey& key,
 												std::function<std::vector<U8>()>&& compileThunk)
 			= 0;
+
+		// Looks up the object code for a module, and calls loadThunk to load the module's IR before
+		// compiling it. loadThunk is passed whether the object code was cached, which lets
+		// loadBinaryModule skip validating the module's function bodies on a cache hit, so the
+		// cache must only return object code for the exact WASM bytes and configBytes it was
+		// compiled from. The configBytes include the feature spec the module was validated with.
+		// If loadThunk returns false, returns false without compiling the module. The default
+		// implementation doesn't probe the cache, so it always validates the function bodies.
+		virtual bool loadCachedObject(const ObjectCacheKey& key,
+									  std::function<bool(bool isCached)>&& loadThunk,
+									  std::function<std::vector<U8>()>&& compileThunk,
+									  std::vector<U8>& outObjectCode)
+		{
+			if(!loadThunk(false)) { return false; }
+			outObjectCode = getCachedObject(key, std::move(compileThunk));
+			return true;
+		}
+
+		// The hits, misses, and evictions are counted since the cache was opened by this process.
+		// The cached object counts describe the whole cache, including objects added by other
+		// processes.
+		virtual ObjectCacheStats getStats() { return ObjectCacheStats(); }
 	};
 
 	WAVM_API void setGlobalObjectCache(std::shared_ptr<ObjectCacheInterface>&& objectCache);
@@ -21,6 +21,7 @@ namespace WAVM { namespace Runtime {
 	struct Context;
 	struct ExceptionType;
 	struct Object;
+	struct ResourceQuota;
 	struct Table;
 	struct Memory;
 
@@ -57,7 +58,7 @@ namespace WAVM { namespace Runtime {
 	static constexpr Uptr contextNumBytes = 16384;
 	static constexpr Uptr maxThunkArgAndReturnBytes = 256;
 	static constexpr Uptr maxMutableGlobals
-		= (contextNumBytes - maxThunkArgAndReturnBytes - sizeof(Context*))
+		= (contextNumBytes - maxThunkArgAndReturnBytes - sizeof(Context*) - sizeof(I64))
 		  / sizeof(IR::UntaggedValue);
 	static constexpr Uptr contextRuntimeDataAlignment = 16384;
 
@@ -69,6 +70,11 @@ namespace WAVM { namespace Runtime {
 	{
 		U8 thunkArgAndReturnData[maxThunkArgAndReturnBytes];
 		Context* context;
+
+		// The fuel remaining for code compiled with CompileOptions::meterFuel. The code traps with
+		// outOfFuel when it becomes negative.
+		I64 fuel;
+
 		IR::UntaggedValue mutableGlobals[maxMutableGlobals];
 	};
 
@@ -166,6 +172,35 @@ namespace WAVM { namespace Runtime {
 															   const IR::UntaggedValue* arguments,
 															   IR::UntaggedValue* results);
 
+	// Calls a function numInvokes times. The arguments and results of each call are packed one
+	// after the other in the arrays. The number of calls that have returned is written to
+	// numCompletedInvokes after each call, so it is valid even if a call doesn't return.
+	typedef Runtime::ContextRuntimeData* (*InvokeBatchThunkPointer)(
+		const Runtime::Function*,
+		Runtime::ContextRuntimeData*,
+		const IR::UntaggedValue* arguments,
+		IR::UntaggedValue* results,
+		Uptr numInvokes,
+		Uptr* numCompletedInvokes);
+
+	// The state that code compiled with CompileOptions::tierUp uses to count calls to a function,
+	// and to forward them to the optimized code that the runtime installs for it.
+	struct FunctionTierUp
+	{
+		// The number of calls to the function between calls to the tierUpFunction intrinsic.
+		static constexpr U32 callInterval = 1024;
+
+		// If non-null, the function's code tail calls this code with its arguments on entry.
+		std::atomic<const void*> code{nullptr};
+
+		// The number of calls to the function's baseline code. Calls may race to increment it, so
+		// it is only approximate.
+		std::atomic<U32> numCalls{0};
+	};
+
+	static_assert((FunctionTierUp::callInterval & (FunctionTierUp::callInterval - 1)) == 0,
+				  "FunctionTierUp::callInterval must be a power of 2");
+
 	// Metadata about a function, used to hold data that can't be emitted directly in an object
 	// file, or must be mutable.
 	struct FunctionMutableData
@@ -174,9 +209,13 @@ namespace WAVM { namespace Runtime {
 		Runtime::Function* function = nullptr;
 		Uptr numCodeBytes = 0;
 		std::atomic<Uptr> numRootReferences{0};
+		std::atomic<bool> isReferencedOutsideInstance{false};
 		std::map<U32, U32> offsetToOpIndexMap;
 		std::string debugName;
 		std::atomic<InvokeThunkPointer> invokeThunk{nullptr};
+		std::atomic<InvokeBatchThunkPointer> invokeBatchThunk{nullptr};
+		FunctionTierUp tierUp;
+		ResourceQuota* resourceQuota{nullptr};
 		void* userData{nullptr};
 		void (*finalizeUserData)(void*);
 
@@ -213,6 +213,10 @@ namespace WAVM { namespace VFS {
 
 		virtual Result openDir(DirEntStream*& outStream) = 0;
 
+		// Gets the host file descriptor that backs the VFD, which Platform::waitForIO uses to wait
+		// for the VFD to be ready for I/O. VFDs that aren't backed by one return notSupported.
+		virtual Result getHostFD(I32& outHostFD) { return Result::notSupported; }
+
 		Result read(void* outData,
 					Uptr numBytes,
 					Uptr* outNumBytesRead = nullptr,
@@ -30,8 +30,12 @@ namespace WAVM { namespace WASM {
 		Type type;
 		std::string message;
 	};
+	// If validateFunctionBodies is false, the function bodies are decoded without being validated.
+	// That is only safe if the bytes are known to be a module that is valid with the module's
+	// feature spec: e.g. if object code compiled from the same bytes was found in an object cache.
 	WAVM_API bool loadBinaryModule(const U8* wasmBytes,
 								   Uptr numWASMBytes,
 								   IR::Module& outModule,
-								   LoadError* outError = nullptr);
+								   LoadError* outError = nullptr,
+								   bool validateFunctionBodies = true);
 }}
@@ -121,6 +121,21 @@ WASM_DECLARE_FEATURE(wat_custom_sections)
 
 #undef WASM_DECLARE_FEATURE
 
+typedef uint8_t wasm_optimization_level_t;
+enum wasm_optimization_level_enum
+{
+	WASM_OPTIMIZATION_LEVEL_NONE,
+	WASM_OPTIMIZATION_LEVEL_FAST,
+	WASM_OPTIMIZATION_LEVEL_BALANCED,
+	WASM_OPTIMIZATION_LEVEL_AGGRESSIVE,
+};
+
+// Sets how much modules compiled by the engine are optimized. The default is
+// WASM_OPTIMIZATION_LEVEL_FAST. Returns false and leaves the config unchanged if
+// optimization_level isn't one of the wasm_optimization_level_enum values.
+WASM_C_API bool wasm_config_set_optimization_level(wasm_config_t* config,
+												   wasm_optimization_level_t optimization_level);
+
 // Engine
 
 WASM_DECLARE_OWN(engine)
@@ -466,6 +481,18 @@ WASM_C_API own wasm_trap_t* wasm_func_call(wasm_store_t*,
 										   const wasm_val_t args[],
 										   wasm_val_t results[]);
 
+// Calls a function num_calls times, with the arguments and results of each call packed one after
+// the other in the args and results arrays. If a call traps, the following calls aren't made. The
+// number of calls that returned is written to out_num_completed_calls if it is non-null. If
+// num_calls is too large for the packed arguments or results to fit in memory, no calls are made,
+// and an invalidArgument trap is returned.
+WASM_C_API own wasm_trap_t* wasm_func_call_batch(wasm_store_t*,
+												 const wasm_func_t*,
+												 size_t num_calls,
+												 const wasm_val_t args[],
+												 wasm_val_t results[],
+												 size_t* out_num_completed_calls);
+
 // Global Instances
 
 WASM_DECLARE_REF(global)
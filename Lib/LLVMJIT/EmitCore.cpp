@@ -1,4 +1,6 @@
+#include <map>
 #include <memory>
+#include <utility>
 #include <vector>
 #include "EmitFunctionContext.h"
 #include "EmitModuleContext.h"
@@ -13,6 +15,7 @@
 PUSH_DISABLE_WARNINGS_FOR_LLVM_HEADERS
 #include <llvm/ADT/ArrayRef.h>
 #include <llvm/ADT/SmallVector.h>
+#include <llvm/Analysis/ValueTracking.h>
 #include <llvm/IR/BasicBlock.h>
 #include <llvm/IR/Constant.h>
 #include <llvm/IR/Constants.h>
@@ -20,6 +23,7 @@ PUSH_DISABLE_WARNINGS_FOR_LLVM_HEADERS
 #include <llvm/IR/Function.h>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/Instructions.h>
+#include <llvm/Support/KnownBits.h>
 POP_DISABLE_WARNINGS_FOR_LLVM_HEADERS
 
 namespace llvm {
@@ -31,6 +35,9 @@ using namespace WAVM::IR;
 using namespace WAVM::LLVMJIT;
 using namespace WAVM::Runtime;
 
+// The maximum number of table elements that a devirtualized call_indirect switches between.
+static constexpr U64 maxDevirtualizedCallIndirectElements = 8;
+
 void EmitFunctionContext::block(ControlStructureImm imm)
 {
 	FunctionType blockType = resolveBlockType(irModule, imm.type);
@@ -74,6 +81,9 @@ void EmitFunctionContext::loop(ControlStructureImm imm)
 	irBuilder.CreateBr(loopBodyBlock);
 	irBuilder.SetInsertPoint(loopBodyBlock);
 
+	// Trap at the start of each iteration if the context is out of fuel.
+	if(moduleContext.meterFuel) { emitFuelCheck(); }
+
 	// Push a control context that ends at the end block/phi.
 	pushControlStack(ControlContext::Type::loop, blockType.results(), endBlock, endPHIs);
 
@@ -95,7 +105,7 @@ void EmitFunctionContext::if_(ControlStructureImm imm)
 
 	// Pop the if condition from the operand stack.
 	auto condition = pop();
-	irBuilder.CreateCondBr(coerceI32ToBool(condition), thenBlock, elseBlock);
+	emitProfiledCondBr(coerceI32ToBool(condition), thenBlock, elseBlock);
 
 	// Pop the arguments from the operand stack.
 	ValueVector args;
@@ -221,7 +231,7 @@ void EmitFunctionContext::br_if(BranchImm imm)
 	auto falseBlock = llvm::BasicBlock::Create(llvmContext, "br_ifElse", function);
 
 	// Emit a conditional branch to either the falseBlock or the target block.
-	irBuilder.CreateCondBr(coerceI32ToBool(condition), target.block, falseBlock);
+	emitProfiledCondBr(coerceI32ToBool(condition), target.block, falseBlock);
 
 	// Resume emitting instructions in the falseBlock.
 	irBuilder.SetInsertPoint(falseBlock);
@@ -362,6 +372,7 @@ void EmitFunctionContext::call_indirect(CallIndirectImm imm)
 	const Uptr numArguments = calleeType.params().size();
 	auto llvmArgs = (llvm::Value**)alloca(sizeof(llvm::Value*) * numArguments);
 	popMultiple(llvmArgs, numArguments);
+	const llvm::ArrayRef<llvm::Value*> args(llvmArgs, numArguments);
 
 	// Coerce the arguments to their canonical type.
 	for(Uptr argIndex = 0; argIndex < numArguments; ++argIndex)
@@ -370,6 +381,110 @@ void EmitFunctionContext::call_indirect(CallIndirectImm imm)
 	// Zero extend the function index to the pointer size.
 	elementIndex = zext(elementIndex, moduleContext.iptrType);
 
+	// If the contents of the table are known, and the element index is known to be within a small
+	// range, try to call the functions in that range directly. The contents are only known for
+	// immutable tables, which the runtime doesn't let the host write to.
+	const TableAnalysis& tableAnalysis = moduleContext.analysis->tables[imm.tableIndex];
+	if(moduleContext.devirtualizeIndirectCalls && tableAnalysis.hasKnownElements)
+	{
+		const llvm::KnownBits knownElementIndexBits
+			= llvm::computeKnownBits(elementIndex, moduleContext.llvmModule->getDataLayout());
+		const U64 minElementIndex = knownElementIndexBits.getMinValue().getZExtValue();
+		const U64 maxElementIndex = knownElementIndexBits.getMaxValue().getZExtValue();
+
+		// Find the functions that the elements in the range are known to contain. Out of bounds,
+		// null, and mismatched elements are left to the indirect call, which traps on them.
+		std::vector<std::pair<Uptr, Uptr>> knownCallees;
+		const Uptr numKnownElements = tableAnalysis.elementFunctionIndices.size();
+		if(maxElementIndex - minElementIndex < maxDevirtualizedCallIndirectElements)
+		{
+			for(U64 rangeElementIndex = minElementIndex;
+				rangeElementIndex <= maxElementIndex && rangeElementIndex < numKnownElements;
+				++rangeElementIndex)
+			{
+				const Uptr functionIndex = getKnownCallIndirectCallee(
+					irModule, tableAnalysis, Uptr(rangeElementIndex), calleeType);
+				if(functionIndex != UINTPTR_MAX)
+				{ knownCallees.push_back({Uptr(rangeElementIndex), functionIndex}); }
+			}
+		}
+
+		if(minElementIndex == maxElementIndex && knownCallees.size() == 1)
+		{
+			// If the element index is constant, call the function in the element directly.
+			llvm::Function* callee = moduleContext.functions[knownCallees[0].second];
+			ValueVector results
+				= emitCallOrInvoke(callee, args, calleeType, getInnermostUnwindToBlock());
+			for(llvm::Value* result : results) { push(result); }
+			return;
+		}
+		else if(knownCallees.size())
+		{
+			// Otherwise, switch on the element index to a direct call of each known function, and
+			// fall back to an indirect call for any other element index.
+			auto endBlock = llvm::BasicBlock::Create(llvmContext, "callIndirectEnd", function);
+			auto endPHIs = createPHIs(endBlock, calleeType.results());
+			auto indirectCallBlock
+				= llvm::BasicBlock::Create(llvmContext, "callIndirectFallback", function);
+			auto llvmSwitch = irBuilder.CreateSwitch(
+				elementIndex, indirectCallBlock, (unsigned int)knownCallees.size());
+
+			// Emit a single direct call for all the elements that contain the same function.
+			std::map<Uptr, llvm::BasicBlock*> functionIndexToDirectCallBlockMap;
+			for(const auto& knownCallee : knownCallees)
+			{
+				llvm::BasicBlock*& directCallBlock
+					= functionIndexToDirectCallBlockMap[knownCallee.second];
+				if(!directCallBlock)
+				{
+					directCallBlock
+						= llvm::BasicBlock::Create(llvmContext, "callIndirectDirect", function);
+					irBuilder.SetInsertPoint(directCallBlock);
+					llvm::Function* callee = moduleContext.functions[knownCallee.second];
+					ValueVector results
+						= emitCallOrInvoke(callee, args, calleeType, getInnermostUnwindToBlock());
+					for(Uptr resultIndex = 0; resultIndex < results.size(); ++resultIndex)
+					{
+						endPHIs[resultIndex]->addIncoming(
+							coerceToCanonicalType(results[resultIndex]),
+							irBuilder.GetInsertBlock());
+					}
+					irBuilder.CreateBr(endBlock);
+				}
+
+				llvmSwitch->addCase(
+					llvm::ConstantInt::get(
+						llvm::cast<llvm::IntegerType>(moduleContext.iptrType), knownCallee.first),
+					directCallBlock);
+			}
+
+			irBuilder.SetInsertPoint(indirectCallBlock);
+			ValueVector results = emitCallTableElement(imm, calleeType, elementIndex, args);
+			for(Uptr resultIndex = 0; resultIndex < results.size(); ++resultIndex)
+			{
+				endPHIs[resultIndex]->addIncoming(coerceToCanonicalType(results[resultIndex]),
+												 irBuilder.GetInsertBlock());
+			}
+			irBuilder.CreateBr(endBlock);
+
+			irBuilder.SetInsertPoint(endBlock);
+			for(llvm::PHINode* endPHI : endPHIs) { push(endPHI); }
+			return;
+		}
+	}
+
+	// Call the function in the table element.
+	ValueVector results = emitCallTableElement(imm, calleeType, elementIndex, args);
+
+	// Push the results on the operand stack.
+	for(llvm::Value* result : results) { push(result); }
+}
+
+ValueVector EmitFunctionContext::emitCallTableElement(CallIndirectImm imm,
+													  FunctionType calleeType,
+													  llvm::Value* elementIndex,
+													  llvm::ArrayRef<llvm::Value*> args)
+{
 	// Load base and endIndex from the TableRuntimeData in CompartmentRuntimeData::tables
 	// corresponding to imm.tableIndex.
 	auto tableRuntimeDataPointer = irBuilder.CreateInBoundsGEP(
@@ -392,25 +507,44 @@ void EmitFunctionContext::call_indirect(CallIndirectImm imm)
 	auto clampedElementIndex = irBuilder.CreateSelect(
 		irBuilder.CreateICmpULT(elementIndex, tableMaxIndex), elementIndex, tableMaxIndex);
 
-	// Load the funcref referenced by the table.
+	// If every element of the table is known to be a function of the callee type, only check
+	// that the index is within the table's fixed size. Otherwise, check the type of the function.
+	const TableAnalysis& tableAnalysis = moduleContext.analysis->tables[imm.tableIndex];
+	const bool elideTypeCheck
+		= canElideCallIndirectTypeCheck(irModule, tableAnalysis, calleeType);
+
+	// Load the funcref referenced by the table. The elements of an immutable table are only
+	// written during instantiation, so they don't need to be loaded with acquire ordering.
 	auto elementPointer = irBuilder.CreateInBoundsGEP(tableBasePointer, {clampedElementIndex});
 	llvm::LoadInst* biasedValueLoad = irBuilder.CreateLoad(elementPointer);
-	biasedValueLoad->setAtomic(llvm::AtomicOrdering::Acquire);
+	if(!tableAnalysis.isImmutable) { biasedValueLoad->setAtomic(llvm::AtomicOrdering::Acquire); }
 	biasedValueLoad->setAlignment(LLVM_ALIGNMENT(sizeof(Uptr)));
 	auto runtimeFunction = irBuilder.CreateIntToPtr(
 		irBuilder.CreateAdd(biasedValueLoad, moduleContext.tableReferenceBias),
 		llvmContext.i8PtrType);
-	auto elementTypeId = loadFromUntypedPointer(
-		irBuilder.CreateInBoundsGEP(
-			runtimeFunction,
-			emitLiteralIptr(offsetof(Runtime::Function, encodedType), moduleContext.iptrType)),
-		moduleContext.iptrType,
-		moduleContext.iptrAlignment);
 	auto calleeTypeId = moduleContext.typeIds[imm.type.index];
 
-	// If the function type doesn't match, trap.
+	llvm::Value* isCallIndirectFail;
+	if(elideTypeCheck)
+	{
+		isCallIndirectFail = irBuilder.CreateICmpUGE(
+			elementIndex,
+			emitLiteralIptr(tableAnalysis.elementFunctionIndices.size(), moduleContext.iptrType));
+	}
+	else
+	{
+		auto elementTypeId = loadFromUntypedPointer(
+			irBuilder.CreateInBoundsGEP(
+				runtimeFunction,
+				emitLiteralIptr(offsetof(Runtime::Function, encodedType), moduleContext.iptrType)),
+			moduleContext.iptrType,
+			moduleContext.iptrAlignment);
+		isCallIndirectFail = irBuilder.CreateICmpNE(calleeTypeId, elementTypeId);
+	}
+
+	// If the index is out of bounds, or the function type doesn't match, trap.
 	emitConditionalTrapIntrinsic(
-		irBuilder.CreateICmpNE(calleeTypeId, elementTypeId),
+		isCallIndirectFail,
 		"callIndirectFail",
 		FunctionType(TypeTuple(),
 					 TypeTuple({moduleContext.iptrValueType,
@@ -429,13 +563,7 @@ void EmitFunctionContext::call_indirect(CallIndirectImm imm)
 			runtimeFunction,
 			emitLiteralIptr(offsetof(Runtime::Function, code), moduleContext.iptrType)),
 		asLLVMType(llvmContext, calleeType)->getPointerTo());
-	ValueVector results = emitCallOrInvoke(functionPointer,
-										   llvm::ArrayRef<llvm::Value*>(llvmArgs, numArguments),
-										   calleeType,
-										   getInnermostUnwindToBlock());
-
-	// Push the results on the operand stack.
-	for(llvm::Value* result : results) { push(result); }
+	return emitCallOrInvoke(functionPointer, args, calleeType, getInnermostUnwindToBlock());
 }
 
 void EmitFunctionContext::nop(IR::NoImm) {}
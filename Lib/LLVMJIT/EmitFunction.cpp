@@ -1,4 +1,5 @@
 #include <stdint.h>
+#include <algorithm>
 #include <initializer_list>
 #include <memory>
 #include <string>
@@ -14,6 +15,7 @@
 #include "WAVM/Inline/BasicTypes.h"
 #include "WAVM/Inline/Errors.h"
 #include "WAVM/Logging/Logging.h"
+#include "WAVM/RuntimeABI/RuntimeABI.h"
 
 PUSH_DISABLE_WARNINGS_FOR_LLVM_HEADERS
 #include <llvm/ADT/SmallVector.h>
@@ -30,6 +32,7 @@ PUSH_DISABLE_WARNINGS_FOR_LLVM_HEADERS
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/Instructions.h>
 #include <llvm/IR/Intrinsics.h>
+#include <llvm/IR/MDBuilder.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Type.h>
 #include <llvm/IR/Value.h>
@@ -175,6 +178,163 @@ void EmitFunctionContext::emitConditionalTrapIntrinsic(
 	irBuilder.SetInsertPoint(endBlock);
 }
 
+void EmitFunctionContext::emitProfileCounterIncrement(Uptr functionCounterIndex,
+													 llvm::Value* i64Increment)
+{
+	WAVM_ASSERT(moduleContext.profileCounters);
+	const Uptr counterIndex
+		= moduleContext.profileCounterOffsets[functionDefIndex] + functionCounterIndex;
+	llvm::Value* counterPointer = irBuilder.CreateIntToPtr(
+		llvm::ConstantExpr::getAdd(
+			moduleContext.profileCounters,
+			emitLiteralIptr(counterIndex * sizeof(U64), moduleContext.iptrType)),
+		llvmContext.i64Type->getPointerTo());
+
+	// The counters are shared by all instances of the module, so increment them atomically to avoid
+	// losing counts from concurrent calls. The increments don't need to be ordered with any other
+	// memory accesses, so use relaxed (monotonic) ordering.
+	irBuilder.CreateAtomicRMW(llvm::AtomicRMWInst::BinOp::Add,
+							  counterPointer,
+							  i64Increment,
+							  llvm::AtomicOrdering::Monotonic);
+}
+
+// Returns a pointer to the fuel in the ContextRuntimeData of the context the function runs on.
+static llvm::Value* getFuelPointer(EmitFunctionContext& functionContext)
+{
+	return functionContext.irBuilder.CreateInBoundsGEP(
+		functionContext.irBuilder.CreateLoad(functionContext.contextPointerVariable),
+		{emitLiteralIptr(offsetof(Runtime::ContextRuntimeData, fuel),
+						 functionContext.moduleContext.iptrType)});
+}
+
+void EmitFunctionContext::emitFuelCharge()
+{
+	if(!numUnchargedFuelOps) { return; }
+
+	// The fuel is only accessed by code running on the context, so it doesn't need to be atomic.
+	llvm::Value* fuelPointer = getFuelPointer(*this);
+	llvm::Value* fuel = loadFromUntypedPointer(fuelPointer, llvmContext.i64Type, sizeof(I64));
+	storeToUntypedPointer(
+		irBuilder.CreateSub(fuel, emitLiteral(llvmContext, numUnchargedFuelOps)),
+		fuelPointer,
+		sizeof(I64));
+	numUnchargedFuelOps = 0;
+}
+
+void EmitFunctionContext::emitFuelCheck()
+{
+	llvm::Value* fuelPointer = getFuelPointer(*this);
+	llvm::Value* fuel = loadFromUntypedPointer(fuelPointer, llvmContext.i64Type, sizeof(I64));
+	emitConditionalTrapIntrinsic(
+		irBuilder.CreateICmpSLT(fuel, llvmContext.typedZeroConstants[(Uptr)ValueType::i64]),
+		"outOfFuelTrap",
+		FunctionType({}, {}, IR::CallingConvention::intrinsic),
+		{});
+}
+
+void EmitFunctionContext::emitTierUpCheck()
+{
+	llvm::Constant* tierUp = moduleContext.functionDefTierUps[functionDefIndex];
+	WAVM_ASSERT(tierUp);
+
+	// Load the optimized code the runtime installed for the function, if any. The acquire load
+	// pairs with the runtime's release store, so the optimized code is visible before it's called.
+	llvm::LoadInst* tierUpCode = irBuilder.CreateLoad(irBuilder.CreateIntToPtr(
+		llvm::ConstantExpr::getAdd(
+			tierUp,
+			emitLiteralIptr(offsetof(Runtime::FunctionTierUp, code), moduleContext.iptrType)),
+		function->getType()->getPointerTo()));
+	tierUpCode->setAtomic(llvm::AtomicOrdering::Acquire);
+	tierUpCode->setAlignment(LLVM_ALIGNMENT(moduleContext.iptrAlignment));
+
+	auto forwardBlock = llvm::BasicBlock::Create(llvmContext, "tierUpForward", function);
+	auto countBlock = llvm::BasicBlock::Create(llvmContext, "tierUpCount", function);
+	irBuilder.CreateCondBr(irBuilder.CreateIsNotNull(tierUpCode), forwardBlock, countBlock);
+
+	// If there is optimized code, tail call it with the function's arguments, and return its
+	// result. The optimized code has the same signature and calling convention as this function.
+	irBuilder.SetInsertPoint(forwardBlock);
+	llvm::SmallVector<llvm::Value*, 8> forwardedArgs;
+	for(llvm::Argument& arg : function->args()) { forwardedArgs.push_back(&arg); }
+	llvm::CallInst* forwardedCall
+		= irBuilder.CreateCall(function->getFunctionType(), tierUpCode, forwardedArgs);
+	forwardedCall->setCallingConv(function->getCallingConv());
+	forwardedCall->setTailCallKind(llvm::CallInst::TCK_Tail);
+	irBuilder.CreateRet(forwardedCall);
+
+	// Otherwise, count the call. Concurrent calls may lose increments, but the count only needs to
+	// be approximate, so it's incremented with a relaxed load and store instead of an atomic RMW.
+	irBuilder.SetInsertPoint(countBlock);
+	llvm::Value* numCallsPointer = irBuilder.CreateIntToPtr(
+		llvm::ConstantExpr::getAdd(
+			tierUp,
+			emitLiteralIptr(offsetof(Runtime::FunctionTierUp, numCalls), moduleContext.iptrType)),
+		llvmContext.i32Type->getPointerTo());
+	llvm::LoadInst* numCalls = irBuilder.CreateLoad(numCallsPointer);
+	numCalls->setAtomic(llvm::AtomicOrdering::Monotonic);
+	numCalls->setAlignment(LLVM_ALIGNMENT(sizeof(U32)));
+	llvm::Value* newNumCalls = irBuilder.CreateAdd(numCalls, emitLiteral(llvmContext, U32(1)));
+	llvm::StoreInst* numCallsStore = irBuilder.CreateStore(newNumCalls, numCallsPointer);
+	numCallsStore->setAtomic(llvm::AtomicOrdering::Monotonic);
+	numCallsStore->setAlignment(LLVM_ALIGNMENT(sizeof(U32)));
+
+	// Every FunctionTierUp::callInterval calls, call the runtime to tier up the function.
+	auto tierUpBlock = llvm::BasicBlock::Create(llvmContext, "tierUp", function);
+	auto tierUpSkipBlock = llvm::BasicBlock::Create(llvmContext, "tierUpSkip", function);
+	llvm::Value* callIntervalMask
+		= emitLiteral(llvmContext, U32(Runtime::FunctionTierUp::callInterval - 1));
+	irBuilder.CreateCondBr(
+		irBuilder.CreateICmpEQ(irBuilder.CreateAnd(newNumCalls, callIntervalMask),
+							   emitLiteral(llvmContext, U32(0))),
+		tierUpBlock,
+		tierUpSkipBlock,
+		moduleContext.likelyFalseBranchWeights);
+
+	irBuilder.SetInsertPoint(tierUpBlock);
+	emitRuntimeIntrinsic(
+		"tierUpFunction",
+		FunctionType({},
+					 {moduleContext.iptrValueType, moduleContext.iptrValueType},
+					 IR::CallingConvention::intrinsic),
+		{moduleContext.instanceId, emitLiteralIptr(functionDefIndex, moduleContext.iptrType)});
+	irBuilder.CreateBr(tierUpSkipBlock);
+
+	irBuilder.SetInsertPoint(tierUpSkipBlock);
+}
+
+void EmitFunctionContext::emitProfiledCondBr(llvm::Value* booleanCondition,
+											 llvm::BasicBlock* trueBlock,
+											 llvm::BasicBlock* falseBlock)
+{
+	if(moduleContext.profileCounters)
+	{
+		emitProfileCounterIncrement(1 + profileBranchIndex * 2, emitLiteral(llvmContext, U64(1)));
+		emitProfileCounterIncrement(2 + profileBranchIndex * 2,
+									zext(booleanCondition, llvmContext.i64Type));
+	}
+
+	llvm::MDNode* branchWeights = nullptr;
+	if(moduleContext.profile)
+	{
+		const Uptr counterIndex
+			= moduleContext.profileCounterOffsets[functionDefIndex] + 1 + profileBranchIndex * 2;
+		const std::vector<U64>& counters = moduleContext.profile->counters;
+		const U64 numExecuted = counters[counterIndex];
+		const U64 numTaken = std::min(numExecuted, counters[counterIndex + 1]);
+		if(numExecuted)
+		{
+			// Branch weights are 32-bit, so scale down counts that don't fit.
+			const U64 scale = numExecuted / UINT32_MAX + 1;
+			branchWeights = llvm::MDBuilder(llvmContext)
+								.createBranchWeights(U32(numTaken / scale),
+													 U32((numExecuted - numTaken) / scale));
+		}
+	}
+
+	irBuilder.CreateCondBr(booleanCondition, trueBlock, falseBlock, branchWeights);
+}
+
 //
 // Control structure operators
 //
@@ -292,6 +452,18 @@ private:
 	Uptr unreachableControlDepth;
 };
 
+// Returns true if the operator may leave the basic block it is in, or call a function that
+// consumes fuel itself, so the fuel for the preceding operators must be charged before it.
+static bool isFuelChargePoint(Opcode opcode)
+{
+	return opcode == Opcode::loop || opcode == Opcode::if_ || opcode == Opcode::else_
+		   || opcode == Opcode::end || opcode == Opcode::try_ || opcode == Opcode::catch_
+		   || opcode == Opcode::catch_all || opcode == Opcode::unreachable || opcode == Opcode::br
+		   || opcode == Opcode::br_if || opcode == Opcode::br_table || opcode == Opcode::return_
+		   || opcode == Opcode::call || opcode == Opcode::call_indirect
+		   || opcode == Opcode::throw_ || opcode == Opcode::rethrow;
+}
+
 void EmitFunctionContext::emit()
 {
 	WAVM_ASSERT(functionType.callingConvention() == CallingConvention::wasm);
@@ -361,6 +533,18 @@ void EmitFunctionContext::emit()
 		}
 	}
 
+	// Forward the call to the function's optimized code if the runtime installed it. This comes
+	// before the profile counter and fuel check, since the optimized code does both itself.
+	if(moduleContext.tierUp) { emitTierUpCheck(); }
+
+	// Count calls to the function.
+	if(moduleContext.profileCounters)
+	{ emitProfileCounterIncrement(0, emitLiteral(llvmContext, U64(1))); }
+
+	// Trap on entry to the function if the context is out of fuel. Together with the check at
+	// each loop header, this bounds the number of operators that run after the fuel runs out.
+	if(moduleContext.meterFuel) { emitFuelCheck(); }
+
 	if(EMIT_ENTER_EXIT_HOOKS)
 	{
 		emitRuntimeIntrinsic(
@@ -375,20 +559,39 @@ void EmitFunctionContext::emit()
 	OperatorDecoderStream decoder(functionDef.code);
 	UnreachableOpVisitor unreachableOpVisitor(*this);
 	OperatorPrinter operatorPrinter(irModule, functionDef);
+	OpcodeVisitor opcodeVisitor;
 	Uptr opIndex = 0;
 	const bool enableTracing = Log::isCategoryEnabled(Log::traceCompilation);
+	const bool enableProfile = moduleContext.profileCounters || moduleContext.profile;
 	while(decoder && controlStack.size())
 	{
 		if(enableTracing) { traceOperator(decoder.decodeOpWithoutConsume(operatorPrinter)); }
 
+		const Opcode opcode = enableProfile || moduleContext.meterFuel
+								  ? decoder.decodeOpWithoutConsume(opcodeVisitor)
+								  : Opcode::nop;
+
+		// Number every if and br_if, including unreachable ones, to match the profile counter
+		// layout computed by getProfileCounterOffsets.
+		const bool isProfiledBranchOp = enableProfile && isProfiledBranch(opcode);
+
 		irBuilder.SetCurrentDebugLocation(
 			llvm::DILocation::get(llvmContext, (unsigned int)opIndex++, 0, diFunction));
 
+		// Charge the fuel for the operators in a basic block before the operator that ends it.
+		if(moduleContext.meterFuel && controlStack.back().isReachable)
+		{
+			++numUnchargedFuelOps;
+			if(isFuelChargePoint(opcode)) { emitFuelCharge(); }
+		}
+
 		if(controlStack.back().isReachable) { decoder.decodeOp(*this); }
 		else
 		{
 			decoder.decodeOp(unreachableOpVisitor);
 		}
+
+		if(isProfiledBranchOp) { ++profileBranchIndex; }
 	};
 	WAVM_ASSERT(irBuilder.GetInsertBlock() == returnBlock);
 
@@ -19,11 +19,32 @@ namespace WAVM { namespace LLVMJIT {
 		struct EmitModuleContext& moduleContext;
 		const IR::Module& irModule;
 		const IR::FunctionDef& functionDef;
+		Uptr functionDefIndex;
 		IR::FunctionType functionType;
 		llvm::Function* function;
 
+		// The index of the current if or br_if operator in the function, which is used to find its
+		// profile counters.
+		Uptr profileBranchIndex = 0;
+
+		// The number of operators emitted since the function's fuel was last decremented.
+		U64 numUnchargedFuelOps = 0;
+
 		std::vector<llvm::Value*> localPointers;
 
+		// Memory addresses that have been explicitly bounds checked. A memory's size never
+		// decreases, so a check that succeeded remains valid for the rest of the basic block that
+		// follows it: checkedAddressesBlock. checkedBytes is the number of bytes after the address
+		// that were checked.
+		struct CheckedAddress
+		{
+			Uptr memoryIndex;
+			llvm::Value* address;
+			U64 checkedBytes;
+		};
+		std::vector<CheckedAddress> checkedAddresses;
+		llvm::BasicBlock* checkedAddressesBlock = nullptr;
+
 		llvm::DISubprogram* diFunction;
 
 		// Information about an in-scope control structure.
@@ -66,11 +87,13 @@ namespace WAVM { namespace LLVMJIT {
 							EmitModuleContext& inModuleContext,
 							const IR::Module& inIRModule,
 							const IR::FunctionDef& inFunctionDef,
+							Uptr inFunctionDefIndex,
 							llvm::Function* inLLVMFunction)
 		: EmitContext(inLLVMContext, inModuleContext.memoryOffsets)
 		, moduleContext(inModuleContext)
 		, irModule(inIRModule)
 		, functionDef(inFunctionDef)
+		, functionDefIndex(inFunctionDefIndex)
 		, functionType(inIRModule.types[inFunctionDef.type.index])
 		, function(inLLVMFunction)
 		{
@@ -138,6 +161,26 @@ namespace WAVM { namespace LLVMJIT {
 											llvm::Type* memoryType,
 											Uptr memoryIndex);
 
+		// Adds a value to one of the function's profile counters.
+		void emitProfileCounterIncrement(Uptr functionCounterIndex, llvm::Value* i64Increment);
+
+		// Emits the conditional branch for an if or br_if. If the module is instrumented, counts
+		// the branch's executions and true conditions. If the module is compiled with a profile,
+		// annotates the branch with the weights observed in the profile.
+		void emitProfiledCondBr(llvm::Value* booleanCondition,
+								llvm::BasicBlock* trueBlock,
+								llvm::BasicBlock* falseBlock);
+
+		// Subtracts the operators emitted since the last call from the context's fuel.
+		void emitFuelCharge();
+
+		// Traps if the context's fuel is negative.
+		void emitFuelCheck();
+
+		// Forwards the call to the function's optimized code if the runtime installed it, and
+		// otherwise counts the call, periodically calling the runtime to tier up the function.
+		void emitTierUpCheck();
+
 		// Traps a divide-by-zero
 		void trapDivideByZero(llvm::Value* divisor);
 
@@ -160,6 +203,13 @@ namespace WAVM { namespace LLVMJIT {
 										  IR::FunctionType intrinsicType,
 										  const std::initializer_list<llvm::Value*>& args);
 
+		// Emits a call of the function in a table element, which traps if the element index is out
+		// of bounds or the element isn't a function of the callee type.
+		ValueVector emitCallTableElement(IR::CallIndirectImm imm,
+										 IR::FunctionType calleeType,
+										 llvm::Value* elementIndex,
+										 llvm::ArrayRef<llvm::Value*> args);
+
 		void pushControlStack(ControlContext::Type type,
 							  IR::TypeTuple resultTypes,
 							  llvm::BasicBlock* endBlock,
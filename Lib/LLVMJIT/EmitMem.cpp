@@ -76,9 +76,37 @@ static llvm::Value* getOffsetAndBoundedAddress(EmitFunctionContext& functionCont
 	const bool is32bitMemoryOn64bitHost
 		= memoryType.indexType == IndexType::i32
 		  && functionContext.moduleContext.iptrValueType == ValueType::i64;
+	const BoundsCheckMode boundsCheckMode = functionContext.moduleContext.boundsCheckMode;
 
 	llvm::IRBuilder<>& irBuilder = functionContext.irBuilder;
 
+	// With explicit bounds checks, every access traps if it's out of bounds.
+	if(boundsCheckMode == BoundsCheckMode::explicitChecks)
+	{ boundsCheckOp = BoundsCheckOp::trapOnOutOfBounds; }
+
+	// If the number of bytes accessed is constant, find out whether an earlier check of the same
+	// address in this basic block already covered this access.
+	llvm::Value* uncheckedAddress = address;
+	llvm::ConstantInt* constantNumBytes = llvm::dyn_cast<llvm::ConstantInt>(numBytes);
+	bool isAlreadyChecked = false;
+	if(boundsCheckOp == BoundsCheckOp::trapOnOutOfBounds && constantNumBytes)
+	{
+		if(irBuilder.GetInsertBlock() != functionContext.checkedAddressesBlock)
+		{ functionContext.checkedAddresses.clear(); }
+
+		const U64 numBytesToCheck = offset + constantNumBytes->getZExtValue();
+		for(const auto& checkedAddress : functionContext.checkedAddresses)
+		{
+			if(checkedAddress.memoryIndex == memoryIndex
+			   && checkedAddress.address == uncheckedAddress
+			   && checkedAddress.checkedBytes >= numBytesToCheck)
+			{
+				isAlreadyChecked = true;
+				break;
+			}
+		}
+	}
+
 	numBytes = irBuilder.CreateZExt(numBytes, address->getType());
 	WAVM_ASSERT(numBytes->getType() == address->getType());
 
@@ -92,16 +120,22 @@ static llvm::Value* getOffsetAndBoundedAddress(EmitFunctionContext& functionCont
 		numBytes = irBuilder.CreateZExt(numBytes, functionContext.moduleContext.iptrType);
 	}
 
-	// If the offset is greater than the size of the guard region, add it before bounds checking,
-	// and check for overflow.
-	if(offset && offset >= Runtime::memoryNumGuardBytes)
+	// If the offset is greater than the size of the guard region, or the address will be checked
+	// against the size of the memory, add it before bounds checking, and check for overflow.
+	const bool addOffsetBeforeBoundsCheck
+		= offset
+		  && (offset >= Runtime::memoryNumGuardBytes
+			  || boundsCheckOp == BoundsCheckOp::trapOnOutOfBounds);
+	if(addOffsetBeforeBoundsCheck)
 	{
 		llvm::Constant* offsetConstant
 			= emitLiteralIptr(offset, functionContext.moduleContext.iptrType);
 
-		if(is32bitMemoryOn64bitHost)
+		if(is32bitMemoryOn64bitHost || isAlreadyChecked)
 		{
-			// This is a 64-bit add of two numbers zero-extended from 32-bit, so it can't overflow.
+			// This is a 64-bit add of two numbers zero-extended from 32-bit, or an add that an
+			// earlier bounds check proved doesn't exceed the size of the memory, so it can't
+			// overflow.
 			address = irBuilder.CreateAdd(address, offsetConstant);
 		}
 		else
@@ -123,7 +157,11 @@ static llvm::Value* getOffsetAndBoundedAddress(EmitFunctionContext& functionCont
 		}
 	}
 
-	if(boundsCheckOp == BoundsCheckOp::trapOnOutOfBounds)
+	if(isAlreadyChecked)
+	{
+		// An earlier check of the same address covered the addressed bytes.
+	}
+	else if(boundsCheckOp == BoundsCheckOp::trapOnOutOfBounds)
 	{
 		// If the caller requires a trap, test whether the addressed bytes are within the bounds of
 		// the memory, and if not call a trap intrinsic.
@@ -145,12 +183,25 @@ static llvm::Value* getOffsetAndBoundedAddress(EmitFunctionContext& functionCont
 			 numBytes,
 			 memoryNumBytes,
 			 emitLiteralIptr(memoryIndex, functionContext.moduleContext.iptrType)});
+
+		// Remember the check, so later accesses to the same address in the basic block that follows
+		// it don't need to repeat it.
+		if(constantNumBytes)
+		{
+			functionContext.checkedAddressesBlock = irBuilder.GetInsertBlock();
+			functionContext.checkedAddresses.push_back(
+				{memoryIndex, uncheckedAddress, offset + constantNumBytes->getZExtValue()});
+		}
 	}
-	else if(is32bitMemoryOn64bitHost)
+	else if(is32bitMemoryOn64bitHost
+			&& (boundsCheckMode == BoundsCheckMode::guardPages
+				|| (boundsCheckMode == BoundsCheckMode::reducedReservation
+					&& offset < Runtime::memoryNumGuardBytes)))
 	{
 		// For 32-bit addresses on 64-bit targets, the runtime will reserve the full range of
 		// addresses that can be generated by this function, so accessing those addresses has
-		// well-defined behavior.
+		// well-defined behavior. With a reduced reservation, the runtime reserves the range of
+		// addresses that can be generated with an offset smaller than the guard region.
 	}
 	else
 	{
@@ -168,7 +219,7 @@ static llvm::Value* getOffsetAndBoundedAddress(EmitFunctionContext& functionCont
 	// This avoids the need to check the addition for overflow, and allows it to be used as the
 	// displacement in x86 addresses. Additionally, it allows the LLVM optimizer to reuse the bounds
 	// checking code for consecutive loads/stores to the same address.
-	if(offset && offset < Runtime::memoryNumGuardBytes)
+	if(offset && !addOffsetBeforeBoundsCheck)
 	{
 		llvm::Constant* offsetConstant
 			= emitLiteralIptr(offset, functionContext.moduleContext.iptrType);
@@ -1,10 +1,12 @@
 #include <stdint.h>
+#include <algorithm>
 #include <vector>
 #include "EmitFunctionContext.h"
 #include "EmitModuleContext.h"
 #include "LLVMJITPrivate.h"
 #include "WAVM/IR/Module.h"
 #include "WAVM/IR/Types.h"
+#include "WAVM/Inline/Assert.h"
 #include "WAVM/Inline/BasicTypes.h"
 #include "WAVM/Inline/Timing.h"
 
@@ -124,10 +126,24 @@ static llvm::Constant* createImportedConstant(llvm::Module& llvmModule, llvm::Tw
 void LLVMJIT::emitModule(const IR::Module& irModule,
 						 LLVMContext& llvmContext,
 						 llvm::Module& outLLVMModule,
-						 llvm::TargetMachine* targetMachine)
+						 llvm::TargetMachine* targetMachine,
+						 const ModuleAnalysis& analysis,
+						 const CompileOptions& options,
+						 Uptr beginFunctionDefIndex,
+						 Uptr endFunctionDefIndex)
 {
+	WAVM_ASSERT(beginFunctionDefIndex <= endFunctionDefIndex);
+	WAVM_ASSERT(endFunctionDefIndex <= irModule.functions.defs.size());
+	const bool instrumentProfile = options.instrumentProfile;
+	const ModuleProfile* profile = options.profile.get();
+
 	Timing::Timer emitTimer;
 	EmitModuleContext moduleContext(irModule, llvmContext, &outLLVMModule, targetMachine);
+	moduleContext.boundsCheckMode = options.boundsCheckMode;
+	moduleContext.analysis = &analysis;
+	moduleContext.devirtualizeIndirectCalls = options.devirtualizeIndirectCalls;
+	moduleContext.meterFuel = options.meterFuel;
+	moduleContext.tierUp = options.tierUp;
 
 	// Set the module data layout for the target machine.
 	outLLVMModule.setDataLayout(targetMachine->createDataLayout());
@@ -201,6 +217,34 @@ void LLVMJIT::emitModule(const IR::Module& irModule,
 	moduleContext.tableReferenceBias = llvm::ConstantExpr::getPtrToInt(
 		createImportedConstant(outLLVMModule, "tableReferenceBias"), moduleContext.iptrType);
 
+	// Compute the profile counter layout if the module is instrumented or compiled with a profile.
+	if(instrumentProfile || profile)
+	{ moduleContext.profileCounterOffsets = getProfileCounterOffsets(irModule); }
+
+	// Create a LLVM external global that will point to the profile counters.
+	if(instrumentProfile)
+	{
+		moduleContext.profileCounters = llvm::ConstantExpr::getPtrToInt(
+			createImportedConstant(outLLVMModule, "profileCounters"), moduleContext.iptrType);
+	}
+
+	if(profile)
+	{
+		WAVM_ASSERT(profile->counters.size() == moduleContext.profileCounterOffsets.back());
+
+		// Hint the inliner to inline functions that are called at least 1% as often as the most
+		// frequently called function.
+		U64 maxEntryCount = 0;
+		for(Uptr functionDefIndex = 0; functionDefIndex < irModule.functions.defs.size();
+			++functionDefIndex)
+		{
+			const Uptr counterIndex = moduleContext.profileCounterOffsets[functionDefIndex];
+			maxEntryCount = std::max(maxEntryCount, profile->counters[counterIndex]);
+		}
+		moduleContext.profile = profile;
+		moduleContext.hotFunctionEntryCount = std::max(U64(1), maxEntryCount / 100);
+	}
+
 #if LLVM_VERSION_MAJOR < 10
 	// Create a LLVM external global that will be a constant Iptr 1 that is opaque to the optimizer.
 	moduleContext.unoptimizableOne = llvm::ConstantExpr::getPtrToInt(
@@ -259,8 +303,10 @@ void LLVMJIT::emitModule(const IR::Module& irModule,
 		moduleContext.functions[functionIndex] = function;
 	}
 
-	// Compile each function in the module.
-	for(Uptr functionDefIndex = 0; functionDefIndex < irModule.functions.defs.size();
+	// Compile each function in the module's partition.
+	if(options.tierUp)
+	{ moduleContext.functionDefTierUps.resize(irModule.functions.defs.size(), nullptr); }
+	for(Uptr functionDefIndex = beginFunctionDefIndex; functionDefIndex < endFunctionDefIndex;
 		++functionDefIndex)
 	{
 		const FunctionDef& functionDef = irModule.functions.defs[functionDefIndex];
@@ -274,6 +320,15 @@ void LLVMJIT::emitModule(const IR::Module& irModule,
 		llvm::Constant* functionDefMutableDataAsIptr
 			= llvm::ConstantExpr::getPtrToInt(functionDefMutableData, moduleContext.iptrType);
 
+		// Create a LLVM external global that will point to the function's FunctionTierUp.
+		if(options.tierUp)
+		{
+			moduleContext.functionDefTierUps[functionDefIndex] = llvm::ConstantExpr::getPtrToInt(
+				createImportedConstant(outLLVMModule,
+									   getExternalName("functionDefTierUp", functionDefIndex)),
+				moduleContext.iptrType);
+		}
+
 		setRuntimeFunctionPrefix(llvmContext,
 								 moduleContext.iptrType,
 								 function,
@@ -282,7 +337,23 @@ void LLVMJIT::emitModule(const IR::Module& irModule,
 								 moduleContext.typeIds[functionDef.type.index]);
 		setFunctionAttributes(targetMachine, function);
 
-		EmitFunctionContext(llvmContext, moduleContext, irModule, functionDef, function).emit();
+		// Annotate the function with its profiled entry count. Functions that were never called
+		// are marked cold, and frequently called functions are hinted to the inliner.
+		if(moduleContext.profile)
+		{
+			const U64 entryCount
+				= profile->counters[moduleContext.profileCounterOffsets[functionDefIndex]];
+			function->setEntryCount(entryCount);
+			if(!entryCount) { function->addFnAttr(llvm::Attribute::Cold); }
+			else if(entryCount >= moduleContext.hotFunctionEntryCount)
+			{
+				function->addFnAttr(llvm::Attribute::InlineHint);
+			}
+		}
+
+		EmitFunctionContext(
+			llvmContext, moduleContext, irModule, functionDef, functionDefIndex, function)
+			.emit();
 	}
 
 	// Finalize the debug info.
@@ -56,6 +56,31 @@ namespace WAVM { namespace LLVMJIT {
 		llvm::Function* cxaEndCatchFunction = nullptr;
 		llvm::Constant* runtimeExceptionTypeInfo = nullptr;
 
+		// If the module is instrumented, the address of the profile counters as an iptr.
+		llvm::Constant* profileCounters = nullptr;
+
+		// If the module is compiled with a profile, the profile, and the entry count that makes a
+		// function a candidate for inlining.
+		const ModuleProfile* profile = nullptr;
+		U64 hotFunctionEntryCount = 0;
+
+		// The index of each function definition's first profile counter.
+		std::vector<Uptr> profileCounterOffsets;
+
+		BoundsCheckMode boundsCheckMode = BoundsCheckMode::guardPages;
+
+		// The analysis of the whole module, which is shared by all its partitions.
+		const ModuleAnalysis* analysis = nullptr;
+
+		bool devirtualizeIndirectCalls = false;
+		bool meterFuel = false;
+
+		// If the module is compiled with CompileOptions::tierUp, the address of each function
+		// definition's FunctionTierUp as an iptr. Only the functions in the partition being
+		// emitted have one.
+		bool tierUp = false;
+		std::vector<llvm::Constant*> functionDefTierUps;
+
 		EmitModuleContext(const IR::Module& inModule,
 						  LLVMContext& inLLVMContext,
 						  llvm::Module* inLLVMModule,
@@ -1,4 +1,6 @@
 #include <string.h>
+#include <algorithm>
+#include <atomic>
 #include <memory>
 #include <string>
 #include <system_error>
@@ -13,6 +15,7 @@
 #include "WAVM/LLVMJIT/LLVMJIT.h"
 #include "WAVM/Logging/Logging.h"
 #include "WAVM/Platform/Defines.h"
+#include "WAVM/Platform/Thread.h"
 
 PUSH_DISABLE_WARNINGS_FOR_LLVM_HEADERS
 #include <llvm-c/Disassembler.h>
@@ -37,6 +40,13 @@ PUSH_DISABLE_WARNINGS_FOR_LLVM_HEADERS
 #include <llvm/Transforms/InstCombine/InstCombine.h>
 #include <llvm/Transforms/Utils.h>
 #endif
+#if LLVM_VERSION_MAJOR >= 12
+#include <llvm/Analysis/AliasAnalysis.h>
+#include <llvm/Passes/PassBuilder.h>
+#else
+#include <llvm/Transforms/IPO.h>
+#include <llvm/Transforms/IPO/PassManagerBuilder.h>
+#endif
 POP_DISABLE_WARNINGS_FOR_LLVM_HEADERS
 
 namespace llvm {
@@ -84,20 +94,15 @@ private:
 	std::vector<U8> output;
 };
 
-static void optimizeLLVMModule(llvm::Module& llvmModule, bool shouldLogMetrics)
+static void addFastOptimizationPasses(llvm::legacy::FunctionPassManager& fpm)
 {
-	// Run some optimization on the module's functions.
-	Timing::Timer optimizationTimer;
-
-	llvm::legacy::FunctionPassManager fpm(&llvmModule);
-	fpm.add(llvm::createPromoteMemoryToRegisterPass());
 	fpm.add(llvm::createInstructionCombiningPass());
 	fpm.add(llvm::createCFGSimplificationPass());
 	fpm.add(llvm::createJumpThreadingPass());
 #if LLVM_VERSION_MAJOR >= 12
-	// LLVM 12 removed the constant propagation pass in favor of the instsimplify pass, which is
-	// itself marked as legacy.
-	// TODO: evaluate if this is the best pass configuration in LLVM 12.
+	// LLVM 12 removed the constant propagation pass, and instsimplify is its replacement: it folds
+	// the constants that jump threading exposes, like constant propagation did, and is just as
+	// cheap. The legacy pass manager only has the legacy version of the pass.
 	fpm.add(llvm::createInstSimplifyLegacyPass());
 #else
 	fpm.add(llvm::createConstantPropagationPass());
@@ -107,10 +112,154 @@ static void optimizeLLVMModule(llvm::Module& llvmModule, bool shouldLogMetrics)
 	// if there's a dead div/rem with limited-range divisor:
 	// https://bugs.llvm.org/show_bug.cgi?id=43514
 	fpm.add(llvm::createDeadCodeEliminationPass());
+}
 
+// Adds passes that merge redundant explicit bounds checks, and hoist the loads of the memory size
+// that they depend on out of loops. The default pipelines already include these passes.
+static void addBoundsCheckOptimizationPasses(llvm::legacy::FunctionPassManager& fpm)
+{
+	fpm.add(llvm::createEarlyCSEPass());
+	fpm.add(llvm::createCorrelatedValuePropagationPass());
+	fpm.add(llvm::createLICMPass());
+	fpm.add(llvm::createCFGSimplificationPass());
+}
+
+// Runs a function pass manager on each function in the module.
+static void runFunctionPasses(llvm::Module& llvmModule, llvm::legacy::FunctionPassManager& fpm)
+{
 	fpm.doInitialization();
 	for(auto functionIt = llvmModule.begin(); functionIt != llvmModule.end(); ++functionIt)
 	{ fpm.run(*functionIt); }
+	fpm.doFinalization();
+}
+
+// Versions the loops in the module that make explicitly bounds checked accesses, so the checks
+// can be hoisted out of them: see hoistLoopBoundsChecks. The loops' induction variables must
+// already be promoted to registers.
+static void hoistModuleLoopBoundsChecks(llvm::Module& llvmModule)
+{
+	for(llvm::Function& function : llvmModule)
+	{
+		if(!function.isDeclaration()) { hoistLoopBoundsChecks(function); }
+	}
+}
+
+// Runs LLVM's default -O2 or -O3 pipeline on the module.
+static void runDefaultPipeline(llvm::Module& llvmModule,
+							   llvm::TargetMachine* targetMachine,
+							   OptimizationLevel optimizationLevel)
+{
+	WAVM_ASSERT(optimizationLevel == OptimizationLevel::balanced
+				|| optimizationLevel == OptimizationLevel::aggressive);
+
+#if LLVM_VERSION_MAJOR >= 12
+	// Use the new pass manager.
+#if LLVM_VERSION_MAJOR >= 14
+	typedef llvm::OptimizationLevel LLVMOptimizationLevel;
+#else
+	typedef llvm::PassBuilder::OptimizationLevel LLVMOptimizationLevel;
+#endif
+	const LLVMOptimizationLevel llvmOptimizationLevel
+		= optimizationLevel == OptimizationLevel::aggressive ? LLVMOptimizationLevel::O3
+															 : LLVMOptimizationLevel::O2;
+
+#if LLVM_VERSION_MAJOR >= 13
+	llvm::PassBuilder passBuilder(targetMachine);
+#else
+	llvm::PassBuilder passBuilder(false, targetMachine);
+#endif
+
+	llvm::LoopAnalysisManager loopAnalysisManager;
+	llvm::FunctionAnalysisManager functionAnalysisManager;
+	llvm::CGSCCAnalysisManager cgsccAnalysisManager;
+	llvm::ModuleAnalysisManager moduleAnalysisManager;
+	functionAnalysisManager.registerPass([&] { return passBuilder.buildDefaultAAPipeline(); });
+	passBuilder.registerModuleAnalyses(moduleAnalysisManager);
+	passBuilder.registerCGSCCAnalyses(cgsccAnalysisManager);
+	passBuilder.registerFunctionAnalyses(functionAnalysisManager);
+	passBuilder.registerLoopAnalyses(loopAnalysisManager);
+	passBuilder.crossRegisterProxies(
+		loopAnalysisManager, functionAnalysisManager, cgsccAnalysisManager, moduleAnalysisManager);
+
+	llvm::ModulePassManager modulePassManager
+		= passBuilder.buildPerModuleDefaultPipeline(llvmOptimizationLevel);
+	modulePassManager.run(llvmModule, moduleAnalysisManager);
+#else
+	// Older versions of LLVM don't have a usable new pass manager pipeline, so use the legacy
+	// PassManagerBuilder to create the equivalent pipeline.
+	llvm::PassManagerBuilder passManagerBuilder;
+	passManagerBuilder.OptLevel = optimizationLevel == OptimizationLevel::aggressive ? 3 : 2;
+	passManagerBuilder.SizeLevel = 0;
+	passManagerBuilder.Inliner
+		= llvm::createFunctionInliningPass(passManagerBuilder.OptLevel, 0, false);
+	passManagerBuilder.LoopVectorize = true;
+	passManagerBuilder.SLPVectorize = true;
+	targetMachine->adjustPassManager(passManagerBuilder);
+
+	llvm::legacy::FunctionPassManager fpm(&llvmModule);
+	llvm::legacy::PassManager mpm;
+	passManagerBuilder.populateFunctionPassManager(fpm);
+	passManagerBuilder.populateModulePassManager(mpm);
+
+	runFunctionPasses(llvmModule, fpm);
+	mpm.run(llvmModule);
+#endif
+}
+
+static void optimizeLLVMModule(llvm::Module& llvmModule,
+							   llvm::TargetMachine* targetMachine,
+							   OptimizationLevel optimizationLevel,
+							   BoundsCheckMode boundsCheckMode,
+							   bool shouldLogMetrics)
+{
+	// Run some optimization on the module's functions.
+	Timing::Timer optimizationTimer;
+
+	switch(optimizationLevel)
+	{
+	case OptimizationLevel::none:
+	case OptimizationLevel::fast: {
+		llvm::legacy::FunctionPassManager fpm(&llvmModule);
+		fpm.add(llvm::createPromoteMemoryToRegisterPass());
+
+		// The baseline tier only promotes locals to registers: it's cheap, and greatly reduces the
+		// amount of IR that the instruction selector has to process.
+		if(optimizationLevel == OptimizationLevel::fast) { addFastOptimizationPasses(fpm); }
+		runFunctionPasses(llvmModule, fpm);
+
+		// Hoist explicit bounds checks out of loops, then clean up the checks that remain.
+		if(optimizationLevel == OptimizationLevel::fast
+		   && boundsCheckMode == BoundsCheckMode::explicitChecks)
+		{
+			hoistModuleLoopBoundsChecks(llvmModule);
+
+			llvm::legacy::FunctionPassManager boundsCheckFPM(&llvmModule);
+			addBoundsCheckOptimizationPasses(boundsCheckFPM);
+			runFunctionPasses(llvmModule, boundsCheckFPM);
+		}
+		break;
+	}
+
+	case OptimizationLevel::balanced:
+	case OptimizationLevel::aggressive:
+		// Hoisting explicit bounds checks out of loops requires the loops' induction variables to
+		// be promoted to registers, so do that and hoist the checks before the default pipeline,
+		// which then optimizes both versions of each versioned loop.
+		if(boundsCheckMode == BoundsCheckMode::explicitChecks)
+		{
+			llvm::legacy::FunctionPassManager fpm(&llvmModule);
+			fpm.add(llvm::createPromoteMemoryToRegisterPass());
+			addFastOptimizationPasses(fpm);
+			runFunctionPasses(llvmModule, fpm);
+
+			hoistModuleLoopBoundsChecks(llvmModule);
+		}
+
+		runDefaultPipeline(llvmModule, targetMachine, optimizationLevel);
+		break;
+
+	default: WAVM_UNREACHABLE();
+	};
 
 	if(shouldLogMetrics)
 	{
@@ -122,7 +271,9 @@ static void optimizeLLVMModule(llvm::Module& llvmModule, bool shouldLogMetrics)
 std::vector<U8> LLVMJIT::compileLLVMModule(LLVMContext& llvmContext,
 										   llvm::Module&& llvmModule,
 										   bool shouldLogMetrics,
-										   llvm::TargetMachine* targetMachine)
+										   llvm::TargetMachine* targetMachine,
+										   OptimizationLevel optimizationLevel,
+										   BoundsCheckMode boundsCheckMode)
 {
 	// Verify the module.
 	if(WAVM_ENABLE_ASSERTS)
@@ -137,7 +288,8 @@ std::vector<U8> LLVMJIT::compileLLVMModule(LLVMContext& llvmContext,
 	}
 
 	// Optimize the module;
-	optimizeLLVMModule(llvmModule, shouldLogMetrics);
+	optimizeLLVMModule(
+		llvmModule, targetMachine, optimizationLevel, boundsCheckMode, shouldLogMetrics);
 
 	// Generate machine code for the module.
 	Timing::Timer machineCodeTimer;
@@ -204,55 +356,272 @@ static std::unique_ptr<llvm::TargetMachine> getAndValidateTargetMachine(
 	return targetMachine;
 }
 
-std::vector<U8> LLVMJIT::compileModule(const IR::Module& irModule, const TargetSpec& targetSpec)
+// The minimum number of function definitions to put in each partition of a module that is
+// compiled on multiple threads. Each partition redundantly declares all of the module's imported
+// symbols, so small partitions aren't worth the overhead.
+static constexpr Uptr minFunctionDefsPerPartition = 16;
+
+// The number of partitions to create per compile thread. Using more partitions than threads
+// balances the load between the threads when the functions vary in size.
+static constexpr Uptr numPartitionsPerThread = 4;
+
+struct CompilePartition
+{
+	Uptr beginFunctionDefIndex;
+	Uptr endFunctionDefIndex;
+	std::vector<U8> objectBytes;
+};
+
+struct CompileThreadState
+{
+	const IR::Module& irModule;
+	const ModuleAnalysis& analysis;
+	const TargetSpec& targetSpec;
+	const CompileOptions& options;
+	std::vector<CompilePartition>& partitions;
+	std::atomic<Uptr> nextPartitionIndex{0};
+
+	CompileThreadState(const IR::Module& inIRModule,
+					   const ModuleAnalysis& inAnalysis,
+					   const TargetSpec& inTargetSpec,
+					   const CompileOptions& inOptions,
+					   std::vector<CompilePartition>& inPartitions)
+	: irModule(inIRModule)
+	, analysis(inAnalysis)
+	, targetSpec(inTargetSpec)
+	, options(inOptions)
+	, partitions(inPartitions)
+	{
+	}
+};
+
+static std::vector<U8> compilePartition(const IR::Module& irModule,
+										const ModuleAnalysis& analysis,
+										const TargetSpec& targetSpec,
+										const CompileOptions& options,
+										Uptr beginFunctionDefIndex,
+										Uptr endFunctionDefIndex,
+										bool shouldLogMetrics)
 {
+	// Each partition is compiled with its own TargetMachine and LLVMContext, so partitions may be
+	// compiled concurrently.
 	std::unique_ptr<llvm::TargetMachine> targetMachine
 		= getAndValidateTargetMachine(irModule.featureSpec, targetSpec);
 
-	// Emit LLVM IR for the module.
+	// Set the machine code optimization level. Generating machine code without optimization also
+	// selects LLVM's fast instruction selector.
+	switch(options.optimizationLevel)
+	{
+	case OptimizationLevel::none: targetMachine->setOptLevel(llvm::CodeGenOpt::None); break;
+	case OptimizationLevel::fast:
+	case OptimizationLevel::balanced: targetMachine->setOptLevel(llvm::CodeGenOpt::Default); break;
+	case OptimizationLevel::aggressive:
+		targetMachine->setOptLevel(llvm::CodeGenOpt::Aggressive);
+		break;
+	default: WAVM_UNREACHABLE();
+	};
+
+	// Emit LLVM IR for the partition.
 	LLVMContext llvmContext;
 	llvm::Module llvmModule("", llvmContext);
-	emitModule(irModule, llvmContext, llvmModule, targetMachine.get());
+	emitModule(irModule,
+			   llvmContext,
+			   llvmModule,
+			   targetMachine.get(),
+			   analysis,
+			   options,
+			   beginFunctionDefIndex,
+			   endFunctionDefIndex);
 
 	// Compile the LLVM IR to object code.
-	return compileLLVMModule(llvmContext, std::move(llvmModule), true, targetMachine.get());
+	return compileLLVMModule(llvmContext,
+							 std::move(llvmModule),
+							 shouldLogMetrics,
+							 targetMachine.get(),
+							 options.optimizationLevel,
+							 options.boundsCheckMode);
+}
+
+static I64 compileThreadEntry(void* argument)
+{
+	CompileThreadState& state = *(CompileThreadState*)argument;
+	while(true)
+	{
+		const Uptr partitionIndex = state.nextPartitionIndex++;
+		if(partitionIndex >= state.partitions.size()) { break; }
+
+		CompilePartition& partition = state.partitions[partitionIndex];
+		partition.objectBytes = compilePartition(state.irModule,
+												 state.analysis,
+												 state.targetSpec,
+												 state.options,
+												 partition.beginFunctionDefIndex,
+												 partition.endFunctionDefIndex,
+												 false);
+	}
+	return 0;
+}
+
+// Partitions a module's function definitions into contiguous ranges with roughly equal amounts of
+// WebAssembly code.
+static std::vector<CompilePartition> partitionFunctionDefs(const IR::Module& irModule,
+														   Uptr numPartitions)
+{
+	Uptr totalCodeBytes = 0;
+	for(const FunctionDef& functionDef : irModule.functions.defs)
+	{ totalCodeBytes += functionDef.code.size(); }
+
+	std::vector<CompilePartition> partitions;
+	Uptr beginFunctionDefIndex = 0;
+	Uptr numPartitionCodeBytes = 0;
+	for(Uptr functionDefIndex = 0; functionDefIndex < irModule.functions.defs.size();
+		++functionDefIndex)
+	{
+		numPartitionCodeBytes += irModule.functions.defs[functionDefIndex].code.size();
+
+		const Uptr numFunctionDefsInPartition = functionDefIndex + 1 - beginFunctionDefIndex;
+		const Uptr numRemainingFunctionDefs = irModule.functions.defs.size() - functionDefIndex - 1;
+		if(partitions.size() + 1 < numPartitions
+		   && numFunctionDefsInPartition >= minFunctionDefsPerPartition
+		   && numRemainingFunctionDefs >= minFunctionDefsPerPartition
+		   && numPartitionCodeBytes * numPartitions >= totalCodeBytes)
+		{
+			partitions.push_back({beginFunctionDefIndex, functionDefIndex + 1, {}});
+			beginFunctionDefIndex = functionDefIndex + 1;
+			numPartitionCodeBytes = 0;
+		}
+	}
+	partitions.push_back({beginFunctionDefIndex, irModule.functions.defs.size(), {}});
+
+	return partitions;
+}
+
+// Returns true if the options have a profile that was collected from a different module, after
+// logging that the profile will be ignored.
+static bool hasMismatchedProfile(const IR::Module& irModule, const CompileOptions& options)
+{
+	if(options.profile
+	   && (options.profile->moduleHash != getProfileModuleHash(irModule)
+		   || options.profile->counters.size() != getNumProfileCounters(irModule)))
+	{
+		Log::printf(Log::error, "Ignoring a profile that was collected from a different module.\n");
+		return true;
+	}
+	return false;
+}
+
+std::vector<U8> LLVMJIT::compileModule(const IR::Module& irModule,
+									   const TargetSpec& targetSpec,
+									   const CompileOptions& options)
+{
+	// Ignore a profile that was collected from a different module.
+	if(hasMismatchedProfile(irModule, options))
+	{
+		CompileOptions optionsWithoutProfile = options;
+		optionsWithoutProfile.profile.reset();
+		return compileModule(irModule, targetSpec, optionsWithoutProfile);
+	}
+
+	Uptr numThreads = options.numThreads;
+	if(numThreads == 0) { numThreads = Platform::getNumberOfHardwareThreads(); }
+
+	// Windows SEH tables are fixed up by loadModule for only a single object file, so always
+	// compile modules for Windows targets as a single partition.
+	if(llvm::Triple(targetSpec.triple).getOS() == llvm::Triple::Win32) { numThreads = 1; }
+
+	// Analyze the whole module once, before it is partitioned.
+	const ModuleAnalysis analysis = analyzeModule(irModule);
+
+	const Uptr maxPartitions = irModule.functions.defs.size() / minFunctionDefsPerPartition;
+	const Uptr numPartitions = std::min(numThreads * numPartitionsPerThread, maxPartitions);
+	if(numThreads <= 1 || numPartitions <= 1)
+	{
+		return compilePartition(
+			irModule, analysis, targetSpec, options, 0, irModule.functions.defs.size(), true);
+	}
+
+	// Validate the target before starting any threads, so an invalid target spec is reported on
+	// the calling thread.
+	getAndValidateTargetMachine(irModule.featureSpec, targetSpec);
+
+	Timing::Timer compileTimer;
+	std::vector<CompilePartition> partitions = partitionFunctionDefs(irModule, numPartitions);
+	numThreads = std::min(numThreads, Uptr(partitions.size()));
+
+	// Compile the partitions on a pool of threads. The calling thread participates as one of the
+	// compile threads.
+	CompileThreadState state(irModule, analysis, targetSpec, options, partitions);
+	std::vector<Platform::Thread*> threads;
+	for(Uptr threadIndex = 1; threadIndex < numThreads; ++threadIndex)
+	{ threads.push_back(Platform::createThread(0, compileThreadEntry, &state)); }
+	compileThreadEntry(&state);
+	for(Platform::Thread* thread : threads) { Platform::joinThread(thread); }
+
+	Timing::logRatePerSecond("Compiled LLVM module partitions",
+							 compileTimer,
+							 (F64)irModule.functions.defs.size(),
+							 "functions");
+	Log::printf(Log::metrics,
+				"Compiled %" WAVM_PRIuPTR " partitions on %" WAVM_PRIuPTR " threads\n",
+				Uptr(partitions.size()),
+				numThreads);
+
+	// Combine the partitions' object files into a single object code image.
+	std::vector<std::vector<U8>> objects;
+	for(CompilePartition& partition : partitions)
+	{ objects.push_back(std::move(partition.objectBytes)); }
+	return combineObjects(std::move(objects));
 }
 
 std::string LLVMJIT::emitLLVMIR(const IR::Module& irModule,
 								const TargetSpec& targetSpec,
-								bool optimize)
+								bool optimize,
+								const CompileOptions& options)
 {
+	// Ignore a profile that was collected from a different module, as compileModule does.
+	if(hasMismatchedProfile(irModule, options))
+	{
+		CompileOptions optionsWithoutProfile = options;
+		optionsWithoutProfile.profile.reset();
+		return emitLLVMIR(irModule, targetSpec, optimize, optionsWithoutProfile);
+	}
+
 	std::unique_ptr<llvm::TargetMachine> targetMachine
 		= getAndValidateTargetMachine(irModule.featureSpec, targetSpec);
 
 	// Emit LLVM IR for the module.
 	LLVMContext llvmContext;
 	llvm::Module llvmModule("", llvmContext);
-	emitModule(irModule, llvmContext, llvmModule, targetMachine.get());
+	emitModule(irModule,
+			   llvmContext,
+			   llvmModule,
+			   targetMachine.get(),
+			   analyzeModule(irModule),
+			   options,
+			   0,
+			   irModule.functions.defs.size());
 
 	// Optimize the LLVM IR.
-	if(optimize) { optimizeLLVMModule(llvmModule, true); }
+	if(optimize)
+	{
+		optimizeLLVMModule(llvmModule,
+						   targetMachine.get(),
+						   options.optimizationLevel,
+						   options.boundsCheckMode,
+						   true);
+	}
 
 	// Print the LLVM IR.
 	return printModule(llvmModule);
 }
 
-std::string LLVMJIT::disassembleObject(const TargetSpec& targetSpec,
-									   const std::vector<U8>& objectBytes)
+static void disassembleObjectFunctions(LLVMDisasmContextRef disasmRef,
+									   const llvm::object::ObjectFile& object,
+									   const llvm::MemoryBufferRef& objectBuffer,
+									   std::string& result)
 {
-	std::string result;
-
-	LLVMDisasmContextRef disasmRef
-		= LLVMCreateDisasm(targetSpec.triple.c_str(), nullptr, 0, nullptr, nullptr);
-	WAVM_ERROR_UNLESS(LLVMSetDisasmOptions(disasmRef, LLVMDisassembler_Option_PrintLatency));
-
-	std::unique_ptr<llvm::object::ObjectFile> object
-		= cantFail(llvm::object::ObjectFile::createObjectFile(llvm::MemoryBufferRef(
-			llvm::StringRef((const char*)objectBytes.data(), objectBytes.size()), "memory")));
-
-	// Iterate over the functions in the loaded object.
 	for(std::pair<llvm::object::SymbolRef, U64> symbolSizePair :
-		llvm::object::computeSymbolSizes(*object))
+		llvm::object::computeSymbolSizes(object))
 	{
 		llvm::object::SymbolRef symbol = symbolSizePair.first;
 
@@ -274,7 +643,7 @@ std::string LLVMJIT::disassembleObject(const TargetSpec& targetSpec,
 		if(!addressInSection) { continue; }
 
 		// Compute the address the function was loaded at.
-		llvm::StringRef sectionContents((const char*)objectBytes.data(), objectBytes.size());
+		llvm::StringRef sectionContents = objectBuffer.getBuffer();
 		if(llvm::Expected<llvm::object::section_iterator> symbolSection = symbol.getSection())
 		{
 #if LLVM_VERSION_MAJOR >= 9
@@ -323,6 +692,24 @@ std::string LLVMJIT::disassembleObject(const TargetSpec& targetSpec,
 			result += '\n';
 		};
 	}
+}
+
+std::string LLVMJIT::disassembleObject(const TargetSpec& targetSpec,
+									   const std::vector<U8>& objectBytes)
+{
+	std::string result;
+
+	LLVMDisasmContextRef disasmRef
+		= LLVMCreateDisasm(targetSpec.triple.c_str(), nullptr, 0, nullptr, nullptr);
+	WAVM_ERROR_UNLESS(LLVMSetDisasmOptions(disasmRef, LLVMDisassembler_Option_PrintLatency));
+
+	// Iterate over the functions in each of the module's object files.
+	for(const llvm::MemoryBufferRef& objectBuffer : splitObjects(objectBytes))
+	{
+		std::unique_ptr<llvm::object::ObjectFile> object
+			= cantFail(llvm::object::ObjectFile::createObjectFile(objectBuffer));
+		disassembleObjectFunctions(disasmRef, *object, objectBuffer, result);
+	}
 
 	LLVMDisasmDispose(disasmRef);
 
@@ -1,4 +1,5 @@
 #include "WAVM/LLVMJIT/LLVMJIT.h"
+#include <string.h>
 #include <utility>
 #include "LLVMJITPrivate.h"
 #include "WAVM/IR/FeatureSpec.h"
@@ -228,7 +229,108 @@ TargetValidationResult LLVMJIT::validateTarget(const TargetSpec& targetSpec,
 	return validateTargetMachine(targetMachine, featureSpec);
 }
 
+// Object code compiled from multiple partitions of a module starts with this magic number, followed
+// by the number of object files as a U64, the size of each object file as a U64, and then the
+// object files themselves, each aligned to objectAlignment bytes.
+static const U8 partitionedObjectMagic[8] = {'W', 'A', 'V', 'M', 'P', 'O', 'B', 'J'};
+static constexpr Uptr objectAlignment = 16;
+
+static Uptr alignObjectOffset(Uptr offset)
+{
+	return (offset + objectAlignment - 1) & ~(objectAlignment - 1);
+}
+
+std::vector<U8> LLVMJIT::combineObjects(std::vector<std::vector<U8>>&& objects)
+{
+	if(objects.size() == 1) { return std::move(objects[0]); }
+
+	Uptr numHeaderBytes = sizeof(partitionedObjectMagic) + sizeof(U64) * (1 + objects.size());
+	Uptr numBytes = alignObjectOffset(numHeaderBytes);
+	for(const std::vector<U8>& object : objects)
+	{ numBytes = alignObjectOffset(numBytes + object.size()); }
+
+	std::vector<U8> result(numBytes, 0);
+	memcpy(result.data(), partitionedObjectMagic, sizeof(partitionedObjectMagic));
+	U64 numObjects = U64(objects.size());
+	memcpy(result.data() + sizeof(partitionedObjectMagic), &numObjects, sizeof(U64));
+
+	Uptr objectOffset = alignObjectOffset(numHeaderBytes);
+	for(Uptr objectIndex = 0; objectIndex < objects.size(); ++objectIndex)
+	{
+		const U64 numObjectBytes = U64(objects[objectIndex].size());
+		memcpy(result.data() + sizeof(partitionedObjectMagic) + sizeof(U64) * (1 + objectIndex),
+			   &numObjectBytes,
+			   sizeof(U64));
+		memcpy(result.data() + objectOffset, objects[objectIndex].data(), numObjectBytes);
+		objectOffset = alignObjectOffset(objectOffset + numObjectBytes);
+	}
+	WAVM_ASSERT(objectOffset == numBytes);
+
+	return result;
+}
+
+std::vector<llvm::MemoryBufferRef> LLVMJIT::splitObjects(const std::vector<U8>& objectBytes)
+{
+	// If the object code doesn't start with the partitioned object magic number, it is a single
+	// native object file.
+	if(objectBytes.size() < sizeof(partitionedObjectMagic) + sizeof(U64)
+	   || memcmp(objectBytes.data(), partitionedObjectMagic, sizeof(partitionedObjectMagic)))
+	{
+		return {llvm::MemoryBufferRef(
+			llvm::StringRef((const char*)objectBytes.data(), objectBytes.size()), "memory")};
+	}
+
+	U64 numObjects = 0;
+	memcpy(&numObjects, objectBytes.data() + sizeof(partitionedObjectMagic), sizeof(U64));
+	WAVM_ERROR_UNLESS(numObjects <= (objectBytes.size() - sizeof(partitionedObjectMagic))
+										 / sizeof(U64)
+									 - 1);
+	const Uptr numHeaderBytes = sizeof(partitionedObjectMagic) + sizeof(U64) * (1 + numObjects);
+
+	std::vector<llvm::MemoryBufferRef> result;
+	Uptr objectOffset = alignObjectOffset(numHeaderBytes);
+	for(Uptr objectIndex = 0; objectIndex < numObjects; ++objectIndex)
+	{
+		const Uptr sizeOffset = sizeof(partitionedObjectMagic) + sizeof(U64) * (1 + objectIndex);
+		U64 numObjectBytes = 0;
+		memcpy(&numObjectBytes, objectBytes.data() + sizeOffset, sizeof(U64));
+		WAVM_ERROR_UNLESS(objectOffset <= objectBytes.size()
+						  && numObjectBytes <= objectBytes.size() - objectOffset);
+
+		result.push_back(llvm::MemoryBufferRef(
+			llvm::StringRef((const char*)objectBytes.data() + objectOffset, Uptr(numObjectBytes)),
+			"memory"));
+		objectOffset = alignObjectOffset(objectOffset + Uptr(numObjectBytes));
+	}
+
+	return result;
+}
+
+const char* LLVMJIT::asString(OptimizationLevel optimizationLevel)
+{
+	switch(optimizationLevel)
+	{
+	case OptimizationLevel::none: return "none";
+	case OptimizationLevel::fast: return "fast";
+	case OptimizationLevel::balanced: return "balanced";
+	case OptimizationLevel::aggressive: return "aggressive";
+	default: WAVM_UNREACHABLE();
+	};
+}
+
+const char* LLVMJIT::asString(BoundsCheckMode boundsCheckMode)
+{
+	switch(boundsCheckMode)
+	{
+	case BoundsCheckMode::guardPages: return "guard-pages";
+	case BoundsCheckMode::reducedReservation: return "reduced-reservation";
+	case BoundsCheckMode::clamp: return "clamp";
+	case BoundsCheckMode::explicitChecks: return "explicit";
+	default: WAVM_UNREACHABLE();
+	};
+}
+
 Version LLVMJIT::getVersion()
 {
-	return Version{LLVM_VERSION_MAJOR, LLVM_VERSION_MINOR, LLVM_VERSION_PATCH, 5};
+	return Version{LLVM_VERSION_MAJOR, LLVM_VERSION_MINOR, LLVM_VERSION_PATCH, 6};
 }
@@ -38,6 +38,7 @@ PUSH_DISABLE_WARNINGS_FOR_LLVM_HEADERS
 #include <llvm/IR/Type.h>
 #include <llvm/Object/ObjectFile.h>
 #include <llvm/Support/DataTypes.h>
+#include <llvm/Support/MemoryBuffer.h>
 #include <llvm/Target/TargetMachine.h>
 POP_DISABLE_WARNINGS_FOR_LLVM_HEADERS
 
@@ -369,11 +370,87 @@ namespace WAVM { namespace LLVMJIT {
 #endif
 	}
 
-	// Emits LLVM IR for a module.
+	// What the compiler knows about how a table defined by a module is used.
+	struct TableAnalysis
+	{
+		// Whether the table can't be mutated after instantiation: it isn't imported or exported, and
+		// isn't mutated by any of the module's code. The runtime prevents the host from mutating
+		// it through Runtime::getDefaultTable: see LLVMJIT::getImmutableTables.
+		bool isImmutable = false;
+
+		// If the table is immutable and its contents after instantiation only depend on active elem
+		// segments with constant offsets, the index of the function in each element of the table,
+		// or UINTPTR_MAX for null elements.
+		bool hasKnownElements = false;
+		std::vector<Uptr> elementFunctionIndices;
+	};
+
+	// The result of analyzing a whole module before emitting any of its functions.
+	struct ModuleAnalysis
+	{
+		std::vector<TableAnalysis> tables;
+	};
+
+	ModuleAnalysis analyzeModule(const IR::Module& irModule);
+
+	// Returns the index of the function that a table element is known to contain, if it is a
+	// function defined by the module with exactly calleeType. Otherwise, returns UINTPTR_MAX.
+	Uptr getKnownCallIndirectCallee(const IR::Module& irModule,
+									const TableAnalysis& table,
+									Uptr elementIndex,
+									IR::FunctionType calleeType);
+
+	// Returns whether every element of a table is known to be a function of exactly calleeType, so
+	// call_indirect through the table only needs to check that the element index is in bounds.
+	bool canElideCallIndirectTypeCheck(const IR::Module& irModule,
+									   const TableAnalysis& table,
+									   IR::FunctionType calleeType);
+
+	// Emits LLVM IR for a module with the given options. Only the function definitions in the
+	// range [beginFunctionDefIndex, endFunctionDefIndex) are emitted with bodies: the other
+	// function definitions are declared as external symbols that must be defined by another object
+	// file loaded into the same module. The options' profile must match the module.
 	void emitModule(const IR::Module& irModule,
 					LLVMContext& llvmContext,
 					llvm::Module& outLLVMModule,
-					llvm::TargetMachine* targetMachine);
+					llvm::TargetMachine* targetMachine,
+					const ModuleAnalysis& analysis,
+					const CompileOptions& options,
+					Uptr beginFunctionDefIndex,
+					Uptr endFunctionDefIndex);
+
+	// Versions the loops in a function compiled with BoundsCheckMode::explicitChecks whose
+	// accessed addresses increase by a constant each iteration: if a check before the loop proves
+	// that none of those accesses will be out of bounds, a copy of the loop without their bounds
+	// checks is run instead of the original loop.
+	void hoistLoopBoundsChecks(llvm::Function& function);
+
+	// A visitor that decodes just the opcode of an operator.
+	struct OpcodeVisitor
+	{
+		typedef IR::Opcode Result;
+
+#define VISIT_OPCODE(_, name, nameString, Imm, ...)                                                \
+	IR::Opcode name(IR::Imm) { return IR::Opcode::name; }
+		WAVM_ENUM_OPERATORS(VISIT_OPCODE)
+#undef VISIT_OPCODE
+	};
+
+	// Returns true if the operator has a pair of profile counters: see ModuleProfile::counters.
+	inline bool isProfiledBranch(IR::Opcode opcode)
+	{
+		return opcode == IR::Opcode::if_ || opcode == IR::Opcode::br_if;
+	}
+
+	// Returns the index of each function definition's first profile counter, followed by the total
+	// number of profile counters used by the module.
+	std::vector<Uptr> getProfileCounterOffsets(const IR::Module& irModule);
+
+	// Combines the object files compiled from partitions of a module into a single object code
+	// image, and splits it back into the object files. Object code that was compiled from a single
+	// partition is just the target's native object file format.
+	std::vector<U8> combineObjects(std::vector<std::vector<U8>>&& objects);
+	std::vector<llvm::MemoryBufferRef> splitObjects(const std::vector<U8>& objectBytes);
 
 	// Used to override LLVM's default behavior of looking up unresolved symbols in DLL exports.
 	llvm::JITEvaluatedSymbol resolveJITImport(llvm::StringRef name);
@@ -389,14 +466,18 @@ namespace WAVM { namespace LLVMJIT {
 		std::string debugName;
 
 #if LAZY_PARSE_DWARF_LINE_INFO
+		// A DWARF context for each of the module's images, keyed by the image's end address.
 		Platform::Mutex dwarfContextMutex;
-		std::unique_ptr<llvm::DWARFContext> dwarfContext;
+		std::map<Uptr, std::unique_ptr<llvm::DWARFContext>> addressToDWARFContextMap;
 #endif
 
+		// Loads the object code, binding its undefined symbols to the values in importedSymbolMap,
+		// then to the functions in wavmIntrinsicsExportMap if it is non-null.
 		Module(const std::vector<U8>& inObjectBytes,
 			   const HashMap<std::string, Uptr>& importedSymbolMap,
 			   bool shouldLogMetrics,
-			   std::string&& inDebugName);
+			   std::string&& inDebugName,
+			   const HashMap<std::string, FunctionBinding>* wavmIntrinsicsExportMap = nullptr);
 		~Module();
 
 	private:
@@ -410,7 +491,7 @@ namespace WAVM { namespace LLVMJIT {
 		// their pointers as keys for deregistration.
 #if LLVM_VERSION_MAJOR < 8
 		std::vector<U8> objectBytes;
-		std::unique_ptr<llvm::object::ObjectFile> object;
+		std::vector<std::unique_ptr<llvm::object::ObjectFile>> objects;
 #endif
 	};
 
@@ -422,7 +503,11 @@ namespace WAVM { namespace LLVMJIT {
 	extern std::vector<U8> compileLLVMModule(LLVMContext& llvmContext,
 											 llvm::Module&& llvmModule,
 											 bool shouldLogMetrics,
-											 llvm::TargetMachine* targetMachine);
+											 llvm::TargetMachine* targetMachine,
+											 OptimizationLevel optimizationLevel
+											 = OptimizationLevel::fast,
+											 BoundsCheckMode boundsCheckMode
+											 = BoundsCheckMode::guardPages);
 
 	extern void processSEHTables(U8* imageBase,
 								 const llvm::LoadedObjectInfo& loadedObject,
@@ -10,6 +10,7 @@
 #include <vector>
 #include "LLVMJITPrivate.h"
 #include "WAVM/IR/Types.h"
+#include "WAVM/Inline/AddressRangeMap.h"
 #include "WAVM/Inline/Assert.h"
 #include "WAVM/Inline/BasicTypes.h"
 #include "WAVM/Inline/Errors.h"
@@ -64,9 +65,9 @@ struct LLVMJIT::GlobalModuleState
 	Platform::Mutex gdbRegistrationListenerMutex;
 	llvm::JITEventListener* gdbRegistrationListener = nullptr;
 
-	// A map from address to loaded JIT symbols.
+	// A map from the address ranges of loaded JIT images to the module that loaded them.
 	Platform::RWMutex addressToModuleMapMutex;
-	std::map<Uptr, LLVMJIT::Module*> addressToModuleMap;
+	AddressRangeMap<LLVMJIT::Module*> addressToModuleMap;
 
 	static const std::shared_ptr<GlobalModuleState>& get()
 	{
@@ -83,59 +84,76 @@ struct LLVMJIT::GlobalModuleState
 	~GlobalModuleState() { delete gdbRegistrationListener; }
 };
 
-// Allocates memory for the LLVM object loader.
+// Allocates memory for the LLVM object loader. RuntimeDyld reserves allocation space separately for
+// each object file it loads, so a module that was compiled as multiple object files is loaded into
+// multiple images.
 struct LLVMJIT::ModuleMemoryManager : llvm::RTDyldMemoryManager
 {
-	ModuleMemoryManager()
-	: imageBaseAddress(nullptr)
-	, isFinalized(false)
-	, codeSection({nullptr, 0, 0})
-	, readOnlySection({nullptr, 0, 0})
-	, readWriteSection({nullptr, 0, 0})
-	, hasRegisteredEHFrames(false)
+	struct Section
 	{
-	}
+		U8* baseAddress;
+		Uptr numPages;
+		Uptr numCommittedBytes;
+	};
+
+	struct Image
+	{
+		U8* baseAddress = nullptr;
+		Uptr numPages = 0;
+
+		Section codeSection{nullptr, 0, 0};
+		Section readOnlySection{nullptr, 0, 0};
+		Section readWriteSection{nullptr, 0, 0};
+
+		llvm::StringMap<std::unique_ptr<llvm::MemoryBuffer>> sectionNameToContentsMap;
+
+		Uptr getNumBytes() const { return numPages << Platform::getBytesPerPageLog2(); }
+		bool contains(const U8* address) const
+		{
+			return address >= baseAddress && address < baseAddress + getNumBytes();
+		}
+	};
+
+	ModuleMemoryManager() : isFinalized(false) {}
 	virtual ~ModuleMemoryManager() override
 	{
 		// Deregister the exception handling frame info.
 		deregisterEHFrames();
 
-		if(!KEEP_UNLOADED_MODULE_ADDRESSES_RESERVED)
-		{ Platform::freeVirtualPages(imageBaseAddress, numAllocatedImagePages); }
-		else
+		for(std::unique_ptr<Image>& image : images)
 		{
-			// Decommit the image pages, but leave them reserved to catch any references to them
-			// that might erroneously remain.
-			Platform::decommitVirtualPages(imageBaseAddress, numAllocatedImagePages);
+			if(!image->numPages) { continue; }
+
+			if(!KEEP_UNLOADED_MODULE_ADDRESSES_RESERVED)
+			{ Platform::freeVirtualPages(image->baseAddress, image->numPages); }
+			else
+			{
+				// Decommit the image pages, but leave them reserved to catch any references to
+				// them that might erroneously remain.
+				Platform::decommitVirtualPages(image->baseAddress, image->numPages);
+			}
+			Platform::deregisterVirtualAllocation(image->getNumBytes());
 		}
-		Platform::deregisterVirtualAllocation(numAllocatedImagePages
-											  << Platform::getBytesPerPageLog2());
 	}
 
 	void registerEHFrames(U8* addr, U64 loadAddr, uintptr_t numBytes) override
 	{
-		if(!USE_WINDOWS_SEH)
-		{
-			Platform::registerEHFrames(imageBaseAddress, addr, numBytes);
-			hasRegisteredEHFrames = true;
-			ehFramesAddr = addr;
-			ehFramesNumBytes = numBytes;
-		}
+		if(!USE_WINDOWS_SEH) { registerFixedSEHFrames(addr, numBytes); }
 	}
 	void registerFixedSEHFrames(U8* addr, Uptr numBytes)
 	{
+		const U8* imageBaseAddress = getImageContaining(addr).baseAddress;
 		Platform::registerEHFrames(imageBaseAddress, addr, numBytes);
-		hasRegisteredEHFrames = true;
-		ehFramesAddr = addr;
-		ehFramesNumBytes = numBytes;
+		registeredEHFrames.push_back({imageBaseAddress, addr, numBytes});
 	}
 	void deregisterEHFrames() override
 	{
-		if(hasRegisteredEHFrames)
+		for(const EHFrames& ehFrames : registeredEHFrames)
 		{
-			hasRegisteredEHFrames = false;
-			Platform::deregisterEHFrames(imageBaseAddress, ehFramesAddr, ehFramesNumBytes);
+			Platform::deregisterEHFrames(
+				ehFrames.imageBaseAddress, ehFrames.addr, ehFrames.numBytes);
 		}
+		registeredEHFrames.clear();
 	}
 
 	virtual bool needsToReserveAllocationSpace() override { return true; }
@@ -146,35 +164,40 @@ struct LLVMJIT::ModuleMemoryManager : llvm::RTDyldMemoryManager
 										uintptr_t numReadWriteBytes,
 										U32 readWriteAlignment) override
 	{
+		WAVM_ASSERT(!isFinalized);
+
 		if(USE_WINDOWS_SEH)
 		{
 			// Pad the code section to allow for the SEH trampoline.
 			numCodeBytes += 32;
 		}
 
+		// Create a new image for the object being loaded.
+		images.emplace_back(new Image);
+		Image& image = *images.back();
+
 		// Calculate the number of pages to be used by each section.
-		codeSection.numPages = shrAndRoundUp(numCodeBytes, Platform::getBytesPerPageLog2());
-		readOnlySection.numPages = shrAndRoundUp(numReadOnlyBytes, Platform::getBytesPerPageLog2());
-		readWriteSection.numPages
+		image.codeSection.numPages = shrAndRoundUp(numCodeBytes, Platform::getBytesPerPageLog2());
+		image.readOnlySection.numPages
+			= shrAndRoundUp(numReadOnlyBytes, Platform::getBytesPerPageLog2());
+		image.readWriteSection.numPages
 			= shrAndRoundUp(numReadWriteBytes, Platform::getBytesPerPageLog2());
-		numAllocatedImagePages
-			= codeSection.numPages + readOnlySection.numPages + readWriteSection.numPages;
-		if(numAllocatedImagePages)
+		image.numPages = image.codeSection.numPages + image.readOnlySection.numPages
+						 + image.readWriteSection.numPages;
+		if(image.numPages)
 		{
 			// Reserve enough contiguous pages for all sections.
-			imageBaseAddress = Platform::allocateVirtualPages(numAllocatedImagePages);
-			if(!imageBaseAddress
-			   || !Platform::commitVirtualPages(imageBaseAddress, numAllocatedImagePages))
+			image.baseAddress = Platform::allocateVirtualPages(image.numPages);
+			if(!image.baseAddress || !Platform::commitVirtualPages(image.baseAddress, image.numPages))
 			{ Errors::fatal("memory allocation for JIT code failed"); }
-			Platform::registerVirtualAllocation(numAllocatedImagePages
-												<< Platform::getBytesPerPageLog2());
-			codeSection.baseAddress = imageBaseAddress;
-			readOnlySection.baseAddress
-				= codeSection.baseAddress
-				  + (codeSection.numPages << Platform::getBytesPerPageLog2());
-			readWriteSection.baseAddress
-				= readOnlySection.baseAddress
-				  + (readOnlySection.numPages << Platform::getBytesPerPageLog2());
+			Platform::registerVirtualAllocation(image.getNumBytes());
+			image.codeSection.baseAddress = image.baseAddress;
+			image.readOnlySection.baseAddress
+				= image.codeSection.baseAddress
+				  + (image.codeSection.numPages << Platform::getBytesPerPageLog2());
+			image.readWriteSection.baseAddress
+				= image.readOnlySection.baseAddress
+				  + (image.readOnlySection.numPages << Platform::getBytesPerPageLog2());
 		}
 	}
 	virtual U8* allocateCodeSection(uintptr_t numBytes,
@@ -182,7 +205,7 @@ struct LLVMJIT::ModuleMemoryManager : llvm::RTDyldMemoryManager
 									U32 sectionID,
 									llvm::StringRef sectionName) override
 	{
-		return allocateBytes(sectionName, (Uptr)numBytes, alignment, codeSection);
+		return allocateBytes(sectionName, (Uptr)numBytes, alignment, getCurrentImage().codeSection);
 	}
 	virtual U8* allocateDataSection(uintptr_t numBytes,
 									U32 alignment,
@@ -190,10 +213,11 @@ struct LLVMJIT::ModuleMemoryManager : llvm::RTDyldMemoryManager
 									llvm::StringRef sectionName,
 									bool isReadOnly) override
 	{
+		Image& image = getCurrentImage();
 		return allocateBytes(sectionName,
 							 (Uptr)numBytes,
 							 alignment,
-							 isReadOnly ? readOnlySection : readWriteSection);
+							 isReadOnly ? image.readOnlySection : image.readWriteSection);
 	}
 	virtual bool finalizeMemory(std::string* ErrMsg = nullptr) override
 	{
@@ -206,23 +230,29 @@ struct LLVMJIT::ModuleMemoryManager : llvm::RTDyldMemoryManager
 	{
 		WAVM_ASSERT(!isFinalized);
 		isFinalized = true;
-		if(codeSection.numPages)
-		{
-			WAVM_ERROR_UNLESS(Platform::setVirtualPageAccess(codeSection.baseAddress,
-															 codeSection.numPages,
-															 Platform::MemoryAccess::readExecute));
-		}
-		if(readOnlySection.numPages)
+		for(std::unique_ptr<Image>& image : images)
 		{
-			WAVM_ERROR_UNLESS(Platform::setVirtualPageAccess(readOnlySection.baseAddress,
-															 readOnlySection.numPages,
-															 Platform::MemoryAccess::readOnly));
-		}
-		if(readWriteSection.numPages)
-		{
-			WAVM_ERROR_UNLESS(Platform::setVirtualPageAccess(readWriteSection.baseAddress,
-															 readWriteSection.numPages,
-															 Platform::MemoryAccess::readWrite));
+			if(image->codeSection.numPages)
+			{
+				WAVM_ERROR_UNLESS(
+					Platform::setVirtualPageAccess(image->codeSection.baseAddress,
+												   image->codeSection.numPages,
+												   Platform::MemoryAccess::readExecute));
+			}
+			if(image->readOnlySection.numPages)
+			{
+				WAVM_ERROR_UNLESS(
+					Platform::setVirtualPageAccess(image->readOnlySection.baseAddress,
+												   image->readOnlySection.numPages,
+												   Platform::MemoryAccess::readOnly));
+			}
+			if(image->readWriteSection.numPages)
+			{
+				WAVM_ERROR_UNLESS(
+					Platform::setVirtualPageAccess(image->readWriteSection.baseAddress,
+												   image->readWriteSection.numPages,
+												   Platform::MemoryAccess::readWrite));
+			}
 		}
 
 		// Invalidate the instruction cache.
@@ -230,47 +260,67 @@ struct LLVMJIT::ModuleMemoryManager : llvm::RTDyldMemoryManager
 	}
 	virtual void invalidateInstructionCache()
 	{
-		// Invalidate the instruction cache for the whole image.
-		llvm::sys::Memory::InvalidateInstructionCache(
-			imageBaseAddress, numAllocatedImagePages << Platform::getBytesPerPageLog2());
+		// Invalidate the instruction cache for all the images.
+		for(std::unique_ptr<Image>& image : images)
+		{
+			if(image->numPages)
+			{
+				llvm::sys::Memory::InvalidateInstructionCache(image->baseAddress,
+															  image->getNumBytes());
+			}
+		}
 	}
 
-	U8* getImageBaseAddress() const { return imageBaseAddress; }
-	Uptr getNumImageBytes() const
+	Uptr getNumImages() const { return images.size(); }
+	const Image& getImage(Uptr imageIndex) const { return *images[imageIndex]; }
+	Image& getCurrentImage()
 	{
-		return numAllocatedImagePages << Platform::getBytesPerPageLog2();
+		WAVM_ASSERT(images.size());
+		return *images.back();
+	}
+	const Image& getImageContaining(const U8* address) const
+	{
+		for(const std::unique_ptr<Image>& image : images)
+		{
+			if(image->contains(address)) { return *image; }
+		}
+		Errors::fatal("address isn't in any of the module's images");
 	}
 
-	Uptr getNumCodeBytes() const { return codeSection.numCommittedBytes; }
-	Uptr getNumReadOnlyBytes() const { return readOnlySection.numCommittedBytes; }
-	Uptr getNumReadWriteBytes() const { return readWriteSection.numCommittedBytes; }
-
-	const llvm::StringMap<std::unique_ptr<llvm::MemoryBuffer>>& getSectionNameToContentsMap() const
+	Uptr getNumCodeBytes() const
+	{
+		Uptr numBytes = 0;
+		for(const std::unique_ptr<Image>& image : images)
+		{ numBytes += image->codeSection.numCommittedBytes; }
+		return numBytes;
+	}
+	Uptr getNumReadOnlyBytes() const
+	{
+		Uptr numBytes = 0;
+		for(const std::unique_ptr<Image>& image : images)
+		{ numBytes += image->readOnlySection.numCommittedBytes; }
+		return numBytes;
+	}
+	Uptr getNumReadWriteBytes() const
 	{
-		return sectionNameToContentsMap;
+		Uptr numBytes = 0;
+		for(const std::unique_ptr<Image>& image : images)
+		{ numBytes += image->readWriteSection.numCommittedBytes; }
+		return numBytes;
 	}
 
 private:
-	struct Section
+	struct EHFrames
 	{
-		U8* baseAddress;
-		Uptr numPages;
-		Uptr numCommittedBytes;
+		const U8* imageBaseAddress;
+		const U8* addr;
+		Uptr numBytes;
 	};
 
-	U8* imageBaseAddress;
-	Uptr numAllocatedImagePages;
+	std::vector<std::unique_ptr<Image>> images;
 	bool isFinalized;
 
-	Section codeSection;
-	Section readOnlySection;
-	Section readWriteSection;
-
-	bool hasRegisteredEHFrames;
-	const U8* ehFramesAddr;
-	Uptr ehFramesNumBytes;
-
-	llvm::StringMap<std::unique_ptr<llvm::MemoryBuffer>> sectionNameToContentsMap;
+	std::vector<EHFrames> registeredEHFrames;
 
 	U8* allocateBytes(llvm::StringRef sectionName, Uptr numBytes, Uptr alignment, Section& section)
 	{
@@ -299,7 +349,7 @@ private:
 		}
 
 		// Record the address the section was allocated at.
-		sectionNameToContentsMap.insert(std::make_pair(
+		getCurrentImage().sectionNameToContentsMap.insert(std::make_pair(
 			sectionName,
 			llvm::MemoryBuffer::getMemBuffer(
 				llvm::StringRef((const char*)allocationBaseAddress, numBytes), "", false)));
@@ -323,7 +373,8 @@ private:
 Module::Module(const std::vector<U8>& objectBytes,
 			   const HashMap<std::string, Uptr>& importedSymbolMap,
 			   bool shouldLogMetrics,
-			   std::string&& inDebugName)
+			   std::string&& inDebugName,
+			   const HashMap<std::string, FunctionBinding>* wavmIntrinsicsExportMap)
 : debugName(std::move(inDebugName))
 , memoryManager(new ModuleMemoryManager())
 , globalModuleState(GlobalModuleState::get())
@@ -333,20 +384,28 @@ Module::Module(const std::vector<U8>& objectBytes,
 {
 	Timing::Timer loadObjectTimer;
 
+	// Parse the object files that make up the module's object code.
 #if LLVM_VERSION_MAJOR >= 8
-	std::unique_ptr<llvm::object::ObjectFile> object;
+	std::vector<std::unique_ptr<llvm::object::ObjectFile>> objects;
+	for(const llvm::MemoryBufferRef& objectBuffer : splitObjects(objectBytes))
+#else
+	for(const llvm::MemoryBufferRef& objectBuffer : splitObjects(this->objectBytes))
 #endif
+	{ objects.push_back(cantFail(llvm::object::ObjectFile::createObjectFile(objectBuffer))); }
 
-	object = cantFail(llvm::object::ObjectFile::createObjectFile(llvm::MemoryBufferRef(
-		llvm::StringRef((const char*)objectBytes.data(), objectBytes.size()), "memory")));
+	// The Windows SEH fixups below only handle a single object file.
+	WAVM_ERROR_UNLESS(!USE_WINDOWS_SEH || objects.size() == 1);
 
 	// Create the LLVM object loader.
 	struct SymbolResolver : llvm::JITSymbolResolver
 	{
 		const HashMap<std::string, Uptr>& importedSymbolMap;
+		const HashMap<std::string, FunctionBinding>* wavmIntrinsicsExportMap;
 
-		SymbolResolver(const HashMap<std::string, Uptr>& inImportedSymbolMap)
+		SymbolResolver(const HashMap<std::string, Uptr>& inImportedSymbolMap,
+					   const HashMap<std::string, FunctionBinding>* inWAVMIntrinsicsExportMap)
 		: importedSymbolMap(inImportedSymbolMap)
+		, wavmIntrinsicsExportMap(inWAVMIntrinsicsExportMap)
 		{
 		}
 
@@ -391,17 +450,29 @@ Module::Module(const std::vector<U8>& objectBytes,
 		llvm::JITEvaluatedSymbol findSymbolImpl(llvm::StringRef name)
 		{
 			const std::string nameString = demangleSymbol(name.str());
-			const Uptr* symbolValue = importedSymbolMap.get(nameString);
-			if(!symbolValue) { return resolveJITImport(nameString); }
-			else
+			if(const Uptr* symbolValue = importedSymbolMap.get(nameString))
 			{
 				// LLVM assumes that a symbol value of zero is a symbol that wasn't resolved.
 				WAVM_ASSERT(*symbolValue);
 				return llvm::JITEvaluatedSymbol(U64(*symbolValue), llvm::JITSymbolFlags::None);
 			}
+
+			// The wavmIntrinsic function symbols are bound directly to the native functions; the
+			// compiled module assumes they have the intrinsic calling convention, so no thunking is
+			// necessary.
+			if(wavmIntrinsicsExportMap)
+			{
+				if(const FunctionBinding* intrinsicBinding = wavmIntrinsicsExportMap->get(nameString))
+				{
+					return llvm::JITEvaluatedSymbol(reinterpret_cast<Uptr>(intrinsicBinding->code),
+													llvm::JITSymbolFlags::None);
+				}
+			}
+
+			return resolveJITImport(nameString);
 		}
 	};
-	SymbolResolver symbolResolver(importedSymbolMap);
+	SymbolResolver symbolResolver(importedSymbolMap, wavmIntrinsicsExportMap);
 	llvm::RuntimeDyld loader(*memoryManager, symbolResolver);
 	// Process all sections on non-Windows platforms. On Windows, this triggers errors due to
 	// unimplemented relocation types in the debug sections.
@@ -421,7 +492,7 @@ Module::Module(const std::vector<U8>& objectBytes,
 	U8* xdataCopy = nullptr;
 	if(USE_WINDOWS_SEH)
 	{
-		for(auto section : object->sections())
+		for(auto section : objects[0]->sections())
 		{
 #if LLVM_VERSION_MAJOR >= 10
 			llvm::Expected<llvm::StringRef> sectionNameOrError = section.getName();
@@ -463,8 +534,11 @@ Module::Module(const std::vector<U8>& objectBytes,
 		}
 	}
 
-	// Use the LLVM object loader to load the object.
-	std::unique_ptr<llvm::RuntimeDyld::LoadedObjectInfo> loadedObject = loader.loadObject(*object);
+	// Use the LLVM object loader to load the objects. References between the objects are resolved
+	// when the loader is finalized.
+	std::vector<std::unique_ptr<llvm::RuntimeDyld::LoadedObjectInfo>> loadedObjects;
+	for(const std::unique_ptr<llvm::object::ObjectFile>& object : objects)
+	{ loadedObjects.push_back(loader.loadObject(*object)); }
 	loader.finalizeWithMemoryManagerLocking();
 	if(loader.hasError())
 	{ Errors::fatalf("RuntimeDyld failed: %s", loader.getErrorString().data()); }
@@ -484,8 +558,8 @@ Module::Module(const std::vector<U8>& objectBytes,
 		memset(trampolineBytes + 2, 0, 4);
 		memcpy(trampolineBytes + 6, &sehHandlerAddress, sizeof(U64));
 
-		processSEHTables(memoryManager->getImageBaseAddress(),
-						 *loadedObject,
+		processSEHTables(memoryManager->getImage(0).baseAddress,
+						 *loadedObjects[0],
 						 pdataSection,
 						 pdataCopy,
 						 pdataNumBytes,
@@ -494,7 +568,7 @@ Module::Module(const std::vector<U8>& objectBytes,
 						 reinterpret_cast<Uptr>(trampolineBytes));
 
 		memoryManager->registerFixedSEHFrames(
-			reinterpret_cast<U8*>(Uptr(loadedObject->getSectionLoadAddress(pdataSection))),
+			reinterpret_cast<U8*>(Uptr(loadedObjects[0]->getSectionLoadAddress(pdataSection))),
 			pdataNumBytes);
 	}
 
@@ -514,94 +588,129 @@ Module::Module(const std::vector<U8>& objectBytes,
 	// final non-writable memory permissions.
 	memoryManager->reallyFinalizeMemory();
 
-	// Notify GDB of the new object.
+	// Each object was loaded into its own image.
+	WAVM_ASSERT(memoryManager->getNumImages() == objects.size());
+
+	// Notify GDB of the new objects. The address of each object's image is used as the key that
+	// identifies the object when it is unloaded.
 	{
 		Platform::Mutex::Lock lock(globalModuleState->gdbRegistrationListenerMutex);
+		for(Uptr objectIndex = 0; objectIndex < objects.size(); ++objectIndex)
+		{
 #if LLVM_VERSION_MAJOR >= 8
-		globalModuleState->gdbRegistrationListener->notifyObjectLoaded(
-			reinterpret_cast<Uptr>(this), *object, *loadedObject);
+			globalModuleState->gdbRegistrationListener->notifyObjectLoaded(
+				reinterpret_cast<Uptr>(&memoryManager->getImage(objectIndex)),
+				*objects[objectIndex],
+				*loadedObjects[objectIndex]);
 #else
-		globalModuleState->gdbRegistrationListener->NotifyObjectEmitted(*object, *loadedObject);
+			globalModuleState->gdbRegistrationListener->NotifyObjectEmitted(
+				*objects[objectIndex], *loadedObjects[objectIndex]);
 #endif
+		}
 	}
 
-	// Create a DWARF context to interpret the debug information in this compilation unit.
 #if LAZY_PARSE_DWARF_LINE_INFO
 	Platform::Mutex::Lock dwarfContextLock(dwarfContextMutex);
-	dwarfContext
-		= llvm::DWARFContext::create(memoryManager->getSectionNameToContentsMap(), sizeof(Uptr));
+#endif
+	for(Uptr objectIndex = 0; objectIndex < objects.size(); ++objectIndex)
+	{
+		const llvm::object::ObjectFile& object = *objects[objectIndex];
+		const llvm::RuntimeDyld::LoadedObjectInfo& loadedObject = *loadedObjects[objectIndex];
+		const ModuleMemoryManager::Image& image = memoryManager->getImage(objectIndex);
+
+		// Create a DWARF context to interpret the debug information in this compilation unit.
+#if LAZY_PARSE_DWARF_LINE_INFO
+		if(image.numPages)
+		{
+			addressToDWARFContextMap.emplace(
+				reinterpret_cast<Uptr>(image.baseAddress + image.getNumBytes()),
+				llvm::DWARFContext::create(image.sectionNameToContentsMap, sizeof(Uptr)));
+		}
 #else
-	auto dwarfContext = llvm::DWARFContext::create(*object, &*loadedObject);
+		auto dwarfContext = llvm::DWARFContext::create(object, &loadedObject);
 #endif
 
-	// Iterate over the functions in the loaded object.
-	for(std::pair<llvm::object::SymbolRef, U64> symbolSizePair :
-		llvm::object::computeSymbolSizes(*object))
-	{
-		llvm::object::SymbolRef symbol = symbolSizePair.first;
+		// Iterate over the functions in the loaded object.
+		for(std::pair<llvm::object::SymbolRef, U64> symbolSizePair :
+			llvm::object::computeSymbolSizes(object))
+		{
+			llvm::object::SymbolRef symbol = symbolSizePair.first;
 
-		// Only process global symbols, which excludes SEH funclets.
+			// Only process global symbols, which excludes SEH funclets.
 #if LLVM_VERSION_MAJOR >= 11
-		auto maybeFlags = symbol.getFlags();
-		if(!(maybeFlags && *maybeFlags & llvm::object::SymbolRef::SF_Global)) { continue; }
+			auto maybeFlags = symbol.getFlags();
+			if(!(maybeFlags && *maybeFlags & llvm::object::SymbolRef::SF_Global)) { continue; }
 #else
-		if(!(symbol.getFlags() & llvm::object::SymbolRef::SF_Global)) { continue; }
+			if(!(symbol.getFlags() & llvm::object::SymbolRef::SF_Global)) { continue; }
 #endif
 
-		// Get the type, name, and address of the symbol. Need to be careful not to get the
-		// Expected<T> for each value unless it will be checked for success before continuing.
-		llvm::Expected<llvm::object::SymbolRef::Type> type = symbol.getType();
-		if(!type || *type != llvm::object::SymbolRef::ST_Function) { continue; }
-		llvm::Expected<llvm::StringRef> name = symbol.getName();
-		if(!name) { continue; }
-		llvm::Expected<U64> address = symbol.getAddress();
-		if(!address) { continue; }
-
-		// Compute the address the function was loaded at.
-		WAVM_ASSERT(*address <= UINTPTR_MAX);
-		Uptr loadedAddress = Uptr(*address);
-		if(llvm::Expected<llvm::object::section_iterator> symbolSection = symbol.getSection())
-		{ loadedAddress += (Uptr)loadedObject->getSectionLoadAddress(*symbolSection.get()); }
-
-		std::map<U32, U32> offsetToOpIndexMap;
+			// Get the type, name, and address of the symbol. Need to be careful not to get the
+			// Expected<T> for each value unless it will be checked for success before continuing.
+			llvm::Expected<llvm::object::SymbolRef::Type> type = symbol.getType();
+			if(!type || *type != llvm::object::SymbolRef::ST_Function) { continue; }
+			llvm::Expected<llvm::StringRef> name = symbol.getName();
+			if(!name) { continue; }
+			llvm::Expected<U64> address = symbol.getAddress();
+			if(!address) { continue; }
+
+			// Compute the address the function was loaded at.
+			WAVM_ASSERT(*address <= UINTPTR_MAX);
+			Uptr loadedAddress = Uptr(*address);
+			if(llvm::Expected<llvm::object::section_iterator> symbolSection = symbol.getSection())
+			{ loadedAddress += (Uptr)loadedObject.getSectionLoadAddress(*symbolSection.get()); }
+
+			std::map<U32, U32> offsetToOpIndexMap;
 #if !LAZY_PARSE_DWARF_LINE_INFO
-		// Get the DWARF line info for this symbol, which maps machine code addresses to
-		// WebAssembly op indices.
+			// Get the DWARF line info for this symbol, which maps machine code addresses to
+			// WebAssembly op indices.
 #if LLVM_VERSION_MAJOR >= 9
-		llvm::Expected<llvm::object::section_iterator> section = symbol.getSection();
-		if(!section) { continue; }
-		llvm::DILineInfoTable lineInfoTable = dwarfContext->getLineInfoForAddressRange(
-			llvm::object::SectionedAddress{loadedAddress, section.get()->getIndex()},
-			symbolSizePair.second);
+			llvm::Expected<llvm::object::section_iterator> section = symbol.getSection();
+			if(!section) { continue; }
+			llvm::DILineInfoTable lineInfoTable = dwarfContext->getLineInfoForAddressRange(
+				llvm::object::SectionedAddress{loadedAddress, section.get()->getIndex()},
+				symbolSizePair.second);
 #else
-		llvm::DILineInfoTable lineInfoTable
-			= dwarfContext->getLineInfoForAddressRange(loadedAddress, symbolSizePair.second);
+			llvm::DILineInfoTable lineInfoTable
+				= dwarfContext->getLineInfoForAddressRange(loadedAddress, symbolSizePair.second);
 #endif
-		for(auto lineInfo : lineInfoTable)
-		{ offsetToOpIndexMap.emplace(U32(lineInfo.first - loadedAddress), lineInfo.second.Line); }
+			for(auto lineInfo : lineInfoTable)
+			{
+				offsetToOpIndexMap.emplace(U32(lineInfo.first - loadedAddress),
+										   lineInfo.second.Line);
+			}
 #endif
 
-		// Add the function to the module's name and address to function maps.
-		WAVM_ASSERT(symbolSizePair.second <= UINTPTR_MAX);
-		Runtime::Function* function
-			= (Runtime::Function*)(loadedAddress - offsetof(Runtime::Function, code));
-		nameToFunctionMap.addOrFail(std::string(*name), function);
-		addressToFunctionMap.emplace(Uptr(loadedAddress + symbolSizePair.second), function);
-
-		// Initialize the function mutable data.
-		WAVM_ASSERT(function->mutableData);
-		function->mutableData->jitModule = this;
-		function->mutableData->function = function;
-		function->mutableData->numCodeBytes = Uptr(symbolSizePair.second);
-		function->mutableData->offsetToOpIndexMap = std::move(offsetToOpIndexMap);
+			// Add the function to the module's name and address to function maps.
+			WAVM_ASSERT(symbolSizePair.second <= UINTPTR_MAX);
+			Runtime::Function* function
+				= (Runtime::Function*)(loadedAddress - offsetof(Runtime::Function, code));
+			nameToFunctionMap.addOrFail(std::string(*name), function);
+			addressToFunctionMap.emplace(Uptr(loadedAddress + symbolSizePair.second), function);
+
+			// Initialize the function mutable data.
+			WAVM_ASSERT(function->mutableData);
+			function->mutableData->jitModule = this;
+			function->mutableData->function = function;
+			function->mutableData->numCodeBytes = Uptr(symbolSizePair.second);
+			function->mutableData->offsetToOpIndexMap = std::move(offsetToOpIndexMap);
+		}
 	}
 
-	const Uptr moduleEndAddress = reinterpret_cast<Uptr>(memoryManager->getImageBaseAddress()
-														 + memoryManager->getNumImageBytes());
+	// Add each of the module's images to the global address to module map.
 	{
 		Platform::RWMutex::ExclusiveLock addressToModuleMapLock(
 			globalModuleState->addressToModuleMapMutex);
-		globalModuleState->addressToModuleMap.emplace(moduleEndAddress, this);
+		for(Uptr imageIndex = 0; imageIndex < memoryManager->getNumImages(); ++imageIndex)
+		{
+			const ModuleMemoryManager::Image& image = memoryManager->getImage(imageIndex);
+			if(image.numPages)
+			{
+				globalModuleState->addressToModuleMap.addOrFail(
+					reinterpret_cast<Uptr>(image.baseAddress),
+					reinterpret_cast<Uptr>(image.baseAddress + image.getNumBytes()),
+					this);
+			}
+		}
 	}
 
 	if(shouldLogMetrics)
@@ -620,24 +729,35 @@ Module::Module(const std::vector<U8>& objectBytes,
 
 Module::~Module()
 {
-	// Notify GDB that the object is being unloaded.
+	// Notify GDB that the objects are being unloaded.
 	{
 		Platform::Mutex::Lock lock(globalModuleState->gdbRegistrationListenerMutex);
 #if LLVM_VERSION_MAJOR >= 8
-		globalModuleState->gdbRegistrationListener->notifyFreeingObject(
-			reinterpret_cast<Uptr>(this));
+		for(Uptr imageIndex = 0; imageIndex < memoryManager->getNumImages(); ++imageIndex)
+		{
+			globalModuleState->gdbRegistrationListener->notifyFreeingObject(
+				reinterpret_cast<Uptr>(&memoryManager->getImage(imageIndex)));
+		}
 #else
-		globalModuleState->gdbRegistrationListener->NotifyFreeingObject(*object);
+		for(const std::unique_ptr<llvm::object::ObjectFile>& object : objects)
+		{ globalModuleState->gdbRegistrationListener->NotifyFreeingObject(*object); }
 #endif
 	}
 
-	// Remove the module from the global address to module map.
+	// Remove the module's images from the global address to module map.
 	{
 		Platform::RWMutex::ExclusiveLock addressToModuleMapLock(
 			globalModuleState->addressToModuleMapMutex);
-		globalModuleState->addressToModuleMap.erase(
-			globalModuleState->addressToModuleMap.find(reinterpret_cast<Uptr>(
-				memoryManager->getImageBaseAddress() + memoryManager->getNumImageBytes())));
+		for(Uptr imageIndex = 0; imageIndex < memoryManager->getNumImages(); ++imageIndex)
+		{
+			const ModuleMemoryManager::Image& image = memoryManager->getImage(imageIndex);
+			if(image.numPages)
+			{
+				WAVM_ERROR_UNLESS(globalModuleState->addressToModuleMap.remove(
+					reinterpret_cast<Uptr>(image.baseAddress),
+					reinterpret_cast<Uptr>(image.baseAddress + image.getNumBytes())));
+			}
+		}
 	}
 
 	// Free the FunctionMutableData objects.
@@ -647,9 +767,31 @@ Module::~Module()
 	delete memoryManager;
 }
 
+#if !USE_WINDOWS_SEH
+static std::type_info* getRuntimeExceptionPointerTypeInfo()
+{
+	// Use __cxxabiv1::__cxa_current_exception_type to get a reference to the std::type_info for
+	// Runtime::Exception* without enabling RTTI. This throws an exception, so only do it the first
+	// time a module is loaded.
+	static std::type_info* runtimeExceptionPointerTypeInfo = []() {
+		std::type_info* typeInfo = nullptr;
+		try
+		{
+			throw(Runtime::Exception*) nullptr;
+		}
+		catch(Runtime::Exception*)
+		{
+			typeInfo = __cxxabiv1::__cxa_current_exception_type();
+		}
+		return typeInfo;
+	}();
+	return runtimeExceptionPointerTypeInfo;
+}
+#endif
+
 std::shared_ptr<LLVMJIT::Module> LLVMJIT::loadModule(
 	const std::vector<U8>& objectFileBytes,
-	HashMap<std::string, FunctionBinding>&& wavmIntrinsicsExportMap,
+	const HashMap<std::string, FunctionBinding>& wavmIntrinsicsExportMap,
 	std::vector<IR::FunctionType>&& types,
 	std::vector<FunctionBinding>&& functionImports,
 	std::vector<TableBinding>&& tables,
@@ -659,18 +801,15 @@ std::shared_ptr<LLVMJIT::Module> LLVMJIT::loadModule(
 	InstanceBinding instance,
 	Uptr tableReferenceBias,
 	const std::vector<Runtime::FunctionMutableData*>& functionDefMutableDatas,
+	U64* profileCounters,
 	std::string&& debugName)
 {
-	// Bind undefined symbols in the compiled object to values.
-	HashMap<std::string, Uptr> importedSymbolMap;
-
-	// Bind the wavmIntrinsic function symbols; the compiled module assumes they have the intrinsic
-	// calling convention, so no thunking is necessary.
-	for(auto exportMapPair : wavmIntrinsicsExportMap)
-	{
-		importedSymbolMap.addOrFail(exportMapPair.key,
-									reinterpret_cast<Uptr>(exportMapPair.value.code));
-	}
+	// Bind undefined symbols in the compiled object to values. The wavmIntrinsic function symbols
+	// are resolved directly from wavmIntrinsicsExportMap, so only the symbols that are specific to
+	// this module are added to the map.
+	HashMap<std::string, Uptr> importedSymbolMap(
+		types.size() + functionImports.size() + tables.size() + memories.size() + globals.size()
+		+ exceptionTypes.size() + functionDefMutableDatas.size() * 2 + 5);
 
 	// Bind the type ID symbols.
 	for(Uptr typeIndex = 0; typeIndex < types.size(); ++typeIndex)
@@ -743,6 +882,10 @@ std::shared_ptr<LLVMJIT::Module> LLVMJIT::loadModule(
 			= functionDefMutableDatas[functionDefIndex];
 		importedSymbolMap.addOrFail(getExternalName("functionDefMutableDatas", functionDefIndex),
 									reinterpret_cast<Uptr>(functionMutableData));
+
+		// Bind the FunctionTierUp that is used by code compiled with CompileOptions::tierUp.
+		importedSymbolMap.addOrFail(getExternalName("functionDefTierUp", functionDefIndex),
+									reinterpret_cast<Uptr>(&functionMutableData->tierUp));
 	}
 
 	// Bind the instance symbol to point to the Instance.
@@ -752,31 +895,27 @@ std::shared_ptr<LLVMJIT::Module> LLVMJIT::loadModule(
 	// Bind the tableReferenceBias symbol to the tableReferenceBias.
 	importedSymbolMap.addOrFail("tableReferenceBias", tableReferenceBias);
 
+	// Bind the profileCounters symbol that is used by code compiled with profile instrumentation.
+	if(profileCounters)
+	{ importedSymbolMap.addOrFail("profileCounters", reinterpret_cast<Uptr>(profileCounters)); }
+
 #if LLVM_VERSION_MAJOR < 10
 	// Bind the unoptimizableOne symbol to 1.
 	importedSymbolMap.addOrFail("unoptimizableOne", 1);
 #endif
 
 #if !USE_WINDOWS_SEH
-	// Use __cxxabiv1::__cxa_current_exception_type to get a reference to the std::type_info for
-	// Runtime::Exception* without enabling RTTI.
-	std::type_info* runtimeExceptionPointerTypeInfo = nullptr;
-	try
-	{
-		throw(Runtime::Exception*) nullptr;
-	}
-	catch(Runtime::Exception*)
-	{
-		runtimeExceptionPointerTypeInfo = __cxxabiv1::__cxa_current_exception_type();
-	}
-
 	// Bind the std::type_info for Runtime::Exception.
 	importedSymbolMap.addOrFail("runtimeExceptionTypeInfo",
-								reinterpret_cast<Uptr>(runtimeExceptionPointerTypeInfo));
+								reinterpret_cast<Uptr>(getRuntimeExceptionPointerTypeInfo()));
 #endif
 
 	// Load the module.
-	return std::make_shared<Module>(objectFileBytes, importedSymbolMap, true, std::move(debugName));
+	return std::make_shared<Module>(objectFileBytes,
+									importedSymbolMap,
+									true,
+									std::move(debugName),
+									&wavmIntrinsicsExportMap);
 }
 
 bool LLVMJIT::getInstructionSourceByAddress(Uptr address, InstructionSource& outSource)
@@ -786,9 +925,9 @@ bool LLVMJIT::getInstructionSourceByAddress(Uptr address, InstructionSource& out
 		auto globalModuleState = GlobalModuleState::get();
 		Platform::RWMutex::ShareableLock addressToModuleMapLock(
 			globalModuleState->addressToModuleMapMutex);
-		auto moduleIt = globalModuleState->addressToModuleMap.upper_bound(address);
-		if(moduleIt == globalModuleState->addressToModuleMap.end()) { return false; }
-		jitModule = moduleIt->second;
+		Module* const* module = globalModuleState->addressToModuleMap.get(address);
+		if(!module) { return false; }
+		jitModule = *module;
 	}
 
 	auto functionIt = jitModule->addressToFunctionMap.upper_bound(address);
@@ -801,7 +940,9 @@ bool LLVMJIT::getInstructionSourceByAddress(Uptr address, InstructionSource& out
 
 #if LAZY_PARSE_DWARF_LINE_INFO
 	Platform::Mutex::Lock dwarfContextLock(jitModule->dwarfContextMutex);
-	llvm::DILineInfo lineInfo = jitModule->dwarfContext->getLineInfoForAddress(
+	auto dwarfContextIt = jitModule->addressToDWARFContextMap.upper_bound(address);
+	if(dwarfContextIt == jitModule->addressToDWARFContextMap.end()) { return false; }
+	llvm::DILineInfo lineInfo = dwarfContextIt->second->getLineInfoForAddress(
 		llvm::object::SectionedAddress{address, llvm::object::SectionedAddress::UndefSection},
 		llvm::DILineInfoSpecifier(
 #if LLVM_VERSION_MAJOR >= 11
@@ -0,0 +1,494 @@
+#include <algorithm>
+#include <vector>
+#include "LLVMJITPrivate.h"
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+
+PUSH_DISABLE_WARNINGS_FOR_LLVM_HEADERS
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/Triple.h>
+#include <llvm/Analysis/AssumptionCache.h>
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/Analysis/ScalarEvolution.h>
+#include <llvm/Analysis/ScalarEvolutionExpressions.h>
+#include <llvm/Analysis/TargetLibraryInfo.h>
+#include <llvm/IR/CFG.h>
+#include <llvm/IR/Dominators.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Intrinsics.h>
+#include <llvm/IR/ValueHandle.h>
+#include <llvm/Transforms/Utils/BasicBlockUtils.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/Transforms/Utils/Local.h>
+#include <llvm/Transforms/Utils/LoopSimplify.h>
+#include <llvm/Transforms/Utils/LoopUtils.h>
+#include <llvm/Transforms/Utils/ValueMapper.h>
+#if LLVM_VERSION_MAJOR >= 11
+#include <llvm/Transforms/Utils/ScalarEvolutionExpander.h>
+#else
+#include <llvm/Analysis/ScalarEvolutionExpander.h>
+#endif
+POP_DISABLE_WARNINGS_FOR_LLVM_HEADERS
+
+using namespace WAVM;
+using namespace WAVM::LLVMJIT;
+
+// Loops with more instructions than this aren't versioned, to limit the growth of the code.
+static constexpr Uptr maxVersionedLoopInstructions = 1000;
+
+// The maximum number of loops that are versioned in a function.
+static constexpr Uptr maxVersionedLoopsPerFunction = 32;
+
+// The maximum depth of the expression that computes the size of a memory for a bounds check.
+static constexpr Uptr maxMemoryNumBytesExpressionDepth = 8;
+
+// A bounds check in a loop whose address increases by a constant each iteration, so it can be
+// replaced by a check of the whole range of addresses before the loop.
+struct HoistableBoundsCheck
+{
+	// The block that branches to the trap block if the access is out of bounds.
+	llvm::BasicBlock* checkBlock;
+	llvm::BasicBlock* trapBlock;
+
+	// The address is a recurrence in the loop plus a constant offset. If the recurrence is
+	// narrower than the address, the address is its zero extension.
+	llvm::IntegerType* addressType;
+	const llvm::SCEVAddRecExpr* addressRecurrence;
+	U64 addressOffset;
+
+	U64 numBytes;
+	llvm::Value* memoryNumBytes;
+};
+
+// Gets the value of a trap call's argument for one of the trap block's predecessors. If the trap
+// block is reached from multiple checks, the argument may be a phi in the trap block.
+static llvm::Value* getTrapArgument(llvm::CallInst* trapCall,
+									Uptr argIndex,
+									llvm::BasicBlock* predecessor)
+{
+	llvm::Value* argument = trapCall->getArgOperand(U32(argIndex));
+	llvm::PHINode* phi = llvm::dyn_cast<llvm::PHINode>(argument);
+	if(phi && phi->getParent() == trapCall->getParent())
+	{ argument = phi->getIncomingValueForBlock(predecessor); }
+	return argument;
+}
+
+// Returns whether a value is computed from loop-invariant values by instructions that can be
+// cloned before the loop.
+static bool isClonableLoopInvariantExpression(llvm::Value* value, llvm::Loop* loop, Uptr depth)
+{
+	llvm::Instruction* instruction = llvm::dyn_cast<llvm::Instruction>(value);
+	if(!instruction || !loop->contains(instruction)) { return true; }
+	if(depth >= maxMemoryNumBytesExpressionDepth) { return false; }
+
+	llvm::LoadInst* load = llvm::dyn_cast<llvm::LoadInst>(instruction);
+	if(!(load && !load->isVolatile()) && !llvm::isa<llvm::CastInst>(instruction)
+	   && !llvm::isa<llvm::BinaryOperator>(instruction)
+	   && !llvm::isa<llvm::GetElementPtrInst>(instruction))
+	{ return false; }
+
+	for(llvm::Value* operand : instruction->operands())
+	{
+		if(!isClonableLoopInvariantExpression(operand, loop, depth + 1)) { return false; }
+	}
+	return true;
+}
+
+// Clones an expression that isClonableLoopInvariantExpression accepted before an instruction
+// outside the loop.
+static llvm::Value* cloneLoopInvariantExpression(llvm::Value* value,
+												 llvm::Loop* loop,
+												 llvm::Instruction* insertBefore,
+												 llvm::ValueToValueMapTy& clonedValues)
+{
+	llvm::Instruction* instruction = llvm::dyn_cast<llvm::Instruction>(value);
+	if(!instruction || !loop->contains(instruction)) { return value; }
+	if(llvm::Value* clonedValue = clonedValues.lookup(instruction)) { return clonedValue; }
+
+	llvm::Instruction* clonedInstruction = instruction->clone();
+	for(Uptr operandIndex = 0; operandIndex < instruction->getNumOperands(); ++operandIndex)
+	{
+		clonedInstruction->setOperand(
+			U32(operandIndex),
+			cloneLoopInvariantExpression(
+				instruction->getOperand(U32(operandIndex)), loop, insertBefore, clonedValues));
+	}
+	clonedInstruction->insertBefore(insertBefore);
+	clonedValues[instruction] = clonedInstruction;
+	return clonedInstruction;
+}
+
+// Finds the bounds checks in a loop that can be hoisted out of it.
+static void findHoistableBoundsChecks(llvm::Loop* loop,
+									  llvm::Function* trapFunction,
+									  llvm::ScalarEvolution& scalarEvolution,
+									  std::vector<HoistableBoundsCheck>& outChecks)
+{
+	llvm::SmallVector<llvm::BasicBlock*, 8> exitBlocks;
+	loop->getUniqueExitBlocks(exitBlocks);
+	for(llvm::BasicBlock* exitBlock : exitBlocks)
+	{
+		// Find the call to the trap intrinsic in a block that ends with unreachable.
+		if(!llvm::isa<llvm::UnreachableInst>(exitBlock->getTerminator())) { continue; }
+		llvm::CallInst* trapCall = nullptr;
+		for(llvm::Instruction& instruction : *exitBlock)
+		{
+			llvm::CallInst* call = llvm::dyn_cast<llvm::CallInst>(&instruction);
+			if(call && call->getCalledFunction() == trapFunction)
+			{
+				trapCall = call;
+				break;
+			}
+		}
+		if(!trapCall) { continue; }
+
+		// The trap is called with (context, address, numBytes, memoryNumBytes, memoryIndex).
+		WAVM_ASSERT(trapFunction->getFunctionType()->getNumParams() == 5);
+		for(llvm::BasicBlock* checkBlock : llvm::predecessors(exitBlock))
+		{
+			llvm::BranchInst* branch = llvm::dyn_cast<llvm::BranchInst>(checkBlock->getTerminator());
+			if(!branch || !branch->isConditional()) { continue; }
+
+			llvm::Value* address = getTrapArgument(trapCall, 1, checkBlock);
+			llvm::ConstantInt* numBytes
+				= llvm::dyn_cast<llvm::ConstantInt>(getTrapArgument(trapCall, 2, checkBlock));
+			llvm::Value* memoryNumBytes = getTrapArgument(trapCall, 3, checkBlock);
+			llvm::IntegerType* addressType = llvm::dyn_cast<llvm::IntegerType>(address->getType());
+			if(!addressType || memoryNumBytes->getType() != addressType || !numBytes
+			   || numBytes->getValue().getActiveBits() > 32
+			   || !isClonableLoopInvariantExpression(memoryNumBytes, loop, 0))
+			{ continue; }
+
+			// Split the address into a recurrence plus a constant offset.
+			const llvm::SCEV* addressSCEV = scalarEvolution.getSCEV(address);
+			U64 addressOffset = 0;
+			if(auto add = llvm::dyn_cast<llvm::SCEVAddExpr>(addressSCEV))
+			{
+				auto constant = llvm::dyn_cast<llvm::SCEVConstant>(add->getOperand(0));
+				if(add->getNumOperands() != 2 || !constant
+				   || constant->getAPInt().getActiveBits() > 32)
+				{ continue; }
+				addressOffset = constant->getAPInt().getZExtValue();
+				addressSCEV = add->getOperand(1);
+			}
+			if(auto zext = llvm::dyn_cast<llvm::SCEVZeroExtendExpr>(addressSCEV))
+			{ addressSCEV = zext->getOperand(); }
+
+			// The recurrence must increase by a non-negative constant each iteration, from a value
+			// that can be computed before the loop.
+			auto addressRecurrence = llvm::dyn_cast<llvm::SCEVAddRecExpr>(addressSCEV);
+			if(!addressRecurrence || addressRecurrence->getLoop() != loop
+			   || !addressRecurrence->isAffine()
+			   || scalarEvolution.getTypeSizeInBits(addressRecurrence->getType())
+					  > addressType->getBitWidth()
+			   || !scalarEvolution.isLoopInvariant(addressRecurrence->getStart(), loop)
+			   || !llvm::isSafeToExpand(addressRecurrence->getStart(), scalarEvolution))
+			{ continue; }
+			auto step
+				= llvm::dyn_cast<llvm::SCEVConstant>(addressRecurrence->getStepRecurrence(scalarEvolution));
+			if(!step || step->getAPInt().isNegative()) { continue; }
+
+			outChecks.push_back({checkBlock,
+								 exitBlock,
+								 addressType,
+								 addressRecurrence,
+								 addressOffset,
+								 numBytes->getZExtValue(),
+								 memoryNumBytes});
+		}
+	}
+}
+
+// Gets an upper bound on the number of times a loop's backedge is taken, or null if it can't be
+// computed.
+static const llvm::SCEV* getMaxBackedgeTakenCount(llvm::Loop* loop,
+												  llvm::DominatorTree& dominatorTree,
+												  llvm::ScalarEvolution& scalarEvolution)
+{
+	// The exit count of an exiting block that is executed on every iteration bounds the number of
+	// iterations, even if the loop may exit earlier through another block.
+	llvm::BasicBlock* latch = loop->getLoopLatch();
+	llvm::SmallVector<llvm::BasicBlock*, 8> exitingBlocks;
+	loop->getExitingBlocks(exitingBlocks);
+	for(llvm::BasicBlock* exitingBlock : exitingBlocks)
+	{
+		if(!dominatorTree.dominates(exitingBlock, latch)) { continue; }
+		const llvm::SCEV* exitCount = scalarEvolution.getExitCount(loop, exitingBlock);
+		if(!llvm::isa<llvm::SCEVCouldNotCompute>(exitCount)
+		   && scalarEvolution.isLoopInvariant(exitCount, loop)
+		   && llvm::isSafeToExpand(exitCount, scalarEvolution))
+		{ return exitCount; }
+	}
+	return nullptr;
+}
+
+// Emits a condition that is true if every access checked by the hoistable bounds checks is in
+// bounds on every iteration of the loop. The condition is emitted before the loop, so the memory
+// size it compares to may be smaller than the size when the access is checked, but never larger,
+// since memories can't shrink.
+static llvm::Value* emitHoistedBoundsCheck(llvm::Loop* loop,
+										   const std::vector<HoistableBoundsCheck>& checks,
+										   const llvm::SCEV* maxBackedgeTakenCount,
+										   llvm::ScalarEvolution& scalarEvolution)
+{
+	llvm::Instruction* insertBefore = loop->getLoopPreheader()->getTerminator();
+	llvm::Module* llvmModule = insertBefore->getModule();
+	llvm::IRBuilder<> irBuilder(insertBefore);
+	llvm::SCEVExpander expander(scalarEvolution, llvmModule->getDataLayout(), "boundsCheck");
+	llvm::ValueToValueMapTy clonedValues;
+
+	llvm::Value* inBounds = irBuilder.getTrue();
+	for(const HoistableBoundsCheck& check : checks)
+	{
+		llvm::IntegerType* addressType = check.addressType;
+		const llvm::SCEV* start = check.addressRecurrence->getStart();
+
+		// Compute the address of the last byte accessed on the last iteration, with checks for
+		// overflow. If none of the computations overflow, then the recurrence doesn't wrap on any
+		// iteration, and so its largest value is on the last iteration.
+		llvm::Value* overflowed = irBuilder.getFalse();
+		auto emitOverflowCheckedOp
+			= [&](llvm::Intrinsic::ID intrinsicID, llvm::Value* left, llvm::Value* right) {
+				  llvm::Function* intrinsic
+					  = llvm::Intrinsic::getDeclaration(llvmModule, intrinsicID, {addressType});
+				  llvm::Value* resultAndOverflow = irBuilder.CreateCall(intrinsic, {left, right});
+				  overflowed = irBuilder.CreateOr(
+					  overflowed, irBuilder.CreateExtractValue(resultAndOverflow, {1}));
+				  return irBuilder.CreateExtractValue(resultAndOverflow, {0});
+			  };
+
+		llvm::Value* startAddress = irBuilder.CreateZExt(
+			expander.expandCodeFor(start, start->getType(), insertBefore), addressType);
+		llvm::Value* numIterations = irBuilder.CreateZExt(
+			expander.expandCodeFor(
+				maxBackedgeTakenCount, maxBackedgeTakenCount->getType(), insertBefore),
+			addressType);
+		auto step = llvm::cast<llvm::SCEVConstant>(
+			check.addressRecurrence->getStepRecurrence(scalarEvolution));
+		llvm::Value* lastAddress
+			= emitOverflowCheckedOp(llvm::Intrinsic::uadd_with_overflow,
+									startAddress,
+									emitOverflowCheckedOp(llvm::Intrinsic::umul_with_overflow,
+														  numIterations,
+														  llvm::ConstantInt::get(
+															  addressType, step->getAPInt().getZExtValue())));
+		llvm::Value* endAddress = emitOverflowCheckedOp(
+			llvm::Intrinsic::uadd_with_overflow,
+			lastAddress,
+			llvm::ConstantInt::get(addressType, check.addressOffset + check.numBytes));
+
+		llvm::Value* memoryNumBytes = cloneLoopInvariantExpression(
+			check.memoryNumBytes, loop, insertBefore, clonedValues);
+		llvm::Value* checkInBounds = irBuilder.CreateAnd(
+			irBuilder.CreateNot(overflowed), irBuilder.CreateICmpULE(endAddress, memoryNumBytes));
+		inBounds = irBuilder.CreateAnd(inBounds, checkInBounds);
+	}
+
+	return inBounds;
+}
+
+// Deletes the instructions that computed a bounds check's condition once it's no longer used.
+// Unlike llvm::RecursivelyDeleteTriviallyDeadInstructions, this also deletes the atomic loads of
+// the memory size that the condition depends on.
+static void deleteDeadBoundsCheckCondition(llvm::Value* condition)
+{
+	// An instruction may be queued more than once, so the queue holds weak handles that are nulled
+	// when it's deleted.
+	llvm::SmallVector<llvm::WeakTrackingVH, 16> deadInstructions;
+	deadInstructions.push_back(condition);
+	while(deadInstructions.size())
+	{
+		llvm::Instruction* instruction
+			= llvm::dyn_cast_or_null<llvm::Instruction>(deadInstructions.pop_back_val());
+		if(!instruction) { continue; }
+
+		llvm::LoadInst* load = llvm::dyn_cast<llvm::LoadInst>(instruction);
+		if(!instruction->use_empty()
+		   || (!llvm::isInstructionTriviallyDead(instruction) && !(load && !load->isVolatile())))
+		{ continue; }
+
+		for(llvm::Value* operand : instruction->operands())
+		{
+			if(llvm::isa<llvm::Instruction>(operand) && operand != instruction)
+			{ deadInstructions.push_back(operand); }
+		}
+		instruction->dropAllReferences();
+		instruction->eraseFromParent();
+	}
+}
+
+// If a loop contains bounds checks that can be hoisted out of it, versions it: a check before the
+// loop tests whether all of the hoisted checks will pass on every iteration, and if so, runs a
+// copy of the loop without them. Otherwise, the original loop runs, and traps on the first
+// out-of-bounds access as before. Returns whether the loop was versioned.
+static bool versionLoop(llvm::Loop* loop,
+						llvm::Function* trapFunction,
+						llvm::DominatorTree& dominatorTree,
+						llvm::LoopInfo& loopInfo,
+						llvm::ScalarEvolution& scalarEvolution,
+						llvm::AssumptionCache& assumptionCache,
+						llvm::SmallPtrSet<llvm::BasicBlock*, 16>& visitedLoopHeaders)
+{
+	// Don't version loops that are too large, or that contain exception handling pads.
+	Uptr numInstructions = 0;
+	for(llvm::BasicBlock* block : loop->blocks())
+	{
+		if(block->isEHPad()) { return false; }
+		numInstructions += block->size();
+	}
+	if(numInstructions > maxVersionedLoopInstructions) { return false; }
+
+	// Put the loop in the form that cloning it requires: a preheader, dedicated exits, and LCSSA
+	// phis for the values that are used outside the loop.
+#if LLVM_VERSION_MAJOR >= 9
+	llvm::simplifyLoop(
+		loop, &dominatorTree, &loopInfo, &scalarEvolution, &assumptionCache, nullptr, false);
+#else
+	llvm::simplifyLoop(loop, &dominatorTree, &loopInfo, &scalarEvolution, &assumptionCache, false);
+#endif
+	visitedLoopHeaders.insert(loop->getHeader());
+	if(!loop->isLoopSimplifyForm()) { return false; }
+	llvm::formLCSSA(*loop, dominatorTree, &loopInfo, &scalarEvolution);
+	if(!loop->isLCSSAForm(dominatorTree)) { return false; }
+
+	std::vector<HoistableBoundsCheck> checks;
+	findHoistableBoundsChecks(loop, trapFunction, scalarEvolution, checks);
+	if(!checks.size()) { return false; }
+
+	const llvm::SCEV* maxBackedgeTakenCount
+		= getMaxBackedgeTakenCount(loop, dominatorTree, scalarEvolution);
+	if(!maxBackedgeTakenCount) { return false; }
+
+	// The number of iterations must fit in the type of the addresses it is used to compute.
+	const U64 maxBackedgeTakenCountBits
+		= scalarEvolution.getTypeSizeInBits(maxBackedgeTakenCount->getType());
+	checks.erase(std::remove_if(checks.begin(),
+								checks.end(),
+								[maxBackedgeTakenCountBits](const HoistableBoundsCheck& check) {
+									return maxBackedgeTakenCountBits
+										   > check.addressType->getBitWidth();
+								}),
+				 checks.end());
+	if(!checks.size()) { return false; }
+
+	llvm::Value* inBounds
+		= emitHoistedBoundsCheck(loop, checks, maxBackedgeTakenCount, scalarEvolution);
+
+	// Split the preheader, so the hoisted check is followed by a preheader for each version of
+	// the loop, and clone the loop.
+	llvm::SmallVector<llvm::BasicBlock*, 8> exitBlocks;
+	loop->getUniqueExitBlocks(exitBlocks);
+	llvm::BasicBlock* hoistedCheckBlock = loop->getLoopPreheader();
+	llvm::BasicBlock* preheader = llvm::SplitBlock(
+		hoistedCheckBlock, hoistedCheckBlock->getTerminator(), &dominatorTree, &loopInfo);
+
+	llvm::ValueToValueMapTy clonedValues;
+	llvm::SmallVector<llvm::BasicBlock*, 16> clonedBlocks;
+	llvm::Loop* uncheckedLoop = llvm::cloneLoopWithPreheader(preheader,
+															 hoistedCheckBlock,
+															 loop,
+															 clonedValues,
+															 ".unchecked",
+															 &loopInfo,
+															 &dominatorTree,
+															 clonedBlocks);
+	llvm::remapInstructionsInBlocks(clonedBlocks, clonedValues);
+	visitedLoopHeaders.insert(uncheckedLoop->getHeader());
+
+	llvm::BasicBlock* uncheckedPreheader = uncheckedLoop->getLoopPreheader();
+	llvm::Instruction* hoistedCheckTerminator = hoistedCheckBlock->getTerminator();
+	llvm::BranchInst::Create(uncheckedPreheader, preheader, inBounds, hoistedCheckTerminator);
+	hoistedCheckTerminator->eraseFromParent();
+
+	// The exits of the loop are shared by both versions, so add the values from the unchecked
+	// version to their LCSSA phis.
+	for(llvm::BasicBlock* exitBlock : exitBlocks)
+	{
+		for(llvm::Instruction& instruction : *exitBlock)
+		{
+			llvm::PHINode* phi = llvm::dyn_cast<llvm::PHINode>(&instruction);
+			if(!phi) { break; }
+
+			const U32 numIncomingValues = phi->getNumIncomingValues();
+			for(U32 incomingIndex = 0; incomingIndex < numIncomingValues; ++incomingIndex)
+			{
+				llvm::BasicBlock* incomingBlock = phi->getIncomingBlock(incomingIndex);
+				if(!loop->contains(incomingBlock)) { continue; }
+
+				llvm::Value* incomingValue = phi->getIncomingValue(incomingIndex);
+				llvm::Value* clonedIncomingValue = clonedValues.lookup(incomingValue);
+				phi->addIncoming(clonedIncomingValue ? clonedIncomingValue : incomingValue,
+								 llvm::cast<llvm::BasicBlock>(clonedValues.lookup(incomingBlock)));
+			}
+		}
+	}
+
+	// Remove the hoisted checks from the unchecked version of the loop.
+	for(const HoistableBoundsCheck& check : checks)
+	{
+		llvm::BasicBlock* uncheckedBlock
+			= llvm::cast<llvm::BasicBlock>(clonedValues.lookup(check.checkBlock));
+		llvm::BranchInst* branch = llvm::cast<llvm::BranchInst>(uncheckedBlock->getTerminator());
+		llvm::BasicBlock* inBoundsSuccessor = branch->getSuccessor(0) == check.trapBlock
+												  ? branch->getSuccessor(1)
+												  : branch->getSuccessor(0);
+		llvm::Value* condition = branch->getCondition();
+
+		check.trapBlock->removePredecessor(uncheckedBlock);
+		llvm::BranchInst::Create(inBoundsSuccessor, branch);
+		branch->eraseFromParent();
+		deleteDeadBoundsCheckCondition(condition);
+	}
+
+	return true;
+}
+
+void LLVMJIT::hoistLoopBoundsChecks(llvm::Function& function)
+{
+	llvm::Function* trapFunction = function.getParent()->getFunction("memoryOutOfBoundsTrap");
+	if(!trapFunction || function.isDeclaration()) { return; }
+
+	llvm::TargetLibraryInfoImpl targetLibraryInfoImpl(
+		llvm::Triple(function.getParent()->getTargetTriple()));
+	llvm::TargetLibraryInfo targetLibraryInfo(targetLibraryInfoImpl);
+
+	// Versioning a loop invalidates the dominator tree, so recompute the analyses after each loop
+	// is versioned. The headers of the loops that were already considered are remembered, so each
+	// loop is only considered once.
+	llvm::SmallPtrSet<llvm::BasicBlock*, 16> visitedLoopHeaders;
+	Uptr numVersionedLoops = 0;
+	bool versionedLoop = true;
+	while(versionedLoop && numVersionedLoops < maxVersionedLoopsPerFunction)
+	{
+		versionedLoop = false;
+
+		llvm::DominatorTree dominatorTree(function);
+		llvm::LoopInfo loopInfo(dominatorTree);
+		llvm::AssumptionCache assumptionCache(function);
+		llvm::ScalarEvolution scalarEvolution(
+			function, targetLibraryInfo, assumptionCache, dominatorTree, loopInfo);
+
+		for(llvm::Loop* loop : loopInfo.getLoopsInPreorder())
+		{
+			// Only innermost loops are versioned.
+			if(loop->getSubLoops().size() || visitedLoopHeaders.count(loop->getHeader()))
+			{ continue; }
+
+			if(versionLoop(loop,
+						   trapFunction,
+						   dominatorTree,
+						   loopInfo,
+						   scalarEvolution,
+						   assumptionCache,
+						   visitedLoopHeaders))
+			{
+				versionedLoop = true;
+				++numVersionedLoops;
+				break;
+			}
+		}
+	}
+}
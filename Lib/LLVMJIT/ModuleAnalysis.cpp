@@ -0,0 +1,197 @@
+#include <vector>
+#include "LLVMJITPrivate.h"
+#include "WAVM/IR/Module.h"
+#include "WAVM/IR/Operators.h"
+#include "WAVM/IR/Types.h"
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::LLVMJIT;
+
+// The maximum number of elements in a table whose contents are tracked by the analysis.
+static constexpr Uptr maxKnownTableElements = 65536;
+
+// A visitor that records the tables that are mutated by an operator.
+struct TableMutationVisitor
+{
+	typedef void Result;
+
+	std::vector<TableAnalysis>& tables;
+
+	TableMutationVisitor(std::vector<TableAnalysis>& inTables) : tables(inTables) {}
+
+	template<typename Imm> void visit(Opcode, Imm) {}
+
+	void visit(Opcode opcode, TableImm imm)
+	{
+		if(opcode == Opcode::table_set || opcode == Opcode::table_grow
+		   || opcode == Opcode::table_fill)
+		{ tables[imm.tableIndex].isImmutable = false; }
+	}
+	void visit(Opcode, TableCopyImm imm) { tables[imm.destTableIndex].isImmutable = false; }
+	void visit(Opcode, ElemSegmentAndTableImm imm) { tables[imm.tableIndex].isImmutable = false; }
+
+#define VISIT_OP(_, name, nameString, Imm, ...)                                                    \
+	void name(Imm imm) { visit(Opcode::name, imm); }
+	WAVM_ENUM_OPERATORS(VISIT_OP)
+#undef VISIT_OP
+};
+
+// Returns the constant offset of an active elem segment, or UINTPTR_MAX if it isn't a constant.
+static Uptr getConstantElemSegmentOffset(const ElemSegment& elemSegment)
+{
+	if(elemSegment.baseOffset.type == InitializerExpression::Type::i32_const)
+	{ return Uptr(U32(elemSegment.baseOffset.i32)); }
+	else if(elemSegment.baseOffset.type == InitializerExpression::Type::i64_const)
+	{
+		return U64(elemSegment.baseOffset.i64) < UINTPTR_MAX ? Uptr(elemSegment.baseOffset.i64)
+															 : UINTPTR_MAX;
+	}
+	else
+	{
+		return UINTPTR_MAX;
+	}
+}
+
+// Computes the elements of an immutable table after the module's active elem segments are copied
+// into it. Returns false if they can't be determined at compile time.
+static bool getKnownTableElements(const IR::Module& irModule,
+								  Uptr tableIndex,
+								  std::vector<Uptr>& outElementFunctionIndices)
+{
+	const TableType& tableType = irModule.tables.getType(tableIndex);
+	if(tableType.elementType != ReferenceType::funcref
+	   || tableType.size.min > maxKnownTableElements)
+	{ return false; }
+
+	// An immutable table never grows, so it has its minimum size after instantiation, and all of
+	// its elements start out null.
+	outElementFunctionIndices.assign(Uptr(tableType.size.min), UINTPTR_MAX);
+
+	for(const ElemSegment& elemSegment : irModule.elemSegments)
+	{
+		if(elemSegment.type != ElemSegment::Type::active || elemSegment.tableIndex != tableIndex)
+		{ continue; }
+
+		// If the segment's offset isn't a constant, or the segment is out of bounds (which makes
+		// instantiation fail), the contents aren't known.
+		const ElemSegment::Contents& contents = *elemSegment.contents;
+		const Uptr numSegmentElements = contents.encoding == ElemSegment::Encoding::index
+											? contents.elemIndices.size()
+											: contents.elemExprs.size();
+		const Uptr baseOffset = getConstantElemSegmentOffset(elemSegment);
+		if(baseOffset > outElementFunctionIndices.size()
+		   || numSegmentElements > outElementFunctionIndices.size() - baseOffset)
+		{ return false; }
+
+		for(Uptr segmentElementIndex = 0; segmentElementIndex < numSegmentElements;
+			++segmentElementIndex)
+		{
+			Uptr& elementFunctionIndex
+				= outElementFunctionIndices[baseOffset + segmentElementIndex];
+			if(contents.encoding == ElemSegment::Encoding::index)
+			{
+				if(contents.externKind != ExternKind::function) { return false; }
+				elementFunctionIndex = contents.elemIndices[segmentElementIndex];
+			}
+			else
+			{
+				const ElemExpr& elemExpr = contents.elemExprs[segmentElementIndex];
+				switch(elemExpr.type)
+				{
+				case ElemExpr::Type::ref_null: elementFunctionIndex = UINTPTR_MAX; break;
+				case ElemExpr::Type::ref_func: elementFunctionIndex = elemExpr.index; break;
+
+				case ElemExpr::Type::invalid:
+				default: WAVM_UNREACHABLE();
+				};
+			}
+		}
+	}
+
+	return true;
+}
+
+ModuleAnalysis LLVMJIT::analyzeModule(const IR::Module& irModule)
+{
+	ModuleAnalysis analysis;
+
+	// Assume that the tables defined by the module are immutable until shown otherwise. Imported
+	// tables may be mutated by other modules or the host.
+	analysis.tables.resize(irModule.tables.size());
+	for(Uptr tableIndex = 0; tableIndex < irModule.tables.size(); ++tableIndex)
+	{ analysis.tables[tableIndex].isImmutable = irModule.tables.isDef(tableIndex); }
+
+	// Exported tables may be mutated by other modules or the host.
+	for(const Export& export_ : irModule.exports)
+	{
+		if(export_.kind == ExternKind::table)
+		{ analysis.tables[export_.index].isImmutable = false; }
+	}
+
+	// Find the tables that are mutated by the module's code.
+	TableMutationVisitor tableMutationVisitor(analysis.tables);
+	for(const FunctionDef& functionDef : irModule.functions.defs)
+	{
+		OperatorDecoderStream decoder(functionDef.code);
+		while(decoder) { decoder.decodeOp(tableMutationVisitor); };
+	}
+
+	// Compute the contents of the immutable tables.
+	for(Uptr tableIndex = 0; tableIndex < irModule.tables.size(); ++tableIndex)
+	{
+		TableAnalysis& table = analysis.tables[tableIndex];
+		if(table.isImmutable)
+		{
+			table.hasKnownElements
+				= getKnownTableElements(irModule, tableIndex, table.elementFunctionIndices);
+			if(!table.hasKnownElements) { table.elementFunctionIndices.clear(); }
+		}
+	}
+
+	return analysis;
+}
+
+Uptr LLVMJIT::getKnownCallIndirectCallee(const IR::Module& irModule,
+										 const TableAnalysis& table,
+										 Uptr elementIndex,
+										 FunctionType calleeType)
+{
+	if(!table.hasKnownElements || elementIndex >= table.elementFunctionIndices.size())
+	{ return UINTPTR_MAX; }
+
+	// Only functions defined by the module are known to have exactly the type they are declared
+	// with: an imported function may have a subtype of its declared type.
+	const Uptr functionIndex = table.elementFunctionIndices[elementIndex];
+	if(functionIndex == UINTPTR_MAX || !irModule.functions.isDef(functionIndex)
+	   || irModule.types[irModule.functions.getType(functionIndex).index] != calleeType)
+	{ return UINTPTR_MAX; }
+
+	return functionIndex;
+}
+
+bool LLVMJIT::canElideCallIndirectTypeCheck(const IR::Module& irModule,
+											const TableAnalysis& table,
+											FunctionType calleeType)
+{
+	if(!table.hasKnownElements) { return false; }
+
+	for(Uptr elementIndex = 0; elementIndex < table.elementFunctionIndices.size(); ++elementIndex)
+	{
+		if(getKnownCallIndirectCallee(irModule, table, elementIndex, calleeType) == UINTPTR_MAX)
+		{ return false; }
+	}
+	return true;
+}
+
+std::vector<bool> LLVMJIT::getImmutableTables(const IR::Module& irModule)
+{
+	const ModuleAnalysis analysis = analyzeModule(irModule);
+
+	std::vector<bool> immutableTables;
+	for(const TableAnalysis& table : analysis.tables)
+	{ immutableTables.push_back(table.isImmutable); }
+	return immutableTables;
+}
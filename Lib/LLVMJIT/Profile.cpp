@@ -0,0 +1,226 @@
+#include <string.h>
+#include <vector>
+#include "LLVMJITPrivate.h"
+#include "WAVM/IR/Module.h"
+#include "WAVM/IR/Operators.h"
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Hash.h"
+#include "WAVM/LLVMJIT/LLVMJIT.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::LLVMJIT;
+
+// The magic number at the start of a serialized profile, followed by a version number.
+static const char profileMagic[8] = {'W', 'A', 'V', 'M', 'P', 'R', 'O', 'F'};
+static constexpr U64 profileVersion = 1;
+
+std::vector<Uptr> LLVMJIT::getProfileCounterOffsets(const IR::Module& irModule)
+{
+	std::vector<Uptr> offsets;
+	offsets.reserve(irModule.functions.defs.size() + 1);
+
+	Uptr numCounters = 0;
+	for(const FunctionDef& functionDef : irModule.functions.defs)
+	{
+		offsets.push_back(numCounters);
+
+		// Count the function's entry, and the execution and condition of each if or br_if.
+		++numCounters;
+		OpcodeVisitor opcodeVisitor;
+		OperatorDecoderStream decoder(functionDef.code);
+		while(decoder)
+		{
+			if(isProfiledBranch(decoder.decodeOp(opcodeVisitor))) { numCounters += 2; }
+		};
+	}
+	offsets.push_back(numCounters);
+
+	return offsets;
+}
+
+Uptr LLVMJIT::getNumProfileCounters(const IR::Module& irModule)
+{
+	return getProfileCounterOffsets(irModule).back();
+}
+
+// Hashes the opcode and immediates of each operator it visits. The immediates are hashed field by
+// field, since the encoded operators contain uninitialized padding between the opcode and
+// immediates, and between the fields of some immediates.
+struct OperatorHasher
+{
+	typedef void Result;
+
+	U64 hash;
+
+	OperatorHasher(const FunctionDef& inFunctionDef, U64 inHash)
+	: hash(inHash), functionDef(inFunctionDef)
+	{
+	}
+
+#define VISIT_OPCODE(encoding, name, nameString, Imm, ...)                                         \
+	void name(Imm imm = {})                                                                        \
+	{                                                                                              \
+		addValue(U64(Opcode::name));                                                               \
+		addImm(imm);                                                                               \
+	}
+	WAVM_ENUM_OPERATORS(VISIT_OPCODE)
+#undef VISIT_OPCODE
+
+private:
+	const FunctionDef& functionDef;
+
+	void addValue(U64 value) { hash = XXH<U64>(&value, sizeof(value), hash); }
+
+	void addImm(NoImm) {}
+	void addImm(MemoryImm imm) { addValue(imm.memoryIndex); }
+	void addImm(MemoryCopyImm imm)
+	{
+		addValue(imm.destMemoryIndex);
+		addValue(imm.sourceMemoryIndex);
+	}
+	void addImm(TableImm imm) { addValue(imm.tableIndex); }
+	void addImm(TableCopyImm imm)
+	{
+		addValue(imm.destTableIndex);
+		addValue(imm.sourceTableIndex);
+	}
+	void addImm(ControlStructureImm imm)
+	{
+		addValue(U64(imm.type.format));
+		switch(imm.type.format)
+		{
+		case IndexedBlockType::noParametersOrResult: break;
+		case IndexedBlockType::oneResult: addValue(U64(imm.type.resultType)); break;
+		case IndexedBlockType::functionType: addValue(imm.type.index); break;
+		default: WAVM_UNREACHABLE();
+		};
+	}
+	void addImm(SelectImm imm) { addValue(U64(imm.type)); }
+	void addImm(BranchImm imm) { addValue(imm.targetDepth); }
+	void addImm(BranchTableImm imm)
+	{
+		addValue(imm.defaultTargetDepth);
+		WAVM_ASSERT(imm.branchTableIndex < functionDef.branchTables.size());
+		const std::vector<Uptr>& targetDepths = functionDef.branchTables[imm.branchTableIndex];
+		addValue(targetDepths.size());
+		for(Uptr targetDepth : targetDepths) { addValue(targetDepth); }
+	}
+	template<typename Value> void addImm(LiteralImm<Value> imm)
+	{
+		hash = XXH<U64>(&imm.value, sizeof(Value), hash);
+	}
+	template<bool isGlobal> void addImm(GetOrSetVariableImm<isGlobal> imm)
+	{
+		addValue(imm.variableIndex);
+	}
+	void addImm(FunctionImm imm) { addValue(imm.functionIndex); }
+	void addImm(FunctionRefImm imm) { addValue(imm.functionIndex); }
+	void addImm(CallIndirectImm imm)
+	{
+		addValue(imm.type.index);
+		addValue(imm.tableIndex);
+	}
+	void addImm(BaseLoadOrStoreImm imm)
+	{
+		addValue(imm.alignmentLog2);
+		addValue(imm.offset);
+		addValue(imm.memoryIndex);
+	}
+	template<Uptr naturalAlignmentLog2, Uptr numLanes>
+	void addImm(LoadOrStoreLaneImm<naturalAlignmentLog2, numLanes> imm)
+	{
+		addImm(BaseLoadOrStoreImm(imm));
+		addValue(imm.laneIndex);
+	}
+	template<Uptr numLanes> void addImm(LaneIndexImm<numLanes> imm) { addValue(imm.laneIndex); }
+	template<Uptr numLanes> void addImm(ShuffleImm<numLanes> imm)
+	{
+		hash = XXH<U64>(imm.laneIndices, sizeof(imm.laneIndices), hash);
+	}
+	void addImm(AtomicFenceImm imm) { addValue(U64(imm.order)); }
+	void addImm(ExceptionTypeImm imm) { addValue(imm.exceptionTypeIndex); }
+	void addImm(RethrowImm imm) { addValue(imm.catchDepth); }
+	void addImm(DataSegmentAndMemImm imm)
+	{
+		addValue(imm.dataSegmentIndex);
+		addValue(imm.memoryIndex);
+	}
+	void addImm(DataSegmentImm imm) { addValue(imm.dataSegmentIndex); }
+	void addImm(ElemSegmentAndTableImm imm)
+	{
+		addValue(imm.elemSegmentIndex);
+		addValue(imm.tableIndex);
+	}
+	void addImm(ElemSegmentImm imm) { addValue(imm.elemSegmentIndex); }
+	void addImm(ReferenceTypeImm imm) { addValue(U64(imm.referenceType)); }
+};
+
+U64 LLVMJIT::getProfileModuleHash(const IR::Module& irModule)
+{
+	// Hash the type, locals, and operators of each function definition, so a profile is only
+	// matched to function definitions that compile to the same code.
+	U64 hash = XXH<U64>(profileMagic, sizeof(profileMagic), 0);
+	for(const FunctionDef& functionDef : irModule.functions.defs)
+	{
+		const U64 typeIndex = U64(functionDef.type.index);
+		hash = XXH<U64>(&typeIndex, sizeof(typeIndex), hash);
+
+		const U64 numLocals = U64(functionDef.nonParameterLocalTypes.size());
+		hash = XXH<U64>(&numLocals, sizeof(numLocals), hash);
+		hash = XXH<U64>(
+			functionDef.nonParameterLocalTypes.data(), numLocals * sizeof(ValueType), hash);
+
+		OperatorHasher operatorHasher(functionDef, hash);
+		OperatorDecoderStream decoder(functionDef.code);
+		while(decoder) { decoder.decodeOp(operatorHasher); };
+		hash = operatorHasher.hash;
+	}
+	return hash;
+}
+
+std::vector<U8> LLVMJIT::serializeModuleProfile(const ModuleProfile& profile)
+{
+	const U64 numCounters = U64(profile.counters.size());
+	const Uptr numHeaderBytes = sizeof(profileMagic) + sizeof(U64) * 3;
+
+	std::vector<U8> result(numHeaderBytes + sizeof(U64) * numCounters);
+	U8* nextByte = result.data();
+	memcpy(nextByte, profileMagic, sizeof(profileMagic));
+	nextByte += sizeof(profileMagic);
+	memcpy(nextByte, &profileVersion, sizeof(U64));
+	nextByte += sizeof(U64);
+	memcpy(nextByte, &profile.moduleHash, sizeof(U64));
+	nextByte += sizeof(U64);
+	memcpy(nextByte, &numCounters, sizeof(U64));
+	nextByte += sizeof(U64);
+	if(numCounters) { memcpy(nextByte, profile.counters.data(), sizeof(U64) * numCounters); }
+
+	return result;
+}
+
+bool LLVMJIT::deserializeModuleProfile(const std::vector<U8>& bytes, ModuleProfile& outProfile)
+{
+	const Uptr numHeaderBytes = sizeof(profileMagic) + sizeof(U64) * 3;
+	if(bytes.size() < numHeaderBytes || memcmp(bytes.data(), profileMagic, sizeof(profileMagic)))
+	{ return false; }
+
+	const U8* nextByte = bytes.data() + sizeof(profileMagic);
+	U64 version = 0;
+	U64 numCounters = 0;
+	memcpy(&version, nextByte, sizeof(U64));
+	nextByte += sizeof(U64);
+	memcpy(&outProfile.moduleHash, nextByte, sizeof(U64));
+	nextByte += sizeof(U64);
+	memcpy(&numCounters, nextByte, sizeof(U64));
+	nextByte += sizeof(U64);
+	if(version != profileVersion || numCounters > (bytes.size() - numHeaderBytes) / sizeof(U64)
+	   || bytes.size() != numHeaderBytes + numCounters * sizeof(U64))
+	{ return false; }
+
+	outProfile.counters.resize(numCounters);
+	if(numCounters) { memcpy(outProfile.counters.data(), nextByte, sizeof(U64) * numCounters); }
+
+	return true;
+}
@@ -49,6 +49,7 @@ struct InvokeThunkCache
 	Platform::RWMutex mutex;
 
 	HashMap<FunctionType, Runtime::Function*> typeToFunctionMap;
+	HashMap<FunctionType, Runtime::Function*> typeToBatchFunctionMap;
 	std::vector<std::unique_ptr<LLVMJIT::Module>> modules;
 
 	static InvokeThunkCache& get()
@@ -61,20 +62,112 @@ private:
 	InvokeThunkCache() {}
 };
 
-InvokeThunkPointer LLVMJIT::getInvokeThunk(FunctionType functionType)
+// Emits code that loads a function's arguments from an array, calls it, and writes its results to
+// another array.
+static void emitInvoke(EmitContext& emitContext,
+					   FunctionType functionType,
+					   llvm::Value* calleeFunction,
+					   llvm::Value* argsArray,
+					   llvm::Value* resultsArray,
+					   llvm::Type* iptrType)
+{
+	LLVMContext& llvmContext = emitContext.llvmContext;
+
+	// Load the function's arguments from the argument array.
+	std::vector<llvm::Value*> arguments;
+	for(Uptr argIndex = 0; argIndex < functionType.params().size(); ++argIndex)
+	{
+		const ValueType paramType = functionType.params()[argIndex];
+		llvm::Value* argOffset = emitLiteral(llvmContext, argIndex * sizeof(UntaggedValue));
+		llvm::Value* arg = emitContext.loadFromUntypedPointer(
+			emitContext.irBuilder.CreateInBoundsGEP(argsArray, {argOffset}),
+			asLLVMType(llvmContext, paramType),
+			alignof(UntaggedValue));
+		arguments.push_back(arg);
+	}
+
+	// Call the function.
+	llvm::Value* functionCode = emitContext.irBuilder.CreateInBoundsGEP(
+		calleeFunction, {emitLiteralIptr(offsetof(Runtime::Function, code), iptrType)});
+	ValueVector results = emitContext.emitCallOrInvoke(
+		emitContext.irBuilder.CreatePointerCast(
+			functionCode, asLLVMType(llvmContext, functionType)->getPointerTo()),
+		arguments,
+		functionType);
+
+	// Write the function's results to the results array.
+	WAVM_ASSERT(results.size() == functionType.results().size());
+	for(Uptr resultIndex = 0; resultIndex < results.size(); ++resultIndex)
+	{
+		llvm::Value* resultOffset = emitLiteral(llvmContext, resultIndex * sizeof(UntaggedValue));
+		llvm::Value* result = results[resultIndex];
+		emitContext.storeToUntypedPointer(
+			result,
+			emitContext.irBuilder.CreateInBoundsGEP(resultsArray, {resultOffset}),
+			alignof(UntaggedValue));
+	}
+}
+
+// Emits the loop of a batch invoke thunk: it calls the function numInvokes times, with the
+// arguments and results of each call packed one after the other in the arrays, and writes the
+// number of calls that have returned to numCompletedInvokes after each call.
+static void emitInvokeBatchLoop(EmitContext& emitContext,
+								FunctionType functionType,
+								llvm::Function* function,
+								llvm::Value* calleeFunction,
+								llvm::Value* argsArray,
+								llvm::Value* resultsArray,
+								llvm::Value* numInvokes,
+								llvm::Value* numCompletedInvokes,
+								llvm::Type* iptrType)
+{
+	LLVMContext& llvmContext = emitContext.llvmContext;
+	llvm::IRBuilder<>& irBuilder = emitContext.irBuilder;
+
+	llvm::BasicBlock* entryBlock = irBuilder.GetInsertBlock();
+	llvm::BasicBlock* loopBlock = llvm::BasicBlock::Create(llvmContext, "loop", function);
+	llvm::BasicBlock* exitBlock = llvm::BasicBlock::Create(llvmContext, "exit", function);
+	irBuilder.CreateCondBr(irBuilder.CreateICmpEQ(numInvokes, emitLiteralIptr(0, iptrType)),
+						   exitBlock,
+						   loopBlock);
+
+	irBuilder.SetInsertPoint(loopBlock);
+	llvm::PHINode* invokeIndex = irBuilder.CreatePHI(iptrType, 2);
+	invokeIndex->addIncoming(emitLiteralIptr(0, iptrType), entryBlock);
+
+	// Offset the argument and result arrays to the values for this call.
+	const Uptr numArgBytes = functionType.params().size() * sizeof(UntaggedValue);
+	const Uptr numResultBytes = functionType.results().size() * sizeof(UntaggedValue);
+	llvm::Value* invokeArgs = irBuilder.CreateInBoundsGEP(
+		argsArray, {irBuilder.CreateMul(invokeIndex, emitLiteralIptr(numArgBytes, iptrType))});
+	llvm::Value* invokeResults = irBuilder.CreateInBoundsGEP(
+		resultsArray,
+		{irBuilder.CreateMul(invokeIndex, emitLiteralIptr(numResultBytes, iptrType))});
+
+	emitInvoke(emitContext, functionType, calleeFunction, invokeArgs, invokeResults, iptrType);
+
+	llvm::Value* nextInvokeIndex = irBuilder.CreateAdd(invokeIndex, emitLiteralIptr(1, iptrType));
+	irBuilder.CreateStore(nextInvokeIndex,
+						  irBuilder.CreatePointerCast(numCompletedInvokes,
+													  iptrType->getPointerTo()));
+	invokeIndex->addIncoming(nextInvokeIndex, irBuilder.GetInsertBlock());
+	irBuilder.CreateCondBr(
+		irBuilder.CreateICmpEQ(nextInvokeIndex, numInvokes), exitBlock, loopBlock);
+
+	irBuilder.SetInsertPoint(exitBlock);
+}
+
+static Runtime::Function* getOrCreateInvokeThunk(FunctionType functionType, bool isBatch)
 {
 	InvokeThunkCache& invokeThunkCache = InvokeThunkCache::get();
+	HashMap<FunctionType, Runtime::Function*>& typeToFunctionMap
+		= isBatch ? invokeThunkCache.typeToBatchFunctionMap : invokeThunkCache.typeToFunctionMap;
 
 	// First, take a shareable lock on the cache mutex, and check if the thunk is cached.
 	{
 		Platform::RWMutex::ShareableLock shareableLock(invokeThunkCache.mutex);
-		Runtime::Function** invokeThunkFunction
-			= invokeThunkCache.typeToFunctionMap.get(functionType);
-		if(invokeThunkFunction)
-		{
-			return reinterpret_cast<InvokeThunkPointer>(
-				const_cast<U8*>((*invokeThunkFunction)->code));
-		}
+		Runtime::Function** invokeThunkFunction = typeToFunctionMap.get(functionType);
+		if(invokeThunkFunction) { return *invokeThunkFunction; }
 	}
 
 	// If the thunk is not cached, take an exclusive lock on the cache mutex.
@@ -82,31 +175,37 @@ InvokeThunkPointer LLVMJIT::getInvokeThunk(FunctionType functionType)
 
 	// Since the cache is unlocked briefly while switching from the shareable to the exclusive lock,
 	// check again if the thunk is cached.
-	Runtime::Function*& invokeThunkFunction
-		= invokeThunkCache.typeToFunctionMap.getOrAdd(functionType, nullptr);
-	if(invokeThunkFunction)
-	{ return reinterpret_cast<InvokeThunkPointer>(const_cast<U8*>(invokeThunkFunction->code)); }
+	Runtime::Function*& invokeThunkFunction = typeToFunctionMap.getOrAdd(functionType, nullptr);
+	if(invokeThunkFunction) { return invokeThunkFunction; }
 
 	// Create a FunctionMutableData object for the thunk.
-	FunctionMutableData* functionMutableData
-		= new FunctionMutableData("thnk!C to WASM thunk!" + asString(functionType));
+	FunctionMutableData* functionMutableData = new FunctionMutableData(
+		(isBatch ? "thnk!C to WASM batch thunk!" : "thnk!C to WASM thunk!")
+		+ asString(functionType));
 
-	// Create a LLVM module and a LLVM function for the thunk.
+	// Create a LLVM module and a LLVM function for the thunk. A batch thunk takes two extra
+	// parameters: the number of calls to make, and a pointer to write the number of completed
+	// calls to.
 	LLVMContext llvmContext;
 	llvm::Module llvmModule("", llvmContext);
 	std::unique_ptr<llvm::TargetMachine> targetMachine = getTargetMachine(getHostTargetSpec());
 	llvmModule.setDataLayout(targetMachine->createDataLayout());
-	auto llvmFunctionType = llvm::FunctionType::get(llvmContext.i8PtrType,
-													{llvmContext.i8PtrType,
-													 llvmContext.i8PtrType,
-													 llvmContext.i8PtrType,
-													 llvmContext.i8PtrType},
-													false);
 #if LLVM_VERSION_MAJOR >= 7
 	llvm::Type* iptrType = getIptrType(llvmContext, targetMachine->getProgramPointerSize());
 #else
 	llvm::Type* iptrType = getIptrType(llvmContext, targetMachine->getPointerSize());
 #endif
+	std::vector<llvm::Type*> llvmParamTypes{llvmContext.i8PtrType,
+											llvmContext.i8PtrType,
+											llvmContext.i8PtrType,
+											llvmContext.i8PtrType};
+	if(isBatch)
+	{
+		llvmParamTypes.push_back(iptrType);
+		llvmParamTypes.push_back(llvmContext.i8PtrType);
+	}
+	auto llvmFunctionType
+		= llvm::FunctionType::get(llvmContext.i8PtrType, llvmParamTypes, false);
 	auto function = llvm::Function::Create(
 		llvmFunctionType, llvm::Function::ExternalLinkage, "thunk", &llvmModule);
 	setRuntimeFunctionPrefix(llvmContext,
@@ -127,38 +226,24 @@ InvokeThunkPointer LLVMJIT::getInvokeThunk(FunctionType functionType)
 
 	emitContext.initContextVariables(contextPointer, iptrType);
 
-	// Load the function's arguments from the argument array.
-	std::vector<llvm::Value*> arguments;
-	for(Uptr argIndex = 0; argIndex < functionType.params().size(); ++argIndex)
+	if(!isBatch)
 	{
-		const ValueType paramType = functionType.params()[argIndex];
-		llvm::Value* argOffset = emitLiteral(llvmContext, argIndex * sizeof(UntaggedValue));
-		llvm::Value* arg = emitContext.loadFromUntypedPointer(
-			emitContext.irBuilder.CreateInBoundsGEP(argsArray, {argOffset}),
-			asLLVMType(llvmContext, paramType),
-			alignof(UntaggedValue));
-		arguments.push_back(arg);
+		emitInvoke(
+			emitContext, functionType, calleeFunction, argsArray, resultsArray, iptrType);
 	}
-
-	// Call the function.
-	llvm::Value* functionCode = emitContext.irBuilder.CreateInBoundsGEP(
-		calleeFunction, {emitLiteralIptr(offsetof(Runtime::Function, code), iptrType)});
-	ValueVector results = emitContext.emitCallOrInvoke(
-		emitContext.irBuilder.CreatePointerCast(
-			functionCode, asLLVMType(llvmContext, functionType)->getPointerTo()),
-		arguments,
-		functionType);
-
-	// Write the function's results to the results array.
-	WAVM_ASSERT(results.size() == functionType.results().size());
-	for(Uptr resultIndex = 0; resultIndex < results.size(); ++resultIndex)
+	else
 	{
-		llvm::Value* resultOffset = emitLiteral(llvmContext, resultIndex * sizeof(UntaggedValue));
-		llvm::Value* result = results[resultIndex];
-		emitContext.storeToUntypedPointer(
-			result,
-			emitContext.irBuilder.CreateInBoundsGEP(resultsArray, {resultOffset}),
-			alignof(UntaggedValue));
+		llvm::Value* numInvokes = &*(function->args().begin() + 4);
+		llvm::Value* numCompletedInvokes = &*(function->args().begin() + 5);
+		emitInvokeBatchLoop(emitContext,
+							functionType,
+							function,
+							calleeFunction,
+							argsArray,
+							resultsArray,
+							numInvokes,
+							numCompletedInvokes,
+							iptrType);
 	}
 
 	// Return the new context pointer.
@@ -175,5 +260,18 @@ InvokeThunkPointer LLVMJIT::getInvokeThunk(FunctionType functionType)
 	invokeThunkCache.modules.push_back(std::unique_ptr<LLVMJIT::Module>(jitModule));
 
 	invokeThunkFunction = jitModule->nameToFunctionMap[mangleSymbol("thunk")];
+	return invokeThunkFunction;
+}
+
+InvokeThunkPointer LLVMJIT::getInvokeThunk(FunctionType functionType)
+{
+	Runtime::Function* invokeThunkFunction = getOrCreateInvokeThunk(functionType, false);
 	return reinterpret_cast<InvokeThunkPointer>(const_cast<U8*>(invokeThunkFunction->code));
 }
+
+InvokeBatchThunkPointer LLVMJIT::getInvokeBatchThunk(FunctionType functionType)
+{
+	Runtime::Function* invokeThunkFunction = getOrCreateInvokeThunk(functionType, true);
+	return reinterpret_cast<InvokeBatchThunkPointer>(
+		const_cast<U8*>(invokeThunkFunction->code));
+}
@@ -1,7 +1,14 @@
 #include "WAVM/ObjectCache/ObjectCache.h"
 #include <errno.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <functional>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <utility>
 #include <vector>
 #include "WAVM/Inline/Assert.h"
 #include "WAVM/Inline/BasicTypes.h"
@@ -10,8 +17,13 @@
 #include "WAVM/Inline/Timing.h"
 #include "WAVM/Platform/Clock.h"
 #include "WAVM/Platform/Defines.h"
+#include "WAVM/Platform/Event.h"
+#include "WAVM/Platform/Mutex.h"
+#include "WAVM/Platform/Random.h"
+#include "WAVM/Platform/Thread.h"
 #include "WAVM/Runtime/Runtime.h"
 #include "lmdb.h"
+#include "zstd.h"
 
 #ifdef _MSC_VER
 #pragma warning(push)
@@ -24,7 +36,7 @@
 #pragma warning(pop)
 #endif
 
-#define CURRENT_DB_VERSION 1
+#define CURRENT_DB_VERSION 3
 
 using namespace WAVM;
 using namespace WAVM::ObjectCache;
@@ -85,7 +97,47 @@ WAVM_PACKED_STRUCT(struct TimeKey {
 	}
 });
 
-WAVM_PACKED_STRUCT(struct Metadata { TimeKey lastAccessTimeKey; });
+WAVM_PACKED_STRUCT(struct Metadata {
+	TimeKey lastAccessTimeKey;
+
+	// The size of the cached object code, and the size of its entry in the object table.
+	U64 numObjectBytes;
+	U64 numStoredBytes;
+});
+
+// The object table stores each object's code after this header, compressed or uncompressed.
+enum class ObjectCompression : U8
+{
+	none = 0,
+	zstd = 1,
+};
+
+WAVM_PACKED_STRUCT(struct ObjectHeader {
+	ObjectCompression compression;
+	U64 numObjectBytes;
+});
+
+// A cache hit only updates the cached object's last access time if it is older than this, so most
+// hits don't need a write transaction. The LRU order is approximate at this granularity.
+static constexpr I64 lastAccessTimeUpdateIntervalNS = I64(60) * 1000000000;
+
+static bool isLastAccessTimeStale(const Metadata& metadata, Time now)
+{
+	return now.ns - metadata.lastAccessTimeKey.getTime().ns >= lastAccessTimeUpdateIntervalNS;
+}
+
+// A record that a process is compiling a module, so other processes that miss the cache for the
+// same module wait for its object code instead of compiling it again. The process renews the lease
+// while it compiles the module. If it stops renewing the lease before adding the object code to
+// the cache, e.g. because it crashed, another process takes over the lease when it expires.
+WAVM_PACKED_STRUCT(struct CompileLease {
+	TimeKey expirationTimeKey;
+	U8 ownerIdBytes[8];
+});
+
+static constexpr I64 compileLeaseDurationNS = I64(30) * 1000000000;
+static constexpr I64 compileLeaseRenewIntervalNS = I64(10) * 1000000000;
+static constexpr I64 compileLeasePollIntervalNS = I64(20) * 1000000;
 
 //
 // Helper functions to reinterpret C++ types to and from MDB_vals.
@@ -123,6 +175,106 @@ template<> void fromMDBVal<MDB_val>(const MDB_val& mdbVal, MDB_val& outMDBVal)
 	outMDBVal = mdbVal;
 }
 
+// Computes the hash of a module's key that identifies it in the cache. The hash must be
+// cryptographic: otherwise, a module could be crafted to collide with another module, and be
+// loaded with the other module's cached object code.
+static void hashModule(const Runtime::ObjectCacheKey& key, U8 outModuleHashBytes[16])
+{
+	Timing::Timer hashTimer;
+
+	// Hash the number of config bytes before them, so the boundary between the config bytes and
+	// the WASM bytes is unambiguous.
+	const U64 numConfigBytes = key.configBytes.size();
+	blake2b_state state;
+	if(blake2b_init(&state, 16) || blake2b_update(&state, &numConfigBytes, sizeof(numConfigBytes))
+	   || blake2b_update(&state, key.configBytes.data(), key.configBytes.size())
+	   || blake2b_update(&state, key.wasmBytes, key.numWASMBytes)
+	   || blake2b_final(&state, outModuleHashBytes, 16))
+	{ Errors::fatal("blake2b error"); }
+
+	Timing::logRatePerSecond(
+		"Hashed module key", hashTimer, key.numWASMBytes / 1024.0 / 1024.0, "MiB");
+}
+
+// Encodes object code as an object table entry. If compressionLevel is non-zero, the object code is
+// compressed, unless that doesn't make it smaller.
+static std::vector<U8> encodeObject(const std::vector<U8>& objectBytes, I32 compressionLevel)
+{
+	ObjectHeader header;
+	header.numObjectBytes = objectBytes.size();
+
+	std::vector<U8> storedBytes;
+	if(compressionLevel != 0)
+	{
+		Timing::Timer compressTimer;
+
+		storedBytes.resize(sizeof(ObjectHeader) + ZSTD_compressBound(objectBytes.size()));
+		const size_t numCompressedBytes = ZSTD_compress(storedBytes.data() + sizeof(ObjectHeader),
+														storedBytes.size() - sizeof(ObjectHeader),
+														objectBytes.data(),
+														objectBytes.size(),
+														compressionLevel);
+		if(ZSTD_isError(numCompressedBytes))
+		{ Errors::fatalf("ZSTD_compress failed: %s", ZSTD_getErrorName(numCompressedBytes)); }
+
+		Timing::logRatePerSecond(
+			"Compressed object", compressTimer, objectBytes.size() / 1024.0 / 1024.0, "MiB");
+
+		if(numCompressedBytes < objectBytes.size())
+		{
+			header.compression = ObjectCompression::zstd;
+			memcpy(storedBytes.data(), &header, sizeof(ObjectHeader));
+			storedBytes.resize(sizeof(ObjectHeader) + numCompressedBytes);
+			return storedBytes;
+		}
+	}
+
+	header.compression = ObjectCompression::none;
+	storedBytes.resize(sizeof(ObjectHeader) + objectBytes.size());
+	memcpy(storedBytes.data(), &header, sizeof(ObjectHeader));
+	if(objectBytes.size())
+	{ memcpy(storedBytes.data() + sizeof(ObjectHeader), objectBytes.data(), objectBytes.size()); }
+	return storedBytes;
+}
+
+// Decodes an object table entry, decompressing it directly from the database's memory map into
+// outObjectBytes. Adds the time spent decompressing it to decompressNanoseconds. Returns false if
+// the entry is corrupt.
+static bool decodeObject(const MDB_val& storedVal,
+						 std::vector<U8>& outObjectBytes,
+						 std::atomic<U64>& decompressNanoseconds)
+{
+	ObjectHeader header;
+	if(storedVal.mv_size < sizeof(ObjectHeader)) { return false; }
+	memcpy(&header, storedVal.mv_data, sizeof(ObjectHeader));
+
+	const U8* payload = (const U8*)storedVal.mv_data + sizeof(ObjectHeader);
+	const Uptr numPayloadBytes = storedVal.mv_size - sizeof(ObjectHeader);
+	switch(header.compression)
+	{
+	case ObjectCompression::none:
+		if(numPayloadBytes != header.numObjectBytes) { return false; }
+		outObjectBytes.assign(payload, payload + numPayloadBytes);
+		return true;
+
+	case ObjectCompression::zstd: {
+		// Check the decompressed size recorded in the zstd frame before allocating the buffer for
+		// it.
+		if(ZSTD_getFrameContentSize(payload, numPayloadBytes) != header.numObjectBytes)
+		{ return false; }
+
+		Timing::Timer decompressTimer;
+		outObjectBytes.resize(Uptr(header.numObjectBytes));
+		const size_t numDecompressedBytes = ZSTD_decompress(
+			outObjectBytes.data(), outObjectBytes.size(), payload, numPayloadBytes);
+		decompressNanoseconds += U64(decompressTimer.getNanoseconds());
+		return !ZSTD_isError(numDecompressedBytes) && numDecompressedBytes == header.numObjectBytes;
+	}
+
+	default: return false;
+	};
+}
+
 static bool testSoftFailure()
 {
 #if 0
@@ -356,9 +508,11 @@ private:
 // Encapsulates the global state of the object cache.
 struct LMDBObjectCache : Runtime::ObjectCacheInterface
 {
-	OpenResult init(const char* path, Uptr maxBytes, U64 inCodeKey)
+	OpenResult init(const char* path, Uptr maxBytes, U64 inCodeKey, I32 inCompressionLevel)
 	{
 		codeKey = inCodeKey;
+		compressionLevel = inCompressionLevel;
+		Platform::getCryptographicRNG(compileLeaseOwnerIdBytes, sizeof(compileLeaseOwnerIdBytes));
 
 		// Open the LMDB database.
 		MDB_env* env = nullptr;
@@ -394,6 +548,7 @@ struct LMDBObjectCache : Runtime::ObjectCacheInterface
 			metaTable = database->openTable(txn, "meta", MDB_CREATE);
 			lruTable = database->openTable(txn, "lru", MDB_CREATE);
 			versionTable = database->openTable(txn, "version", MDB_CREATE);
+			compileLeaseTable = database->openTable(txn, "compileLeases", MDB_CREATE);
 
 			// Check the object cache version stored in the database.
 			const char versionString[] = "version";
@@ -414,6 +569,7 @@ struct LMDBObjectCache : Runtime::ObjectCacheInterface
 				Database::dropDB(txn, metaTable);
 				Database::dropDB(txn, lruTable);
 				Database::dropDB(txn, versionTable);
+				Database::dropDB(txn, compileLeaseTable);
 			}
 
 			if(writeVersion)
@@ -445,49 +601,81 @@ struct LMDBObjectCache : Runtime::ObjectCacheInterface
 		}
 	}
 
-	bool tryGetCachedObject(U8 moduleHash[16],
-							const U8* wasmBytes,
-							Uptr numWASMBytes,
-							std::vector<U8>& outObjectCode)
+	bool lookupCachedObject(U8 moduleHash[16], std::vector<U8>& outObjectCode)
 	{
 		Timing::Timer readTimer;
 
-		ScopedTxn txn(database->beginTxn());
+		const Time now = Platform::getClockTime(Platform::Clock::realtime);
+		ModuleKey moduleKey(codeKey, moduleHash);
 
-		// Check for a cached module with this hash key.
+		// Check for a cached module with this hash key in a read-only transaction, which doesn't
+		// contend for the database's writer lock with other threads and processes. The object code
+		// is copied out of the database's memory map, since it must outlive the transaction.
 		bool hadCachedObject = false;
-		ModuleKey moduleKey(codeKey, moduleHash);
-		if(Database::tryGetKeyValue(txn, objectTable, moduleKey, outObjectCode))
+		bool needsLastAccessTimeUpdate = false;
 		{
-			// Update the last-used time for the cached module.
-			Metadata metadata;
-			Database::getKeyValue(txn, metaTable, moduleKey, metadata);
-			Database::deleteKey(txn, lruTable, metadata.lastAccessTimeKey);
-			metadata.lastAccessTimeKey = Platform::getClockTime(Platform::Clock::realtime);
-			Database::putKeyValue(txn, metaTable, moduleKey, metadata);
-			Database::putKeyValue(txn, lruTable, metadata.lastAccessTimeKey, moduleKey);
-
-			hadCachedObject = true;
+			ScopedTxn txn(database->beginTxn(MDB_RDONLY));
+			if(tryGetObjectCode(txn, moduleKey, outObjectCode))
+			{
+				Metadata metadata;
+				Database::getKeyValue(txn, metaTable, moduleKey, metadata);
+				needsLastAccessTimeUpdate = isLastAccessTimeStale(metadata, now);
+				hadCachedObject = true;
+			}
 		}
 
-		// Commit the read transaction.
-		txn.commit();
-
 		Timing::logTimer("Probed for cached object", readTimer);
+		if(hadCachedObject) { ++numHits; }
+
+		// Update the last-used time for the cached module if it's stale. The object was found, so
+		// a failure to update its last-used time is only logged.
+		if(needsLastAccessTimeUpdate)
+		{
+			try
+			{
+				updateLastAccessTime(moduleKey, now);
+			}
+			catch(Database::Exception const& exception)
+			{
+				Log::printf(Log::debug,
+							"Failed to update object cache access time: %s\n",
+							Database::Exception::getMessage(exception.type));
+			}
+		}
 
 		return hadCachedObject;
 	}
 
-	void addCachedObject(U8 moduleHash[16],
-						 const U8* wasmBytes,
-						 Uptr numWASMBytes,
-						 const std::vector<U8>& objectBytes)
+	void updateLastAccessTime(const ModuleKey& moduleKey, Time now)
+	{
+		ScopedTxn txn(database->beginTxn());
+
+		// Another thread or process may have updated the last-used time, or evicted the module,
+		// since it was read.
+		Metadata metadata;
+		if(!Database::tryGetKeyValue(txn, metaTable, moduleKey, metadata)
+		   || !isLastAccessTimeStale(metadata, now))
+		{ return; }
+
+		Database::deleteKey(txn, lruTable, metadata.lastAccessTimeKey);
+		metadata.lastAccessTimeKey = now;
+		Database::putKeyValue(txn, metaTable, moduleKey, metadata);
+		Database::putKeyValue(txn, lruTable, metadata.lastAccessTimeKey, moduleKey);
+
+		txn.commit();
+	}
+
+	void addCachedObject(U8 moduleHash[16], const std::vector<U8>& objectBytes)
 	{
 		Timing::Timer writeTimer;
 
 		Time now = Platform::getClockTime(Platform::Clock::realtime);
 		ModuleKey moduleKey(codeKey, moduleHash);
 
+		// Compress the object code before beginning the write transaction, so other threads and
+		// processes aren't blocked from writing to the database while it's compressed.
+		const std::vector<U8> storedBytes = encodeObject(objectBytes, compressionLevel);
+
 		// Try to add the module to the database.
 		bool firstTry = true;
 		while(true)
@@ -515,11 +703,13 @@ struct LMDBObjectCache : Runtime::ObjectCacheInterface
 			if(Database::tryGetKeyValue(txn, metaTable, moduleKey, metadata))
 			{ Database::deleteKey(txn, lruTable, metadata.lastAccessTimeKey); }
 			metadata.lastAccessTimeKey = now;
+			metadata.numObjectBytes = objectBytes.size();
+			metadata.numStoredBytes = storedBytes.size();
 
 			// Add the module to the object, metadata, and LRU tables.
 			if(Database::tryPutKeyValue(txn, metaTable, moduleKey, metadata)
 			   && Database::tryPutKeyValue(txn, lruTable, metadata.lastAccessTimeKey, moduleKey)
-			   && Database::tryPutKeyValue(txn, objectTable, moduleKey, objectBytes))
+			   && Database::tryPutKeyValue(txn, objectTable, moduleKey, storedBytes))
 			{
 				txn.commit();
 				break;
@@ -571,11 +761,13 @@ struct LMDBObjectCache : Runtime::ObjectCacheInterface
 					= F64((now.ns - metadata.lastAccessTimeKey.getTime().ns) / 1000000000);
 
 				Log::printf(Log::debug,
-							"  %16" PRIx64 "|%16" PRIx64 "%16" PRIx64
-							" last access: %.1f seconds ago\n",
+							"  %16" PRIx64 "|%16" PRIx64 "%16" PRIx64 " %" PRIu64 " bytes (%" PRIu64
+							" stored) last access: %.1f seconds ago\n",
 							moduleKey.getCodeKey(),
 							moduleKey.moduleHashU64s[0],
 							moduleKey.moduleHashU64s[1],
+							U64(metadata.numObjectBytes),
+							U64(metadata.numStoredBytes),
 							lastAccessTimeAge);
 
 				getResult = Database::tryGetCursor(cursor, moduleKey, metadata, MDB_NEXT);
@@ -609,42 +801,395 @@ struct LMDBObjectCache : Runtime::ObjectCacheInterface
 		}
 	}
 
+	virtual bool loadCachedObject(const Runtime::ObjectCacheKey& key,
+								  std::function<bool(bool isCached)>&& loadThunk,
+								  std::function<std::vector<U8>()>&& compileThunk,
+								  std::vector<U8>& outObjectCode) override
+	{
+		U8 moduleHashBytes[16];
+		hashModule(key, moduleHashBytes);
+
+		if(tryLookupCachedObject(moduleHashBytes, outObjectCode)) { return loadThunk(true); }
+
+		// Only compile the module if it loads.
+		if(!loadThunk(false)) { return false; }
+		outObjectCode = compileCachedObject(moduleHashBytes, compileThunk);
+		return true;
+	}
+
 	virtual std::vector<U8> getCachedObject(
-		const U8* wasmBytes,
-		Uptr numWASMBytes,
+		const Runtime::ObjectCacheKey& key,
 		std::function<std::vector<U8>()>&& compileThunk) override
 	{
-		// Compute a hash of the serialized WASM module.
-		Timing::Timer hashTimer;
-
 		U8 moduleHashBytes[16];
-		if(blake2b(moduleHashBytes, sizeof(moduleHashBytes), wasmBytes, numWASMBytes, nullptr, 0))
-		{ Errors::fatal("blake2b error"); }
+		hashModule(key, moduleHashBytes);
 
-		Timing::logRatePerSecond(
-			"Hashed module key", hashTimer, numWASMBytes / 1024.0 / 1024.0, "MiB");
+		std::vector<U8> objectCode;
+		if(tryLookupCachedObject(moduleHashBytes, objectCode)) { return objectCode; }
+		return compileCachedObject(moduleHashBytes, compileThunk);
+	}
+
+	virtual Runtime::ObjectCacheStats getStats() override
+	{
+		Runtime::ObjectCacheStats stats;
+		stats.numHits = numHits;
+		stats.numMisses = numMisses;
+		stats.numDeduplicatedCompiles = numDeduplicatedCompiles;
+		stats.numEvictions = numEvictions;
+		stats.decompressNanoseconds = decompressNanoseconds;
+
+		// Sum the sizes of the cached objects from the metadata table, which is much smaller than
+		// the object table.
+		try
+		{
+			ScopedTxn txn(database->beginTxn(MDB_RDONLY));
+			MDB_cursor* cursor = Database::openCursor(txn, metaTable);
 
-		// Try to find the module's object code in the cache.
+			ModuleKey moduleKey;
+			Metadata metadata;
+			bool getResult = Database::tryGetCursor(cursor, moduleKey, metadata, MDB_FIRST);
+			while(getResult)
+			{
+				++stats.numCachedObjects;
+				stats.numCachedObjectBytes += metadata.numObjectBytes;
+				stats.numStoredObjectBytes += metadata.numStoredBytes;
+
+				getResult = Database::tryGetCursor(cursor, moduleKey, metadata, MDB_NEXT);
+			};
+			Database::closeCursor(cursor);
+		}
+		catch(Database::Exception const& exception)
+		{
+			Log::printf(Log::error,
+						"Failed to read object cache metadata: %s\n",
+						Database::Exception::getMessage(exception.type));
+		}
+
+		return stats;
+	}
+
+private:
+	// A compile of a module by a thread in this process. Its mutex is locked by the compiling
+	// thread until objectCode is set, or until the compile throws an exception and leaves
+	// hasObjectCode false.
+	struct InFlightCompile
+	{
+		Platform::Mutex mutex;
 		std::vector<U8> objectCode;
+		bool hasObjectCode = false;
+	};
+	typedef std::pair<U64, U64> InFlightCompileKey;
+
+	// Removes an in-flight compile from the cache's map, and unlocks its mutex to wake the threads
+	// waiting for it.
+	struct ScopedInFlightCompile
+	{
+		ScopedInFlightCompile(LMDBObjectCache& inCache,
+							  const InFlightCompileKey& inKey,
+							  const std::shared_ptr<InFlightCompile>& inInFlightCompile)
+		: cache(inCache), key(inKey), inFlightCompile(inInFlightCompile)
+		{
+		}
+
+		~ScopedInFlightCompile()
+		{
+			{
+				Platform::Mutex::Lock inFlightCompilesLock(cache.inFlightCompilesMutex);
+				cache.inFlightCompiles.erase(key);
+			}
+			inFlightCompile->mutex.unlock();
+		}
+
+	private:
+		LMDBObjectCache& cache;
+		InFlightCompileKey key;
+		std::shared_ptr<InFlightCompile> inFlightCompile;
+	};
+
+	// Renews the compile leases that this process holds on a single background thread, so other
+	// processes don't take over the lease of a compile that takes longer than the lease's duration.
+	// The thread is started when the first lease is added, and stopped when the cache is destroyed.
+	struct CompileLeaseRenewer
+	{
+		CompileLeaseRenewer(LMDBObjectCache& inCache) : cache(inCache) {}
+
+		~CompileLeaseRenewer()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				WAVM_ASSERT(moduleKeys.empty());
+				shouldStop = true;
+			}
+			stopCondition.notify_one();
+			if(thread) { Platform::joinThread(thread); }
+		}
+
+		void addLease(const ModuleKey& moduleKey)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			moduleKeys.emplace(getInFlightCompileKey(moduleKey), moduleKey);
+			if(!thread) { thread = Platform::createThread(0, threadEntry, this); }
+		}
+
+		// Stops renewing a lease. The lease isn't renewed after this returns.
+		void removeLease(const ModuleKey& moduleKey)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			moduleKeys.erase(getInFlightCompileKey(moduleKey));
+		}
+
+	private:
+		LMDBObjectCache& cache;
+		Platform::Thread* thread = nullptr;
+
+		// Protects shouldStop and moduleKeys. It is held while the leases are renewed, so a lease
+		// removed by removeLease can't be renewed after the compiling thread releases it.
+		std::mutex mutex;
+		std::condition_variable stopCondition;
+		bool shouldStop = false;
+		std::map<InFlightCompileKey, ModuleKey> moduleKeys;
+
+		static I64 threadEntry(void* argument)
+		{
+			CompileLeaseRenewer& renewer = *(CompileLeaseRenewer*)argument;
+			const std::chrono::nanoseconds renewInterval(compileLeaseRenewIntervalNS);
+			std::unique_lock<std::mutex> lock(renewer.mutex);
+			while(true)
+			{
+				// Renew the leases every compileLeaseRenewIntervalNS, so each lease is renewed at
+				// most that long after it was acquired or last renewed.
+				if(renewer.stopCondition.wait_for(
+					   lock, renewInterval, [&renewer] { return renewer.shouldStop; }))
+				{ break; }
+
+				for(auto moduleKeyIt = renewer.moduleKeys.begin();
+					moduleKeyIt != renewer.moduleKeys.end();)
+				{
+					try
+					{
+						// Stop renewing a lease if another process took it over.
+						if(!renewer.cache.renewCompileLease(moduleKeyIt->second))
+						{
+							moduleKeyIt = renewer.moduleKeys.erase(moduleKeyIt);
+							continue;
+						}
+					}
+					catch(Database::Exception const& exception)
+					{
+						Log::printf(
+							Log::error,
+							"Failed to renew module compilation lease in object cache: %s\n",
+							Database::Exception::getMessage(exception.type));
+					}
+					++moduleKeyIt;
+				};
+			};
+			return 0;
+		}
+	};
+
+	// Renews this process's lease on compiling a module until it goes out of scope.
+	struct ScopedCompileLeaseRenewal
+	{
+		ScopedCompileLeaseRenewal(CompileLeaseRenewer& inRenewer, const ModuleKey& inModuleKey)
+		: renewer(inRenewer), moduleKey(inModuleKey)
+		{
+			renewer.addLease(moduleKey);
+		}
+
+		~ScopedCompileLeaseRenewal() { renewer.removeLease(moduleKey); }
+
+	private:
+		CompileLeaseRenewer& renewer;
+		ModuleKey moduleKey;
+	};
+
+	static InFlightCompileKey getInFlightCompileKey(const ModuleKey& moduleKey)
+	{
+		return InFlightCompileKey(moduleKey.moduleHashU64s[0], moduleKey.moduleHashU64s[1]);
+	}
+
+	enum class CompileLeaseResult
+	{
+		acquired,
+		heldByOtherProcess,
+		compiled,
+	};
+
+	std::unique_ptr<Database> database;
+	MDB_dbi objectTable;
+	MDB_dbi metaTable;
+	MDB_dbi lruTable;
+	MDB_dbi versionTable;
+	MDB_dbi compileLeaseTable;
+	U64 codeKey{0};
+	I32 compressionLevel{0};
+	U8 compileLeaseOwnerIdBytes[8];
+
+	std::atomic<U64> numHits{0};
+	std::atomic<U64> numMisses{0};
+	std::atomic<U64> numDeduplicatedCompiles{0};
+	std::atomic<U64> numEvictions{0};
+	std::atomic<U64> decompressNanoseconds{0};
+
+	Platform::Mutex inFlightCompilesMutex;
+	std::map<InFlightCompileKey, std::shared_ptr<InFlightCompile>> inFlightCompiles;
+
+	// Declared after database, so the renewal thread is stopped before the database is closed.
+	CompileLeaseRenewer compileLeaseRenewer{*this};
+
+	// Looks up a module's object code in the cache. A failure to read the cache is logged, and
+	// treated as a miss.
+	bool tryLookupCachedObject(U8 moduleHashBytes[16], std::vector<U8>& outObjectCode)
+	{
 		try
 		{
-			if(tryGetCachedObject(moduleHashBytes, wasmBytes, numWASMBytes, objectCode))
-			{ return objectCode; }
+			return lookupCachedObject(moduleHashBytes, outObjectCode);
 		}
 		catch(Database::Exception const& exception)
 		{
 			Log::printf(Log::error,
 						"Failed to lookup module in object cache: %s\n",
 						Database::Exception::getMessage(exception.type));
+			return false;
+		}
+	}
+
+	// Compiles a module that wasn't found in the cache, and adds it to the cache.
+	std::vector<U8> compileCachedObject(U8 moduleHashBytes[16],
+										const std::function<std::vector<U8>()>& compileThunk)
+	{
+		// If another thread in this process is already compiling the module, wait for its object
+		// code instead.
+		const ModuleKey moduleKey(codeKey, moduleHashBytes);
+		const InFlightCompileKey inFlightCompileKey = getInFlightCompileKey(moduleKey);
+		std::shared_ptr<InFlightCompile> inFlightCompile;
+		bool isCompilingThread = false;
+		{
+			Platform::Mutex::Lock inFlightCompilesLock(inFlightCompilesMutex);
+			auto inFlightCompileIt = inFlightCompiles.find(inFlightCompileKey);
+			if(inFlightCompileIt != inFlightCompiles.end())
+			{ inFlightCompile = inFlightCompileIt->second; }
+			else
+			{
+				// Lock the in-flight compile's mutex until its object code is available.
+				inFlightCompile = std::make_shared<InFlightCompile>();
+				inFlightCompile->mutex.lock();
+				inFlightCompiles.emplace(inFlightCompileKey, inFlightCompile);
+				isCompilingThread = true;
+			}
+		}
+
+		++numMisses;
+		if(!isCompilingThread)
+		{
+			Timing::Timer waitTimer;
+			Platform::Mutex::Lock inFlightCompileLock(inFlightCompile->mutex);
+			if(inFlightCompile->hasObjectCode)
+			{
+				++numDeduplicatedCompiles;
+				Log::printf(Log::metrics,
+							"Deduplicated compile: waited %.2fms for object code compiled by"
+							" another thread\n",
+							waitTimer.getMilliseconds());
+				return inFlightCompile->objectCode;
+			}
+
+			// If the other thread's compile threw an exception, compile the module on this thread.
+			inFlightCompileLock.unlock();
+			return compileOrWaitForOtherProcess(moduleHashBytes, compileThunk);
+		}
+
+		// Remove the in-flight compile and wake the threads waiting for it when this function
+		// returns or throws an exception.
+		ScopedInFlightCompile scopedInFlightCompile(*this, inFlightCompileKey, inFlightCompile);
+
+		std::vector<U8> objectCode = compileOrWaitForOtherProcess(moduleHashBytes, compileThunk);
+
+		// Pass the object code to the threads that are waiting for it.
+		inFlightCompile->objectCode = objectCode;
+		inFlightCompile->hasObjectCode = true;
+
+		return objectCode;
+	}
+
+	// Compiles a module and adds it to the cache, unless another process holds the lease to
+	// compile it: in that case, waits for the other process to add its object code to the cache.
+	std::vector<U8> compileOrWaitForOtherProcess(
+		U8 moduleHash[16],
+		const std::function<std::vector<U8>()>& compileThunk)
+	{
+		ModuleKey moduleKey(codeKey, moduleHash);
+		std::vector<U8> objectCode;
+		bool hasLease = false;
+		try
+		{
+			Timing::Timer waitTimer;
+			Platform::Event pollEvent;
+			while(true)
+			{
+				const CompileLeaseResult leaseResult
+					= tryAcquireCompileLease(moduleKey, objectCode);
+				if(leaseResult == CompileLeaseResult::acquired)
+				{
+					hasLease = true;
+					break;
+				}
+				else if(leaseResult == CompileLeaseResult::compiled)
+				{
+					++numDeduplicatedCompiles;
+					Log::printf(Log::metrics,
+								"Deduplicated compile: waited %.2fms for object code compiled by"
+								" another process\n",
+								waitTimer.getMilliseconds());
+					return objectCode;
+				}
+
+				// Nothing signals the event: it's just used to sleep between polls.
+				pollEvent.wait(Time{I128(compileLeasePollIntervalNS)});
+			};
+		}
+		catch(Database::Exception const& exception)
+		{
+			Log::printf(Log::error,
+						"Failed to lease module compilation in object cache: %s\n",
+						Database::Exception::getMessage(exception.type));
 		}
 
-		// If there wasn't a matching cached module+object code, compile the module.
-		objectCode = compileThunk();
+		// Renew the compile lease until the compile finishes. If the compile throws an exception,
+		// release the compile lease so other processes don't wait for it to expire.
+		try
+		{
+			std::unique_ptr<ScopedCompileLeaseRenewal> compileLeaseRenewal;
+			if(hasLease)
+			{
+				compileLeaseRenewal = std::unique_ptr<ScopedCompileLeaseRenewal>(
+					new ScopedCompileLeaseRenewal(compileLeaseRenewer, moduleKey));
+			}
+			objectCode = compileThunk();
+		}
+		catch(...)
+		{
+			if(hasLease)
+			{
+				try
+				{
+					releaseCompileLease(moduleKey);
+				}
+				catch(Database::Exception const& exception)
+				{
+					Log::printf(Log::error,
+								"Failed to release module compilation lease in object cache: %s\n",
+								Database::Exception::getMessage(exception.type));
+				}
+			}
+			throw;
+		}
 
-		// Add the cached module+object code to the database.
+		// Add the cached module+object code to the database, and release the compile lease.
 		try
 		{
-			addCachedObject(moduleHashBytes, wasmBytes, numWASMBytes, objectCode);
+			addCachedObject(moduleHash, objectCode);
 		}
 		catch(Database::Exception const& exception)
 		{
@@ -652,17 +1197,112 @@ struct LMDBObjectCache : Runtime::ObjectCacheInterface
 						"Failed to add module to object cache: %s\n",
 						Database::Exception::getMessage(exception.type));
 		}
+		if(hasLease)
+		{
+			try
+			{
+				releaseCompileLease(moduleKey);
+			}
+			catch(Database::Exception const& exception)
+			{
+				Log::printf(Log::error,
+							"Failed to release module compilation lease in object cache: %s\n",
+							Database::Exception::getMessage(exception.type));
+			}
+		}
 
 		return objectCode;
 	}
 
-private:
-	std::unique_ptr<Database> database;
-	MDB_dbi objectTable;
-	MDB_dbi metaTable;
-	MDB_dbi lruTable;
-	MDB_dbi versionTable;
-	U64 codeKey{0};
+	CompileLeaseResult tryAcquireCompileLease(const ModuleKey& moduleKey,
+											  std::vector<U8>& outObjectCode)
+	{
+		const Time now = Platform::getClockTime(Platform::Clock::realtime);
+
+		// Check for the object code or an unexpired lease in a read-only transaction first, so
+		// processes that are waiting for another process to compile the module don't contend for
+		// the writer lock.
+		CompileLease lease;
+		{
+			ScopedTxn txn(database->beginTxn(MDB_RDONLY));
+			if(tryGetObjectCode(txn, moduleKey, outObjectCode))
+			{ return CompileLeaseResult::compiled; }
+			if(Database::tryGetKeyValue(txn, compileLeaseTable, moduleKey, lease)
+			   && lease.expirationTimeKey.getTime().ns > now.ns)
+			{ return CompileLeaseResult::heldByOtherProcess; }
+		}
+
+		// Check again with the writer lock held before writing the lease.
+		ScopedTxn txn(database->beginTxn());
+		if(tryGetObjectCode(txn, moduleKey, outObjectCode))
+		{ return CompileLeaseResult::compiled; }
+		if(Database::tryGetKeyValue(txn, compileLeaseTable, moduleKey, lease))
+		{
+			if(lease.expirationTimeKey.getTime().ns > now.ns)
+			{ return CompileLeaseResult::heldByOtherProcess; }
+
+			Log::printf(Log::debug,
+						"Compile lease for %16" PRIx64 "%16" PRIx64 " expired.\n",
+						moduleKey.moduleHashU64s[0],
+						moduleKey.moduleHashU64s[1]);
+		}
+
+		lease.expirationTimeKey = Time{now.ns + compileLeaseDurationNS};
+		memcpy(lease.ownerIdBytes, compileLeaseOwnerIdBytes, sizeof(lease.ownerIdBytes));
+		Database::putKeyValue(txn, compileLeaseTable, moduleKey, lease);
+		txn.commit();
+
+		return CompileLeaseResult::acquired;
+	}
+
+	// Extends this process's lease on compiling a module. Returns false if another process took
+	// over the lease after it expired.
+	bool renewCompileLease(const ModuleKey& moduleKey)
+	{
+		const Time now = Platform::getClockTime(Platform::Clock::realtime);
+
+		ScopedTxn txn(database->beginTxn());
+		CompileLease lease;
+		if(!Database::tryGetKeyValue(txn, compileLeaseTable, moduleKey, lease)
+		   || memcmp(lease.ownerIdBytes, compileLeaseOwnerIdBytes, sizeof(lease.ownerIdBytes)))
+		{ return false; }
+
+		lease.expirationTimeKey = Time{now.ns + compileLeaseDurationNS};
+		Database::putKeyValue(txn, compileLeaseTable, moduleKey, lease);
+		txn.commit();
+		return true;
+	}
+
+	void releaseCompileLease(const ModuleKey& moduleKey)
+	{
+		ScopedTxn txn(database->beginTxn());
+
+		// Only delete the lease if another process didn't take it over after it expired.
+		CompileLease lease;
+		if(Database::tryGetKeyValue(txn, compileLeaseTable, moduleKey, lease)
+		   && !memcmp(lease.ownerIdBytes, compileLeaseOwnerIdBytes, sizeof(lease.ownerIdBytes)))
+		{
+			Database::deleteKey(txn, compileLeaseTable, moduleKey);
+			txn.commit();
+		}
+	}
+
+	// Reads a module's object code from the object table. Returns false if the module isn't in the
+	// cache, or its entry is corrupt.
+	bool tryGetObjectCode(MDB_txn* txn, const ModuleKey& moduleKey, std::vector<U8>& outObjectCode)
+	{
+		MDB_val storedVal;
+		if(!Database::tryGetKeyValue(txn, objectTable, moduleKey, storedVal)) { return false; }
+		if(!decodeObject(storedVal, outObjectCode, decompressNanoseconds))
+		{
+			Log::printf(Log::error,
+						"Cached object for %16" PRIx64 "%16" PRIx64 " is corrupt.\n",
+						moduleKey.moduleHashU64s[0],
+						moduleKey.moduleHashU64s[1]);
+			return false;
+		}
+		return true;
+	}
 
 	bool evictLRU()
 	{
@@ -683,6 +1323,7 @@ private:
 
 		// Commit the delete.
 		txn.commit();
+		++numEvictions;
 
 		Log::printf(Log::debug,
 					"Evicted %16" PRIx64 "%16" PRIx64 " from the object cache.\n",
@@ -696,11 +1337,11 @@ private:
 OpenResult ObjectCache::open(const char* path,
 							 Uptr maxBytes,
 							 U64 codeKey,
-							 std::shared_ptr<Runtime::ObjectCacheInterface>& outObjectCache)
+							 std::shared_ptr<Runtime::ObjectCacheInterface>& outObjectCache,
+							 I32 compressionLevel)
 {
-	LMDBObjectCache lmdbObjectCache;
-	OpenResult result = lmdbObjectCache.init(path, maxBytes, codeKey);
-	if(result == OpenResult::success)
-	{ outObjectCache = std::make_shared<LMDBObjectCache>(std::move(lmdbObjectCache)); }
+	std::shared_ptr<LMDBObjectCache> lmdbObjectCache = std::make_shared<LMDBObjectCache>();
+	OpenResult result = lmdbObjectCache->init(path, maxBytes, codeKey, compressionLevel);
+	if(result == OpenResult::success) { outObjectCache = std::move(lmdbObjectCache); }
 	return result;
 }
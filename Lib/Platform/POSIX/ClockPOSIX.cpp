@@ -82,6 +82,13 @@ Time Platform::getClockTime(Clock clock)
 		struct rusage ru;
 		WAVM_ERROR_UNLESS(!getrusage(RUSAGE_SELF, &ru));
 		return Time{timevalToNS(ru.ru_stime) + timevalToNS(ru.ru_utime)};
+#endif
+	}
+	case Clock::threadCPUTime: {
+#ifdef CLOCK_THREAD_CPUTIME_ID
+		return Time{getClockAsI128(CLOCK_THREAD_CPUTIME_ID)};
+#else
+		return getClockTime(Clock::processCPUTime);
 #endif
 	}
 	default: WAVM_UNREACHABLE();
@@ -107,6 +114,13 @@ Time Platform::getClockResolution(Clock clock)
 		return Time{getClockResAsI128(CLOCK_PROCESS_CPUTIME_ID)};
 #else
 		return Time{1000};
+#endif
+	}
+	case Clock::threadCPUTime: {
+#ifdef CLOCK_THREAD_CPUTIME_ID
+		return Time{getClockResAsI128(CLOCK_THREAD_CPUTIME_ID)};
+#else
+		return getClockResolution(Clock::processCPUTime);
 #endif
 	}
 	default: WAVM_UNREACHABLE();
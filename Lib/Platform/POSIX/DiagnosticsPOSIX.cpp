@@ -29,9 +29,10 @@ extern "C" const char* __asan_default_options()
 		   ":replace_intrin=false";
 }
 
-CallStack Platform::captureCallStack(Uptr numOmittedFramesFromTop)
+CallStack Platform::captureCallStack(Uptr numOmittedFramesFromTop, Uptr maxFrames)
 {
 	CallStack result;
+	if(!maxFrames) { return result; }
 
 #if WAVM_ENABLE_UNWIND
 	unw_context_t context;
@@ -40,7 +41,9 @@ CallStack Platform::captureCallStack(Uptr numOmittedFramesFromTop)
 	unw_cursor_t cursor;
 
 	WAVM_ERROR_UNLESS(!unw_init_local(&cursor, &context));
-	for(Uptr frameIndex = 0; !result.frames.isFull() && unw_step(&cursor) > 0; ++frameIndex)
+	for(Uptr frameIndex = 0;
+		!result.frames.isFull() && result.frames.size() < maxFrames && unw_step(&cursor) > 0;
+		++frameIndex)
 	{
 		if(frameIndex >= numOmittedFramesFromTop)
 		{
@@ -28,7 +28,10 @@ Platform::Event::Event()
 	WAVM_ERROR_UNLESS(!pthread_condattr_setclock(&conditionVariableAttr, CLOCK_MONOTONIC));
 #endif
 
-	WAVM_ERROR_UNLESS(!pthread_cond_init((pthread_cond_t*)&pthreadCond, nullptr));
+	// The attribute must be passed to pthread_cond_init: wait computes its deadline from the
+	// monotonic clock, so a condition variable that uses the default realtime clock would see the
+	// deadline as long past, and time out immediately.
+	WAVM_ERROR_UNLESS(!pthread_cond_init((pthread_cond_t*)&pthreadCond, &conditionVariableAttr));
 	WAVM_ERROR_UNLESS(!pthread_mutex_init((pthread_mutex_t*)&pthreadMutex, nullptr));
 
 	WAVM_ERROR_UNLESS(!pthread_condattr_destroy(&conditionVariableAttr));
@@ -577,6 +577,12 @@ struct POSIXFD : VFD
 		outStream = new POSIXDirEntStream(dir);
 		return Result::success;
 	}
+
+	virtual Result getHostFD(I32& outHostFD) override
+	{
+		outHostFD = fd;
+		return Result::success;
+	}
 };
 
 struct POSIXStdFD : POSIXFD
@@ -604,6 +610,16 @@ VFD* Platform::getStdFD(StdDevice device)
 	};
 }
 
+Result Platform::createPipe(VFD*& outReadVFD, VFD*& outWriteVFD)
+{
+	int pipeFDs[2];
+	if(pipe(pipeFDs)) { return asVFSResult(errno); }
+
+	outReadVFD = new POSIXFD(pipeFDs[0]);
+	outWriteVFD = new POSIXFD(pipeFDs[1]);
+	return Result::success;
+}
+
 struct POSIXFS : HostFS
 {
 	virtual Result open(const std::string& path,
@@ -0,0 +1,420 @@
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <map>
+#include <vector>
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/I128.h"
+#include "WAVM/Inline/Time.h"
+#include "WAVM/Platform/Clock.h"
+#include "WAVM/Platform/File.h"
+#include "WAVM/Platform/Mutex.h"
+#include "WAVM/VFS/VFS.h"
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
+using namespace WAVM;
+using namespace WAVM::Platform;
+using namespace WAVM::VFS;
+
+// Polls the host FDs without blocking, and writes their readiness to the corresponding IOWaits.
+// Returns the number of IOWaits that are ready.
+static Uptr pollIOWaits(IOWait* waits, std::vector<pollfd>& pollFDs)
+{
+	int pollResult;
+	do
+	{
+		pollResult = poll(pollFDs.data(), nfds_t(pollFDs.size()), 0);
+	} while(pollResult < 0 && errno == EINTR);
+	if(pollResult < 0) { Errors::fatalf("poll failed: %s", strerror(errno)); }
+
+	Uptr numReadyWaits = 0;
+	for(Uptr waitIndex = 0; waitIndex < pollFDs.size(); ++waitIndex)
+	{
+		IOWait& wait = waits[waitIndex];
+		const pollfd& pollFD = pollFDs[waitIndex];
+
+		// IOWaits without a host FD already have an error result.
+		wait.isReady = pollFD.fd < 0;
+		if(wait.isReady)
+		{
+			++numReadyWaits;
+			continue;
+		}
+
+		wait.isReadable = pollFD.revents & POLLIN;
+		wait.isWritable = pollFD.revents & POLLOUT;
+		wait.isHungUp = pollFD.revents & POLLHUP;
+		if(pollFD.revents & (POLLERR | POLLNVAL)) { wait.result = Result::ioDeviceError; }
+
+		wait.numReadableBytes = 0;
+		int numReadableBytes = 0;
+		if(wait.isReadable && !ioctl(pollFD.fd, FIONREAD, &numReadableBytes)
+		   && numReadableBytes > 0)
+		{ wait.numReadableBytes = U64(numReadableBytes); }
+
+		wait.isReady = wait.result != Result::success || wait.isHungUp
+					   || (wait.waitForRead && wait.isReadable)
+					   || (wait.waitForWrite && wait.isWritable);
+		if(wait.isReady) { ++numReadyWaits; }
+	}
+
+	return numReadyWaits;
+}
+
+#ifdef __linux__
+
+// A thread that is waiting for I/O. The reactor thread signals it when one of the host FDs it is
+// waiting for is ready.
+struct IOWaiter
+{
+	IOWaiter()
+	{
+		pthread_condattr_t conditionVariableAttr;
+		WAVM_ERROR_UNLESS(!pthread_condattr_init(&conditionVariableAttr));
+		WAVM_ERROR_UNLESS(!pthread_condattr_setclock(&conditionVariableAttr, CLOCK_MONOTONIC));
+		WAVM_ERROR_UNLESS(!pthread_cond_init(&cond, &conditionVariableAttr));
+		WAVM_ERROR_UNLESS(!pthread_condattr_destroy(&conditionVariableAttr));
+
+		WAVM_ERROR_UNLESS(!pthread_mutex_init(&mutex, nullptr));
+	}
+
+	~IOWaiter()
+	{
+		pthread_cond_destroy(&cond);
+		WAVM_ERROR_UNLESS(!pthread_mutex_destroy(&mutex));
+	}
+
+	void signal()
+	{
+		WAVM_ERROR_UNLESS(!pthread_mutex_lock(&mutex));
+		isSignaled = true;
+		WAVM_ERROR_UNLESS(!pthread_cond_signal(&cond));
+		WAVM_ERROR_UNLESS(!pthread_mutex_unlock(&mutex));
+	}
+
+	// Waits until the waiter is signaled or the monotonic clock reaches the deadline, and resets
+	// the signal.
+	void wait(Time deadline)
+	{
+		timespec deadlineTimeSpec;
+		if(!isInfinity(deadline))
+		{
+			deadlineTimeSpec.tv_sec = U64(deadline.ns / 1000000000);
+			deadlineTimeSpec.tv_nsec = U64(deadline.ns % 1000000000);
+		}
+
+		WAVM_ERROR_UNLESS(!pthread_mutex_lock(&mutex));
+		while(!isSignaled)
+		{
+			if(isInfinity(deadline)) { WAVM_ERROR_UNLESS(!pthread_cond_wait(&cond, &mutex)); }
+			else
+			{
+				const int result = pthread_cond_timedwait(&cond, &mutex, &deadlineTimeSpec);
+				if(result == ETIMEDOUT) { break; }
+				WAVM_ERROR_UNLESS(!result);
+			}
+		};
+		isSignaled = false;
+		WAVM_ERROR_UNLESS(!pthread_mutex_unlock(&mutex));
+	}
+
+private:
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	bool isSignaled = false;
+};
+
+// Watches the host FDs that threads are waiting for with a single epoll instance, and signals the
+// waiting threads when their FDs are ready. Each FD is registered once for the union of the events
+// its waiters are waiting for. The registrations are one-shot, so an FD that stays ready doesn't
+// wake the reactor thread again until the waiters that remain after an event re-arm it.
+struct EpollReactor
+{
+	static EpollReactor& get()
+	{
+		// The reactor thread never exits, so the reactor is never destroyed.
+		static EpollReactor* reactor = new EpollReactor;
+		return *reactor;
+	}
+
+	// Adds a waiter for events on a host FD. Returns false if epoll can't watch the FD.
+	bool addWaiter(IOWaiter* waiter, I32 fd, U32 events)
+	{
+		Platform::Mutex::Lock lock(mutex);
+
+		auto registrationIt = fdRegistrations.find(fd);
+		if(registrationIt == fdRegistrations.end())
+		{ registrationIt = fdRegistrations.emplace(fd, std::vector<FDWaiter>()).first; }
+		registrationIt->second.push_back({waiter, events});
+
+		if(!armRegistration(fd, registrationIt->second))
+		{
+			registrationIt->second.pop_back();
+			updateRegistration(registrationIt);
+			return false;
+		}
+		return true;
+	}
+
+	// Removes a waiter for events on a host FD, if the reactor hasn't already signaled and removed
+	// it.
+	void removeWaiter(IOWaiter* waiter, I32 fd)
+	{
+		Platform::Mutex::Lock lock(mutex);
+
+		auto registrationIt = fdRegistrations.find(fd);
+		if(registrationIt == fdRegistrations.end()) { return; }
+
+		std::vector<FDWaiter>& fdWaiters = registrationIt->second;
+		const Uptr numFDWaiters = fdWaiters.size();
+		for(Uptr fdWaiterIndex = 0; fdWaiterIndex < fdWaiters.size();)
+		{
+			if(fdWaiters[fdWaiterIndex].waiter != waiter) { ++fdWaiterIndex; }
+			else
+			{
+				fdWaiters[fdWaiterIndex] = fdWaiters.back();
+				fdWaiters.pop_back();
+			}
+		}
+		if(fdWaiters.size() != numFDWaiters) { updateRegistration(registrationIt); }
+	}
+
+private:
+	struct FDWaiter
+	{
+		IOWaiter* waiter;
+		U32 events;
+	};
+
+	typedef std::map<I32, std::vector<FDWaiter>> FDRegistrationMap;
+
+	int epollFD;
+	Platform::Mutex mutex;
+	FDRegistrationMap fdRegistrations;
+
+	EpollReactor()
+	{
+		epollFD = epoll_create1(EPOLL_CLOEXEC);
+		if(epollFD < 0) { Errors::fatalf("epoll_create1 failed: %s", strerror(errno)); }
+
+		pthread_t thread;
+		WAVM_ERROR_UNLESS(!pthread_create(&thread, nullptr, threadEntry, this));
+		WAVM_ERROR_UNLESS(!pthread_detach(thread));
+	}
+
+	static void* threadEntry(void* argument)
+	{
+		((EpollReactor*)argument)->run();
+		return nullptr;
+	}
+
+	void run()
+	{
+		static constexpr int maxEvents = 64;
+		epoll_event events[maxEvents];
+		while(true)
+		{
+			const int numEvents = epoll_wait(epollFD, events, maxEvents, -1);
+			if(numEvents < 0)
+			{
+				if(errno == EINTR) { continue; }
+				Errors::fatalf("epoll_wait failed: %s", strerror(errno));
+			}
+
+			Platform::Mutex::Lock lock(mutex);
+			for(int eventIndex = 0; eventIndex < numEvents; ++eventIndex)
+			{
+				const epoll_event& event = events[eventIndex];
+				auto registrationIt = fdRegistrations.find(event.data.fd);
+				if(registrationIt == fdRegistrations.end()) { continue; }
+
+				// Signal and remove the waiters that the event satisfies. An error or hangup
+				// satisfies all waiters.
+				std::vector<FDWaiter>& fdWaiters = registrationIt->second;
+				for(Uptr fdWaiterIndex = 0; fdWaiterIndex < fdWaiters.size();)
+				{
+					if(!(event.events & (fdWaiters[fdWaiterIndex].events | EPOLLERR | EPOLLHUP)))
+					{ ++fdWaiterIndex; }
+					else
+					{
+						fdWaiters[fdWaiterIndex].waiter->signal();
+						fdWaiters[fdWaiterIndex] = fdWaiters.back();
+						fdWaiters.pop_back();
+					}
+				}
+
+				updateRegistration(registrationIt);
+			};
+		};
+	}
+
+	// Registers an FD with epoll for the events its waiters are waiting for. Returns false if epoll
+	// can't watch the FD.
+	bool armRegistration(I32 fd, const std::vector<FDWaiter>& fdWaiters)
+	{
+		epoll_event event;
+		memset(&event, 0, sizeof(event));
+		event.events = EPOLLONESHOT;
+		for(const FDWaiter& fdWaiter : fdWaiters) { event.events |= fdWaiter.events; }
+		event.data.fd = fd;
+
+		// The FD may still be registered from an earlier wait, or may have been closed and
+		// implicitly removed from the epoll instance since then.
+		if(!epoll_ctl(epollFD, EPOLL_CTL_MOD, fd, &event)) { return true; }
+		if(errno == ENOENT && !epoll_ctl(epollFD, EPOLL_CTL_ADD, fd, &event)) { return true; }
+		return false;
+	}
+
+	// Re-arms the registration for an FD for its remaining waiters, or removes it if no waiters
+	// remain.
+	void updateRegistration(FDRegistrationMap::iterator registrationIt)
+	{
+		const I32 fd = registrationIt->first;
+		if(registrationIt->second.size())
+		{
+			if(armRegistration(fd, registrationIt->second)) { return; }
+
+			// If the FD can't be re-armed, e.g. because it was closed, wake its waiters so they
+			// can observe its state.
+			for(const FDWaiter& fdWaiter : registrationIt->second) { fdWaiter.waiter->signal(); }
+		}
+
+		// The FD may have been closed, which implicitly removes it from the epoll instance.
+		epoll_ctl(epollFD, EPOLL_CTL_DEL, fd, nullptr);
+		fdRegistrations.erase(registrationIt);
+	}
+};
+
+#endif
+
+#ifndef __linux__
+// Without epoll, waitForIO blocks in poll, which can't be interrupted. If a wait may be
+// interrupted, poll wakes at this interval to check for it.
+static constexpr int maxInterruptibleBlockingPollMS = 10;
+#endif
+
+namespace WAVM { namespace Platform {
+	// Gives waitForIO access to the state of an IOWaitInterrupt.
+	struct IOWaitInterruptAccess
+	{
+		static bool isInterrupted(IOWaitInterrupt* interrupt)
+		{
+			if(!interrupt) { return false; }
+			Mutex::Lock lock(interrupt->mutex);
+			return interrupt->isInterrupted;
+		}
+
+		// Sets the waiter that interrupting the IOWaitInterrupt signals. Returns false if it has
+		// already been interrupted.
+		static bool beginWait(IOWaitInterrupt* interrupt, void* waiter)
+		{
+			if(!interrupt) { return true; }
+			Mutex::Lock lock(interrupt->mutex);
+			if(interrupt->isInterrupted) { return false; }
+			interrupt->waiter = waiter;
+			return true;
+		}
+
+		static void endWait(IOWaitInterrupt* interrupt)
+		{
+			if(!interrupt) { return; }
+			Mutex::Lock lock(interrupt->mutex);
+			interrupt->waiter = nullptr;
+		}
+	};
+}}
+
+void Platform::IOWaitInterrupt::interrupt()
+{
+	Mutex::Lock lock(mutex);
+	isInterrupted = true;
+#ifdef __linux__
+	if(waiter) { ((IOWaiter*)waiter)->signal(); }
+#endif
+}
+
+Uptr Platform::waitForIO(IOWait* waits, Uptr numWaits, Time timeout, IOWaitInterrupt* interrupt)
+{
+	const Time deadline = isInfinity(timeout)
+							  ? timeout
+							  : Time{getClockTime(Clock::monotonic).ns + timeout.ns};
+
+	// Get the host FDs to poll. Negative host FDs can't be waited for, so they are immediately
+	// ready with an error.
+	std::vector<pollfd> pollFDs(numWaits);
+	for(Uptr waitIndex = 0; waitIndex < numWaits; ++waitIndex)
+	{
+		IOWait& wait = waits[waitIndex];
+		pollfd& pollFD = pollFDs[waitIndex];
+		pollFD.events = (wait.waitForRead ? POLLIN : 0) | (wait.waitForWrite ? POLLOUT : 0);
+		pollFD.revents = 0;
+		pollFD.fd = wait.hostFD >= 0 ? wait.hostFD : -1;
+		wait.result = wait.hostFD >= 0 ? Result::success : Result::notSupported;
+	}
+
+	while(true)
+	{
+		// Once interrupted, the FDs may be closed, so don't poll them again.
+		if(IOWaitInterruptAccess::isInterrupted(interrupt)) { return 0; }
+
+		// Check whether any of the FDs are already ready.
+		const Uptr numReadyWaits = pollIOWaits(waits, pollFDs);
+		if(numReadyWaits) { return numReadyWaits; }
+
+		const Time now = getClockTime(Clock::monotonic);
+		if(!isInfinity(deadline) && now.ns >= deadline.ns) { return 0; }
+
+#ifdef __linux__
+		// Register the FDs with the reactor, and sleep until the reactor signals that one of them
+		// is ready, or the deadline passes. If one of the FDs can't be registered, don't sleep,
+		// and let the next poll report its state.
+		IOWaiter waiter;
+		if(!IOWaitInterruptAccess::beginWait(interrupt, &waiter)) { return 0; }
+		if(numWaits)
+		{
+			EpollReactor& reactor = EpollReactor::get();
+			bool registeredAllFDs = true;
+			Uptr numRegisteredWaits = 0;
+			for(; numRegisteredWaits < numWaits && registeredAllFDs; ++numRegisteredWaits)
+			{
+				const pollfd& pollFD = pollFDs[numRegisteredWaits];
+				const U32 events = ((pollFD.events & POLLIN) ? U32(EPOLLIN) : 0)
+								   | ((pollFD.events & POLLOUT) ? U32(EPOLLOUT) : 0);
+				registeredAllFDs = reactor.addWaiter(&waiter, pollFD.fd, events);
+			}
+
+			if(registeredAllFDs) { waiter.wait(deadline); }
+
+			for(Uptr waitIndex = 0; waitIndex < numRegisteredWaits; ++waitIndex)
+			{ reactor.removeWaiter(&waiter, pollFDs[waitIndex].fd); }
+		}
+		else
+		{
+			waiter.wait(deadline);
+		}
+		IOWaitInterruptAccess::endWait(interrupt);
+#else
+		// Without epoll, just block in poll. Its timeout is in milliseconds, so round the time
+		// until the deadline up to avoid waking before it.
+		int timeoutMS = -1;
+		if(!isInfinity(deadline))
+		{
+			const I128 timeoutMSI128 = (deadline.ns - now.ns + 999999) / 1000000;
+			timeoutMS = timeoutMSI128 > INT_MAX ? INT_MAX : int(timeoutMSI128);
+		}
+		if(interrupt && (timeoutMS < 0 || timeoutMS > maxInterruptibleBlockingPollMS))
+		{ timeoutMS = maxInterruptibleBlockingPollMS; }
+		if(poll(pollFDs.data(), nfds_t(pollFDs.size()), timeoutMS) < 0 && errno != EINTR)
+		{ Errors::fatalf("poll failed: %s", strerror(errno)); }
+#endif
+	};
+}
@@ -1,8 +1,10 @@
 #include <errno.h>
+#include <fcntl.h>
 #include <string.h>
 #include <sys/mman.h>
 #include <sys/resource.h>
 #include <unistd.h>
+#include <algorithm>
 #include "POSIXPrivate.h"
 #include "WAVM/Inline/Assert.h"
 #include "WAVM/Inline/BasicTypes.h"
@@ -15,6 +17,13 @@
 #define MAP_ANONYMOUS MAP_ANON
 #endif
 
+#ifdef __linux__
+#include <sys/syscall.h>
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+#endif
+
 using namespace WAVM;
 using namespace WAVM::Platform;
 
@@ -207,3 +216,181 @@ Uptr Platform::getPeakMemoryUsageBytes()
 	return Uptr(ru.ru_maxrss) * 1024;
 #endif
 }
+
+#ifdef __linux__
+struct Platform::MemorySnapshot
+{
+	int fd;
+	Uptr numPages;
+};
+
+// Returns true if a page contains only zeroes.
+static bool isZeroPage(const U8* page)
+{
+	const Uptr numWords = getBytesPerPage() / sizeof(Uptr);
+	const Uptr* words = (const Uptr*)page;
+	for(Uptr wordIndex = 0; wordIndex < numWords; ++wordIndex)
+	{
+		if(words[wordIndex]) { return false; }
+	}
+	return true;
+}
+
+MemorySnapshot* Platform::createMemorySnapshot(const U8* baseVirtualAddress, Uptr numPages)
+{
+	WAVM_ERROR_UNLESS(isPageAligned(const_cast<U8*>(baseVirtualAddress)));
+	const Uptr pageSizeLog2 = getBytesPerPageLog2();
+
+	// Create an anonymous in-memory file to hold the snapshot.
+	const int fd = int(syscall(SYS_memfd_create, "wavm-memory-snapshot", MFD_CLOEXEC));
+	if(fd < 0) { return nullptr; }
+	if(ftruncate(fd, off_t(numPages << pageSizeLog2)))
+	{
+		close(fd);
+		return nullptr;
+	}
+
+	// Copy the pages to the file, skipping zero pages to leave holes in the file that don't use
+	// any memory.
+	Uptr pageIndex = 0;
+	while(pageIndex < numPages)
+	{
+		if(isZeroPage(baseVirtualAddress + (pageIndex << pageSizeLog2)))
+		{
+			++pageIndex;
+			continue;
+		}
+
+		Uptr endPageIndex = pageIndex + 1;
+		while(endPageIndex < numPages
+			  && !isZeroPage(baseVirtualAddress + (endPageIndex << pageSizeLog2)))
+		{ ++endPageIndex; };
+
+		const U8* bytes = baseVirtualAddress + (pageIndex << pageSizeLog2);
+		Uptr numBytes = (endPageIndex - pageIndex) << pageSizeLog2;
+		off_t offset = off_t(pageIndex << pageSizeLog2);
+		while(numBytes)
+		{
+			const ssize_t result = pwrite(fd, bytes, numBytes, offset);
+			if(result < 0)
+			{
+				if(errno == EINTR) { continue; }
+				close(fd);
+				return nullptr;
+			}
+			bytes += result;
+			numBytes -= Uptr(result);
+			offset += result;
+		};
+
+		pageIndex = endPageIndex;
+	};
+
+	return new MemorySnapshot{fd, numPages};
+}
+
+void Platform::destroyMemorySnapshot(MemorySnapshot* snapshot)
+{
+	WAVM_ERROR_UNLESS(!close(snapshot->fd));
+	delete snapshot;
+}
+
+bool Platform::mapMemorySnapshot(MemorySnapshot* snapshot, U8* baseVirtualAddress, Uptr numPages)
+{
+	WAVM_ERROR_UNLESS(isPageAligned(baseVirtualAddress));
+	WAVM_ERROR_UNLESS(numPages <= snapshot->numPages);
+	const Uptr numBytes = numPages << getBytesPerPageLog2();
+	if(mmap(baseVirtualAddress,
+			numBytes,
+			PROT_READ | PROT_WRITE,
+			MAP_FIXED | MAP_PRIVATE,
+			snapshot->fd,
+			0)
+	   != MAP_FAILED)
+	{ return true; }
+
+	// A MAP_FIXED mmap that fails may have unmapped some of the pages it was replacing, so map zero
+	// pages in their place.
+	if(mmap(baseVirtualAddress,
+			numBytes,
+			PROT_READ | PROT_WRITE,
+			MAP_FIXED | MAP_PRIVATE | MAP_ANONYMOUS,
+			-1,
+			0)
+	   == MAP_FAILED)
+	{
+		Errors::fatalf("mmap(0x%" WAVM_PRIxPTR ", %" WAVM_PRIuPTR
+					   ", PROT_READ | PROT_WRITE, MAP_FIXED | MAP_PRIVATE | MAP_ANONYMOUS, -1, 0) "
+					   "failed: %s",
+					   reinterpret_cast<Uptr>(baseVirtualAddress),
+					   numBytes,
+					   strerror(errno));
+	}
+	return false;
+}
+
+bool Platform::getNumCopiedSnapshotPages(U8* baseVirtualAddress,
+										 Uptr numPages,
+										 Uptr& outNumCopiedPages)
+{
+	WAVM_ERROR_UNLESS(isPageAligned(baseVirtualAddress));
+
+	// Read the page map entries for the pages: a page that was mapped from the snapshot file is
+	// anonymous once it has been copied.
+	const int fd = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+	if(fd < 0) { return false; }
+
+	static constexpr U64 pagePresentBit = U64(1) << 63;
+	static constexpr U64 pageSwappedBit = U64(1) << 62;
+	static constexpr U64 pageFileOrSharedBit = U64(1) << 61;
+
+	Uptr numCopiedPages = 0;
+	U64 entries[512];
+	Uptr pageIndex = 0;
+	while(pageIndex < numPages)
+	{
+		const Uptr numEntries = std::min(numPages - pageIndex, Uptr(512));
+		const Uptr firstPage = (reinterpret_cast<Uptr>(baseVirtualAddress) >> getBytesPerPageLog2())
+							   + pageIndex;
+		const ssize_t result = pread(
+			fd, entries, numEntries * sizeof(U64), off_t(firstPage * sizeof(U64)));
+		if(result != ssize_t(numEntries * sizeof(U64)))
+		{
+			close(fd);
+			return false;
+		}
+
+		for(Uptr entryIndex = 0; entryIndex < numEntries; ++entryIndex)
+		{
+			const U64 entry = entries[entryIndex];
+			if((entry & (pagePresentBit | pageSwappedBit)) && !(entry & pageFileOrSharedBit))
+			{ ++numCopiedPages; }
+		}
+		pageIndex += numEntries;
+	};
+
+	close(fd);
+	outNumCopiedPages = numCopiedPages;
+	return true;
+}
+#else
+MemorySnapshot* Platform::createMemorySnapshot(const U8* baseVirtualAddress, Uptr numPages)
+{
+	// Copy-on-write snapshots are only implemented on Linux.
+	return nullptr;
+}
+
+void Platform::destroyMemorySnapshot(MemorySnapshot* snapshot) { WAVM_UNREACHABLE(); }
+
+bool Platform::mapMemorySnapshot(MemorySnapshot* snapshot, U8* baseVirtualAddress, Uptr numPages)
+{
+	WAVM_UNREACHABLE();
+}
+
+bool Platform::getNumCopiedSnapshotPages(U8* baseVirtualAddress,
+										 Uptr numPages,
+										 Uptr& outNumCopiedPages)
+{
+	return false;
+}
+#endif
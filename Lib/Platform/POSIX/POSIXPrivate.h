@@ -34,6 +34,7 @@ namespace WAVM { namespace Platform {
 		jmp_buf catchJump;
 		bool (*filter)(void*, Signal, CallStack&&);
 		void* filterArgument;
+		Uptr maxCallStackFrames;
 	};
 
 	struct SigAltStack
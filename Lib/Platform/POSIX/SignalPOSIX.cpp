@@ -17,6 +17,11 @@ extern "C" int __sigreturn(ucontext_t*, int);
 
 thread_local SignalContext* Platform::innermostSignalContext = nullptr;
 
+// The values that sigsetjmp returns in catchSignals when jumping back to it from the signal handler
+// or from jumpToInnermostCatchSignals.
+static constexpr int signalHandlerJumpValue = 1;
+static constexpr int jumpToCatchSignalsJumpValue = 2;
+
 struct ScopedSignalContext : SignalContext
 {
 	bool isLinked = false;
@@ -80,7 +85,10 @@ static void maskSignals(int how)
 
 	// Capture the execution context, omitting this function and the function that called it, so the
 	// top of the callstack is the function that triggered the signal.
-	CallStack callStack = captureCallStack(2);
+	const Uptr maxCallStackFrames = innermostSignalContext
+										? innermostSignalContext->maxCallStackFrames
+										: CallStack::maxFrames;
+	CallStack callStack = captureCallStack(2, maxCallStackFrames);
 
 	// Undo the -1 offset that captureCallStack applied to the trapping IP on the assumption that
 	// the signal trampoline frame is returning from an ordinary call.
@@ -96,7 +104,7 @@ static void maskSignals(int how)
 			callStack.~CallStack();
 
 			// Jump back to the execution context that was saved in catchSignals.
-			siglongjmp(signalContext->catchJump, 1);
+			siglongjmp(signalContext->catchJump, signalHandlerJumpValue);
 		}
 	}
 
@@ -125,13 +133,15 @@ bool Platform::initGlobalSignalsOnce()
 
 bool Platform::catchSignals(void (*thunk)(void*),
 							bool (*filter)(void*, Signal, CallStack&&),
-							void* argument)
+							void* argument,
+							Uptr maxCallStackFrames)
 {
 	initThreadAndGlobalSignals();
 
 	ScopedSignalContext signalContext;
 	signalContext.filter = filter;
 	signalContext.filterArgument = argument;
+	signalContext.maxCallStackFrames = maxCallStackFrames;
 
 #ifdef __WAVIX__
 	Errors::unimplemented("Wavix catchSignals");
@@ -139,16 +149,17 @@ bool Platform::catchSignals(void (*thunk)(void*),
 	// Use sigsetjmp to capture the execution state into the signal context. If a signal is raised,
 	// the signal handler will jump back to here. Tell sigsetjmp not to save the signal mask, since
 	// that's quite expensive (a syscall). Instead, just unblock the signals that our handler blocks
-	// after handling those signals.
-	bool isReturningFromSignalHandler = sigsetjmp(signalContext.catchJump, 0) != 0;
-	if(!isReturningFromSignalHandler)
+	// after handling those signals. jumpToInnermostCatchSignals also jumps back to here, but
+	// doesn't block any signals.
+	const int catchJumpValue = sigsetjmp(signalContext.catchJump, 0);
+	if(!catchJumpValue)
 	{
 		signalContext.link();
 
 		// Call the thunk.
 		thunk(argument);
 	}
-	else
+	else if(catchJumpValue == signalHandlerJumpValue)
 	{
 #if defined(__APPLE__)
 		// On MacOS, it's necessary to call __sigreturn to restore the sigaltstack state after
@@ -161,7 +172,20 @@ bool Platform::catchSignals(void (*thunk)(void*),
 	}
 #endif
 
-	return isReturningFromSignalHandler;
+	return catchJumpValue != 0;
+}
+
+void* Platform::getInnermostCatchSignalsArgument(bool (*filter)(void*, Signal, CallStack&&))
+{
+	return innermostSignalContext && innermostSignalContext->filter == filter
+			   ? innermostSignalContext->filterArgument
+			   : nullptr;
+}
+
+void Platform::jumpToInnermostCatchSignals()
+{
+	WAVM_ERROR_UNLESS(innermostSignalContext);
+	siglongjmp(innermostSignalContext->catchJump, jumpToCatchSignalsJumpValue);
 }
 
 // The LLVM project libunwind implementation that WAVM uses matches the Apple ABI, which expects
@@ -97,6 +97,16 @@ Time Platform::getClockTime(Clock clock)
 
 		return Time{fileTimeToI128(kernelTime) + fileTimeToI128(userTime)};
 	}
+	case Clock::threadCPUTime: {
+		FILETIME creationTime;
+		FILETIME exitTime;
+		FILETIME kernelTime;
+		FILETIME userTime;
+		WAVM_ERROR_UNLESS(
+			GetThreadTimes(GetCurrentThread(), &creationTime, &exitTime, &kernelTime, &userTime));
+
+		return Time{fileTimeToI128(kernelTime) + fileTimeToI128(userTime)};
+	}
 	default: WAVM_UNREACHABLE();
 	};
 }
@@ -113,6 +123,7 @@ Time Platform::getClockResolution(Clock clock)
 		return Time{I128(result)};
 	}
 	case Clock::processCPUTime: return Time{100};
+	case Clock::threadCPUTime: return Time{100};
 	default: WAVM_UNREACHABLE();
 	};
 }
@@ -111,7 +111,9 @@ bool Platform::getInstructionSourceByAddress(Uptr ip, InstructionSource& outSour
 	}
 }
 
-CallStack Platform::unwindStack(const CONTEXT& immutableContext, Uptr numOmittedFramesFromTop)
+CallStack Platform::unwindStack(const CONTEXT& immutableContext,
+								Uptr numOmittedFramesFromTop,
+								Uptr maxFrames)
 {
 	// Make a mutable copy of the context.
 	CONTEXT context;
@@ -121,7 +123,9 @@ CallStack Platform::unwindStack(const CONTEXT& immutableContext, Uptr numOmitted
 	// reached the base.
 	CallStack callStack;
 #if WAVM_ENABLE_UNWIND
-	for(Uptr frameIndex = 0; !callStack.frames.isFull() && context.Rip; ++frameIndex)
+	for(Uptr frameIndex = 0;
+		!callStack.frames.isFull() && callStack.frames.size() < maxFrames && context.Rip;
+		++frameIndex)
 	{
 		if(frameIndex >= numOmittedFramesFromTop)
 		{
@@ -158,14 +162,16 @@ CallStack Platform::unwindStack(const CONTEXT& immutableContext, Uptr numOmitted
 	return callStack;
 }
 
-CallStack Platform::captureCallStack(Uptr numOmittedFramesFromTop)
+CallStack Platform::captureCallStack(Uptr numOmittedFramesFromTop, Uptr maxFrames)
 {
+	if(!maxFrames) { return CallStack(); }
+
 	// Capture the current processor state.
 	CONTEXT context;
 	RtlCaptureContext(&context);
 
 	// Unwind the stack.
-	return unwindStack(context, numOmittedFramesFromTop + 1);
+	return unwindStack(context, numOmittedFramesFromTop + 1, maxFrames);
 }
 
 static std::atomic<Uptr> numCommittedPageBytes{0};
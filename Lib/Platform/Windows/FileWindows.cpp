@@ -672,6 +672,70 @@ VFD* Platform::getStdFD(StdDevice device)
 	};
 }
 
+Result Platform::createPipe(VFD*& outReadVFD, VFD*& outWriteVFD)
+{
+	HANDLE readHandle;
+	HANDLE writeHandle;
+	if(!CreatePipe(&readHandle, &writeHandle, nullptr, 0)) { return asVFSResult(GetLastError()); }
+
+	outReadVFD = new WindowsFD(readHandle, GENERIC_READ, 0, 0, false, VFDSync::none);
+	outWriteVFD = new WindowsFD(writeHandle, GENERIC_WRITE, 0, 0, false, VFDSync::none);
+	return Result::success;
+}
+
+void Platform::IOWaitInterrupt::interrupt()
+{
+	Mutex::Lock lock(mutex);
+	isInterrupted = true;
+	if(waiter) { ((Event*)waiter)->signal(); }
+}
+
+namespace WAVM { namespace Platform {
+	// Gives waitForIO access to the state of an IOWaitInterrupt.
+	struct IOWaitInterruptAccess
+	{
+		// Sets the event that interrupting the IOWaitInterrupt signals. Returns false if it has
+		// already been interrupted.
+		static bool beginWait(IOWaitInterrupt* interrupt, Event* event)
+		{
+			if(!interrupt) { return true; }
+			Mutex::Lock lock(interrupt->mutex);
+			if(interrupt->isInterrupted) { return false; }
+			interrupt->waiter = event;
+			return true;
+		}
+
+		static void endWait(IOWaitInterrupt* interrupt)
+		{
+			if(!interrupt) { return; }
+			Mutex::Lock lock(interrupt->mutex);
+			interrupt->waiter = nullptr;
+		}
+	};
+}}
+
+Uptr Platform::waitForIO(IOWait* waits, Uptr numWaits, Time timeout, IOWaitInterrupt* interrupt)
+{
+	// Waiting for I/O readiness isn't implemented on Windows, so all FDs are immediately ready
+	// with an error, and a wait without any FDs just sleeps until the timeout.
+	for(Uptr waitIndex = 0; waitIndex < numWaits; ++waitIndex)
+	{
+		waits[waitIndex].isReady = true;
+		waits[waitIndex].result = Result::notSupported;
+	}
+
+	if(!numWaits)
+	{
+		Event event;
+		if(IOWaitInterruptAccess::beginWait(interrupt, &event))
+		{
+			event.wait(timeout);
+			IOWaitInterruptAccess::endWait(interrupt);
+		}
+	}
+	return numWaits;
+}
+
 struct WindowsFS : HostFS
 {
 	virtual Result open(const std::string& path,
@@ -196,3 +196,23 @@ Uptr Platform::getPeakMemoryUsageBytes()
 		GetCurrentProcess(), &processMemoryCounters, sizeof(processMemoryCounters)));
 	return processMemoryCounters.PeakWorkingSetSize;
 }
+
+MemorySnapshot* Platform::createMemorySnapshot(const U8* baseVirtualAddress, Uptr numPages)
+{
+	// Copy-on-write snapshots aren't implemented on Windows.
+	return nullptr;
+}
+
+void Platform::destroyMemorySnapshot(MemorySnapshot* snapshot) { WAVM_UNREACHABLE(); }
+
+bool Platform::mapMemorySnapshot(MemorySnapshot* snapshot, U8* baseVirtualAddress, Uptr numPages)
+{
+	WAVM_UNREACHABLE();
+}
+
+bool Platform::getNumCopiedSnapshotPages(U8* baseVirtualAddress,
+										 Uptr numPages,
+										 Uptr& outNumCopiedPages)
+{
+	return false;
+}
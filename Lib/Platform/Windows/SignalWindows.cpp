@@ -61,14 +61,16 @@ static bool translateSEHToSignal(EXCEPTION_POINTERS* exceptionPointers, Signal&
 // the body of the sehSignalFilterFunction __try pulled out into a function.
 static LONG CALLBACK sehSignalFilterFunctionNonReentrant(EXCEPTION_POINTERS* exceptionPointers,
 														 bool (*filter)(void*, Signal, CallStack&&),
-														 void* context)
+														 void* context,
+														 Uptr maxCallStackFrames)
 {
 	Signal signal;
 	if(!translateSEHToSignal(exceptionPointers, signal)) { return EXCEPTION_CONTINUE_SEARCH; }
 	else
 	{
 		// Unwind the stack frames from the context of the exception.
-		CallStack callStack = unwindStack(*exceptionPointers->ContextRecord, 0);
+		CallStack callStack
+			= unwindStack(*exceptionPointers->ContextRecord, 0, maxCallStackFrames);
 
 		if((*filter)(context, signal, std::move(callStack))) { return EXCEPTION_EXECUTE_HANDLER; }
 		else
@@ -80,11 +82,13 @@ static LONG CALLBACK sehSignalFilterFunctionNonReentrant(EXCEPTION_POINTERS* exc
 
 static LONG CALLBACK sehSignalFilterFunction(EXCEPTION_POINTERS* exceptionPointers,
 											 bool (*filter)(void*, Signal, CallStack&&),
-											 void* context)
+											 void* context,
+											 Uptr maxCallStackFrames)
 {
 	__try
 	{
-		return sehSignalFilterFunctionNonReentrant(exceptionPointers, filter, context);
+		return sehSignalFilterFunctionNonReentrant(
+			exceptionPointers, filter, context, maxCallStackFrames);
 	}
 	__except(Errors::fatal("reentrant exception"), true)
 	{
@@ -94,7 +98,8 @@ static LONG CALLBACK sehSignalFilterFunction(EXCEPTION_POINTERS* exceptionPointe
 
 bool Platform::catchSignals(void (*thunk)(void*),
 							bool (*filter)(void*, Signal, CallStack&&),
-							void* context)
+							void* context,
+							Uptr maxCallStackFrames)
 {
 	initThread();
 
@@ -103,7 +108,8 @@ bool Platform::catchSignals(void (*thunk)(void*),
 		(*thunk)(context);
 		return false;
 	}
-	__except(sehSignalFilterFunction(GetExceptionInformation(), filter, context))
+	__except(sehSignalFilterFunction(
+		GetExceptionInformation(), filter, context, maxCallStackFrames))
 	{
 		// After a stack overflow, the stack will be left in a damaged state. Let the CRT repair it.
 		WAVM_ERROR_UNLESS(_resetstkoflw());
@@ -111,3 +117,15 @@ bool Platform::catchSignals(void (*thunk)(void*),
 		return true;
 	}
 }
+
+void* Platform::getInnermostCatchSignalsArgument(bool (*filter)(void*, Signal, CallStack&&))
+{
+	// catchSignals uses SEH on Windows, so there isn't a catch point that can be jumped to without
+	// unwinding the stack.
+	return nullptr;
+}
+
+void Platform::jumpToInnermostCatchSignals()
+{
+	Errors::unimplemented("jumpToInnermostCatchSignals on Windows");
+}
@@ -11,7 +11,9 @@
 namespace WAVM { namespace Platform {
 	void initThread();
 
-	CallStack unwindStack(const CONTEXT& immutableContext, Uptr numOmittedFramesFromTop);
+	CallStack unwindStack(const CONTEXT& immutableContext,
+						  Uptr numOmittedFramesFromTop,
+						  Uptr maxFrames = CallStack::maxFrames);
 
 	Time fileTimeToWAVMRealTime(FILETIME fileTime);
 	FILETIME wavmRealTimeToFileTime(Time realTime);
@@ -1,15 +1,11 @@
 #include <stdint.h>
-#include <algorithm>
 #include <atomic>
 #include <cmath>
 #include <memory>
-#include <utility>
-#include <vector>
 #include "RuntimePrivate.h"
 #include "WAVM/Inline/Assert.h"
 #include "WAVM/Inline/BasicTypes.h"
 #include "WAVM/Inline/Hash.h"
-#include "WAVM/Inline/HashMap.h"
 #include "WAVM/Platform/Clock.h"
 #include "WAVM/Platform/Event.h"
 #include "WAVM/Platform/Mutex.h"
@@ -24,60 +20,75 @@ namespace WAVM { namespace Runtime {
 	WAVM_DEFINE_INTRINSIC_MODULE(wavmIntrinsicsAtomics)
 }}
 
-// Holds a list of threads (in the form of events that will wake them) that
-// are waiting on a specific address.
-struct WaitList
+// A thread that is waiting on an address. Each thread has a single wait node that it links into
+// the wait queue of the bucket for the address it is waiting on.
+struct WaitNode
 {
-	Platform::Mutex mutex;
-	std::vector<Platform::Event*> wakeEvents;
-	std::atomic<Uptr> numReferences;
-
-	WaitList() : numReferences(1) {}
+	Platform::Event wakeEvent;
+	Uptr address{0};
+	WaitNode* previous{nullptr};
+	WaitNode* next{nullptr};
+	bool isQueued{false};
 };
 
-// An event that is reused within a thread when it waits on a WaitList.
-thread_local std::unique_ptr<Platform::Event> threadWakeEvent = nullptr;
+// A bucket of the wait table: a FIFO queue of the threads waiting on the addresses that hash to
+// the bucket. Each bucket has its own lock, so waits and notifies on addresses in different buckets
+// don't contend with each other. The buckets are aligned to avoid false sharing between them.
+struct alignas(64) WaitBucket
+{
+	Platform::Mutex mutex;
+	WaitNode* head{nullptr};
+	WaitNode* tail{nullptr};
 
-// A map from address to a list of threads waiting on that address.
-static Platform::Mutex addressToWaitListMapMutex;
-static HashMap<Uptr, WaitList*> addressToWaitListMap;
+	// The number of threads that are waiting on an address in the bucket, or are checking the
+	// value at the address before waiting. This is used to skip locking the bucket when notifying
+	// an address that no threads are waiting on.
+	std::atomic<Uptr> numWaiters{0};
 
-// Opens the wait list for a given address.
-// Increases the wait list's reference count, and returns a pointer to it.
-// Note that it does not lock the wait list mutex.
-// A call to openWaitList should be followed by a call to closeWaitList to avoid leaks.
-static WaitList* openWaitList(Uptr address)
-{
-	Platform::Mutex::Lock mapLock(addressToWaitListMapMutex);
-	auto waitListPtr = addressToWaitListMap.get(address);
-	if(waitListPtr)
+	void enqueue(WaitNode* node)
 	{
-		++(*waitListPtr)->numReferences;
-		return *waitListPtr;
-	}
-	else
-	{
-		WaitList* waitList = new WaitList();
-		addressToWaitListMap.set(address, waitList);
-		return waitList;
+		WAVM_ASSERT(!node->isQueued);
+		node->previous = tail;
+		node->next = nullptr;
+		if(tail) { tail->next = node; }
+		else
+		{
+			head = node;
+		}
+		tail = node;
+		node->isQueued = true;
 	}
-}
 
-// Closes a wait list, deleting it and removing it from the global map if it was the last reference.
-static void closeWaitList(Uptr address, WaitList* waitList)
-{
-	if(--waitList->numReferences == 0)
+	void remove(WaitNode* node)
 	{
-		Platform::Mutex::Lock mapLock(addressToWaitListMapMutex);
-		if(!waitList->numReferences)
+		WAVM_ASSERT(node->isQueued);
+		if(node->previous) { node->previous->next = node->next; }
+		else
 		{
-			WAVM_ASSERT(!waitList->wakeEvents.size());
-			delete waitList;
-			addressToWaitListMap.remove(address);
+			head = node->next;
 		}
+		if(node->next) { node->next->previous = node->previous; }
+		else
+		{
+			tail = node->previous;
+		}
+		node->previous = node->next = nullptr;
+		node->isQueued = false;
+		--numWaiters;
 	}
+};
+
+static constexpr Uptr numWaitBuckets = 256;
+static WaitBucket waitBuckets[numWaitBuckets];
+
+static WaitBucket& getWaitBucket(Uptr address)
+{
+	return waitBuckets[Hash<Uptr>()(address) & (numWaitBuckets - 1)];
 }
 
+// The wait node for the current thread.
+thread_local std::unique_ptr<WaitNode> threadWaitNode = nullptr;
+
 // Loads a value from memory with seq_cst memory order.
 // The caller must ensure that the pointer is naturally aligned.
 template<typename Value> static Value atomicLoad(const Value* valuePointer)
@@ -99,66 +110,75 @@ template<typename Value> static void atomicStore(Value* valuePointer, Value newV
 template<typename Value>
 static U32 waitOnAddress(Value* valuePointer, Value expectedValue, I64 timeout)
 {
-	// Open the wait list for this address.
 	const Uptr address = reinterpret_cast<Uptr>(valuePointer);
-	WaitList* waitList = openWaitList(address);
+	WaitBucket& bucket = getWaitBucket(address);
 
-	// Lock the wait list, and check that *valuePointer is still what the caller expected it to be.
+	// If the thread hasn't yet created a wait node, do so.
+	if(!threadWaitNode) { threadWaitNode = std::unique_ptr<WaitNode>(new WaitNode); }
+	WaitNode* waitNode = threadWaitNode.get();
+
+	// Lock the bucket, and check that *valuePointer is still what the caller expected it to be.
 	{
-		Platform::Mutex::Lock waitListLock(waitList->mutex);
+		Platform::Mutex::Lock bucketLock(bucket.mutex);
+
+		// Count this thread as a waiter before loading the value: wakeAddress stores to the value
+		// before checking whether there are any waiters, so either it will see this thread as a
+		// waiter, or this thread will see the value it stored. The value may have been stored by
+		// a non-atomic WebAssembly store, so this relies on this fence and the matching fence in
+		// wakeAddress rather than on the ordering of the atomic operations.
+		++bucket.numWaiters;
+		std::atomic_thread_fence(std::memory_order_seq_cst);
 
 		// Use unwindSignalsAsExceptions to ensure that an access violation signal produced by the
 		// load will be thrown as a Runtime::Exception and unwind the stack (e.g. the locks).
 		Value value;
-		Runtime::unwindSignalsAsExceptions(
-			[valuePointer, &value] { value = atomicLoad(valuePointer); });
+		try
+		{
+			Runtime::unwindSignalsAsExceptions(
+				[valuePointer, &value] { value = atomicLoad(valuePointer); });
+		}
+		catch(...)
+		{
+			--bucket.numWaiters;
+			throw;
+		}
 
 		if(value != expectedValue)
 		{
-			// If *valuePointer wasn't the expected value, unlock the wait list and return.
-			waitListLock.unlock();
-			closeWaitList(address, waitList);
+			// If *valuePointer wasn't the expected value, return without waiting.
+			--bucket.numWaiters;
 			return 1;
 		}
-		else
-		{
-			// If the thread hasn't yet created a wake event, do so.
-			if(!threadWakeEvent)
-			{ threadWakeEvent = std::unique_ptr<Platform::Event>(new Platform::Event()); }
 
-			// Add the wake event to the wait list, and unlock the wait list.
-			waitList->wakeEvents.push_back(threadWakeEvent.get());
-			waitListLock.unlock();
-		}
+		// Add the thread's wait node to the bucket's queue.
+		waitNode->address = address;
+		bucket.enqueue(waitNode);
 	}
 
 	// Wait for the thread's wake event to be signaled.
 	bool timedOut = false;
-	if(!threadWakeEvent->wait(timeout < 0 ? Time::infinity() : Time{I128(timeout)}))
+	if(!waitNode->wakeEvent.wait(timeout < 0 ? Time::infinity() : Time{I128(timeout)}))
 	{
-		// If the wait timed out, lock the wait list and check if the thread's wake event is still
-		// in the wait list.
-		Platform::Mutex::Lock waitListLock(waitList->mutex);
-		auto wakeEventIt = std::find(
-			waitList->wakeEvents.begin(), waitList->wakeEvents.end(), threadWakeEvent.get());
-		if(wakeEventIt != waitList->wakeEvents.end())
+		// If the wait timed out, lock the bucket and check if the thread's wait node is still in
+		// the queue.
+		Platform::Mutex::Lock bucketLock(bucket.mutex);
+		if(waitNode->isQueued)
 		{
-			// If the event was still on the wait list, remove it, and return the "timed out"
+			// If the wait node was still in the queue, remove it, and return the "timed out"
 			// result.
-			waitList->wakeEvents.erase(wakeEventIt);
+			bucket.remove(waitNode);
 			timedOut = true;
 		}
 		else
 		{
-			// In between the wait timing out and locking the wait list, some other thread tried to
+			// In between the wait timing out and locking the bucket, some other thread tried to
 			// wake this thread. The event will now be signaled, so use an immediately expiring wait
 			// on it to reset it.
 			WAVM_ERROR_UNLESS(
-				threadWakeEvent->wait(Platform::getClockTime(Platform::Clock::monotonic)));
+				waitNode->wakeEvent.wait(Platform::getClockTime(Platform::Clock::monotonic)));
 		}
 	}
 
-	closeWaitList(address, waitList);
 	return timedOut ? 2 : 0;
 }
 
@@ -166,31 +186,37 @@ static U32 wakeAddress(void* pointer, U32 numToWake)
 {
 	if(numToWake == 0) { return 0; }
 
-	// Open the wait list for this address.
 	const Uptr address = reinterpret_cast<Uptr>(pointer);
-	WaitList* waitList = openWaitList(address);
-	Uptr actualNumToWake = numToWake;
-	{
-		Platform::Mutex::Lock waitListLock(waitList->mutex);
+	WaitBucket& bucket = getWaitBucket(address);
 
-		// Determine how many threads to wake.
-		// numToWake==UINT32_MAX means wake all waiting threads.
-		if(actualNumToWake == UINT32_MAX || actualNumToWake > waitList->wakeEvents.size())
-		{ actualNumToWake = waitList->wakeEvents.size(); }
+	// If no threads are waiting on any address in the bucket, there's no need to lock it. The
+	// fence orders the caller's stores to the address before the load of numWaiters: it pairs with
+	// the fence in waitOnAddress.
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if(!bucket.numWaiters.load()) { return 0; }
 
-		// Signal the events corresponding to the oldest waiting threads.
-		for(Uptr wakeIndex = 0; wakeIndex < actualNumToWake; ++wakeIndex)
-		{ waitList->wakeEvents[wakeIndex]->signal(); }
+	Uptr numWoken = 0;
+	{
+		Platform::Mutex::Lock bucketLock(bucket.mutex);
 
-		// Remove the events from the wait list.
-		waitList->wakeEvents.erase(waitList->wakeEvents.begin(),
-								   waitList->wakeEvents.begin() + actualNumToWake);
+		// Wake the oldest threads waiting on the address.
+		// numToWake==UINT32_MAX means wake all waiting threads.
+		WaitNode* node = bucket.head;
+		while(node && (numToWake == UINT32_MAX || numWoken < numToWake))
+		{
+			WaitNode* nextNode = node->next;
+			if(node->address == address)
+			{
+				bucket.remove(node);
+				node->wakeEvent.signal();
+				++numWoken;
+			}
+			node = nextNode;
+		}
 	}
-	closeWaitList(address, waitList);
 
-	if(actualNumToWake > UINT32_MAX)
-	{ throwException(ExceptionTypes::integerDivideByZeroOrOverflow); }
-	return U32(actualNumToWake);
+	if(numWoken > UINT32_MAX) { throwException(ExceptionTypes::integerDivideByZeroOrOverflow); }
+	return U32(numWoken);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(wavmIntrinsicsAtomics,
@@ -75,7 +75,18 @@ Compartment* Runtime::createCompartment(std::string&& debugName)
 	return new Compartment(std::move(debugName), runtimeData, unalignedRuntimeData);
 }
 
-Compartment* Runtime::cloneCompartment(const Compartment* compartment, std::string&& debugName)
+// Copies the state that tryCollectInstance uses to an object's clone.
+static void copyInstanceReferenceState(const GCObject* object, GCObject* newObject)
+{
+	newObject->definingInstanceId = object->definingInstanceId;
+	newObject->isReferencedOutsideInstance.store(
+		object->isReferencedOutsideInstance.load(std::memory_order_acquire),
+		std::memory_order_release);
+}
+
+Compartment* Runtime::cloneCompartment(const Compartment* compartment,
+									   std::string&& debugName,
+									   MemoryCloneMode memoryCloneMode)
 {
 	Timing::Timer timer;
 
@@ -95,14 +106,16 @@ Compartment* Runtime::cloneCompartment(const Compartment* compartment, std::stri
 		{
 			Table* newTable = cloneTable(table, newCompartment);
 			if(!newTable) { goto error; }
+			copyInstanceReferenceState(table, newTable);
 			WAVM_ASSERT(newTable->id == table->id);
 		}
 
 		// Clone memories.
 		for(Memory* memory : compartment->memories)
 		{
-			Memory* newMemory = cloneMemory(memory, newCompartment);
+			Memory* newMemory = cloneMemory(memory, newCompartment, memoryCloneMode);
 			if(!newMemory) { goto error; }
+			copyInstanceReferenceState(memory, newMemory);
 			WAVM_ASSERT(newMemory->id == memory->id);
 		}
 
@@ -115,6 +128,7 @@ Compartment* Runtime::cloneCompartment(const Compartment* compartment, std::stri
 		{
 			Global* newGlobal = cloneGlobal(global, newCompartment);
 			if(!newGlobal) { goto error; }
+			copyInstanceReferenceState(global, newGlobal);
 			WAVM_ASSERT(newGlobal->id == global->id);
 			WAVM_ASSERT(newGlobal->mutableGlobalIndex == global->mutableGlobalIndex);
 		}
@@ -124,6 +138,7 @@ Compartment* Runtime::cloneCompartment(const Compartment* compartment, std::stri
 		{
 			ExceptionType* newExceptionType = cloneExceptionType(exceptionType, newCompartment);
 			if(!newExceptionType) { goto error; }
+			copyInstanceReferenceState(exceptionType, newExceptionType);
 			WAVM_ASSERT(newExceptionType->id == exceptionType->id);
 		}
 
@@ -132,6 +147,7 @@ Compartment* Runtime::cloneCompartment(const Compartment* compartment, std::stri
 		{
 			Instance* newInstance = cloneInstance(instance, newCompartment);
 			if(!newInstance) { goto error; }
+			copyInstanceReferenceState(instance, newInstance);
 			WAVM_ASSERT(newInstance->id == instance->id);
 		}
 
@@ -230,7 +246,12 @@ bool Runtime::isInCompartment(const Object* object, const Compartment* compartme
 		Platform::RWMutex::ShareableLock compartmentLock(compartment->mutex);
 		if(!compartment->instances.contains(function->instanceId)) { return false; }
 		Instance* instance = compartment->instances[function->instanceId];
-		return instance->jitModule.get() == function->mutableData->jitModule;
+		if(instance->jitModule.get() == function->mutableData->jitModule) { return true; }
+
+		// The function may also be in the optimized code that the instance tiered up to.
+		if(!instance->tierUp) { return false; }
+		Platform::Mutex::Lock tierUpLock(instance->tierUp->mutex);
+		return instance->tierUp->optimizedJITModule.get() == function->mutableData->jitModule;
 	}
 	else
 	{
@@ -44,6 +44,7 @@ Context* Runtime::createContext(Compartment* compartment, std::string&& debugNam
 			   maxMutableGlobals * sizeof(IR::UntaggedValue));
 
 		context->runtimeData->context = context;
+		context->runtimeData->fuel = INT64_MAX;
 	}
 
 	return context;
@@ -53,6 +54,7 @@ Runtime::Context::~Context()
 {
 	WAVM_ASSERT_RWMUTEX_IS_EXCLUSIVELY_LOCKED_BY_CURRENT_THREAD(compartment->mutex);
 	if(id != UINTPTR_MAX) { compartment->contexts.removeOrFail(id); }
+	compartment->numDestroyedContextInvokes += numStartedInvokes.load(std::memory_order_relaxed);
 
 	Platform::decommitVirtualPages((U8*)runtimeData,
 								   sizeof(ContextRuntimeData) >> Platform::getBytesPerPageLog2());
@@ -70,6 +72,29 @@ Context* Runtime::cloneContext(const Context* context, Compartment* newCompartme
 		memcpy(clonedContext->runtimeData->mutableGlobals,
 			   context->runtimeData->mutableGlobals,
 			   maxMutableGlobals * sizeof(IR::UntaggedValue));
+		clonedContext->runtimeData->fuel = context->runtimeData->fuel;
+		clonedContext->exceptionCallStackDepth.store(
+			context->exceptionCallStackDepth.load(std::memory_order_relaxed),
+			std::memory_order_relaxed);
 	}
 	return clonedContext;
 }
+
+I64 Runtime::getContextFuel(const Context* context) { return context->runtimeData->fuel; }
+
+void Runtime::setContextFuel(Context* context, I64 fuel) { context->runtimeData->fuel = fuel; }
+
+void Runtime::addContextFuel(Context* context, I64 fuel)
+{
+	// Saturate instead of overflowing if the fuel is added past INT64_MAX or INT64_MIN.
+	I64& contextFuel = context->runtimeData->fuel;
+	if(fuel > 0 && contextFuel > INT64_MAX - fuel) { contextFuel = INT64_MAX; }
+	else if(fuel < 0 && contextFuel < INT64_MIN - fuel)
+	{
+		contextFuel = INT64_MIN;
+	}
+	else
+	{
+		contextFuel += fuel;
+	}
+}
@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <string.h>
+#include <atomic>
 #include <string>
 #include <utility>
 #include <vector>
@@ -21,6 +22,12 @@
 using namespace WAVM;
 using namespace WAVM::Runtime;
 
+static std::atomic<Uptr> globalExceptionCallStackDepth{Platform::CallStack::maxFrames};
+
+// The exception call stack depth of the context that invokeFunction is running code on in this
+// thread, or UINTPTR_MAX to use the global depth.
+static thread_local Uptr threadExceptionCallStackDepth = UINTPTR_MAX;
+
 namespace WAVM { namespace Runtime {
 	WAVM_DEFINE_INTRINSIC_MODULE(wavmIntrinsicsException)
 }}
@@ -198,6 +205,46 @@ IR::UntaggedValue Runtime::getExceptionArgument(const Exception* exception, Uptr
 	return exception->arguments[argIndex];
 }
 
+void Runtime::setExceptionCallStackDepth(Uptr depth)
+{
+	globalExceptionCallStackDepth.store(depth, std::memory_order_relaxed);
+}
+
+Uptr Runtime::getExceptionCallStackDepth()
+{
+	return globalExceptionCallStackDepth.load(std::memory_order_relaxed);
+}
+
+void Runtime::setExceptionCallStackDepth(Context* context, Uptr depth)
+{
+	context->exceptionCallStackDepth.store(depth, std::memory_order_relaxed);
+}
+
+Runtime::ScopedExceptionCallStackDepth::ScopedExceptionCallStackDepth(Uptr depth)
+: outerDepth(threadExceptionCallStackDepth)
+{
+	threadExceptionCallStackDepth = depth;
+}
+
+Runtime::ScopedExceptionCallStackDepth::~ScopedExceptionCallStackDepth()
+{
+	threadExceptionCallStackDepth = outerDepth;
+}
+
+static Uptr getCurrentExceptionCallStackDepth()
+{
+	return threadExceptionCallStackDepth != UINTPTR_MAX
+			   ? threadExceptionCallStackDepth
+			   : globalExceptionCallStackDepth.load(std::memory_order_relaxed);
+}
+
+WAVM_FORCENOINLINE Platform::CallStack Runtime::captureExceptionCallStack(
+	Uptr numOmittedFramesFromTop)
+{
+	return Platform::captureCallStack(numOmittedFramesFromTop + 1,
+									  getCurrentExceptionCallStackDepth());
+}
+
 const Platform::CallStack& Runtime::getExceptionCallStack(const Exception* exception)
 {
 	return exception->callStack;
@@ -272,7 +319,7 @@ std::string Runtime::describeException(const Exception* exception)
 {
 	WAVM_ASSERT(type->sig.params.size() == arguments.size());
 	throwException(
-		createException(type, arguments.data(), arguments.size(), Platform::captureCallStack(1)));
+		createException(type, arguments.data(), arguments.size(), captureExceptionCallStack(1)));
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(wavmIntrinsicsException,
@@ -292,7 +339,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wavmIntrinsicsException,
 	auto args = reinterpret_cast<const IR::UntaggedValue*>(Uptr(argsBits));
 
 	Exception* exception = createException(
-		exceptionType, args, exceptionType->sig.params.size(), Platform::captureCallStack(1));
+		exceptionType, args, exceptionType->sig.params.size(), captureExceptionCallStack(1));
 
 	return reinterpret_cast<Uptr>(exception);
 }
@@ -426,10 +473,80 @@ void Runtime::unwindSignalsAsExceptions(const std::function<void()>& thunk)
 				   return true;
 			   }
 		   },
-		   &context))
+		   &context,
+		   getCurrentExceptionCallStackDepth()))
 	{
 		Exception* exception = nullptr;
 		translateSignalToRuntimeException(context.signal, std::move(context.callStack), exception);
 		throw exception;
 	}
 }
+
+struct CatchTrapsContext
+{
+	void (*thunk)(void*);
+	void* thunkArgument;
+	Platform::Signal signal;
+	Platform::CallStack callStack;
+	Exception* exception = nullptr;
+};
+
+static bool catchTrapsFilter(void* contextVoid,
+							 Platform::Signal signal,
+							 Platform::CallStack&& callStack)
+{
+	if(!isRuntimeException(signal)) { return false; }
+	else
+	{
+		CatchTrapsContext& context = *(CatchTrapsContext*)contextVoid;
+		context.signal = signal;
+		context.callStack = std::move(callStack);
+		return true;
+	}
+}
+
+Exception* Runtime::catchTraps(void (*thunk)(void*), void* argument)
+{
+	CatchTrapsContext context;
+	context.thunk = thunk;
+	context.thunkArgument = argument;
+	if(!Platform::catchSignals(
+		   [](void* contextVoid) {
+			   CatchTrapsContext& context = *(CatchTrapsContext*)contextVoid;
+			   context.thunk(context.thunkArgument);
+		   },
+		   catchTrapsFilter,
+		   &context,
+		   getCurrentExceptionCallStackDepth()))
+	{ return nullptr; }
+
+	// If trap jumped back to the catchSignals, it already created the exception. Otherwise,
+	// translate the signal that was caught into a runtime exception.
+	if(!context.exception)
+	{
+		translateSignalToRuntimeException(
+			context.signal, std::move(context.callStack), context.exception);
+	}
+	return context.exception;
+}
+
+[[noreturn]] void Runtime::trap(ExceptionType* type,
+								const IR::UntaggedValue* arguments,
+								Uptr numArguments)
+{
+	WAVM_ASSERT(type->sig.params.size() == numArguments);
+	Exception* exception
+		= createException(type, arguments, numArguments, captureExceptionCallStack(1));
+
+	// If the innermost signal catch on this thread is from catchTraps, return the exception to it
+	// without unwinding the stack.
+	CatchTrapsContext* catchTrapsContext
+		= (CatchTrapsContext*)Platform::getInnermostCatchSignalsArgument(catchTrapsFilter);
+	if(catchTrapsContext)
+	{
+		catchTrapsContext->exception = exception;
+		Platform::jumpToInnermostCatchSignals();
+	}
+
+	throw exception;
+}
@@ -59,6 +59,8 @@ void Runtime::initializeGlobal(Global* global, Value value)
 	global->hasBeenInitialized = true;
 
 	global->initialValue = value;
+	if(isReferenceType(global->type.valueType))
+	{ noteReference(value.object, global->definingInstanceId); }
 	if(global->type.isMutable)
 	{
 		// Initialize the global's mutable value for all current and future contexts.
@@ -127,6 +129,8 @@ Value Runtime::setGlobalValue(Context* context, const Global* global, Value newV
 	WAVM_ERROR_UNLESS(context->compartment == global->compartment);
 	WAVM_ERROR_UNLESS(!isReferenceType(global->type.valueType) || !newValue.object
 					  || isInCompartment(newValue.object, context->compartment));
+	if(isReferenceType(global->type.valueType))
+	{ noteReference(newValue.object, global->definingInstanceId); }
 	UntaggedValue& value = context->runtimeData->mutableGlobals[global->mutableGlobalIndex];
 	const Value previousValue = Value(global->type.valueType, value);
 	value = newValue;
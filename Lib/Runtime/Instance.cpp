@@ -1,3 +1,4 @@
+#include <atomic>
 #include <memory>
 #include <utility>
 #include "RuntimePrivate.h"
@@ -11,6 +12,7 @@
 #include "WAVM/Inline/HashMap.h"
 #include "WAVM/Inline/Timing.h"
 #include "WAVM/LLVMJIT/LLVMJIT.h"
+#include "WAVM/Logging/Logging.h"
 #include "WAVM/Platform/Intrinsic.h"
 #include "WAVM/Platform/RWMutex.h"
 #include "WAVM/Runtime/Runtime.h"
@@ -60,6 +62,85 @@ static Uptr getIndexValue(const Value& value, IndexType indexType)
 	};
 }
 
+// Returns the map from the names of the wavmIntrinsic functions to their native functions. The map
+// doesn't depend on the module being instantiated, so it is only created once.
+static const HashMap<std::string, LLVMJIT::FunctionBinding>& getWAVMIntrinsicsExportMap()
+{
+	static const HashMap<std::string, LLVMJIT::FunctionBinding> wavmIntrinsicsExportMap = []() {
+		HashMap<std::string, LLVMJIT::FunctionBinding> result;
+		for(const HashMapPair<std::string, Intrinsics::Function*>& intrinsicFunctionPair :
+			Intrinsics::getUninstantiatedFunctions(
+				{WAVM_INTRINSIC_MODULE_REF(wavmIntrinsics),
+				 WAVM_INTRINSIC_MODULE_REF(wavmIntrinsicsAtomics),
+				 WAVM_INTRINSIC_MODULE_REF(wavmIntrinsicsException),
+				 WAVM_INTRINSIC_MODULE_REF(wavmIntrinsicsMemory),
+				 WAVM_INTRINSIC_MODULE_REF(wavmIntrinsicsTable)}))
+		{
+			LLVMJIT::FunctionBinding functionBinding{
+				intrinsicFunctionPair.value->getNativeFunction()};
+			result.add(intrinsicFunctionPair.key, functionBinding);
+		}
+		return result;
+	}();
+	return wavmIntrinsicsExportMap;
+}
+
+// Loads a module's object code for an instance, binding its symbols to the instance's imports and
+// definitions. LLVMJIT::loadModule fills in the functionDefMutableDatas' function pointers with the
+// loaded functions.
+static std::shared_ptr<LLVMJIT::Module> loadObjectCode(
+	ModuleConstRefParam module,
+	const std::vector<U8>& objectCode,
+	Uptr instanceId,
+	const std::vector<LLVMJIT::FunctionBinding>& jitFunctionImports,
+	const std::vector<Table*>& tables,
+	const std::vector<Memory*>& memories,
+	const std::vector<Global*>& globals,
+	const std::vector<Runtime::ExceptionType*>& exceptionTypes,
+	const std::vector<FunctionMutableData*>& functionDefMutableDatas,
+	std::string&& debugName)
+{
+	std::vector<LLVMJIT::TableBinding> jitTables;
+	for(Table* table : tables) { jitTables.push_back({table->id}); }
+
+	std::vector<LLVMJIT::MemoryBinding> jitMemories;
+	for(Memory* memory : memories) { jitMemories.push_back({memory->id}); }
+
+	std::vector<LLVMJIT::GlobalBinding> jitGlobals;
+	for(Global* global : globals)
+	{
+		LLVMJIT::GlobalBinding globalSpec;
+		globalSpec.type = global->type;
+		if(global->type.isMutable) { globalSpec.mutableGlobalIndex = global->mutableGlobalIndex; }
+		else
+		{
+			globalSpec.immutableValuePointer = &global->initialValue;
+		}
+		jitGlobals.push_back(globalSpec);
+	}
+
+	std::vector<LLVMJIT::ExceptionTypeBinding> jitExceptionTypes;
+	for(Runtime::ExceptionType* exceptionType : exceptionTypes)
+	{ jitExceptionTypes.push_back({exceptionType->id}); }
+
+	std::vector<FunctionType> jitTypes = module->ir.types;
+	return LLVMJIT::loadModule(objectCode,
+							   getWAVMIntrinsicsExportMap(),
+							   std::move(jitTypes),
+							   std::vector<LLVMJIT::FunctionBinding>(jitFunctionImports),
+							   std::move(jitTables),
+							   std::move(jitMemories),
+							   std::move(jitGlobals),
+							   std::move(jitExceptionTypes),
+							   {instanceId},
+							   reinterpret_cast<Uptr>(getOutOfBoundsElement()),
+							   functionDefMutableDatas,
+							   module->profileCounters
+								   ? reinterpret_cast<U64*>(module->profileCounters->data())
+								   : nullptr,
+							   std::move(debugName));
+}
+
 Instance::~Instance()
 {
 	if(id != UINTPTR_MAX)
@@ -67,6 +148,63 @@ Instance::~Instance()
 		WAVM_ASSERT_RWMUTEX_IS_EXCLUSIVELY_LOCKED_BY_CURRENT_THREAD(compartment->mutex);
 		compartment->instances.removeOrFail(id);
 	}
+
+	if(resourceQuota)
+	{
+		resourceQuota->instances.free(1);
+		resourceQuota->codeBytes.free(numCodeBytes);
+	}
+}
+
+InstanceTierUp::~InstanceTierUp()
+{
+	if(resourceQuota) { resourceQuota->codeBytes.free(numCodeBytes); }
+}
+
+// Charges an instance and the object code it loads to a resource quota. Returns false if the quota
+// doesn't have room for them.
+static bool allocateInstanceQuota(ResourceQuotaRefParam resourceQuota, Uptr numCodeBytes)
+{
+	if(!resourceQuota) { return true; }
+	if(!resourceQuota->instances.allocate(1)) { return false; }
+	if(!resourceQuota->codeBytes.allocate(numCodeBytes))
+	{
+		resourceQuota->instances.free(1);
+		return false;
+	}
+	return true;
+}
+
+// Returns whether the code of a module may give references to the objects it defines to code
+// outside its instance without calling the runtime: by writing them to an imported mutable global,
+// passing them to an imported function or to another instance's function in any of its tables, or
+// throwing them in an imported exception type. Tables the module defines may also hold other
+// instances' functions, since they may be exported or written by the host.
+static bool mayPassReferencesToImports(const IR::Module& irModule)
+{
+	for(const auto& globalImport : irModule.globals.imports)
+	{
+		if(globalImport.type.isMutable && isReferenceType(globalImport.type.valueType))
+		{ return true; }
+	}
+	for(const auto& exceptionTypeImport : irModule.exceptionTypes.imports)
+	{
+		for(ValueType param : exceptionTypeImport.type.params)
+		{
+			if(isReferenceType(param)) { return true; }
+		}
+	}
+	if(irModule.functions.imports.size() || irModule.tables.size())
+	{
+		for(FunctionType type : irModule.types)
+		{
+			for(ValueType param : type.params())
+			{
+				if(isReferenceType(param)) { return true; }
+			}
+		}
+	}
+	return false;
 }
 
 Instance* Runtime::instantiateModule(Compartment* compartment,
@@ -113,6 +251,20 @@ Instance* Runtime::instantiateModule(Compartment* compartment,
 			Memory* memory = asMemory(importObject);
 			WAVM_ERROR_UNLESS(
 				isSubtype(getMemoryType(memory), module->ir.memories.getType(kindIndex.index)));
+
+			// The module's code may elide bounds checks that rely on the memory reserving enough
+			// address space, so fail to instantiate it if the memory reserves less.
+			if(memory->numReservedBytes
+			   < getMinMemoryReservedBytes(getMemoryType(memory),
+										   module->compileOptions.boundsCheckMode))
+			{
+				Log::printf(Log::debug,
+							"Failed to instantiate %s: imported memory %s doesn't reserve enough"
+							" address space for the module's bounds-check mode.\n",
+							moduleDebugName.c_str(),
+							memory->debugName.c_str());
+				return nullptr;
+			}
 			memoryImports.push_back(memory);
 			break;
 		}
@@ -169,6 +321,20 @@ Instance* Runtime::instantiateModuleInternal(Compartment* compartment,
 	}
 	if(id == UINTPTR_MAX) { return nullptr; }
 
+	// Record the references to the instance's imports. Imports of native functions (by intrinsic
+	// modules) aren't objects.
+	for(Uptr importIndex = 0; importIndex < functionImports.size(); ++importIndex)
+	{
+		const FunctionType functionType
+			= module->ir.types[module->ir.functions.imports[importIndex].type.index];
+		if(functionType.callingConvention() == CallingConvention::wasm)
+		{ noteReference(asObject(functionImports[importIndex].wasmFunction), id); }
+	}
+	for(Table* table : tables) { noteReference(table, id); }
+	for(Memory* memory : memories) { noteReference(memory, id); }
+	for(Global* global : globals) { noteReference(global, id); }
+	for(ExceptionType* exceptionType : exceptionTypes) { noteReference(exceptionType, id); }
+
 	// Deserialize the disassembly names.
 	DisassemblyNames disassemblyNames;
 	getDisassemblyNames(module->ir, disassemblyNames);
@@ -189,6 +355,7 @@ Instance* Runtime::instantiateModuleInternal(Compartment* compartment,
 			compartment->instances.removeOrFail(id);
 			throwException(ExceptionTypes::outOfMemory);
 		}
+		table->definingInstanceId = id;
 		tables.push_back(table);
 	}
 	for(Uptr memoryDefIndex = 0; memoryDefIndex < module->ir.memories.defs.size(); ++memoryDefIndex)
@@ -198,13 +365,15 @@ Instance* Runtime::instantiateModuleInternal(Compartment* compartment,
 		auto memory = createMemory(compartment,
 								   module->ir.memories.defs[memoryDefIndex].type,
 								   std::move(debugName),
-								   resourceQuota);
+								   resourceQuota,
+								   module->compileOptions.boundsCheckMode);
 		if(!memory)
 		{
 			Platform::RWMutex::ExclusiveLock compartmentLock(compartment->mutex);
 			compartment->instances.removeOrFail(id);
 			throwException(ExceptionTypes::outOfMemory);
 		}
+		memory->definingInstanceId = id;
 		memories.push_back(memory);
 	}
 
@@ -216,6 +385,7 @@ Instance* Runtime::instantiateModuleInternal(Compartment* compartment,
 		const GlobalDef& globalDef = module->ir.globals.defs[globalDefIndex];
 		Global* global
 			= createGlobal(compartment, globalDef.type, std::move(debugName), resourceQuota);
+		global->definingInstanceId = id;
 		globals.push_back(global);
 
 		// Defer evaluation of globals with (ref.func ...) initializers until the module's code is
@@ -238,23 +408,22 @@ Instance* Runtime::instantiateModuleInternal(Compartment* compartment,
 		std::string debugName
 			= disassemblyNames
 				  .exceptionTypes[module->ir.exceptionTypes.imports.size() + exceptionTypeDefIndex];
-		exceptionTypes.push_back(
-			createExceptionType(compartment, exceptionTypeDef.type, std::move(debugName)));
+		ExceptionType* exceptionType
+			= createExceptionType(compartment, exceptionTypeDef.type, std::move(debugName));
+		exceptionType->definingInstanceId = id;
+		exceptionTypes.push_back(exceptionType);
 	}
 
-	// Set up the values to bind to the symbols in the LLVMJIT object code.
-	HashMap<std::string, LLVMJIT::FunctionBinding> wavmIntrinsicsExportMap;
-	for(const HashMapPair<std::string, Intrinsics::Function*>& intrinsicFunctionPair :
-		Intrinsics::getUninstantiatedFunctions({WAVM_INTRINSIC_MODULE_REF(wavmIntrinsics),
-												WAVM_INTRINSIC_MODULE_REF(wavmIntrinsicsAtomics),
-												WAVM_INTRINSIC_MODULE_REF(wavmIntrinsicsException),
-												WAVM_INTRINSIC_MODULE_REF(wavmIntrinsicsMemory),
-												WAVM_INTRINSIC_MODULE_REF(wavmIntrinsicsTable)}))
+	// Charge the instance and its object code to the resource quota.
+	std::shared_ptr<const std::vector<U8>> objectCode = module->getObjectCode();
+	if(!allocateInstanceQuota(resourceQuota, objectCode->size()))
 	{
-		LLVMJIT::FunctionBinding functionBinding{intrinsicFunctionPair.value->getNativeFunction()};
-		wavmIntrinsicsExportMap.add(intrinsicFunctionPair.key, functionBinding);
+		Platform::RWMutex::ExclusiveLock compartmentLock(compartment->mutex);
+		compartment->instances.removeOrFail(id);
+		throwException(ExceptionTypes::outOfMemory);
 	}
 
+	// Set up the values to bind to the symbols in the LLVMJIT object code.
 	std::vector<Function*> functions;
 	std::vector<LLVMJIT::FunctionBinding> jitFunctionImports;
 	for(Uptr importIndex = 0; importIndex < module->ir.functions.imports.size(); ++importIndex)
@@ -273,29 +442,6 @@ Instance* Runtime::instantiateModuleInternal(Compartment* compartment,
 		}
 	}
 
-	std::vector<LLVMJIT::TableBinding> jitTables;
-	for(Table* table : tables) { jitTables.push_back({table->id}); }
-
-	std::vector<LLVMJIT::MemoryBinding> jitMemories;
-	for(Memory* memory : memories) { jitMemories.push_back({memory->id}); }
-
-	std::vector<LLVMJIT::GlobalBinding> jitGlobals;
-	for(Global* global : globals)
-	{
-		LLVMJIT::GlobalBinding globalSpec;
-		globalSpec.type = global->type;
-		if(global->type.isMutable) { globalSpec.mutableGlobalIndex = global->mutableGlobalIndex; }
-		else
-		{
-			globalSpec.immutableValuePointer = &global->initialValue;
-		}
-		jitGlobals.push_back(globalSpec);
-	}
-
-	std::vector<LLVMJIT::ExceptionTypeBinding> jitExceptionTypes;
-	for(ExceptionType* exceptionType : exceptionTypes)
-	{ jitExceptionTypes.push_back({exceptionType->id}); }
-
 	// Create a FunctionMutableData for each function definition.
 	std::vector<FunctionMutableData*> functionDefMutableDatas;
 	for(Uptr functionDefIndex = 0; functionDefIndex < module->ir.functions.defs.size();
@@ -308,26 +454,22 @@ Instance* Runtime::instantiateModuleInternal(Compartment* compartment,
 		{ debugName = "<function #" + std::to_string(functionDefIndex) + ">"; }
 		debugName = "wasm!" + moduleDebugName + '!' + debugName;
 
-		functionDefMutableDatas.push_back(new FunctionMutableData(std::move(debugName)));
+		FunctionMutableData* functionMutableData = new FunctionMutableData(std::move(debugName));
+		functionMutableData->resourceQuota = resourceQuota.get();
+		functionDefMutableDatas.push_back(functionMutableData);
 	}
 
 	// Load the compiled module's object code with this instance's imports.
-	std::vector<FunctionType> jitTypes = module->ir.types;
-	std::vector<Runtime::Function*> jitFunctionDefs;
-	jitFunctionDefs.resize(module->ir.functions.defs.size(), nullptr);
-	std::shared_ptr<LLVMJIT::Module> jitModule
-		= LLVMJIT::loadModule(module->objectCode,
-							  std::move(wavmIntrinsicsExportMap),
-							  std::move(jitTypes),
-							  std::move(jitFunctionImports),
-							  std::move(jitTables),
-							  std::move(jitMemories),
-							  std::move(jitGlobals),
-							  std::move(jitExceptionTypes),
-							  {id},
-							  reinterpret_cast<Uptr>(getOutOfBoundsElement()),
-							  functionDefMutableDatas,
-							  std::string(moduleDebugName));
+	std::shared_ptr<LLVMJIT::Module> jitModule = loadObjectCode(module,
+																*objectCode,
+																id,
+																jitFunctionImports,
+																tables,
+																memories,
+																globals,
+																exceptionTypes,
+																functionDefMutableDatas,
+																std::string(moduleDebugName));
 
 	// LLVMJIT::loadModule filled in the functionDefMutableDatas' function pointers with the
 	// compiled functions. Add those functions to the module.
@@ -395,6 +537,12 @@ Instance* Runtime::instantiateModuleInternal(Compartment* compartment,
 									  std::move(jitModule),
 									  std::move(moduleDebugName),
 									  resourceQuota);
+	instance->profileCounters = module->profileCounters;
+	instance->numCodeBytes = objectCode->size();
+	if(module->compileOptions.tierUp)
+	{ instance->tierUp = std::make_shared<InstanceTierUp>(module, std::move(jitFunctionImports)); }
+	if(mayPassReferencesToImports(module->ir))
+	{ instance->isReferencedOutsideInstance.store(true, std::memory_order_release); }
 	{
 		Platform::RWMutex::ExclusiveLock compartmentLock(compartment->mutex);
 		compartment->instances[id] = instance;
@@ -412,11 +560,29 @@ Instance* Runtime::instantiateModuleInternal(Compartment* compartment,
 		}
 	}
 
-	// Copy the module's data segments into their designated memory instances.
+	// Map the images of the module's memories, which contain the active data segments with
+	// constant offsets that precede any other active data segments for the same memory.
+	std::shared_ptr<const MemoryImages> memoryImages = module->getMemoryImages();
+	const Uptr numMemoryImports = module->ir.memories.imports.size();
+	std::vector<bool> isMemoryImageMapped(module->ir.memories.defs.size(), false);
+	for(Uptr memoryDefIndex = 0; memoryDefIndex < module->ir.memories.defs.size(); ++memoryDefIndex)
+	{
+		const MemoryImage& memoryImage = memoryImages->memoryDefImages[memoryDefIndex];
+		if(memoryImage.snapshot)
+		{
+			isMemoryImageMapped[memoryDefIndex] = mapMemoryImage(
+				instance->memories[numMemoryImports + memoryDefIndex], memoryImage);
+		}
+	}
+
+	// Copy the module's other data segments into their designated memory instances. If a memory's
+	// image couldn't be mapped, copy the data segments in the image too.
 	for(Uptr segmentIndex = 0; segmentIndex < module->ir.dataSegments.size(); ++segmentIndex)
 	{
 		const DataSegment& dataSegment = module->ir.dataSegments[segmentIndex];
-		if(dataSegment.isActive)
+		if(dataSegment.isActive
+		   && (!memoryImages->isDataSegmentInImage[segmentIndex]
+			   || !isMemoryImageMapped[dataSegment.memoryIndex - numMemoryImports]))
 		{
 			WAVM_ASSERT(instance->dataSegments[segmentIndex] == nullptr);
 
@@ -471,9 +637,106 @@ Instance* Runtime::instantiateModuleInternal(Compartment* compartment,
 		}
 	}
 
+	// Now that the elem segments are copied into the tables, prevent the host from mutating the
+	// tables that the module's code assumes are immutable.
+	std::shared_ptr<const std::vector<bool>> immutableTables = module->getImmutableTables();
+	for(Uptr tableIndex = module->ir.tables.imports.size(); tableIndex < immutableTables->size();
+		++tableIndex)
+	{
+		if((*immutableTables)[tableIndex]) { instance->tables[tableIndex]->isImmutable = true; }
+	}
+
 	return instance;
 }
 
+// Installs the optimized code for one of an instance's hot baseline function definitions. If the
+// module's optimized object code isn't ready yet, starts compiling it instead: the baseline
+// function calls this again after another FunctionTierUp::callInterval calls.
+static void tierUpInstanceFunction(Instance* instance, Uptr functionDefIndex)
+{
+	InstanceTierUp& tierUp = *instance->tierUp;
+	std::shared_ptr<const std::vector<U8>> optimizedObjectCode
+		= tierUp.module->getOptimizedObjectCode();
+	if(!optimizedObjectCode)
+	{
+		// Compile the optimized object code with the same options as the baseline code, other
+		// than the optimization level and tierUp, which startBackgroundOptimization changes.
+		Runtime::Module::startBackgroundOptimization(tierUp.module, tierUp.module->compileOptions);
+		return;
+	}
+
+	Platform::Mutex::Lock tierUpLock(tierUp.mutex);
+	if(!tierUp.optimizedJITModule)
+	{
+		if(tierUp.hasFailed) { return; }
+
+		// Charge the optimized object code to the instance's resource quota. If there isn't room
+		// for it, the instance keeps running the baseline code.
+		if(instance->resourceQuota
+		   && !instance->resourceQuota->codeBytes.allocate(optimizedObjectCode->size()))
+		{
+			Log::printf(Log::debug,
+						"Couldn't tier up %s: its resource quota doesn't have room for the"
+						" optimized object code.\n",
+						instance->debugName.c_str());
+			tierUp.hasFailed = true;
+			return;
+		}
+		tierUp.resourceQuota = instance->resourceQuota;
+		tierUp.numCodeBytes = optimizedObjectCode->size();
+
+		// Load the optimized object code with the same bindings as the baseline code. Its
+		// functions get their own FunctionMutableData, with the same debug names as the baseline
+		// functions.
+		Timing::Timer loadTimer;
+		const Uptr numFunctionImports = tierUp.module->ir.functions.imports.size();
+		std::vector<FunctionMutableData*> functionDefMutableDatas;
+		for(Uptr functionDefIndex = 0; functionDefIndex < tierUp.module->ir.functions.defs.size();
+			++functionDefIndex)
+		{
+			const FunctionMutableData* baselineMutableData
+				= instance->functions[numFunctionImports + functionDefIndex]->mutableData;
+			FunctionMutableData* functionMutableData
+				= new FunctionMutableData(std::string(baselineMutableData->debugName));
+			functionMutableData->resourceQuota = baselineMutableData->resourceQuota;
+			functionDefMutableDatas.push_back(functionMutableData);
+		}
+		tierUp.optimizedJITModule = loadObjectCode(tierUp.module,
+												   *optimizedObjectCode,
+												   instance->id,
+												   tierUp.functionImports,
+												   instance->tables,
+												   instance->memories,
+												   instance->globals,
+												   instance->exceptionTypes,
+												   functionDefMutableDatas,
+												   std::string(instance->debugName));
+		for(FunctionMutableData* functionMutableData : functionDefMutableDatas)
+		{ tierUp.optimizedFunctionDefs.push_back(functionMutableData->function); }
+		Timing::logTimer("Loaded optimized object code to tier up an instance", loadTimer);
+	}
+
+	// Forward calls to the baseline function to its optimized code. The release store pairs with
+	// the baseline code's acquire load, so the loaded code is visible to threads that call it.
+	const Uptr numFunctionImports = tierUp.module->ir.functions.imports.size();
+	Function* baselineFunction = instance->functions[numFunctionImports + functionDefIndex];
+	Function* optimizedFunction = tierUp.optimizedFunctionDefs[functionDefIndex];
+	baselineFunction->mutableData->tierUp.code.store(optimizedFunction->code,
+													 std::memory_order_release);
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(wavmIntrinsics,
+							   "tierUpFunction",
+							   void,
+							   tierUpFunction,
+							   Uptr instanceId,
+							   Uptr functionDefIndex)
+{
+	Instance* instance = getInstanceFromRuntimeData(contextRuntimeData, instanceId);
+	WAVM_ASSERT(instance->tierUp);
+	tierUpInstanceFunction(instance, functionDefIndex);
+}
+
 Instance* Runtime::cloneInstance(Instance* instance, Compartment* newCompartment)
 {
 	// Remap the module's references to the cloned compartment.
@@ -516,6 +779,9 @@ Instance* Runtime::cloneInstance(Instance* instance, Compartment* newCompartment
 		newElemSegments = instance->elemSegments;
 	}
 
+	// Charge the new Instance to the same resource quota as the old one.
+	if(!allocateInstanceQuota(instance->resourceQuota, instance->numCodeBytes)) { return nullptr; }
+
 	// Create the new Instance in the cloned compartment, but with the same ID as the old one.
 	std::shared_ptr<LLVMJIT::Module> jitModuleCopy = instance->jitModule;
 	Instance* newInstance = new Instance(newCompartment,
@@ -533,6 +799,9 @@ Instance* Runtime::cloneInstance(Instance* instance, Compartment* newCompartment
 										 std::move(jitModuleCopy),
 										 std::string(instance->debugName),
 										 instance->resourceQuota);
+	newInstance->profileCounters = instance->profileCounters;
+	newInstance->numCodeBytes = instance->numCodeBytes;
+	newInstance->tierUp = instance->tierUp;
 	{
 		Platform::RWMutex::ExclusiveLock compartmentLock(newCompartment->mutex);
 		newCompartment->instances.insertOrFail(instance->id, newInstance);
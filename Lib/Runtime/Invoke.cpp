@@ -6,8 +6,10 @@
 #include "WAVM/IR/Value.h"
 #include "WAVM/Inline/Assert.h"
 #include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Time.h"
 #include "WAVM/LLVMJIT/LLVMJIT.h"
 #include "WAVM/Logging/Logging.h"
+#include "WAVM/Platform/Clock.h"
 #include "WAVM/Runtime/Runtime.h"
 #include "WAVM/RuntimeABI/RuntimeABI.h"
 
@@ -15,11 +17,15 @@ using namespace WAVM;
 using namespace WAVM::IR;
 using namespace WAVM::Runtime;
 
-void Runtime::invokeFunction(Context* context,
-							 const Function* function,
-							 FunctionType invokeSig,
-							 const UntaggedValue arguments[],
-							 UntaggedValue outResults[])
+// Returns the type of the exception to throw if a function can't be invoked with the given
+// signature or its resource quota has no CPU time left, or null if it can be invoked. Asserts that
+// the function, the context, and any reference arguments of numInvokes calls are all in the same
+// compartment. Records that the reference arguments are referenced by the function's instance.
+static Runtime::ExceptionType* checkInvoke(Context* context,
+										   const Function* function,
+										   FunctionType invokeSig,
+										   const UntaggedValue arguments[],
+										   Uptr numInvokes = 1)
 {
 	FunctionType functionType{function->encodedType};
 
@@ -34,30 +40,120 @@ void Runtime::invokeFunction(Context* context,
 				asString(invokeSig).c_str(),
 				asString(getFunctionType(function)).c_str());
 		}
-		throwException(ExceptionTypes::invokeSignatureMismatch);
+		return ExceptionTypes::invokeSignatureMismatch;
 	}
 
-	// Assert that the function, the context, and any reference arguments are all in the same
-	// compartment.
+	const ResourceQuota* resourceQuota = function->mutableData->resourceQuota;
+	if(resourceQuota && resourceQuota->cpuTimeNanoseconds.isExhausted())
+	{ return ExceptionTypes::outOfCPUTime; }
+
 	if(WAVM_ENABLE_ASSERTS)
 	{
 		WAVM_ASSERT(isInCompartment(asObject(function), context->compartment));
-		for(Uptr argumentIndex = 0; argumentIndex < invokeSig.params().size(); ++argumentIndex)
+		const Uptr numParams = invokeSig.params().size();
+		for(Uptr argumentIndex = 0; argumentIndex < numInvokes * numParams; ++argumentIndex)
 		{
-			const ValueType argType = invokeSig.params()[argumentIndex];
+			const ValueType argType = invokeSig.params()[argumentIndex % numParams];
 			const UntaggedValue& arg = arguments[argumentIndex];
 			WAVM_ASSERT(!isReferenceType(argType) || !arg.object
 						|| isInCompartment(arg.object, context->compartment));
 		}
 	}
 
-	// Get the invoke thunk for this function type. Cache it in the function's FunctionMutableData
-	// to avoid the global lock implied by LLVMJIT::getInvokeThunk.
+	const TypeTuple& params = invokeSig.params();
+	for(Uptr paramIndex = 0; paramIndex < params.size(); ++paramIndex)
+	{
+		if(isReferenceType(params[paramIndex]))
+		{
+			for(Uptr invokeIndex = 0; invokeIndex < numInvokes; ++invokeIndex)
+			{
+				noteReference(arguments[invokeIndex * params.size() + paramIndex].object,
+							  function->instanceId);
+			}
+		}
+	}
+
+	return nullptr;
+}
+
+// Charges the CPU time used by the calling thread while in scope to the invoked function's
+// resource quota, if it limits CPU time. The time used by a nested invocation is only charged to
+// the nested invocation's quota.
+struct ScopedCPUTimeCharge
+{
+	ScopedCPUTimeCharge(const Function* function)
+	: resourceQuota(function->mutableData->resourceQuota)
+	{
+		if(resourceQuota && !resourceQuota->cpuTimeNanoseconds.isLimited())
+		{ resourceQuota = nullptr; }
+		if(resourceQuota)
+		{
+			startTime = Platform::getClockTime(Platform::Clock::threadCPUTime);
+			outerCharge = currentCharge;
+			if(outerCharge) { outerCharge->chargeUntil(startTime); }
+			currentCharge = this;
+		}
+	}
+
+	~ScopedCPUTimeCharge()
+	{
+		if(resourceQuota)
+		{
+			const Time endTime = Platform::getClockTime(Platform::Clock::threadCPUTime);
+			chargeUntil(endTime);
+			WAVM_ASSERT(currentCharge == this);
+			currentCharge = outerCharge;
+			if(outerCharge) { outerCharge->startTime = endTime; }
+		}
+	}
+
+private:
+	static thread_local ScopedCPUTimeCharge* currentCharge;
+
+	ResourceQuota* resourceQuota;
+	ScopedCPUTimeCharge* outerCharge = nullptr;
+	Time startTime;
+
+	void chargeUntil(Time time)
+	{
+		resourceQuota->cpuTimeNanoseconds.charge(U64(time.ns - startTime.ns));
+		startTime = time;
+	}
+};
+
+thread_local ScopedCPUTimeCharge* ScopedCPUTimeCharge::currentCharge = nullptr;
+
+// Counts the invokes on a context that have started and returned. Only the thread invoking code on
+// the context writes the counts, so they don't need atomic read-modify-write operations.
+struct ScopedInvokeCount
+{
+	ScopedInvokeCount(Context* inContext) : context(inContext)
+	{
+		context->numStartedInvokes.store(
+			context->numStartedInvokes.load(std::memory_order_relaxed) + 1,
+			std::memory_order_relaxed);
+	}
+
+	~ScopedInvokeCount()
+	{
+		context->numReturnedInvokes.store(
+			context->numReturnedInvokes.load(std::memory_order_relaxed) + 1,
+			std::memory_order_release);
+	}
+
+private:
+	Context* context;
+};
+
+// Gets the invoke thunk for a function's type. Caches it in the function's FunctionMutableData to
+// avoid the global lock implied by LLVMJIT::getInvokeThunk.
+static InvokeThunkPointer getInvokeThunk(const Function* function)
+{
 	InvokeThunkPointer invokeThunk
 		= function->mutableData->invokeThunk.load(std::memory_order_acquire);
 	if(WAVM_UNLIKELY(!invokeThunk))
 	{
-		invokeThunk = LLVMJIT::getInvokeThunk(functionType);
+		invokeThunk = LLVMJIT::getInvokeThunk(FunctionType{function->encodedType});
 
 		// Replace the cached thunk pointer, but since LLVMJIT::getInvokeThunk is guaranteed to
 		// return the same thunk when called with the same FunctionType, we can assume that any
@@ -65,34 +161,190 @@ void Runtime::invokeFunction(Context* context,
 		function->mutableData->invokeThunk.store(invokeThunk, std::memory_order_release);
 	}
 	WAVM_ASSERT(invokeThunk);
+	return invokeThunk;
+}
 
-	// MacOS std::function is a little more pessimistic about heap allocating captures, and without
-	// wrapping these captured variables into a single reference, does a heap allocation for the
-	// thunk passed to unwindSignalsAsExceptions below.
-	struct InvokeContext
+static InvokeBatchThunkPointer getInvokeBatchThunk(const Function* function)
+{
+	InvokeBatchThunkPointer invokeBatchThunk
+		= function->mutableData->invokeBatchThunk.load(std::memory_order_acquire);
+	if(WAVM_UNLIKELY(!invokeBatchThunk))
 	{
-		Context* context;
-		const Function* function;
-		const UntaggedValue* arguments;
-		UntaggedValue* outResults;
-		InvokeThunkPointer invokeThunk;
-	};
+		invokeBatchThunk = LLVMJIT::getInvokeBatchThunk(FunctionType{function->encodedType});
+		function->mutableData->invokeBatchThunk.store(invokeBatchThunk,
+													  std::memory_order_release);
+	}
+	WAVM_ASSERT(invokeBatchThunk);
+	return invokeBatchThunk;
+}
+
+// MacOS std::function is a little more pessimistic about heap allocating captures, and without
+// wrapping these captured variables into a single reference, does a heap allocation for the
+// thunk passed to unwindSignalsAsExceptions below. tryInvokeFunction also passes it to catchTraps
+// as the thunk argument.
+struct InvokeContext
+{
+	Context* context;
+	const Function* function;
+	const UntaggedValue* arguments;
+	UntaggedValue* outResults;
+	InvokeThunkPointer invokeThunk;
+};
+
+static void callInvokeThunk(void* invokeContextVoid)
+{
+	const InvokeContext& invokeContext = *(const InvokeContext*)invokeContextVoid;
+	ContextRuntimeData* contextRuntimeData = getContextRuntimeData(invokeContext.context);
+
+	// Call the invoke thunk.
+	(*invokeContext.invokeThunk)(invokeContext.function,
+								 contextRuntimeData,
+								 invokeContext.arguments,
+								 invokeContext.outResults);
+}
+
+void Runtime::invokeFunction(Context* context,
+							 const Function* function,
+							 FunctionType invokeSig,
+							 const UntaggedValue arguments[],
+							 UntaggedValue outResults[])
+{
+	if(Runtime::ExceptionType* exceptionType = checkInvoke(context, function, invokeSig, arguments))
+	{ throwException(exceptionType); }
+
 	InvokeContext invokeContext;
 	invokeContext.context = context;
 	invokeContext.function = function;
 	invokeContext.arguments = arguments;
 	invokeContext.outResults = outResults;
-	invokeContext.invokeThunk = invokeThunk;
+	invokeContext.invokeThunk = getInvokeThunk(function);
+
+	// Capture call stacks for the exceptions created by the invoked code with the context's depth.
+	const Uptr contextExceptionCallStackDepth
+		= context->exceptionCallStackDepth.load(std::memory_order_relaxed);
+	ScopedExceptionCallStackDepth scopedExceptionCallStackDepth(contextExceptionCallStackDepth);
+
+	ScopedCPUTimeCharge scopedCPUTimeCharge(function);
+	ScopedInvokeCount scopedInvokeCount(context);
 
 	// Use unwindSignalsAsExceptions to ensure that any signal that occurs in WebAssembly code calls
 	// C++ destructors on the stack between here and where it is caught.
-	unwindSignalsAsExceptions([&invokeContext] {
-		ContextRuntimeData* contextRuntimeData = getContextRuntimeData(invokeContext.context);
-
-		// Call the invoke thunk.
-		(*invokeContext.invokeThunk)(invokeContext.function,
-									 contextRuntimeData,
-									 invokeContext.arguments,
-									 invokeContext.outResults);
-	});
+	unwindSignalsAsExceptions([&invokeContext] { callInvokeThunk(&invokeContext); });
+}
+
+Exception* Runtime::tryInvokeFunction(Context* context,
+									  const Function* function,
+									  FunctionType invokeSig,
+									  const UntaggedValue arguments[],
+									  UntaggedValue outResults[])
+{
+	if(Runtime::ExceptionType* exceptionType = checkInvoke(context, function, invokeSig, arguments))
+	{ return createException(exceptionType, nullptr, 0, captureExceptionCallStack(0)); }
+
+	InvokeContext invokeContext;
+	invokeContext.context = context;
+	invokeContext.function = function;
+	invokeContext.arguments = arguments;
+	invokeContext.outResults = outResults;
+	invokeContext.invokeThunk = getInvokeThunk(function);
+
+	const Uptr contextExceptionCallStackDepth
+		= context->exceptionCallStackDepth.load(std::memory_order_relaxed);
+	ScopedExceptionCallStackDepth scopedExceptionCallStackDepth(contextExceptionCallStackDepth);
+
+	ScopedCPUTimeCharge scopedCPUTimeCharge(function);
+	ScopedInvokeCount scopedInvokeCount(context);
+
+	// Traps in the WebAssembly code return to catchTraps without unwinding the stack. Runtime
+	// exceptions thrown by intrinsics or host functions still need to be caught here.
+	try
+	{
+		return catchTraps(callInvokeThunk, &invokeContext);
+	}
+	catch(Exception* exception)
+	{
+		return exception;
+	}
+}
+
+struct InvokeBatchContext
+{
+	Context* context;
+	const Function* function;
+	Uptr numInvokes;
+	const UntaggedValue* arguments;
+	UntaggedValue* outResults;
+	Uptr numCompletedInvokes;
+	InvokeBatchThunkPointer invokeBatchThunk;
+};
+
+static void callInvokeBatchThunk(void* invokeBatchContextVoid)
+{
+	InvokeBatchContext& invokeBatchContext = *(InvokeBatchContext*)invokeBatchContextVoid;
+	ContextRuntimeData* contextRuntimeData = getContextRuntimeData(invokeBatchContext.context);
+
+	// Call the batch invoke thunk, which loops over the calls in JIT code.
+	(*invokeBatchContext.invokeBatchThunk)(invokeBatchContext.function,
+										   contextRuntimeData,
+										   invokeBatchContext.arguments,
+										   invokeBatchContext.outResults,
+										   invokeBatchContext.numInvokes,
+										   &invokeBatchContext.numCompletedInvokes);
+}
+
+Exception* Runtime::tryInvokeFunctionBatch(Context* context,
+										   const Function* function,
+										   FunctionType invokeSig,
+										   Uptr numInvokes,
+										   const UntaggedValue arguments[],
+										   UntaggedValue outResults[],
+										   Uptr* outNumCompletedInvokes)
+{
+	if(outNumCompletedInvokes) { *outNumCompletedInvokes = 0; }
+	if(Runtime::ExceptionType* exceptionType
+	   = checkInvoke(context, function, invokeSig, arguments, numInvokes))
+	{ return createException(exceptionType, nullptr, 0, captureExceptionCallStack(0)); }
+
+	InvokeBatchContext invokeBatchContext;
+	invokeBatchContext.context = context;
+	invokeBatchContext.function = function;
+	invokeBatchContext.numInvokes = numInvokes;
+	invokeBatchContext.arguments = arguments;
+	invokeBatchContext.outResults = outResults;
+	invokeBatchContext.numCompletedInvokes = 0;
+	invokeBatchContext.invokeBatchThunk = getInvokeBatchThunk(function);
+
+	const Uptr contextExceptionCallStackDepth
+		= context->exceptionCallStackDepth.load(std::memory_order_relaxed);
+	ScopedExceptionCallStackDepth scopedExceptionCallStackDepth(contextExceptionCallStackDepth);
+
+	ScopedCPUTimeCharge scopedCPUTimeCharge(function);
+	ScopedInvokeCount scopedInvokeCount(context);
+
+	// Catch traps once for the whole batch.
+	Exception* exception;
+	try
+	{
+		exception = catchTraps(callInvokeBatchThunk, &invokeBatchContext);
+	}
+	catch(Exception* thrownException)
+	{
+		exception = thrownException;
+	}
+
+	WAVM_ASSERT(exception || invokeBatchContext.numCompletedInvokes == numInvokes);
+	if(outNumCompletedInvokes) { *outNumCompletedInvokes = invokeBatchContext.numCompletedInvokes; }
+	return exception;
+}
+
+void Runtime::invokeFunctionBatch(Context* context,
+								  const Function* function,
+								  FunctionType invokeSig,
+								  Uptr numInvokes,
+								  const UntaggedValue arguments[],
+								  UntaggedValue outResults[])
+{
+	if(Exception* exception = tryInvokeFunctionBatch(
+		   context, function, invokeSig, numInvokes, arguments, outResults))
+	{ throwException(exception); }
 }
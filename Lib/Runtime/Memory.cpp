@@ -8,8 +8,11 @@
 #include "WAVM/IR/IR.h"
 #include "WAVM/IR/Types.h"
 #include "WAVM/IR/Value.h"
+#include "WAVM/Inline/AddressRangeMap.h"
 #include "WAVM/Inline/Assert.h"
 #include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Timing.h"
+#include "WAVM/Logging/Logging.h"
 #include "WAVM/Platform/Intrinsic.h"
 #include "WAVM/Platform/RWMutex.h"
 #include "WAVM/Runtime/Runtime.h"
@@ -22,9 +25,42 @@ namespace WAVM { namespace Runtime {
 	WAVM_DEFINE_INTRINSIC_MODULE(wavmIntrinsicsMemory)
 }}
 
-// Global lists of memories; used to query whether an address is reserved by one of them.
+// Global map of the address ranges reserved by memories that aren't in the memory pool; used to
+// query whether an address is reserved by one of them.
 static Platform::RWMutex memoriesMutex;
-static std::vector<Memory*> memories;
+static AddressRangeMap<Memory*> memoryAddressRanges;
+
+// For 32-bit memories on a 64-bit runtime, allocate 8GB of address space for the memory. This
+// allows eliding bounds checks on memory accesses, since a 32-bit index + 32-bit offset will
+// always be within the reserved address-space.
+static constexpr Uptr memory32NumReservedBytes = Uptr(8) * 1024 * 1024 * 1024;
+static constexpr Uptr memoryPoolSlotNumBytes = memory32NumReservedBytes + memoryNumGuardBytes;
+
+static constexpr Uptr defaultMemoryPoolSize =
+#if WAVM_ENABLE_TSAN
+	0;
+#else
+	16;
+#endif
+
+// A pool of address-space reservations for 32-bit memories. The pool reserves its slots as a
+// single contiguous range of address space, so the memory that owns an address in the pool can be
+// found by dividing the address's offset by the slot size. Freed slots are decommitted instead of
+// unmapped, and reused by the next memory. The pool is protected by memoriesMutex.
+struct MemoryPool
+{
+	Uptr maxSlots = defaultMemoryPoolSize;
+	bool reservationFailed = false;
+
+	U8* baseAddress = nullptr;
+	Uptr numSlots = 0;
+	std::vector<Memory*> slotMemories;
+	std::vector<Uptr> freeSlots;
+
+	U64 numHits = 0;
+	U64 numMisses = 0;
+};
+static MemoryPool memoryPool;
 
 static constexpr U64 maxMemory64WASMPages =
 #if WAVM_ENABLE_TSAN
@@ -39,36 +75,118 @@ static Uptr getPlatformPagesPerWebAssemblyPageLog2()
 	return IR::numBytesPerPageLog2 - Platform::getBytesPerPageLog2();
 }
 
-static Memory* createMemoryImpl(Compartment* compartment,
-								IR::MemoryType type,
-								std::string&& debugName,
-								ResourceQuotaRefParam resourceQuota)
+// Allocates a slot from the memory pool, reserving the pool's address space if it hasn't been yet.
+// Returns null if the pool has no free slots.
+static U8* allocateMemoryPoolSlot(Uptr& outSlotIndex)
 {
-	Memory* memory = new Memory(compartment, type, std::move(debugName), resourceQuota);
+	Platform::RWMutex::ExclusiveLock memoriesLock(memoriesMutex);
 
-	const Uptr pageBytesLog2 = Platform::getBytesPerPageLog2();
+	if(!memoryPool.baseAddress && memoryPool.maxSlots && !memoryPool.reservationFailed)
+	{
+		const Uptr numPoolPages
+			= (memoryPool.maxSlots * memoryPoolSlotNumBytes) >> Platform::getBytesPerPageLog2();
+		memoryPool.baseAddress = Platform::allocateVirtualPages(numPoolPages);
+		if(!memoryPool.baseAddress)
+		{
+			Log::printf(Log::debug,
+						"Failed to reserve address space for a pool of %" WAVM_PRIuPTR
+						" memories.\n",
+						memoryPool.maxSlots);
+			memoryPool.reservationFailed = true;
+		}
+		else
+		{
+			memoryPool.numSlots = memoryPool.maxSlots;
+			memoryPool.slotMemories.assign(memoryPool.numSlots, nullptr);
+
+			// Add the slots to the free list in reverse order, so the lowest slots are used first.
+			memoryPool.freeSlots.clear();
+			for(Uptr slotIndex = memoryPool.numSlots; slotIndex > 0; --slotIndex)
+			{ memoryPool.freeSlots.push_back(slotIndex - 1); }
+		}
+	}
 
-	Uptr memoryMaxPages;
+	if(memoryPool.freeSlots.empty())
+	{
+		++memoryPool.numMisses;
+		return nullptr;
+	}
+
+	++memoryPool.numHits;
+	outSlotIndex = memoryPool.freeSlots.back();
+	memoryPool.freeSlots.pop_back();
+	WAVM_ASSERT(!memoryPool.slotMemories[outSlotIndex]);
+	return memoryPool.baseAddress + outSlotIndex * memoryPoolSlotNumBytes;
+}
+
+// Returns the number of bytes of address space to reserve for a memory that is accessed by code
+// compiled with boundsCheckMode.
+static Uptr getMemoryNumReservedBytes(IR::MemoryType type,
+									  LLVMJIT::BoundsCheckMode boundsCheckMode)
+{
 	if(type.indexType == IR::IndexType::i32)
 	{
 		static_assert(sizeof(Uptr) == 8, "WAVM's runtime requires a 64-bit host");
+		switch(boundsCheckMode)
+		{
+		case LLVMJIT::BoundsCheckMode::guardPages: return memory32NumReservedBytes;
+
+		// Reserve the 4GB that a 32-bit index can address, plus the offsets that are smaller than
+		// the guard region. Accesses with larger offsets are clamped to the end of the reservation.
+		case LLVMJIT::BoundsCheckMode::reducedReservation:
+			return (Uptr(IR::maxMemory32Pages) << IR::numBytesPerPageLog2) + memoryNumGuardBytes;
 
-		// For 32-bit memories on a 64-bit runtime, allocate 8GB of address space for the memory.
-		// This allows eliding bounds checks on memory accesses, since a 32-bit index + 32-bit
-		// offset will always be within the reserved address-space.
-		memoryMaxPages = (Uptr(8) * 1024 * 1024 * 1024) >> pageBytesLog2;
+		// Only reserve the memory's maximum size: accesses outside it are clamped or trapped.
+		case LLVMJIT::BoundsCheckMode::clamp:
+		case LLVMJIT::BoundsCheckMode::explicitChecks:
+			return Uptr(std::min(type.size.max, IR::maxMemory32Pages)) << IR::numBytesPerPageLog2;
+
+		default: WAVM_UNREACHABLE();
+		};
 	}
 	else
 	{
 		// Clamp the maximum size of 64-bit memories to maxMemory64Bytes.
-		memoryMaxPages = std::min(type.size.max, maxMemory64WASMPages);
+		return Uptr(std::min(type.size.max, maxMemory64WASMPages)) << IR::numBytesPerPageLog2;
+	}
+}
 
-		// Convert maxMemoryPages from fixed size WASM pages (64KB) to platform-specific pages.
-		memoryMaxPages <<= getPlatformPagesPerWebAssemblyPageLog2();
+Uptr Runtime::getMinMemoryReservedBytes(IR::MemoryType type,
+										LLVMJIT::BoundsCheckMode boundsCheckMode)
+{
+	// Code that elides bounds checks for 32-bit memories requires the memory to reserve the
+	// addresses it may access. Otherwise, the code clamps addresses to the memory's own
+	// reservation, so any memory may be used.
+	if(type.indexType == IR::IndexType::i32
+	   && (boundsCheckMode == LLVMJIT::BoundsCheckMode::guardPages
+		   || boundsCheckMode == LLVMJIT::BoundsCheckMode::reducedReservation))
+	{ return getMemoryNumReservedBytes(type, boundsCheckMode); }
+	else
+	{
+		return 0;
 	}
+}
+
+static Memory* createMemoryImpl(Compartment* compartment,
+								IR::MemoryType type,
+								std::string&& debugName,
+								ResourceQuotaRefParam resourceQuota,
+								Uptr numReservedBytes)
+{
+	Memory* memory = new Memory(compartment, type, std::move(debugName), resourceQuota);
+
+	const Uptr pageBytesLog2 = Platform::getBytesPerPageLog2();
+	const Uptr memoryMaxPages = numReservedBytes >> pageBytesLog2;
+	WAVM_ASSERT(!(numReservedBytes & ((Uptr(1) << pageBytesLog2) - 1)));
+
+	// Try to allocate the address space for 32-bit memories that reserve the full 8GB from the
+	// pool.
+	if(type.indexType == IR::IndexType::i32 && numReservedBytes == memory32NumReservedBytes)
+	{ memory->baseAddress = allocateMemoryPoolSlot(memory->poolSlotIndex); }
 
 	const Uptr numGuardPages = memoryNumGuardBytes >> pageBytesLog2;
-	memory->baseAddress = Platform::allocateVirtualPages(memoryMaxPages + numGuardPages);
+	if(!memory->baseAddress)
+	{ memory->baseAddress = Platform::allocateVirtualPages(memoryMaxPages + numGuardPages); }
 	memory->numReservedBytes = memoryMaxPages << pageBytesLog2;
 	if(!memory->baseAddress)
 	{
@@ -83,10 +201,19 @@ static Memory* createMemoryImpl(Compartment* compartment,
 		return nullptr;
 	}
 
-	// Add the memory to the global array.
+	// Add the memory to the global array, or to the pool slot it was allocated from.
 	{
 		Platform::RWMutex::ExclusiveLock memoriesLock(memoriesMutex);
-		memories.push_back(memory);
+		if(memory->poolSlotIndex != UINTPTR_MAX)
+		{ memoryPool.slotMemories[memory->poolSlotIndex] = memory; }
+		else
+		{
+			memoryAddressRanges.addOrFail(
+				reinterpret_cast<Uptr>(memory->baseAddress),
+				reinterpret_cast<Uptr>(memory->baseAddress) + memory->numReservedBytes
+					+ memoryNumGuardBytes,
+				memory);
+		}
 	}
 
 	return memory;
@@ -96,9 +223,28 @@ Memory* Runtime::createMemory(Compartment* compartment,
 							  IR::MemoryType type,
 							  std::string&& debugName,
 							  ResourceQuotaRefParam resourceQuota)
+{
+	// Memories created by the embedder may be imported by modules compiled with any bounds-check
+	// mode, so reserve the address space that the guardPages mode requires.
+	return createMemory(compartment,
+						type,
+						std::move(debugName),
+						resourceQuota,
+						LLVMJIT::BoundsCheckMode::guardPages);
+}
+
+Memory* Runtime::createMemory(Compartment* compartment,
+							  IR::MemoryType type,
+							  std::string&& debugName,
+							  ResourceQuotaRefParam resourceQuota,
+							  LLVMJIT::BoundsCheckMode boundsCheckMode)
 {
 	WAVM_ASSERT(type.size.min <= UINTPTR_MAX);
-	Memory* memory = createMemoryImpl(compartment, type, std::move(debugName), resourceQuota);
+	Memory* memory = createMemoryImpl(compartment,
+									  type,
+									  std::move(debugName),
+									  resourceQuota,
+									  getMemoryNumReservedBytes(type, boundsCheckMode));
 	if(!memory) { return nullptr; }
 
 	// Add the memory to the compartment's memories IndexMap.
@@ -121,17 +267,105 @@ Memory* Runtime::createMemory(Compartment* compartment,
 	return memory;
 }
 
-Memory* Runtime::cloneMemory(Memory* memory, Compartment* newCompartment)
+// Returns the number of invokes that have been started on a compartment's contexts, or UINT64_MAX
+// if code is running on any of them. The caller must hold the compartment's mutex.
+static U64 getCompartmentNumInvokes(const Compartment* compartment)
+{
+	U64 numInvokes = compartment->numDestroyedContextInvokes;
+	for(const Context* context : compartment->contexts)
+	{
+		const U64 numReturnedInvokes = context->numReturnedInvokes.load(std::memory_order_acquire);
+		const U64 numStartedInvokes = context->numStartedInvokes.load(std::memory_order_relaxed);
+		if(numStartedInvokes != numReturnedInvokes) { return UINT64_MAX; }
+		numInvokes += numStartedInvokes;
+	}
+	return numInvokes;
+}
+
+// Gets a snapshot of a memory's first numPlatformPages platform pages to map its clones from. If
+// the pages are all mapped from the memory's snapshot, and none of them have been written since,
+// the snapshot is reused. Otherwise, a new snapshot is created, and outIsNewSnapshot is set.
+static std::shared_ptr<Platform::MemorySnapshot> getCloneSnapshot(Memory* memory,
+																  Uptr numPlatformPages,
+																  bool& outIsNewSnapshot)
+{
+	outIsNewSnapshot = false;
+
+	Uptr numCopiedPages = 0;
+	if(memory->snapshot && memory->numSnapshotPages == numPlatformPages
+	   && Platform::getNumCopiedSnapshotPages(
+		   memory->baseAddress, numPlatformPages, numCopiedPages)
+	   && numCopiedPages == 0)
+	{ return memory->snapshot; }
+
+	Timing::Timer snapshotTimer;
+	Platform::MemorySnapshot* snapshot
+		= Platform::createMemorySnapshot(memory->baseAddress, numPlatformPages);
+	if(!snapshot) { return nullptr; }
+	Timing::logTimer("Created memory snapshot", snapshotTimer);
+
+	outIsNewSnapshot = true;
+	return std::shared_ptr<Platform::MemorySnapshot>(snapshot, &Platform::destroyMemorySnapshot);
+}
+
+Memory* Runtime::cloneMemory(Memory* memory,
+							 Compartment* newCompartment,
+							 MemoryCloneMode memoryCloneMode)
 {
 	Platform::RWMutex::ExclusiveLock resizingLock(memory->resizingMutex);
 	const IR::MemoryType memoryType = getMemoryType(memory);
 	std::string debugName = memory->debugName;
-	Memory* newMemory
-		= createMemoryImpl(newCompartment, memoryType, std::move(debugName), memory->resourceQuota);
+	Memory* newMemory = createMemoryImpl(newCompartment,
+										 memoryType,
+										 std::move(debugName),
+										 memory->resourceQuota,
+										 memory->numReservedBytes);
 	if(!newMemory) { return nullptr; }
 
 	// Copy the memory contents to the new memory.
-	memcpy(newMemory->baseAddress, memory->baseAddress, memoryType.size.min * IR::numBytesPerPage);
+	const Uptr numPlatformPages = memoryType.size.min << getPlatformPagesPerWebAssemblyPageLog2();
+	const Uptr numBytes = memoryType.size.min * IR::numBytesPerPage;
+	const U64 numInvokes = getCompartmentNumInvokes(memory->compartment);
+	std::shared_ptr<Platform::MemorySnapshot> cloneSnapshot;
+	bool isNewSnapshot = false;
+	if(memoryCloneMode == MemoryCloneMode::copyOnWrite && numPlatformPages)
+	{ cloneSnapshot = getCloneSnapshot(memory, numPlatformPages, isNewSnapshot); }
+
+	// Map the new memory's pages from the snapshot of the original memory. If the snapshot
+	// couldn't be created or mapped, copy the original memory's contents instead.
+	if(!cloneSnapshot
+	   || !Platform::mapMemorySnapshot(
+		   cloneSnapshot.get(), newMemory->baseAddress, numPlatformPages))
+	{ memcpy(newMemory->baseAddress, memory->baseAddress, numBytes); }
+	else
+	{
+		newMemory->snapshot = cloneSnapshot;
+		newMemory->numSnapshotPages = numPlatformPages;
+
+		// Remap the original memory from a new snapshot, so writing it copies the written pages
+		// instead of modifying the snapshot, and later clones can share the snapshot. Code running
+		// in the compartment could write the memory after it was copied to the snapshot, and
+		// remapping the memory would lose the write, so only remap it if no code has been invoked
+		// in the compartment since the snapshot was created.
+		if(isNewSnapshot && numInvokes != UINT64_MAX
+		   && getCompartmentNumInvokes(memory->compartment) == numInvokes)
+		{
+			if(Platform::mapMemorySnapshot(
+				   cloneSnapshot.get(), memory->baseAddress, numPlatformPages))
+			{
+				memory->snapshot = std::move(cloneSnapshot);
+				memory->numSnapshotPages = numPlatformPages;
+			}
+			else
+			{
+				// The original memory's pages were zeroed, so copy its contents back from the new
+				// memory, which has the same contents.
+				memcpy(memory->baseAddress, newMemory->baseAddress, numBytes);
+				memory->snapshot.reset();
+				memory->numSnapshotPages = 0;
+			}
+		}
+	}
 
 	resizingLock.unlock();
 
@@ -168,27 +402,41 @@ Runtime::Memory::~Memory()
 		runtimeData.endAddress = 0;
 	}
 
-	// Remove the memory from the global array.
+	const Uptr pageBytesLog2 = Platform::getBytesPerPageLog2();
+	if(poolSlotIndex != UINTPTR_MAX)
 	{
-		Platform::RWMutex::ExclusiveLock memoriesLock(memoriesMutex);
-		for(Uptr memoryIndex = 0; memoryIndex < memories.size(); ++memoryIndex)
+		// Decommit the memory's pages, and return its slot to the pool.
+		if(numPages)
 		{
-			if(memories[memoryIndex] == this)
-			{
-				memories.erase(memories.begin() + memoryIndex);
-				break;
-			}
+			const Uptr numPlatformPages = numPages << getPlatformPagesPerWebAssemblyPageLog2();
+			Platform::decommitVirtualPages(baseAddress, numPlatformPages);
+			Platform::deregisterVirtualAllocation(numPlatformPages);
 		}
-	}
 
-	// Free the virtual address space.
-	const Uptr pageBytesLog2 = Platform::getBytesPerPageLog2();
-	if(baseAddress && numReservedBytes > 0)
+		Platform::RWMutex::ExclusiveLock memoriesLock(memoriesMutex);
+		memoryPool.slotMemories[poolSlotIndex] = nullptr;
+		memoryPool.freeSlots.push_back(poolSlotIndex);
+	}
+	else
 	{
-		Platform::freeVirtualPages(baseAddress,
-								   (numReservedBytes + memoryNumGuardBytes) >> pageBytesLog2);
+		// Remove the memory's address range from the global map.
+		if(baseAddress)
+		{
+			Platform::RWMutex::ExclusiveLock memoriesLock(memoriesMutex);
+			memoryAddressRanges.remove(
+				reinterpret_cast<Uptr>(baseAddress),
+				reinterpret_cast<Uptr>(baseAddress) + numReservedBytes + memoryNumGuardBytes);
+		}
 
-		Platform::deregisterVirtualAllocation(numPages >> pageBytesLog2);
+		// Free the virtual address space.
+		if(baseAddress && numReservedBytes > 0)
+		{
+			Platform::freeVirtualPages(baseAddress,
+									   (numReservedBytes + memoryNumGuardBytes) >> pageBytesLog2);
+
+			Platform::deregisterVirtualAllocation(numPages
+												  << getPlatformPagesPerWebAssemblyPageLog2());
+		}
 	}
 
 	// Free the allocated quota.
@@ -197,21 +445,30 @@ Runtime::Memory::~Memory()
 
 bool Runtime::isAddressOwnedByMemory(U8* address, Memory*& outMemory, Uptr& outMemoryAddress)
 {
-	// Iterate over all memories and check if the address is within the reserved address space for
-	// each.
 	Platform::RWMutex::ShareableLock memoriesLock(memoriesMutex);
-	for(auto memory : memories)
+
+	// If the address is in the memory pool, look up the memory that owns the address's slot.
+	if(address >= memoryPool.baseAddress
+	   && address < memoryPool.baseAddress + memoryPool.numSlots * memoryPoolSlotNumBytes)
 	{
-		U8* startAddress = memory->baseAddress;
-		U8* endAddress = memory->baseAddress + memory->numReservedBytes + memoryNumGuardBytes;
-		if(address >= startAddress && address < endAddress)
-		{
-			outMemory = memory;
-			outMemoryAddress = address - startAddress;
-			return true;
-		}
+		const Uptr poolOffset = Uptr(address - memoryPool.baseAddress);
+		Memory* memory = memoryPool.slotMemories[poolOffset / memoryPoolSlotNumBytes];
+		if(!memory) { return false; }
+
+		outMemory = memory;
+		outMemoryAddress = poolOffset % memoryPoolSlotNumBytes;
+		return true;
 	}
-	return false;
+
+	// Otherwise, find the memory whose reserved address range contains the address.
+	Uptr startAddress = 0;
+	Memory* const* memory
+		= memoryAddressRanges.get(reinterpret_cast<Uptr>(address), &startAddress);
+	if(!memory) { return false; }
+
+	outMemory = *memory;
+	outMemoryAddress = reinterpret_cast<Uptr>(address) - startAddress;
+	return true;
 }
 
 Uptr Runtime::getMemoryNumPages(const Memory* memory)
@@ -279,6 +536,14 @@ void Runtime::unmapMemoryPages(Memory* memory, Uptr pageIndex, Uptr numPages)
 	WAVM_ASSERT(pageIndex + numPages > pageIndex);
 	WAVM_ASSERT((pageIndex + numPages) * IR::numBytesPerPage <= memory->numReservedBytes);
 
+	// Decommitting pages that were mapped from a snapshot changes the memory's contents without
+	// copying the pages, so the pages that are still mapped from the snapshot can't be counted.
+	{
+		Platform::RWMutex::ExclusiveLock resizingLock(memory->resizingMutex);
+		memory->snapshot.reset();
+		memory->numSnapshotPages = 0;
+	}
+
 	// Decommit the pages.
 	Platform::decommitVirtualPages(memory->baseAddress + pageIndex * IR::numBytesPerPage,
 								   numPages << getPlatformPagesPerWebAssemblyPageLog2());
@@ -286,6 +551,56 @@ void Runtime::unmapMemoryPages(Memory* memory, Uptr pageIndex, Uptr numPages)
 	Platform::deregisterVirtualAllocation(numPages << getPlatformPagesPerWebAssemblyPageLog2());
 }
 
+MemoryCopyOnWriteStats Runtime::getMemoryCopyOnWriteStats(const Memory* memory)
+{
+	Platform::RWMutex::ShareableLock resizingLock(memory->resizingMutex);
+
+	MemoryCopyOnWriteStats stats;
+	if(memory->snapshot)
+	{
+		stats.numSnapshotPages = memory->numSnapshotPages;
+		if(!Platform::getNumCopiedSnapshotPages(
+			   memory->baseAddress, memory->numSnapshotPages, stats.numCopiedPages))
+		{ stats.numCopiedPages = UINTPTR_MAX; }
+	}
+	return stats;
+}
+
+MemoryPoolStats Runtime::getMemoryPoolStats()
+{
+	Platform::RWMutex::ShareableLock memoriesLock(memoriesMutex);
+
+	MemoryPoolStats stats;
+	stats.numSlots = memoryPool.maxSlots;
+	stats.numAllocatedSlots = memoryPool.numSlots - memoryPool.freeSlots.size();
+	stats.numHits = memoryPool.numHits;
+	stats.numMisses = memoryPool.numMisses;
+	return stats;
+}
+
+bool Runtime::setMemoryPoolSize(Uptr numSlots)
+{
+	Platform::RWMutex::ExclusiveLock memoriesLock(memoriesMutex);
+	if(memoryPool.freeSlots.size() != memoryPool.numSlots) { return false; }
+
+	// Free the pool's current reservation; it will be reserved with the new size the next time a
+	// memory is created.
+	if(memoryPool.baseAddress)
+	{
+		Platform::freeVirtualPages(
+			memoryPool.baseAddress,
+			(memoryPool.numSlots * memoryPoolSlotNumBytes) >> Platform::getBytesPerPageLog2());
+		memoryPool.baseAddress = nullptr;
+		memoryPool.numSlots = 0;
+		memoryPool.slotMemories.clear();
+		memoryPool.freeSlots.clear();
+	}
+
+	memoryPool.maxSlots = numSlots;
+	memoryPool.reservationFailed = false;
+	return true;
+}
+
 U8* Runtime::getMemoryBaseAddress(Memory* memory) { return memory->baseAddress; }
 
 static U8* getValidatedMemoryOffsetRangeImpl(Memory* memory,
@@ -329,6 +644,24 @@ U8* Runtime::getValidatedMemoryOffsetRange(Memory* memory, Uptr address, Uptr nu
 		numBytes);
 }
 
+bool Runtime::mapMemoryImage(Memory* memory, const MemoryImage& memoryImage)
+{
+	Platform::RWMutex::ExclusiveLock resizingLock(memory->resizingMutex);
+	WAVM_ASSERT(!memory->snapshot);
+	WAVM_ASSERT(memoryImage.numPlatformPages
+				<= memory->numPages.load(std::memory_order_acquire)
+					   << getPlatformPagesPerWebAssemblyPageLog2());
+
+	// Map the image's pages copy-on-write, and remember the snapshot they are mapped from, so
+	// cloning the memory can reuse it if none of the pages have been written.
+	if(!Platform::mapMemorySnapshot(
+		   memoryImage.snapshot.get(), memory->baseAddress, memoryImage.numPlatformPages))
+	{ return false; }
+	memory->snapshot = memoryImage.snapshot;
+	memory->numSnapshotPages = memoryImage.numPlatformPages;
+	return true;
+}
+
 void Runtime::initDataSegment(Instance* instance,
 							  Uptr dataSegmentIndex,
 							  const std::vector<U8>* dataVector,
@@ -430,12 +763,15 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wavmIntrinsics,
 							   Uptr memoryNumBytes,
 							   Uptr memoryId)
 {
-	Compartment* compartment = getCompartmentFromContextRuntimeData(contextRuntimeData);
-	Platform::RWMutex::ShareableLock compartmentLock(compartment->mutex);
-	Memory* memory = compartment->memories[memoryId];
-	compartmentLock.unlock();
+	Memory* memory;
+	{
+		Compartment* compartment = getCompartmentFromContextRuntimeData(contextRuntimeData);
+		Platform::RWMutex::ShareableLock compartmentLock(compartment->mutex);
+		memory = compartment->memories[memoryId];
+	}
 
 	const U64 outOfBoundsAddress = U64(address) > memoryNumBytes ? U64(address) : memoryNumBytes;
 
-	throwException(ExceptionTypes::outOfBoundsMemoryAccess, {memory, outOfBoundsAddress});
+	IR::UntaggedValue exceptionArguments[2] = {memory, outOfBoundsAddress};
+	trap(ExceptionTypes::outOfBoundsMemoryAccess, exceptionArguments, 2);
 }
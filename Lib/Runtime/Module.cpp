@@ -1,13 +1,26 @@
 #include "WAVM/IR/Module.h"
+#include <string.h>
+#include <algorithm>
+#include <atomic>
 #include <memory>
 #include <utility>
+#include <vector>
 #include "RuntimePrivate.h"
+#include "WAVM/IR/FeatureSpec.h"
 #include "WAVM/IR/IR.h"
+#include "WAVM/IR/Types.h"
 #include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Hash.h"
+#include "WAVM/Inline/Serialization.h"
 #include "WAVM/Inline/Timing.h"
 #include "WAVM/LLVMJIT/LLVMJIT.h"
+#include "WAVM/Logging/Logging.h"
+#include "WAVM/Platform/Event.h"
 #include "WAVM/Platform/Intrinsic.h"
+#include "WAVM/Platform/Memory.h"
+#include "WAVM/Platform/Mutex.h"
 #include "WAVM/Platform/RWMutex.h"
+#include "WAVM/Platform/Thread.h"
 #include "WAVM/Runtime/Runtime.h"
 #include "WAVM/WASM/WASM.h"
 
@@ -30,16 +43,92 @@ static std::shared_ptr<ObjectCacheInterface> getGlobalObjectCache()
 	return globalObjectCache;
 }
 
+// Creates the key that identifies a module's object code in the object cache.
+static ObjectCacheKey getObjectCacheKey(const U8* wasmBytes,
+										Uptr numWASMBytes,
+										const IR::FeatureSpec& featureSpec,
+										const LLVMJIT::CompileOptions& compileOptions)
+{
+	ObjectCacheKey key;
+	key.wasmBytes = wasmBytes;
+	key.numWASMBytes = numWASMBytes;
+
+	// Serialize the compile options that change the object code. numThreads only changes how the
+	// module is partitioned for compilation, so object code compiled with any number of threads
+	// may be shared.
+	Serialization::ArrayOutputStream configStream;
+	U64 optimizationLevel = U64(compileOptions.optimizationLevel);
+	U64 boundsCheckMode = U64(compileOptions.boundsCheckMode);
+	U64 devirtualizeIndirectCalls = U64(compileOptions.devirtualizeIndirectCalls);
+	U64 meterFuel = U64(compileOptions.meterFuel);
+	U64 tierUp = U64(compileOptions.tierUp);
+	serialize(configStream, optimizationLevel);
+	serialize(configStream, boundsCheckMode);
+	serialize(configStream, devirtualizeIndirectCalls);
+	serialize(configStream, meterFuel);
+	serialize(configStream, tierUp);
+
+	// A profile changes the object code, so serialize a hash of it, or 0 if there isn't one.
+	U64 profileHash = 0;
+	if(compileOptions.profile)
+	{
+		const LLVMJIT::ModuleProfile& profile = *compileOptions.profile;
+		profileHash = XXH<U64>(&profile.moduleHash, sizeof(profile.moduleHash), 1);
+		profileHash = XXH<U64>(
+			profile.counters.data(), profile.counters.size() * sizeof(U64), profileHash);
+	}
+	serialize(configStream, profileHash);
+
+	// Serialize the feature spec: loadBinaryModule skips validating the function bodies of a module
+	// whose object code is cached, so the object code may only be used for modules that are loaded
+	// with the same features.
+#define VISIT_FEATURE(name, ...)                                                                   \
+	U64 name = U64(featureSpec.name);                                                              \
+	serialize(configStream, name);
+	WAVM_ENUM_FEATURES(VISIT_FEATURE)
+#undef VISIT_FEATURE
+	U64 maxLocals = U64(featureSpec.maxLocals);
+	U64 maxLabelsPerFunction = U64(featureSpec.maxLabelsPerFunction);
+	U64 maxDataSegments = U64(featureSpec.maxDataSegments);
+	serialize(configStream, maxLocals);
+	serialize(configStream, maxLabelsPerFunction);
+	serialize(configStream, maxDataSegments);
+
+	key.configBytes = configStream.getBytes();
+
+	return key;
+}
+
+// The compiled code increments the counters as plain U64s.
+static_assert(sizeof(std::atomic<U64>) == sizeof(U64), "std::atomic<U64> must be a plain U64");
+
+static void allocateProfileCounters(Runtime::Module& module)
+{
+	// Value-initializing the atomics zeroes them.
+	module.profileCounters = std::make_shared<std::vector<std::atomic<U64>>>(
+		LLVMJIT::getNumProfileCounters(module.ir));
+}
+
 ModuleRef Runtime::compileModule(const IR::Module& irModule)
+{
+	return compileModule(irModule, LLVMJIT::CompileOptions());
+}
+
+ModuleRef Runtime::compileModule(const IR::Module& irModule,
+								 const LLVMJIT::CompileOptions& compileOptions)
 {
 	// Get a pointer to the global object cache, if there is one.
 	std::shared_ptr<ObjectCacheInterface> objectCache = getGlobalObjectCache();
 
 	std::vector<U8> objectCode;
-	if(!objectCache)
+	if(!objectCache || compileOptions.optimizationLevel == LLVMJIT::OptimizationLevel::none
+	   || compileOptions.instrumentProfile)
 	{
-		// If there's no global object cache, just compile the module.
-		objectCode = LLVMJIT::compileModule(irModule, LLVMJIT::getHostTargetSpec());
+		// If there's no global object cache, just compile the module. Baseline and instrumented
+		// object code isn't cached: a cached baseline or instrumented object would otherwise be
+		// used in place of the optimized object code for the module.
+		objectCode
+			= LLVMJIT::compileModule(irModule, LLVMJIT::getHostTargetSpec(), compileOptions);
 	}
 	else
 	{
@@ -49,13 +138,20 @@ ModuleRef Runtime::compileModule(const IR::Module& irModule)
 		Timing::logTimer("Created object cache key from IR module", keyTimer);
 
 		// Check for cached object code for the module before compiling it.
-		objectCode
-			= objectCache->getCachedObject(wasmBytes.data(), wasmBytes.size(), [&irModule]() {
-				  return LLVMJIT::compileModule(irModule, LLVMJIT::getHostTargetSpec());
-			  });
+		objectCode = objectCache->getCachedObject(
+			getObjectCacheKey(
+				wasmBytes.data(), wasmBytes.size(), irModule.featureSpec, compileOptions),
+			[&irModule, &compileOptions]() {
+				return LLVMJIT::compileModule(
+					irModule, LLVMJIT::getHostTargetSpec(), compileOptions);
+			});
 	}
 
-	return std::make_shared<Runtime::Module>(IR::Module(irModule), std::move(objectCode));
+	ModuleRef module
+		= std::make_shared<Runtime::Module>(IR::Module(irModule), std::move(objectCode));
+	module->compileOptions = compileOptions;
+	if(compileOptions.instrumentProfile) { allocateProfileCounters(*module); }
+	return module;
 }
 
 bool Runtime::loadBinaryModule(const U8* wasmBytes,
@@ -64,36 +160,396 @@ bool Runtime::loadBinaryModule(const U8* wasmBytes,
 							   const IR::FeatureSpec& featureSpec,
 							   WASM::LoadError* outError)
 {
-	// Load the module IR.
-	IR::Module irModule(std::move(featureSpec));
-	if(!WASM::loadBinaryModule(wasmBytes, numWASMBytes, irModule, outError)) { return false; }
+	return loadBinaryModule(
+		wasmBytes, numWASMBytes, outModule, featureSpec, LLVMJIT::CompileOptions(), outError);
+}
 
+bool Runtime::loadBinaryModule(const U8* wasmBytes,
+							   Uptr numWASMBytes,
+							   ModuleRef& outModule,
+							   const IR::FeatureSpec& featureSpec,
+							   const LLVMJIT::CompileOptions& compileOptions,
+							   WASM::LoadError* outError)
+{
 	// Get a pointer to the global object cache, if there is one.
 	std::shared_ptr<ObjectCacheInterface> objectCache = getGlobalObjectCache();
+	const bool useObjectCache
+		= objectCache && compileOptions.optimizationLevel != LLVMJIT::OptimizationLevel::none
+		  && !compileOptions.instrumentProfile;
 
+	IR::Module irModule(std::move(featureSpec));
 	std::vector<U8> objectCode;
-	if(!objectCache)
+	if(!useObjectCache)
 	{
-		// If there's no global object cache, just compile the module.
-		objectCode = LLVMJIT::compileModule(irModule, LLVMJIT::getHostTargetSpec());
+		// If there's no global object cache, just load and compile the module. Baseline and
+		// instrumented object code isn't cached: a cached baseline or instrumented object would
+		// otherwise be used in place of the optimized object code for the module.
+		if(!WASM::loadBinaryModule(wasmBytes, numWASMBytes, irModule, outError)) { return false; }
+		objectCode
+			= LLVMJIT::compileModule(irModule, LLVMJIT::getHostTargetSpec(), compileOptions);
 	}
 	else
 	{
-		// Check for cached object code for the module before compiling it.
-		objectCode = objectCache->getCachedObject(wasmBytes, numWASMBytes, [&irModule]() {
-			return LLVMJIT::compileModule(irModule, LLVMJIT::getHostTargetSpec());
-		});
+		// Probe the object cache before loading the module IR. Object code is only cached for
+		// valid modules, so if the module's object code is cached, its function bodies don't need
+		// to be validated again. If it isn't cached, compile the module and add it to the cache,
+		// unless another thread or process adds it to the cache first.
+		if(!objectCache->loadCachedObject(
+			   getObjectCacheKey(wasmBytes, numWASMBytes, featureSpec, compileOptions),
+			   [&](bool isCached) {
+				   return WASM::loadBinaryModule(
+					   wasmBytes, numWASMBytes, irModule, outError, !isCached);
+			   },
+			   [&irModule, &compileOptions]() {
+				   return LLVMJIT::compileModule(
+					   irModule, LLVMJIT::getHostTargetSpec(), compileOptions);
+			   },
+			   objectCode))
+		{ return false; }
 	}
 
 	outModule = std::make_shared<Runtime::Module>(std::move(irModule), std::move(objectCode));
+	outModule->compileOptions = compileOptions;
+	if(compileOptions.instrumentProfile) { allocateProfileCounters(*outModule); }
+	return true;
+}
+
+std::shared_ptr<const std::vector<U8>> Runtime::Module::getObjectCode() const
+{
+	Platform::Mutex::Lock lock(mutex);
+	return objectCode;
+}
+
+void Runtime::Module::setOptimizedObjectCode(std::vector<U8>&& newObjectCode) const
+{
+	std::shared_ptr<const std::vector<U8>> newObjectCodeRef
+		= std::make_shared<std::vector<U8>>(std::move(newObjectCode));
+
+	Platform::Mutex::Lock lock(mutex);
+	objectCode = std::move(newObjectCodeRef);
+	hasOptimizedObjectCode = true;
+}
+
+std::shared_ptr<const std::vector<U8>> Runtime::Module::getOptimizedObjectCode() const
+{
+	Platform::Mutex::Lock lock(mutex);
+	return hasOptimizedObjectCode ? objectCode : nullptr;
+}
+
+struct BackgroundOptimizationState
+{
+	ModuleConstRef module;
+	LLVMJIT::CompileOptions compileOptions;
+	std::shared_ptr<ObjectCacheInterface> objectCache;
+};
+
+// Counts the running background optimization threads. They are detached, so releasing a module
+// doesn't wait for its optimization to finish, but the process waits for them to exit before it
+// destroys the global state they use.
+struct BackgroundOptimizationThreads
+{
+	std::atomic<Uptr> numThreads{0};
+
+	~BackgroundOptimizationThreads()
+	{
+		// Nothing signals the event: it's just used to sleep between polls.
+		Platform::Event pollEvent;
+		while(numThreads.load(std::memory_order_acquire))
+		{ pollEvent.wait(Time{I128(1000000)}); };
+	}
+};
+
+static BackgroundOptimizationThreads& getBackgroundOptimizationThreads()
+{
+	static BackgroundOptimizationThreads backgroundOptimizationThreads;
+	return backgroundOptimizationThreads;
+}
+
+static void optimizeModule(const BackgroundOptimizationState& state)
+{
+	// If the thread holds the only reference to the module, it was released before its
+	// optimization started, so skip it.
+	if(state.module.use_count() == 1)
+	{
+		Log::printf(Log::debug, "Skipped optimizing a module that was released.\n");
+		return;
+	}
+
+	const IR::Module& irModule = state.module->ir;
+	const LLVMJIT::CompileOptions& compileOptions = state.compileOptions;
+
+	Timing::Timer optimizationTimer;
+	std::vector<U8> objectCode;
+	if(!state.objectCache || compileOptions.instrumentProfile)
+	{
+		// Instrumented object code isn't cached, since the object cache key doesn't distinguish it
+		// from the uninstrumented object code for the module.
+		objectCode
+			= LLVMJIT::compileModule(irModule, LLVMJIT::getHostTargetSpec(), compileOptions);
+	}
+	else
+	{
+		// Use the object cache to avoid recompiling the module if its optimized object code was
+		// cached by an earlier process.
+		std::vector<U8> wasmBytes = WASM::saveBinaryModule(irModule);
+		objectCode = state.objectCache->getCachedObject(
+			getObjectCacheKey(
+				wasmBytes.data(), wasmBytes.size(), irModule.featureSpec, compileOptions),
+			[&irModule, &compileOptions]() {
+				return LLVMJIT::compileModule(
+					irModule, LLVMJIT::getHostTargetSpec(), compileOptions);
+			});
+	}
+	Timing::logTimer("Optimized module in background", optimizationTimer);
+
+	state.module->setOptimizedObjectCode(std::move(objectCode));
+}
+
+static I64 backgroundOptimizationThreadEntry(void* argument)
+{
+	std::unique_ptr<BackgroundOptimizationState> state(
+		(BackgroundOptimizationState*)argument);
+	optimizeModule(*state);
+
+	// Release the thread's reference to the module before letting the process exit, since it may
+	// be the last reference.
+	state.reset();
+	getBackgroundOptimizationThreads().numThreads.fetch_sub(1, std::memory_order_release);
+	return 0;
+}
+
+void Runtime::Module::startBackgroundOptimization(ModuleConstRefParam module,
+												  const LLVMJIT::CompileOptions& compileOptions)
+{
+	{
+		Platform::Mutex::Lock lock(module->mutex);
+		if(module->hasStartedBackgroundOptimization) { return; }
+		module->hasStartedBackgroundOptimization = true;
+	}
+
+	BackgroundOptimizationState* state
+		= new BackgroundOptimizationState{module, compileOptions, getGlobalObjectCache()};
+	if(state->compileOptions.optimizationLevel == LLVMJIT::OptimizationLevel::none)
+	{ state->compileOptions.optimizationLevel = LLVMJIT::CompileOptions().optimizationLevel; }
+
+	// The optimized object code must use the same bounds-check mode as the code it replaces,
+	// since existing memories only reserve the address space that mode requires. It must also
+	// meter fuel if the code it replaces did, so tiering up doesn't lift the module's fuel limit,
+	// and be instrumented exactly when the module has profile counters for it to increment.
+	state->compileOptions.boundsCheckMode = module->compileOptions.boundsCheckMode;
+	state->compileOptions.meterFuel = module->compileOptions.meterFuel;
+	state->compileOptions.instrumentProfile = module->compileOptions.instrumentProfile;
+
+	// The optimized object code replaces the baseline code, so it doesn't need to tier up itself.
+	state->compileOptions.tierUp = false;
+
+	getBackgroundOptimizationThreads().numThreads.fetch_add(1, std::memory_order_relaxed);
+	Platform::detachThread(Platform::createThread(0, backgroundOptimizationThreadEntry, state));
+}
+
+void Runtime::optimizeModuleInBackground(ModuleConstRefParam module,
+										 const LLVMJIT::CompileOptions& compileOptions)
+{
+	Runtime::Module::startBackgroundOptimization(module, compileOptions);
+}
+
+// Memory images are only built for memories whose data segments contain at least this many bytes:
+// copying less than a page of data is cheaper than mapping it from a snapshot.
+static constexpr Uptr minMemoryImageBytes = 4096;
+
+// Gets the constant offset of an active data segment in its memory. Returns false if the offset
+// depends on an imported global.
+static bool getConstantDataSegmentOffset(const DataSegment& dataSegment,
+										 IndexType indexType,
+										 U64& outOffset)
+{
+	if(dataSegment.baseOffset.type == InitializerExpression::Type::i32_const)
+	{
+		WAVM_ASSERT(indexType == IndexType::i32);
+		outOffset = U32(dataSegment.baseOffset.i32);
+		return true;
+	}
+	else if(dataSegment.baseOffset.type == InitializerExpression::Type::i64_const)
+	{
+		WAVM_ASSERT(indexType == IndexType::i64);
+		outOffset = U64(dataSegment.baseOffset.i64);
+		return true;
+	}
+	else
+	{
+		return false;
+	}
+}
+
+static std::shared_ptr<const MemoryImages> buildMemoryImages(const IR::Module& irModule)
+{
+	Timing::Timer buildTimer;
+
+	const Uptr numMemoryImports = irModule.memories.imports.size();
+	const Uptr numMemoryDefs = irModule.memories.defs.size();
+
+	std::shared_ptr<MemoryImages> images = std::make_shared<MemoryImages>();
+	images->memoryDefImages.resize(numMemoryDefs);
+	images->isDataSegmentInImage.assign(irModule.dataSegments.size(), false);
+
+	// Choose the active data segments to include in each memory's image. Active data segments are
+	// copied in order, so a memory's image contains the segments that precede its first segment
+	// with a non-constant offset. A segment that is out of bounds of the memory's initial size also
+	// ends the image, so that instantiating the module still traps after copying the segments that
+	// precede it.
+	std::vector<bool> isImageEnded(numMemoryDefs, false);
+	std::vector<U64> numImageDataBytes(numMemoryDefs, 0);
+	std::vector<U64> imageEndOffsets(numMemoryDefs, 0);
+	for(Uptr segmentIndex = 0; segmentIndex < irModule.dataSegments.size(); ++segmentIndex)
+	{
+		const DataSegment& dataSegment = irModule.dataSegments[segmentIndex];
+		if(!dataSegment.isActive || dataSegment.memoryIndex < numMemoryImports) { continue; }
+
+		const Uptr memoryDefIndex = dataSegment.memoryIndex - numMemoryImports;
+		if(isImageEnded[memoryDefIndex]) { continue; }
+
+		const MemoryType& memoryType = irModule.memories.defs[memoryDefIndex].type;
+		const U64 memoryNumBytes
+			= memoryType.size.min < (U64(1) << (64 - IR::numBytesPerPageLog2))
+				  ? memoryType.size.min << IR::numBytesPerPageLog2
+				  : UINT64_MAX;
+		const U64 numSegmentBytes = dataSegment.data->size();
+		U64 offset = 0;
+		if(!getConstantDataSegmentOffset(dataSegment, memoryType.indexType, offset)
+		   || offset > memoryNumBytes || numSegmentBytes > memoryNumBytes - offset)
+		{
+			isImageEnded[memoryDefIndex] = true;
+			continue;
+		}
+
+		images->isDataSegmentInImage[segmentIndex] = true;
+		numImageDataBytes[memoryDefIndex] += numSegmentBytes;
+		imageEndOffsets[memoryDefIndex]
+			= std::max(imageEndOffsets[memoryDefIndex], offset + numSegmentBytes);
+	}
+
+	// Build the image of each memory with enough data to benefit from it.
+	const Uptr pageBytesLog2 = Platform::getBytesPerPageLog2();
+	Uptr numImageBytes = 0;
+	for(Uptr memoryDefIndex = 0; memoryDefIndex < numMemoryDefs; ++memoryDefIndex)
+	{
+		const Uptr memoryIndex = numMemoryImports + memoryDefIndex;
+		const Uptr numPlatformPages
+			= Uptr((imageEndOffsets[memoryDefIndex] + (Uptr(1) << pageBytesLog2) - 1)
+				   >> pageBytesLog2);
+
+		// Copy the segments into a temporary buffer, and create a snapshot of it.
+		Platform::MemorySnapshot* snapshot = nullptr;
+		if(numImageDataBytes[memoryDefIndex] >= minMemoryImageBytes)
+		{
+			U8* imageBytes = Platform::allocateVirtualPages(numPlatformPages);
+			if(imageBytes && Platform::commitVirtualPages(imageBytes, numPlatformPages))
+			{
+				for(Uptr segmentIndex = 0; segmentIndex < irModule.dataSegments.size();
+					++segmentIndex)
+				{
+					const DataSegment& dataSegment = irModule.dataSegments[segmentIndex];
+					if(images->isDataSegmentInImage[segmentIndex]
+					   && dataSegment.memoryIndex == memoryIndex)
+					{
+						U64 offset = 0;
+						getConstantDataSegmentOffset(
+							dataSegment,
+							irModule.memories.defs[memoryDefIndex].type.indexType,
+							offset);
+						if(dataSegment.data->size())
+						{
+							memcpy(imageBytes + offset,
+								   dataSegment.data->data(),
+								   dataSegment.data->size());
+						}
+					}
+				}
+
+				snapshot = Platform::createMemorySnapshot(imageBytes, numPlatformPages);
+			}
+			if(imageBytes) { Platform::freeVirtualPages(imageBytes, numPlatformPages); }
+		}
+
+		if(snapshot)
+		{
+			images->memoryDefImages[memoryDefIndex].snapshot
+				= std::shared_ptr<Platform::MemorySnapshot>(snapshot,
+															&Platform::destroyMemorySnapshot);
+			images->memoryDefImages[memoryDefIndex].numPlatformPages = numPlatformPages;
+			numImageBytes += numPlatformPages << pageBytesLog2;
+		}
+		else
+		{
+			// If the memory has no image, its segments are copied when it is instantiated.
+			for(Uptr segmentIndex = 0; segmentIndex < irModule.dataSegments.size(); ++segmentIndex)
+			{
+				if(irModule.dataSegments[segmentIndex].memoryIndex == memoryIndex)
+				{ images->isDataSegmentInImage[segmentIndex] = false; }
+			}
+		}
+	}
+
+	if(numImageBytes)
+	{
+		Timing::logRatePerSecond(
+			"Built memory images", buildTimer, numImageBytes / 1024.0 / 1024.0, "MiB");
+	}
+
+	return images;
+}
+
+std::shared_ptr<const MemoryImages> Runtime::Module::getMemoryImages() const
+{
+	Platform::Mutex::Lock lock(memoryImagesMutex);
+	if(!memoryImages) { memoryImages = buildMemoryImages(ir); }
+	return memoryImages;
+}
+
+std::shared_ptr<const std::vector<bool>> Runtime::Module::getImmutableTables() const
+{
+	Platform::Mutex::Lock lock(immutableTablesMutex);
+	if(!immutableTables)
+	{
+		immutableTables
+			= std::make_shared<const std::vector<bool>>(LLVMJIT::getImmutableTables(ir));
+	}
+	return immutableTables;
+}
+
+bool Runtime::getModuleProfile(ModuleConstRefParam module, LLVMJIT::ModuleProfile& outProfile)
+{
+	if(!module->profileCounters) { return false; }
+
+	// The counters may be incremented concurrently by the module's instances, so read them with
+	// relaxed atomic loads to match the relaxed atomic increments.
+	const std::vector<std::atomic<U64>>& counters = *module->profileCounters;
+	outProfile.moduleHash = LLVMJIT::getProfileModuleHash(module->ir);
+	outProfile.counters.resize(counters.size());
+	for(Uptr counterIndex = 0; counterIndex < counters.size(); ++counterIndex)
+	{ outProfile.counters[counterIndex] = counters[counterIndex].load(std::memory_order_relaxed); }
 	return true;
 }
 
 ModuleRef Runtime::loadPrecompiledModule(const IR::Module& irModule,
 										 const std::vector<U8>& objectCode)
 {
-	return std::make_shared<Module>(IR::Module(irModule), std::vector<U8>(objectCode));
+	return loadPrecompiledModule(irModule, objectCode, LLVMJIT::CompileOptions());
+}
+
+ModuleRef Runtime::loadPrecompiledModule(const IR::Module& irModule,
+										 const std::vector<U8>& objectCode,
+										 const LLVMJIT::CompileOptions& compileOptions)
+{
+	ModuleRef module
+		= std::make_shared<Module>(IR::Module(irModule), std::vector<U8>(objectCode));
+	module->compileOptions = compileOptions;
+	if(compileOptions.instrumentProfile) { allocateProfileCounters(*module); }
+	return module;
 }
 
 const IR::Module& Runtime::getModuleIR(ModuleConstRefParam module) { return module->ir; }
-std::vector<U8> Runtime::getObjectCode(ModuleConstRefParam module) { return module->objectCode; }
+std::vector<U8> Runtime::getObjectCode(ModuleConstRefParam module)
+{
+	return *module->getObjectCode();
+}
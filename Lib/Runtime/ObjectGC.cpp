@@ -1,4 +1,5 @@
 #include <inttypes.h>
+#include <algorithm>
 #include <atomic>
 #include <utility>
 #include <vector>
@@ -71,13 +72,38 @@ void Runtime::removeGCRoot(const Object* object) noexcept
 	}
 }
 
+void Runtime::noteReference(Object* object, Uptr referrerInstanceId)
+{
+	if(!object) { return; }
+	if(object->kind == ObjectKind::function)
+	{
+		Function* function = asFunction(object);
+		FunctionMutableData* mutableData = function->mutableData;
+		if(function->instanceId != UINTPTR_MAX && function->instanceId != referrerInstanceId
+		   && !mutableData->isReferencedOutsideInstance.load(std::memory_order_relaxed))
+		{ mutableData->isReferencedOutsideInstance.store(true, std::memory_order_release); }
+	}
+	else
+	{
+		GCObject* gcObject = (GCObject*)object;
+		if(gcObject->definingInstanceId != UINTPTR_MAX
+		   && gcObject->definingInstanceId != referrerInstanceId
+		   && !gcObject->isReferencedOutsideInstance.load(std::memory_order_relaxed))
+		{ gcObject->isReferencedOutsideInstance.store(true, std::memory_order_release); }
+	}
+}
+
 struct GCState
 {
 	Compartment* compartment;
+	const bool onlyYoungObjects;
 	HashSet<GCObject*> unreferencedObjects;
 	std::vector<GCObject*> pendingScanObjects;
 
-	GCState(Compartment* inCompartment) : compartment(inCompartment) {}
+	GCState(Compartment* inCompartment, bool inOnlyYoungObjects)
+	: compartment(inCompartment), onlyYoungObjects(inOnlyYoungObjects)
+	{
+	}
 
 	void visitReference(Object* object)
 	{
@@ -105,13 +131,45 @@ struct GCState
 		for(auto reference : array) { visitReference(asObject(reference)); }
 	}
 
+	// Returns whether an old object may reference objects that were created after it survived a
+	// garbage collection. The other references of an object are all created with the object, so
+	// they are at least as old as it.
+	static bool mayReferenceYoungObjects(GCObject* object)
+	{
+		if(object->kind == ObjectKind::table)
+		{ return asTable(object)->wasWrittenSinceScan.load(std::memory_order_acquire); }
+		else if(object->kind == ObjectKind::global)
+		{
+			// Mutable globals are written by WebAssembly code without a write barrier, so assume
+			// that any mutable global of reference type may reference young objects.
+			Global* global = asGlobal(object);
+			return global->type.isMutable && isReferenceType(global->type.valueType);
+		}
+		else
+		{
+			return false;
+		}
+	}
+
 	void initGCObject(GCObject* object, bool forceRoot = false)
 	{
-		if(forceRoot || object->numRootReferences > 0) { pendingScanObjects.push_back(object); }
+		if(onlyYoungObjects && object->isOld)
+		{
+			// A young garbage collection assumes that old objects are referenced, so it only needs
+			// to scan the old objects that may reference young objects.
+			if(mayReferenceYoungObjects(object)) { pendingScanObjects.push_back(object); }
+		}
+		else if(forceRoot || object->numRootReferences > 0)
+		{
+			pendingScanObjects.push_back(object);
+		}
 		else
 		{
 			unreferencedObjects.add(object);
 		}
+
+		// Any object that isn't deleted by this garbage collection is old after it.
+		object->isOld = true;
 	}
 
 	void scanObject(GCObject* object)
@@ -125,6 +183,10 @@ struct GCState
 		case ObjectKind::table: {
 			Table* table = asTable(object);
 
+			// Clear the table's write barrier flag before reading its elements, so any element
+			// written after they are read will cause the next young garbage collection to scan it.
+			table->wasWrittenSinceScan.store(false, std::memory_order_relaxed);
+
 			Platform::RWMutex::ShareableLock resizingLock(table->resizingMutex);
 			const Uptr numElements = getTableNumElements(table);
 			for(Uptr elementIndex = 0; elementIndex < numElements; ++elementIndex)
@@ -177,33 +239,48 @@ struct GCState
 	}
 };
 
-static bool collectGarbageImpl(Compartment* compartment)
+// Returns the function definitions in the optimized code that an instance's baseline functions
+// forward their calls to, which may be referenced like the instance's own functions.
+static std::vector<Function*> getOptimizedFunctionDefs(Instance* instance)
+{
+	if(!instance->tierUp) { return {}; }
+	Platform::Mutex::Lock tierUpLock(instance->tierUp->mutex);
+	return instance->tierUp->optimizedFunctionDefs;
+}
+
+static bool collectGarbageImpl(Compartment* compartment, bool onlyYoungObjects)
 {
-	Platform::RWMutex::ExclusiveLock compartmentLock(compartment->mutex);
 	Timing::Timer timer;
+	Platform::RWMutex::ExclusiveLock compartmentLock(compartment->mutex);
+	Timing::Timer pauseTimer;
 
-	GCState state(compartment);
+	GCState state(compartment, onlyYoungObjects);
 
 	// Initialize the GC state from the compartment's various sets of objects.
 	state.initGCObject(compartment);
 	for(Instance* instance : compartment->instances)
 	{
-		if(instance)
+		// A young garbage collection doesn't scan old instances, so it doesn't need to check
+		// whether their functions are roots.
+		if(!instance || (onlyYoungObjects && instance->isOld)) { continue; }
+
+		// Transfer root markings from functions to their instance.
+		bool hasRootFunction = false;
+		for(Function* function : instance->functions)
 		{
-			// Transfer root markings from functions to their instance.
-			bool hasRootFunction = false;
-			for(Function* function : instance->functions)
+			if(function && function->mutableData->numRootReferences
+			   && function->instanceId == instance->id)
 			{
-				if(function && function->mutableData->numRootReferences
-				   && function->instanceId == instance->id)
-				{
-					hasRootFunction = true;
-					break;
-				}
+				hasRootFunction = true;
+				break;
 			}
-
-			state.initGCObject(instance, hasRootFunction);
 		}
+		for(Function* function : getOptimizedFunctionDefs(instance))
+		{
+			if(function->mutableData->numRootReferences) { hasRootFunction = true; }
+		}
+
+		state.initGCObject(instance, hasRootFunction);
 	}
 	for(Memory* memory : compartment->memories) { state.initGCObject(memory); }
 	for(Table* table : compartment->tables) { state.initGCObject(table); }
@@ -235,29 +312,118 @@ static bool collectGarbageImpl(Compartment* compartment)
 		}
 	}
 
+	// Update the compartment's pause time statistics before unlocking it.
+	const F64 pauseMilliseconds = pauseTimer.getMilliseconds();
+	const Uptr numGarbageCollections = ++compartment->numGarbageCollections;
+	const F64 totalPauseMilliseconds
+		= compartment->totalGarbageCollectionPauseMilliseconds += pauseMilliseconds;
+	const F64 maxPauseMilliseconds = compartment->maxGarbageCollectionPauseMilliseconds
+		= std::max(compartment->maxGarbageCollectionPauseMilliseconds, pauseMilliseconds);
+
 	// Delete the compartment last, if it wasn't referenced.
 	compartmentLock.unlock();
 	if(wasCompartmentUnreferenced) { delete compartment; }
 
 	Log::printf(Log::metrics,
-				"Collected garbage in %.2fms: %" WAVM_PRIuPTR " roots, %" WAVM_PRIuPTR
-				" objects, %" WAVM_PRIuPTR " garbage\n",
+				"Collected %s garbage in %.2fms (%.2fms paused): %" WAVM_PRIuPTR
+				" roots, %" WAVM_PRIuPTR " objects, %" WAVM_PRIuPTR " garbage\n",
+				onlyYoungObjects ? "young" : "all",
 				timer.getMilliseconds(),
+				pauseMilliseconds,
 				numRoots,
 				numInitialObjects,
 				Uptr(state.unreferencedObjects.size()));
+	Log::printf(Log::metrics,
+				"Compartment garbage collection pauses: %.2fms max, %.2fms mean over %" WAVM_PRIuPTR
+				" collections\n",
+				maxPauseMilliseconds,
+				totalPauseMilliseconds / F64(numGarbageCollections),
+				numGarbageCollections);
 
 	return wasCompartmentUnreferenced;
 }
 
 void Runtime::collectCompartmentGarbage(Compartment* compartment)
 {
-	collectGarbageImpl(compartment);
+	collectGarbageImpl(compartment, false);
+}
+
+void Runtime::collectCompartmentYoungGarbage(Compartment* compartment)
+{
+	collectGarbageImpl(compartment, true);
 }
 
 bool Runtime::tryCollectCompartment(GCPointer<Compartment>&& compartmentRootRef)
 {
 	Compartment* compartment = &*compartmentRootRef;
 	compartmentRootRef = nullptr;
-	return collectGarbageImpl(compartment);
+	return collectGarbageImpl(compartment, false);
+}
+
+// Returns whether an object defined by an instance may be referenced by anything but the instance.
+static bool isReferencedOutsideInstance(const GCObject* object)
+{
+	return object->numRootReferences.load(std::memory_order_acquire)
+		   || object->isReferencedOutsideInstance.load(std::memory_order_acquire);
+}
+
+template<typename Array>
+static void gatherInstanceDefinedObjects(const Instance* instance,
+										 const Array& array,
+										 std::vector<GCObject*>& outObjects)
+{
+	for(GCObject* object : array)
+	{
+		if(object && object->definingInstanceId == instance->id) { outObjects.push_back(object); }
+	}
+}
+
+bool Runtime::tryCollectInstance(GCPointer<Instance>&& instanceRootRef)
+{
+	Timing::Timer timer;
+	Instance* instance = &*instanceRootRef;
+	instanceRootRef = nullptr;
+
+	Compartment* compartment = instance->compartment;
+	Platform::RWMutex::ExclusiveLock compartmentLock(compartment->mutex);
+
+	// If the instance or any function it defined may be referenced, it can't be freed.
+	if(isReferencedOutsideInstance(instance)) { return false; }
+	for(Function* function : instance->functions)
+	{
+		if(function && function->instanceId == instance->id
+		   && (function->mutableData->numRootReferences.load(std::memory_order_acquire)
+			   || function->mutableData->isReferencedOutsideInstance.load(
+				   std::memory_order_acquire)))
+		{ return false; }
+	}
+	for(Function* function : getOptimizedFunctionDefs(instance))
+	{
+		if(function->mutableData->numRootReferences.load(std::memory_order_acquire)
+		   || function->mutableData->isReferencedOutsideInstance.load(std::memory_order_acquire))
+		{ return false; }
+	}
+
+	// The other objects defined by the instance may reference its functions, so they must not be
+	// referenced either. References to the instance's objects from each other form cycles that
+	// only the instance can reach, so they are freed together with it.
+	std::vector<GCObject*> definedObjects;
+	gatherInstanceDefinedObjects(instance, instance->tables, definedObjects);
+	gatherInstanceDefinedObjects(instance, instance->memories, definedObjects);
+	gatherInstanceDefinedObjects(instance, instance->globals, definedObjects);
+	gatherInstanceDefinedObjects(instance, instance->exceptionTypes, definedObjects);
+	for(GCObject* object : definedObjects)
+	{
+		if(isReferencedOutsideInstance(object)) { return false; }
+	}
+
+	delete instance;
+	for(GCObject* object : definedObjects) { delete object; }
+
+	compartmentLock.unlock();
+	Log::printf(Log::metrics,
+				"Collected instance in %.2fms: %" WAVM_PRIuPTR " objects\n",
+				timer.getMilliseconds(),
+				Uptr(definedObjects.size() + 1));
+	return true;
 }
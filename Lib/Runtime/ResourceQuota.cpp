@@ -38,3 +38,49 @@ void Runtime::setResourceQuotaMaxMemoryPages(ResourceQuotaRefParam resourceQuota
 {
 	resourceQuota->memoryPages.setMax(maxMemoryPages);
 }
+
+Uptr Runtime::getResourceQuotaMaxInstances(ResourceQuotaConstRefParam resourceQuota)
+{
+	return resourceQuota->instances.getMax();
+}
+
+Uptr Runtime::getResourceQuotaCurrentInstances(ResourceQuotaConstRefParam resourceQuota)
+{
+	return resourceQuota->instances.getCurrent();
+}
+
+void Runtime::setResourceQuotaMaxInstances(ResourceQuotaRefParam resourceQuota, Uptr maxInstances)
+{
+	resourceQuota->instances.setMax(maxInstances);
+}
+
+Uptr Runtime::getResourceQuotaMaxCodeBytes(ResourceQuotaConstRefParam resourceQuota)
+{
+	return resourceQuota->codeBytes.getMax();
+}
+
+Uptr Runtime::getResourceQuotaCurrentCodeBytes(ResourceQuotaConstRefParam resourceQuota)
+{
+	return resourceQuota->codeBytes.getCurrent();
+}
+
+void Runtime::setResourceQuotaMaxCodeBytes(ResourceQuotaRefParam resourceQuota, Uptr maxCodeBytes)
+{
+	resourceQuota->codeBytes.setMax(maxCodeBytes);
+}
+
+U64 Runtime::getResourceQuotaMaxCPUTimeNanoseconds(ResourceQuotaConstRefParam resourceQuota)
+{
+	return resourceQuota->cpuTimeNanoseconds.getMax();
+}
+
+U64 Runtime::getResourceQuotaCurrentCPUTimeNanoseconds(ResourceQuotaConstRefParam resourceQuota)
+{
+	return resourceQuota->cpuTimeNanoseconds.getCurrent();
+}
+
+void Runtime::setResourceQuotaMaxCPUTimeNanoseconds(ResourceQuotaRefParam resourceQuota,
+													 U64 maxCPUTimeNanoseconds)
+{
+	resourceQuota->cpuTimeNanoseconds.setMax(maxCPUTimeNanoseconds);
+}
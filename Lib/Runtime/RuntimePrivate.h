@@ -2,6 +2,7 @@
 
 #include <atomic>
 #include <functional>
+#include <limits>
 #include <memory>
 #include "WAVM/IR/Module.h"
 #include "WAVM/Inline/BasicTypes.h"
@@ -11,7 +12,10 @@
 #include "WAVM/Inline/IndexMap.h"
 #include "WAVM/LLVMJIT/LLVMJIT.h"
 #include "WAVM/Platform/Defines.h"
+#include "WAVM/Platform/Memory.h"
+#include "WAVM/Platform/Mutex.h"
 #include "WAVM/Platform/RWMutex.h"
+#include "WAVM/Platform/Thread.h"
 #include "WAVM/Runtime/Intrinsics.h"
 #include "WAVM/Runtime/Runtime.h"
 #include "WAVM/RuntimeABI/RuntimeABI.h"
@@ -31,6 +35,19 @@ namespace WAVM { namespace Runtime {
 		void (*finalizeUserData)(void*);
 		std::string debugName;
 
+		// Whether the object survived a garbage collection of its compartment. Young garbage
+		// collections assume that old objects are referenced. Only accessed while the
+		// compartment's mutex is exclusively locked.
+		bool isOld{false};
+
+		// The ID of the instance that defined the object, or UINTPTR_MAX if it wasn't defined by an
+		// instance.
+		Uptr definingInstanceId{UINTPTR_MAX};
+
+		// Whether the object may be referenced by something other than the instance that defined
+		// it. tryCollectInstance doesn't free an instance that defined such an object.
+		std::atomic<bool> isReferencedOutsideInstance{false};
+
 		GCObject(ObjectKind inKind, Compartment* inCompartment, std::string&& inDebugName);
 		virtual ~GCObject();
 	};
@@ -57,6 +74,17 @@ namespace WAVM { namespace Runtime {
 		mutable Platform::RWMutex resizingMutex;
 		std::atomic<Uptr> numElements{0};
 
+		// Set when an element is written, and cleared when the garbage collector scans the table.
+		// A young garbage collection must scan old tables with this set, since they may reference
+		// young objects.
+		std::atomic<bool> wasWrittenSinceScan{false};
+
+		// Whether the table was defined by an instance whose code assumes that the table isn't
+		// mutated after instantiation (see LLVMJIT::getImmutableTables). The host can't write or
+		// grow such a table. Only set during instantiation, before the table is visible to the
+		// host.
+		bool isImmutable{false};
+
 		ResourceQuotaRef resourceQuota;
 
 		Table(Compartment* inCompartment,
@@ -91,9 +119,19 @@ namespace WAVM { namespace Runtime {
 		U8* baseAddress = nullptr;
 		Uptr numReservedBytes = 0;
 
+		// The index of the memory pool slot that the memory's address space was allocated from, or
+		// UINTPTR_MAX if the memory reserved its own address space.
+		Uptr poolSlotIndex = UINTPTR_MAX;
+
 		mutable Platform::RWMutex resizingMutex;
 		std::atomic<Uptr> numPages{0};
 
+		// If the memory's first numSnapshotPages platform pages are mapped copy-on-write from a
+		// snapshot, the snapshot. It is shared with the memories cloned from the snapshot, and
+		// while none of the pages have been written, with later copy-on-write clones.
+		std::shared_ptr<Platform::MemorySnapshot> snapshot;
+		Uptr numSnapshotPages = 0;
+
 		ResourceQuotaRef resourceQuota;
 
 		Memory(Compartment* inCompartment,
@@ -155,16 +193,110 @@ namespace WAVM { namespace Runtime {
 	typedef std::vector<std::shared_ptr<std::vector<U8>>> DataSegmentVector;
 	typedef std::vector<std::shared_ptr<IR::ElemSegment::Contents>> ElemSegmentVector;
 
+	// A page-aligned image of the initial contents of a memory defined by a module. New instances
+	// of the memory map the image copy-on-write instead of copying the module's data segments.
+	struct MemoryImage
+	{
+		std::shared_ptr<Platform::MemorySnapshot> snapshot;
+		Uptr numPlatformPages{0};
+	};
+
+	// The images of a module's memory definitions, and which of its data segments they contain.
+	struct MemoryImages
+	{
+		std::vector<MemoryImage> memoryDefImages;
+		std::vector<bool> isDataSegmentInImage;
+	};
+
 	// A compiled WebAssembly module.
 	struct Module
 	{
 		IR::Module ir;
-		std::vector<U8> objectCode;
+
+		// If the module was compiled with profile instrumentation, the counters that are
+		// atomically incremented by its instances.
+		std::shared_ptr<std::vector<std::atomic<U64>>> profileCounters;
+
+		// The options that the module's object code was compiled with. The bounds-check mode
+		// determines how much address space the memories it accesses must reserve, and if tierUp
+		// is set, its instances load the module's optimized object code when their functions get
+		// hot. The optimized object code is compiled with the same options, except for its
+		// optimization level and tierUp.
+		LLVMJIT::CompileOptions compileOptions;
 
 		Module(IR::Module&& inIR, std::vector<U8>&& inObjectCode)
-		: ir(inIR), objectCode(std::move(inObjectCode))
+		: ir(inIR), objectCode(std::make_shared<std::vector<U8>>(std::move(inObjectCode)))
+		{
+		}
+
+		// Returns the module's current object code.
+		std::shared_ptr<const std::vector<U8>> getObjectCode() const;
+
+		// Replaces the module's object code with the optimized object code compiled by its
+		// background optimization. Instances of the module that are created afterward use the
+		// optimized object code, and instances that were created before then may load it to tier
+		// up their functions.
+		void setOptimizedObjectCode(std::vector<U8>&& newObjectCode) const;
+
+		// Returns the module's optimized object code, or null if its background optimization
+		// hasn't finished.
+		std::shared_ptr<const std::vector<U8>> getOptimizedObjectCode() const;
+
+		// Starts compiling optimized object code for the module on a background thread, unless it
+		// has already been started. The thread holds a reference to the module until it finishes.
+		static void startBackgroundOptimization(ModuleConstRefParam module,
+												const LLVMJIT::CompileOptions& compileOptions);
+
+		// Returns the images of the module's memories, building them the first time it's called.
+		std::shared_ptr<const MemoryImages> getMemoryImages() const;
+
+		// Returns whether each of the module's tables is immutable after instantiation (see
+		// LLVMJIT::getImmutableTables), analyzing the module the first time it's called.
+		std::shared_ptr<const std::vector<bool>> getImmutableTables() const;
+
+	private:
+		mutable Platform::Mutex mutex;
+		mutable std::shared_ptr<const std::vector<U8>> objectCode;
+		mutable bool hasStartedBackgroundOptimization{false};
+		mutable bool hasOptimizedObjectCode{false};
+
+		mutable Platform::Mutex memoryImagesMutex;
+		mutable std::shared_ptr<const MemoryImages> memoryImages;
+
+		mutable Platform::Mutex immutableTablesMutex;
+		mutable std::shared_ptr<const std::vector<bool>> immutableTables;
+	};
+
+	// The state used to tier up the functions of an instance whose code was compiled with
+	// LLVMJIT::CompileOptions::tierUp. Clones of the instance share its baseline code, and so its
+	// FunctionTierUp state, so they also share this.
+	struct InstanceTierUp
+	{
+		// The module the instance was instantiated from, and the bindings of its function imports,
+		// which are used to load the module's optimized object code for the instance.
+		const ModuleConstRef module;
+		const std::vector<LLVMJIT::FunctionBinding> functionImports;
+
+		// The optimized object code loaded for the instance, and the function definitions in it.
+		// Calls to the instance's hot baseline functions are forwarded to these functions. Only
+		// accessed while mutex is locked.
+		mutable Platform::Mutex mutex;
+		std::shared_ptr<LLVMJIT::Module> optimizedJITModule;
+		std::vector<Function*> optimizedFunctionDefs;
+		bool hasFailed{false};
+
+		// The optimized object code is charged to the resource quota of the instance that loaded
+		// it until this is freed.
+		ResourceQuotaRef resourceQuota;
+		Uptr numCodeBytes{0};
+
+		InstanceTierUp(ModuleConstRefParam inModule,
+					   std::vector<LLVMJIT::FunctionBinding>&& inFunctionImports)
+		: module(inModule), functionImports(std::move(inFunctionImports))
 		{
 		}
+
+		~InstanceTierUp();
 	};
 
 	// An instance of a WebAssembly module.
@@ -191,7 +323,17 @@ namespace WAVM { namespace Runtime {
 
 		const std::shared_ptr<LLVMJIT::Module> jitModule;
 
+		// Keeps the module's profile counters alive while the instance's code may increment them.
+		std::shared_ptr<std::vector<std::atomic<U64>>> profileCounters;
+
+		// If the instance's code was compiled with LLVMJIT::CompileOptions::tierUp, the state used
+		// to tier up its functions.
+		std::shared_ptr<InstanceTierUp> tierUp;
+
+		// The instance and the number of bytes of object code it loaded are charged to its resource
+		// quota until it is freed.
 		ResourceQuotaRef resourceQuota;
+		Uptr numCodeBytes = 0;
 
 		Instance(Compartment* inCompartment,
 				 Uptr inID,
@@ -233,6 +375,16 @@ namespace WAVM { namespace Runtime {
 		Uptr id = UINTPTR_MAX;
 		struct ContextRuntimeData* runtimeData = nullptr;
 
+		// The maximum number of call stack frames to capture for exceptions created while code is
+		// invoked on the context, or UINTPTR_MAX to use the global depth.
+		std::atomic<Uptr> exceptionCallStackDepth{UINTPTR_MAX};
+
+		// The number of invokes on the context that have started and returned. They are only
+		// written by the thread invoking code on the context, and are read by cloneMemory to find
+		// whether code is running while it snapshots a memory.
+		std::atomic<U64> numStartedInvokes{0};
+		std::atomic<U64> numReturnedInvokes{0};
+
 		Context(Compartment* inCompartment, std::string&& inDebugName)
 		: GCObject(ObjectKind::context, inCompartment, std::move(inDebugName))
 		{
@@ -258,6 +410,15 @@ namespace WAVM { namespace Runtime {
 		DenseStaticIntSet<U32, maxMutableGlobals> globalDataAllocationMask;
 		IR::UntaggedValue initialContextMutableGlobals[maxMutableGlobals];
 
+		// The number of invokes that were started on the compartment's destroyed contexts.
+		U64 numDestroyedContextInvokes = 0;
+
+		// Statistics about the time the compartment's mutex has been exclusively locked by the
+		// garbage collector, which are logged as metrics after each garbage collection.
+		Uptr numGarbageCollections = 0;
+		F64 totalGarbageCollectionPauseMilliseconds = 0.0;
+		F64 maxGarbageCollectionPauseMilliseconds = 0.0;
+
 		Compartment(std::string&& inDebugName,
 					struct CompartmentRuntimeData* inRuntimeData,
 					U8* inUnalignedRuntimeData);
@@ -276,54 +437,64 @@ namespace WAVM { namespace Runtime {
 
 	struct ResourceQuota
 	{
+		// A quota's current usage and maximum. They are updated with atomic operations instead of
+		// a lock, so a quota shared by many instances doesn't serialize their allocations.
 		template<typename Value> struct CurrentAndMax
 		{
-			CurrentAndMax(Value inMax) : current{0}, max(inMax) {}
+			CurrentAndMax(Value inMax) : current{0}, max{inMax} {}
 
 			bool allocate(Value delta)
 			{
-				Platform::RWMutex::ExclusiveLock lock(mutex);
-
-				// Make sure the delta doesn't make current overflow.
-				if(current + delta < current) { return false; }
-
-				if(current + delta > max) { return false; }
-
-				current += delta;
+				Value oldCurrent = current.load(std::memory_order_relaxed);
+				do
+				{
+					// Make sure the delta doesn't make current overflow or exceed max.
+					if(oldCurrent + delta < oldCurrent
+					   || oldCurrent + delta > max.load(std::memory_order_relaxed))
+					{ return false; }
+				} while(!current.compare_exchange_weak(
+					oldCurrent, oldCurrent + delta, std::memory_order_relaxed));
 				return true;
 			}
 
 			void free(Value delta)
 			{
-				Platform::RWMutex::ExclusiveLock lock(mutex);
-				WAVM_ASSERT(current - delta <= current);
-				current -= delta;
+				const Value oldCurrent = current.fetch_sub(delta, std::memory_order_relaxed);
+				WAVM_ASSERT(oldCurrent - delta <= oldCurrent);
+				WAVM_SUPPRESS_UNUSED(oldCurrent);
 			}
 
-			Value getCurrent() const
+			// Adds a delta to current without checking it against max, for usage that can only be
+			// measured after it happened. Saturates instead of overflowing.
+			void charge(Value delta)
 			{
-				Platform::RWMutex::ShareableLock lock(mutex);
-				return current;
-			}
-			Value getMax() const
-			{
-				Platform::RWMutex::ShareableLock lock(mutex);
-				return max;
-			}
-			void setMax(Value newMax)
-			{
-				Platform::RWMutex::ExclusiveLock lock(mutex);
-				max = newMax;
+				Value oldCurrent = current.load(std::memory_order_relaxed);
+				Value newCurrent;
+				do
+				{
+					newCurrent = oldCurrent + delta < oldCurrent ? std::numeric_limits<Value>::max()
+																 : oldCurrent + delta;
+				} while(!current.compare_exchange_weak(
+					oldCurrent, newCurrent, std::memory_order_relaxed));
 			}
 
+			Value getCurrent() const { return current.load(std::memory_order_relaxed); }
+			Value getMax() const { return max.load(std::memory_order_relaxed); }
+			void setMax(Value newMax) { max.store(newMax, std::memory_order_relaxed); }
+
+			bool isLimited() const { return getMax() != std::numeric_limits<Value>::max(); }
+			bool isExhausted() const { return getCurrent() >= getMax(); }
+
 		private:
-			mutable Platform::RWMutex mutex;
-			Value current;
-			Value max;
+			std::atomic<Value> current;
+			std::atomic<Value> max;
 		};
 
 		CurrentAndMax<Uptr> memoryPages{UINTPTR_MAX};
 		CurrentAndMax<Uptr> tableElems{UINTPTR_MAX};
+		CurrentAndMax<Uptr> instances{UINTPTR_MAX};
+		CurrentAndMax<Uptr> codeBytes{UINTPTR_MAX};
+		CurrentAndMax<U64> cpuTimeNanoseconds{UINT64_MAX};
 	};
 
 	WAVM_DECLARE_INTRINSIC_MODULE(wavmIntrinsics);
@@ -332,13 +503,58 @@ namespace WAVM { namespace Runtime {
 	WAVM_DECLARE_INTRINSIC_MODULE(wavmIntrinsicsMemory);
 	WAVM_DECLARE_INTRINSIC_MODULE(wavmIntrinsicsTable);
 
+	// Overrides the exception call stack depth for the current thread while in scope.
+	struct ScopedExceptionCallStackDepth
+	{
+		ScopedExceptionCallStackDepth(Uptr depth);
+		~ScopedExceptionCallStackDepth();
+
+	private:
+		Uptr outerDepth;
+	};
+
+	// Captures the call stack for an exception, limited to the current exception call stack
+	// depth, omitting this function and numOmittedFramesFromTop of its callers.
+	Platform::CallStack captureExceptionCallStack(Uptr numOmittedFramesFromTop);
+
+	// Calls a thunk, and returns the runtime exception for any trap that occurs within it, or null
+	// if it returns normally. Traps caused by signals or raised by trap return to here without
+	// unwinding the stack or throwing a C++ exception. Other runtime exceptions are still thrown.
+	Exception* catchTraps(void (*thunk)(void*), void* argument);
+
+	// Creates a runtime exception for a WebAssembly trap. If the innermost catch on this thread is
+	// from catchTraps, jumps back to it without unwinding the stack, and otherwise throws the
+	// exception. Must only be called from intrinsics that are called directly by WebAssembly code,
+	// and that don't have any locals with destructors in scope.
+	[[noreturn]] void trap(ExceptionType* type,
+						   const IR::UntaggedValue* arguments = nullptr,
+						   Uptr numArguments = 0);
+
+	// Records that an object is referenced by the instance with the given ID, or by an object that
+	// wasn't defined by an instance if it is UINTPTR_MAX.
+	void noteReference(Object* object, Uptr referrerInstanceId);
+
 	// Checks whether an address is owned by a table or memory.
 	bool isAddressOwnedByTable(U8* address, Table*& outTable, Uptr& outTableIndex);
 	bool isAddressOwnedByMemory(U8* address, Memory*& outMemory, Uptr& outMemoryAddress);
 
+	// Creates a memory that reserves the address space that code compiled with boundsCheckMode
+	// requires to access it.
+	Memory* createMemory(Compartment* compartment,
+						 IR::MemoryType type,
+						 std::string&& debugName,
+						 ResourceQuotaRefParam resourceQuota,
+						 LLVMJIT::BoundsCheckMode boundsCheckMode);
+
+	// Returns the number of bytes of address space that a memory must reserve to be accessed by
+	// code compiled with boundsCheckMode.
+	Uptr getMinMemoryReservedBytes(IR::MemoryType type, LLVMJIT::BoundsCheckMode boundsCheckMode);
+
 	// Clones objects into a new compartment with the same ID.
 	Table* cloneTable(Table* memory, Compartment* newCompartment);
-	Memory* cloneMemory(Memory* memory, Compartment* newCompartment);
+	Memory* cloneMemory(Memory* memory,
+						Compartment* newCompartment,
+						MemoryCloneMode memoryCloneMode);
 	ExceptionType* cloneExceptionType(ExceptionType* exceptionType, Compartment* newCompartment);
 	Instance* cloneInstance(Instance* instance, Compartment* newCompartment);
 
@@ -349,6 +565,10 @@ namespace WAVM { namespace Runtime {
 	Table* getTableFromRuntimeData(ContextRuntimeData* contextRuntimeData, Uptr tableId);
 	Memory* getMemoryFromRuntimeData(ContextRuntimeData* contextRuntimeData, Uptr memoryId);
 
+	// Maps the first numPlatformPages pages of a newly created memory from a memory image. Returns
+	// false if the pages couldn't be mapped, in which case they are left zeroed.
+	bool mapMemoryImage(Memory* memory, const MemoryImage& memoryImage);
+
 	// Initialize a data segment (equivalent to executing a memory.init instruction).
 	void initDataSegment(Instance* instance,
 						 Uptr dataSegmentIndex,
@@ -3,6 +3,7 @@
 #include <vector>
 #include "RuntimePrivate.h"
 #include "WAVM/IR/Types.h"
+#include "WAVM/Inline/AddressRangeMap.h"
 #include "WAVM/Inline/Assert.h"
 #include "WAVM/Inline/BasicTypes.h"
 #include "WAVM/LLVMJIT/LLVMJIT.h"
@@ -20,9 +21,10 @@ namespace WAVM { namespace Runtime {
 	WAVM_DEFINE_INTRINSIC_MODULE(wavmIntrinsicsTable)
 }}
 
-// Global lists of tables; used to query whether an address is reserved by one of them.
+// Global map of the address ranges reserved by tables; used to query whether an address is reserved
+// by one of them.
 static Platform::RWMutex tablesMutex;
-static std::vector<Table*> tables;
+static AddressRangeMap<Table*> tableAddressRanges;
 
 static constexpr Uptr numGuardPages = 1;
 static constexpr U64 maxTable32Elems = U64(UINT32_MAX) + 1;
@@ -87,14 +89,25 @@ static Table* createTableImpl(Compartment* compartment,
 		return nullptr;
 	}
 
-	// Add the table to the global array.
+	// Add the table's address range to the global map.
+	if(table->numReservedBytes)
 	{
 		Platform::RWMutex::ExclusiveLock tablesLock(tablesMutex);
-		tables.push_back(table);
+		tableAddressRanges.addOrFail(
+			reinterpret_cast<Uptr>(table->elements),
+			reinterpret_cast<Uptr>(table->elements) + table->numReservedBytes,
+			table);
 	}
 	return table;
 }
 
+// Records that a table's elements were written, so the next young garbage collection scans it.
+static void markTableWritten(Table* table)
+{
+	if(!table->wasWrittenSinceScan.load(std::memory_order_relaxed))
+	{ table->wasWrittenSinceScan.store(true, std::memory_order_release); }
+}
+
 static GrowResult growTableImpl(Table* table,
 								Uptr numElementsToGrow,
 								Uptr* outOldNumElements,
@@ -147,6 +160,8 @@ static GrowResult growTableImpl(Table* table,
 		if(initializeNewElements)
 		{
 			// Write the uninitialized sentinel value to the new elements.
+			markTableWritten(table);
+			noteReference(initializeToElement, table->definingInstanceId);
 			const Uptr biasedTableInitElement
 				= objectToBiasedTableElementValue(initializeToElement);
 			for(Uptr elementIndex = oldNumElements; elementIndex < newNumElements; ++elementIndex)
@@ -239,6 +254,7 @@ Table* Runtime::cloneTable(Table* table, Compartment* newCompartment)
 		Platform::RWMutex::ExclusiveLock compartmentLock(newCompartment->mutex);
 
 		newTable->id = table->id;
+		newTable->isImmutable = table->isImmutable;
 		newCompartment->tables.insertOrFail(newTable->id, newTable);
 		newCompartment->runtimeData->tables[newTable->id].base = newTable->elements;
 		newCompartment->runtimeData->tables[newTable->id].endIndex = newTable->numReservedElements;
@@ -261,17 +277,12 @@ Table::~Table()
 		compartment->runtimeData->tables[id].endIndex = 0;
 	}
 
-	// Remove the table from the global array.
+	// Remove the table's address range from the global map.
+	if(elements && numReservedBytes)
 	{
 		Platform::RWMutex::ExclusiveLock tablesLock(tablesMutex);
-		for(Uptr tableIndex = 0; tableIndex < tables.size(); ++tableIndex)
-		{
-			if(tables[tableIndex] == this)
-			{
-				tables.erase(tables.begin() + tableIndex);
-				break;
-			}
-		}
+		tableAddressRanges.remove(reinterpret_cast<Uptr>(elements),
+								  reinterpret_cast<Uptr>(elements) + numReservedBytes);
 	}
 
 	// Free the virtual address space.
@@ -292,21 +303,15 @@ Table::~Table()
 
 bool Runtime::isAddressOwnedByTable(U8* address, Table*& outTable, Uptr& outTableIndex)
 {
-	// Iterate over all tables and check if the address is within the reserved address space for
-	// each.
+	// Find the table whose reserved address range contains the address.
 	Platform::RWMutex::ShareableLock tablesLock(tablesMutex);
-	for(auto table : tables)
-	{
-		U8* startAddress = (U8*)table->elements;
-		U8* endAddress = ((U8*)table->elements) + table->numReservedBytes;
-		if(address >= startAddress && address < endAddress)
-		{
-			outTable = table;
-			outTableIndex = (address - startAddress) / sizeof(Table::Element);
-			return true;
-		}
-	}
-	return false;
+	Uptr startAddress = 0;
+	Table* const* table = tableAddressRanges.get(reinterpret_cast<Uptr>(address), &startAddress);
+	if(!table) { return false; }
+
+	outTable = *table;
+	outTableIndex = (reinterpret_cast<Uptr>(address) - startAddress) / sizeof(Table::Element);
+	return true;
 }
 
 static Object* setTableElementNonNull(Table* table, Uptr index, Object* object)
@@ -323,6 +328,8 @@ static Object* setTableElementNonNull(Table* table, Uptr index, Object* object)
 
 	// Compute the biased value to store in the table.
 	const Uptr biasedValue = objectToBiasedTableElementValue(object);
+	markTableWritten(table);
+	noteReference(object, table->definingInstanceId);
 
 	// Atomically replace the table element, throwing an out-of-bounds exception before the write if
 	// the element being replaced is an out-of-bounds sentinel value.
@@ -372,6 +379,9 @@ Object* Runtime::setTableElement(Table* table, Uptr index, Object* newValue)
 {
 	WAVM_ASSERT(!newValue || isInCompartment(newValue, table->compartment));
 
+	// The code of the instance that defined an immutable table assumes its elements never change.
+	if(table->isImmutable) { throwException(ExceptionTypes::invalidArgument); }
+
 	// If the new value is null, write the uninitialized sentinel value instead.
 	if(!newValue) { newValue = getUninitializedElement(); }
 
@@ -413,6 +423,13 @@ GrowResult Runtime::growTable(Table* table,
 							  Uptr* outOldNumElements,
 							  Object* initialElement)
 {
+	// The code of the instance that defined an immutable table assumes its size never changes.
+	if(table->isImmutable && numElementsToGrow)
+	{
+		if(outOldNumElements) { *outOldNumElements = getTableNumElements(table); }
+		return GrowResult::outOfMaxSize;
+	}
+
 	// If the initial value is null, write the uninitialized sentinel value instead.
 	if(!initialElement) { initialElement = getUninitializedElement(); }
 
@@ -732,14 +749,18 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wavmIntrinsicsTable,
 {
 	Table* table = getTableFromRuntimeData(contextRuntimeData, tableId);
 	if(asObject(function) == getOutOfBoundsElement())
-	{ throwException(ExceptionTypes::outOfBoundsTableAccess, {table, U64(index)}); }
+	{
+		IR::UntaggedValue exceptionArguments[2] = {table, U64(index)};
+		trap(ExceptionTypes::outOfBoundsTableAccess, exceptionArguments, 2);
+	}
 	else if(asObject(function) == getUninitializedElement())
 	{
-		throwException(ExceptionTypes::uninitializedTableElement, {table, U64(index)});
+		IR::UntaggedValue exceptionArguments[2] = {table, U64(index)};
+		trap(ExceptionTypes::uninitializedTableElement, exceptionArguments, 2);
 	}
 	else
 	{
-		throwException(ExceptionTypes::indirectCallSignatureMismatch,
-					   {function, U64(expectedTypeEncoding)});
+		IR::UntaggedValue exceptionArguments[2] = {function, U64(expectedTypeEncoding)};
+		trap(ExceptionTypes::indirectCallSignatureMismatch, exceptionArguments, 2);
 	}
 }
@@ -26,12 +26,17 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wavmIntrinsics,
 							   void,
 							   divideByZeroOrIntegerOverflowTrap)
 {
-	throwException(ExceptionTypes::integerDivideByZeroOrOverflow);
+	trap(ExceptionTypes::integerDivideByZeroOrOverflow);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(wavmIntrinsics, "unreachableTrap", void, unreachableTrap)
 {
-	throwException(ExceptionTypes::reachedUnreachable);
+	trap(ExceptionTypes::reachedUnreachable);
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(wavmIntrinsics, "outOfFuelTrap", void, outOfFuelTrap)
+{
+	trap(ExceptionTypes::outOfFuel);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(wavmIntrinsics,
@@ -39,7 +44,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wavmIntrinsics,
 							   void,
 							   invalidFloatOperationTrap)
 {
-	throwException(ExceptionTypes::invalidFloatOperation);
+	trap(ExceptionTypes::invalidFloatOperation);
 }
 
 static thread_local Uptr indentLevel = 0;
@@ -1,8 +1,15 @@
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <tuple>
+#include <vector>
 #include "./WASIPrivate.h"
 #include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/I128.h"
 #include "WAVM/Inline/Time.h"
 #include "WAVM/Logging/Logging.h"
 #include "WAVM/Platform/Clock.h"
+#include "WAVM/Platform/File.h"
 #include "WAVM/Platform/RWMutex.h"
 #include "WAVM/Runtime/Runtime.h"
 #include "WAVM/VFS/VFS.h"
@@ -261,6 +268,13 @@ Result WASI::FDE::close()
 {
 	WAVM_ASSERT(vfd);
 
+	// Interrupt any poll_oneoff calls that are waiting for the VFD's host FD before closing it.
+	{
+		Platform::Mutex::Lock pollInterruptsLock(pollInterruptsMutex);
+		for(Platform::IOWaitInterrupt* pollInterrupt : pollInterrupts)
+		{ pollInterrupt->interrupt(); }
+	}
+
 	Result result = vfd->close();
 	vfd = nullptr;
 
@@ -1527,3 +1541,228 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasiFile,
 	const VFS::Result result = process->fileSystem->createDir(canonicalPath);
 	return TRACE_SYSCALL_RETURN(asWASIErrNo(result));
 }
+
+// An FDE that poll_oneoff waits for without holding its lock. While it is being waited for,
+// closing the FDE interrupts the wait.
+struct PolledFDE
+{
+	__wasi_errno_t error = __WASI_ESUCCESS;
+
+	// Only set if error==__WASI_ESUCCESS:
+	std::shared_ptr<FDE> fde;
+	I32 hostFD = -1;
+	Platform::IOWaitInterrupt* interrupt = nullptr;
+
+	PolledFDE() {}
+	PolledFDE(const PolledFDE&) = delete;
+	void operator=(const PolledFDE&) = delete;
+
+	~PolledFDE()
+	{
+		if(interrupt)
+		{
+			Platform::Mutex::Lock pollInterruptsLock(fde->pollInterruptsMutex);
+			std::vector<Platform::IOWaitInterrupt*>& pollInterrupts = fde->pollInterrupts;
+			pollInterrupts.erase(
+				std::find(pollInterrupts.begin(), pollInterrupts.end(), interrupt));
+		}
+	}
+
+	// Looks up and locks the FDE for an FD, and registers the interrupt with it, so closing the
+	// FDE interrupts the wait.
+	void init(Process* process, __wasi_fd_t fd, Platform::IOWaitInterrupt* inInterrupt)
+	{
+		LockedFDE lockedFDE = getLockedFDE(process, fd, __WASI_RIGHT_POLL_FD_READWRITE, 0);
+		error = lockedFDE.error;
+		if(error != __WASI_ESUCCESS) { return; }
+
+		error = asWASIErrNo(lockedFDE.fde->vfd->getHostFD(hostFD));
+		if(error != __WASI_ESUCCESS) { return; }
+
+		fde = lockedFDE.fde;
+		interrupt = inInterrupt;
+		Platform::Mutex::Lock pollInterruptsLock(fde->pollInterruptsMutex);
+		fde->pollInterrupts.push_back(interrupt);
+	}
+
+	// Returns whether the FDE was closed since init.
+	bool wasClosed() const
+	{
+		Platform::RWMutex::ShareableLock fdeLock(fde->mutex);
+		return !fde->vfd;
+	}
+};
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(wasiFile,
+							   "poll_oneoff",
+							   __wasi_errno_return_t,
+							   wasi_poll_oneoff,
+							   WASIAddress inAddress,
+							   WASIAddress outAddress,
+							   WASIAddress numSubscriptions,
+							   WASIAddress outNumEventsAddress)
+{
+	TRACE_SYSCALL("poll_oneoff",
+				  "(" WASIADDRESS_FORMAT ", " WASIADDRESS_FORMAT ", %u, " WASIADDRESS_FORMAT ")",
+				  inAddress,
+				  outAddress,
+				  numSubscriptions,
+				  outNumEventsAddress);
+
+	Process* process = getProcessFromContextRuntimeData(contextRuntimeData);
+
+	if(!numSubscriptions) { return TRACE_SYSCALL_RETURN(__WASI_EINVAL); }
+
+	// Copy the subscriptions out of the guest memory, so other guest threads can't change them
+	// while they are being processed.
+	const __wasi_subscription_t* guestSubscriptions
+		= memoryArrayPtr<__wasi_subscription_t>(process->memory, inAddress, numSubscriptions);
+	std::vector<__wasi_subscription_t> subscriptions(guestSubscriptions,
+													 guestSubscriptions + numSubscriptions);
+
+	std::vector<__wasi_event_t> events;
+	auto addEvent = [&events](const __wasi_subscription_t& subscription, __wasi_errno_t error) {
+		__wasi_event_t event;
+		memset(&event, 0, sizeof(event));
+		event.userdata = subscription.userdata;
+		event.error = error;
+		event.type = subscription.type;
+		events.push_back(event);
+		return &events.back();
+	};
+
+	// Translate the clock subscriptions to deadlines on the monotonic clock, and the fd
+	// subscriptions to IOWaits. Each FD is looked up once, even if it has several subscriptions.
+	// The FDEs aren't locked during the wait, so other threads can use and close them, and closing
+	// one of them interrupts the wait.
+	std::vector<Uptr> clockSubscriptionIndices;
+	std::vector<Time> clockDeadlines;
+	std::vector<Uptr> ioWaitSubscriptionIndices;
+	std::vector<Platform::IOWait> ioWaits;
+	std::vector<const PolledFDE*> ioWaitPolledFDEs;
+	Platform::IOWaitInterrupt interrupt;
+	std::map<__wasi_fd_t, PolledFDE> polledFDEs;
+	const Time startTime = Platform::getClockTime(Platform::Clock::monotonic);
+	for(Uptr subscriptionIndex = 0; subscriptionIndex < numSubscriptions; ++subscriptionIndex)
+	{
+		const __wasi_subscription_t& subscription = subscriptions[subscriptionIndex];
+		switch(subscription.type)
+		{
+		case __WASI_EVENTTYPE_CLOCK: {
+			TRACE_SYSCALL_FLOW("subscription[%" WAVM_PRIuPTR "]=(clock=%u, timeout=%" PRIu64
+							   ", flags=%u)",
+							   subscriptionIndex,
+							   subscription.u.clock.clock_id,
+							   subscription.u.clock.timeout,
+							   subscription.u.clock.flags);
+
+			Platform::Clock platformClock;
+			switch(subscription.u.clock.clock_id)
+			{
+			case __WASI_CLOCK_REALTIME: platformClock = Platform::Clock::realtime; break;
+			case __WASI_CLOCK_MONOTONIC: platformClock = Platform::Clock::monotonic; break;
+			case __WASI_CLOCK_PROCESS_CPUTIME_ID:
+			case __WASI_CLOCK_THREAD_CPUTIME_ID: addEvent(subscription, __WASI_ENOTSUP); continue;
+			default: addEvent(subscription, __WASI_EINVAL); continue;
+			};
+
+			Time deadline{startTime.ns + subscription.u.clock.timeout};
+			if(subscription.u.clock.flags & __WASI_SUBSCRIPTION_CLOCK_ABSTIME)
+			{ deadline.ns -= Platform::getClockTime(platformClock).ns; }
+
+			clockSubscriptionIndices.push_back(subscriptionIndex);
+			clockDeadlines.push_back(deadline);
+			break;
+		}
+		case __WASI_EVENTTYPE_FD_READ:
+		case __WASI_EVENTTYPE_FD_WRITE: {
+			const __wasi_fd_t fd = subscription.u.fd_readwrite.fd;
+			TRACE_SYSCALL_FLOW("subscription[%" WAVM_PRIuPTR "]=(fd=%u, type=%u)",
+							   subscriptionIndex,
+							   fd,
+							   subscription.type);
+
+			auto polledFDEIt = polledFDEs.find(fd);
+			if(polledFDEIt == polledFDEs.end())
+			{
+				polledFDEIt = polledFDEs.emplace_hint(polledFDEIt,
+													  std::piecewise_construct,
+													  std::forward_as_tuple(fd),
+													  std::forward_as_tuple());
+				polledFDEIt->second.init(process, fd, &interrupt);
+			}
+			const PolledFDE& polledFDE = polledFDEIt->second;
+			if(polledFDE.error != __WASI_ESUCCESS)
+			{
+				addEvent(subscription, polledFDE.error);
+				continue;
+			}
+
+			Platform::IOWait ioWait;
+			ioWait.hostFD = polledFDE.hostFD;
+			ioWait.waitForRead = subscription.type == __WASI_EVENTTYPE_FD_READ;
+			ioWait.waitForWrite = subscription.type == __WASI_EVENTTYPE_FD_WRITE;
+			ioWaitSubscriptionIndices.push_back(subscriptionIndex);
+			ioWaits.push_back(ioWait);
+			ioWaitPolledFDEs.push_back(&polledFDE);
+			break;
+		}
+		default: addEvent(subscription, __WASI_EINVAL); break;
+		};
+	}
+
+	// Wait until at least one subscription has an event. If some subscriptions already have an
+	// event, just poll the FDs without waiting.
+	while(true)
+	{
+		Time timeout = events.size() ? Time{0} : Time::infinity();
+		const Time waitStartTime = Platform::getClockTime(Platform::Clock::monotonic);
+		for(const Time& deadline : clockDeadlines)
+		{
+			const I128 untilDeadline = deadline.ns > waitStartTime.ns
+										   ? deadline.ns - waitStartTime.ns
+										   : I128(0);
+			if(isInfinity(timeout) || untilDeadline < timeout.ns) { timeout.ns = untilDeadline; }
+		}
+
+		Platform::waitForIO(ioWaits.data(), ioWaits.size(), timeout, &interrupt);
+
+		for(Uptr waitIndex = 0; waitIndex < ioWaits.size(); ++waitIndex)
+		{
+			const __wasi_subscription_t& subscription
+				= subscriptions[ioWaitSubscriptionIndices[waitIndex]];
+
+			// If the FDE was closed during the wait, its host FD may have been reused, so ignore
+			// the readiness that the wait observed for it.
+			if(ioWaitPolledFDEs[waitIndex]->wasClosed())
+			{
+				addEvent(subscription, __WASI_EBADF);
+				continue;
+			}
+
+			const Platform::IOWait& ioWait = ioWaits[waitIndex];
+			if(!ioWait.isReady) { continue; }
+
+			__wasi_event_t* event = addEvent(subscription, asWASIErrNo(ioWait.result));
+			if(ioWait.waitForRead) { event->u.fd_readwrite.nbytes = ioWait.numReadableBytes; }
+			if(ioWait.isHungUp) { event->u.fd_readwrite.flags = __WASI_EVENT_FD_READWRITE_HANGUP; }
+		}
+
+		const Time waitEndTime = Platform::getClockTime(Platform::Clock::monotonic);
+		for(Uptr clockIndex = 0; clockIndex < clockDeadlines.size(); ++clockIndex)
+		{
+			if(waitEndTime.ns >= clockDeadlines[clockIndex].ns)
+			{ addEvent(subscriptions[clockSubscriptionIndices[clockIndex]], __WASI_ESUCCESS); }
+		}
+
+		if(events.size()) { break; }
+	};
+
+	WAVM_ASSERT(events.size() <= numSubscriptions);
+	__wasi_event_t* guestEvents
+		= memoryArrayPtr<__wasi_event_t>(process->memory, outAddress, events.size());
+	memcpy(guestEvents, events.data(), events.size() * sizeof(__wasi_event_t));
+	memoryRef<WASIAddress>(process->memory, outNumEventsAddress) = WASIAddress(events.size());
+
+	return TRACE_SYSCALL_RETURN(__WASI_ESUCCESS, "(%" WAVM_PRIuPTR ")", events.size());
+}
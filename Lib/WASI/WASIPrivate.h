@@ -1,9 +1,11 @@
 #include <memory.h>
+#include <vector>
 #include "WAVM/IR/Types.h"
 #include "WAVM/Inline/BasicTypes.h"
 #include "WAVM/Inline/HashMap.h"
 #include "WAVM/Inline/IndexMap.h"
 #include "WAVM/Inline/Time.h"
+#include "WAVM/Platform/File.h"
 #include "WAVM/Platform/Mutex.h"
 #include "WAVM/Platform/RWMutex.h"
 #include "WAVM/Runtime/Intrinsics.h"
@@ -71,6 +73,11 @@ namespace WAVM { namespace WASI {
 
 		VFS::DirEntStream* dirEntStream{nullptr};
 
+		// The poll_oneoff calls that are waiting for the FDE without holding its lock. Closing the
+		// FDE interrupts them.
+		Platform::Mutex pollInterruptsMutex;
+		std::vector<Platform::IOWaitInterrupt*> pollInterrupts;
+
 		FDE(VFS::VFD* inVFD,
 			__wasi_rights_t inRights,
 			__wasi_rights_t inInheritingRights,
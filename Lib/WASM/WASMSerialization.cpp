@@ -491,6 +491,7 @@ static void serialize(OutputStream& stream, SectionID sectionID)
 struct ModuleSerializationState
 {
 	bool hadDataCountSection = false;
+	bool validateFunctionBodies = true;
 	std::shared_ptr<ModuleValidationState> validationState;
 	const Module& module;
 
@@ -1038,6 +1039,7 @@ static void serializeFunctionBody(InputStream& sectionStream,
 	ArrayOutputStream irCodeByteStream;
 	OperatorEncoderStream irEncoderStream(irCodeByteStream);
 	CodeValidationStream codeValidationStream(*moduleState.validationState, functionDef);
+	const bool validateCode = moduleState.validateFunctionBodies;
 	while(bodyStream.capacity())
 	{
 		Opcode opcode;
@@ -1048,7 +1050,7 @@ static void serializeFunctionBody(InputStream& sectionStream,
 	case Uptr(Opcode::name): {                                                                     \
 		Imm imm;                                                                                   \
 		serialize(bodyStream, imm, functionDef, moduleState);                                      \
-		codeValidationStream.name(imm);                                                            \
+		if(validateCode) { codeValidationStream.name(imm); }                                       \
 		irEncoderStream.name(imm);                                                                 \
 		break;                                                                                     \
 	}
@@ -1058,7 +1060,7 @@ static void serializeFunctionBody(InputStream& sectionStream,
 		case 0x1b: {
 			SelectImm imm{ValueType::any};
 
-			codeValidationStream.select(imm);
+			if(validateCode) { codeValidationStream.select(imm); }
 			irEncoderStream.select(imm);
 			break;
 		}
@@ -1066,7 +1068,7 @@ static void serializeFunctionBody(InputStream& sectionStream,
 			SelectImm imm;
 			serialize(bodyStream, imm, functionDef, moduleState);
 
-			codeValidationStream.select(imm);
+			if(validateCode) { codeValidationStream.select(imm); }
 			irEncoderStream.select(imm);
 			break;
 		}
@@ -1075,7 +1077,7 @@ static void serializeFunctionBody(InputStream& sectionStream,
 											  + std::to_string(Uptr(opcode)) + ")");
 		};
 	};
-	codeValidationStream.finish();
+	if(validateCode) { codeValidationStream.finish(); }
 
 	functionDef.code = std::move(irCodeByteStream.getBytes());
 }
@@ -1507,12 +1509,15 @@ static void serializeModule(OutputStream& moduleStream, Module& module)
 	serializeCustomSectionsAfterKnownSection(moduleStream, module, OrderedSectionID::data);
 }
 
-static void serializeModule(InputStream& moduleStream, Module& module)
+static void serializeModule(InputStream& moduleStream,
+							Module& module,
+							bool validateFunctionBodies)
 {
 	serializeConstant(moduleStream, "magic number", U32(magicNumber));
 	serializeConstant(moduleStream, "version", U32(currentVersion));
 
 	ModuleSerializationState moduleState(module);
+	moduleState.validateFunctionBodies = validateFunctionBodies;
 	moduleState.validationState = IR::createModuleValidationState(module);
 
 	OrderedSectionID lastKnownOrderedSectionID = OrderedSectionID::moduleBeginning;
@@ -1656,7 +1661,8 @@ std::vector<U8> WASM::saveBinaryModule(const Module& module)
 bool WASM::loadBinaryModule(const U8* wasmBytes,
 							Uptr numWASMBytes,
 							IR::Module& outModule,
-							LoadError* outError)
+							LoadError* outError,
+							bool validateFunctionBodies)
 {
 	// Load the module from a binary WebAssembly file.
 	try
@@ -1664,7 +1670,7 @@ bool WASM::loadBinaryModule(const U8* wasmBytes,
 		Timing::Timer loadTimer;
 		MemoryInputStream stream(wasmBytes, numWASMBytes);
 
-		serializeModule(stream, outModule);
+		serializeModule(stream, outModule, validateFunctionBodies);
 
 		Timing::logRatePerSecond("Loaded WASM", loadTimer, numWASMBytes / 1024.0 / 1024.0, "MiB");
 		return true;
@@ -1,5 +1,7 @@
 #include <string.h>
+#include <algorithm>
 #include <string>
+#include <vector>
 #include "WAVM/IR/Module.h"
 #include "WAVM/IR/Types.h"
 #include "WAVM/Inline/BasicTypes.h"
@@ -57,6 +59,7 @@ static_assert(sizeof(wasm_val_t) == sizeof(UntaggedValue), "wasm_val_t should ma
 struct wasm_config_t
 {
 	FeatureSpec featureSpec;
+	LLVMJIT::CompileOptions compileOptions;
 };
 
 struct wasm_engine_t
@@ -264,6 +267,30 @@ IMPLEMENT_FEATURE(any_extern_kind_elems, allowAnyExternKindElemSegments)
 IMPLEMENT_FEATURE(wat_quoted_names, quotedNamesInTextFormat)
 IMPLEMENT_FEATURE(wat_custom_sections, customSectionsInTextFormat)
 
+bool wasm_config_set_optimization_level(wasm_config_t* config,
+										wasm_optimization_level_t optimization_level)
+{
+	switch(optimization_level)
+	{
+	case WASM_OPTIMIZATION_LEVEL_NONE:
+		config->compileOptions.optimizationLevel = LLVMJIT::OptimizationLevel::none;
+		break;
+	case WASM_OPTIMIZATION_LEVEL_FAST:
+		config->compileOptions.optimizationLevel = LLVMJIT::OptimizationLevel::fast;
+		break;
+	case WASM_OPTIMIZATION_LEVEL_BALANCED:
+		config->compileOptions.optimizationLevel = LLVMJIT::OptimizationLevel::balanced;
+		break;
+	case WASM_OPTIMIZATION_LEVEL_AGGRESSIVE:
+		config->compileOptions.optimizationLevel = LLVMJIT::OptimizationLevel::aggressive;
+		break;
+	default:
+		Log::printf(Log::debug, "Invalid optimization level: %u\n", U32(optimization_level));
+		return false;
+	};
+	return true;
+}
+
 // wasm_engine_t
 wasm_engine_t* wasm_engine_new() { return new wasm_engine_t; }
 wasm_engine_t* wasm_engine_new_with_config(wasm_config_t* config)
@@ -738,8 +765,12 @@ wasm_module_t* wasm_module_new(wasm_engine_t* engine, const char* wasmBytes, uin
 {
 	WASM::LoadError loadError;
 	ModuleRef module;
-	if(loadBinaryModule(
-		   (const U8*)wasmBytes, numWASMBytes, module, engine->config.featureSpec, &loadError))
+	if(loadBinaryModule((const U8*)wasmBytes,
+						numWASMBytes,
+						module,
+						engine->config.featureSpec,
+						engine->config.compileOptions,
+						&loadError))
 	{ return new wasm_module_t{module}; }
 	else
 	{
@@ -761,7 +792,7 @@ wasm_module_t* wasm_module_new_text(wasm_engine_t* engine, const char* text, siz
 		return nullptr;
 	}
 
-	ModuleRef module = compileModule(irModule);
+	ModuleRef module = compileModule(irModule, engine->config.compileOptions);
 	return new wasm_module_t{module};
 }
 
@@ -947,6 +978,53 @@ wasm_trap_t* wasm_func_call(wasm_store_t* store,
 	return exception;
 }
 
+wasm_trap_t* wasm_func_call_batch(wasm_store_t* store,
+								  const wasm_func_t* function,
+								  size_t num_calls,
+								  const wasm_val_t args[],
+								  wasm_val_t outResults[],
+								  size_t* out_num_completed_calls)
+{
+	FunctionType functionType = getFunctionType((Function*)function);
+
+	// Return an error trap if the number of calls is too large for the packed arguments or results
+	// to fit in memory.
+	const Uptr maxValuesPerCall
+		= std::max(functionType.params().size(), functionType.results().size());
+	if(maxValuesPerCall && num_calls > UINTPTR_MAX / sizeof(UntaggedValue) / maxValuesPerCall)
+	{
+		if(out_num_completed_calls) { *out_num_completed_calls = 0; }
+		return createException(
+			ExceptionTypes::invalidArgument, nullptr, 0, Platform::captureCallStack(1));
+	}
+
+	const Uptr numArgs = num_calls * functionType.params().size();
+	const Uptr numResults = num_calls * functionType.results().size();
+
+	// wasm_val_t isn't as aligned as UntaggedValue, so copy the arguments and results once for the
+	// whole batch.
+	std::vector<UntaggedValue> wavmArgs(numArgs);
+	for(Uptr argIndex = 0; argIndex < numArgs; ++argIndex)
+	{ memcpy(&wavmArgs[argIndex].bytes, &args[argIndex], sizeof(wasm_val_t)); }
+	std::vector<UntaggedValue> wavmResults(numResults);
+
+	Uptr numCompletedCalls = 0;
+	Exception* exception = tryInvokeFunctionBatch(store,
+												  function,
+												  functionType,
+												  num_calls,
+												  wavmArgs.data(),
+												  wavmResults.data(),
+												  &numCompletedCalls);
+
+	const Uptr numCompletedResults = numCompletedCalls * functionType.results().size();
+	for(Uptr resultIndex = 0; resultIndex < numCompletedResults; ++resultIndex)
+	{ memcpy(&outResults[resultIndex], &wavmResults[resultIndex].bytes, sizeof(wasm_val_t)); }
+	if(out_num_completed_calls) { *out_num_completed_calls = numCompletedCalls; }
+
+	return exception;
+}
+
 // wasm_global_t
 IMPLEMENT_REF(global, Global)
 
@@ -1133,6 +1211,7 @@ wasm_instance_t* wasm_instance_new(wasm_store_t* store,
 										 module->module,
 										 std::move(importBindings),
 										 std::string(debug_name));
+			if(!instance) { return; }
 
 			addGCRoot(instance);
 
@@ -1,6 +1,7 @@
 #include <inttypes.h>
 #include <stdlib.h>
 #include <string.h>
+#include <algorithm>
 #include <string>
 #include <utility>
 #include <vector>
@@ -15,6 +16,11 @@
 #include "WAVM/Inline/Timing.h"
 #include "WAVM/LLVMJIT/LLVMJIT.h"
 #include "WAVM/Logging/Logging.h"
+#include "WAVM/ObjectCache/ObjectCache.h"
+#include "WAVM/Platform/Clock.h"
+#include "WAVM/Platform/Defines.h"
+#include "WAVM/Platform/Diagnostics.h"
+#include "WAVM/Platform/File.h"
 #include "WAVM/Platform/Thread.h"
 #include "WAVM/Runtime/Intrinsics.h"
 #include "WAVM/Runtime/Runtime.h"
@@ -37,6 +43,7 @@ struct ThreadArgs
 {
 	Context* context = nullptr;
 	Function* function = nullptr;
+	Uptr threadIndex = 0;
 	F64 elapsedNanoseconds = 0;
 	Platform::Thread* thread = nullptr;
 };
@@ -54,6 +61,7 @@ void runBenchmark(Compartment* compartment,
 		ThreadArgs* threadArgs = new ThreadArgs;
 		threadArgs->context = createContext(compartment);
 		threadArgs->function = function;
+		threadArgs->threadIndex = threadIndex;
 		threadArgs->thread = Platform::createThread(512 * 1024, threadFunc, threadArgs);
 		threads.push_back(threadArgs);
 	}
@@ -89,10 +97,16 @@ void runBenchmarkSingleAndMultiThreaded(Compartment* compartment,
 
 void showBenchmarkHelp(WAVM::Log::Category outputCategory)
 {
-	Log::printf(outputCategory, "Usage: wavm test bench\n");
+	Log::printf(outputCategory,
+				"Usage: wavm test bench\n"
+				"\n"
+				"If WAVM_OBJECT_CACHE_DIR is set, also measures object cache hits in the cache\n"
+				"in that directory. Run several benchmark processes at once to measure hits\n"
+				"that are concurrent across processes.\n");
 }
 
 static constexpr Uptr numInvokesPerThread = 100000000;
+static constexpr Uptr numInvokesPerBatch = 1000;
 
 void runInvokeBench()
 {
@@ -169,6 +183,55 @@ void runInvokeBench()
 			return 0;
 		});
 
+	// Benchmark tryInvokeFunction.
+	runBenchmarkSingleAndMultiThreaded(
+		compartment, function, "tryInvokeFunction", [](void* argument) -> I64 {
+			ThreadArgs* threadArgs = (ThreadArgs*)argument;
+
+			FunctionType invokeSig({ValueType::i32}, {ValueType::i32});
+
+			Timing::Timer timer;
+			for(Uptr repeatIndex = 0; repeatIndex < numInvokesPerThread; ++repeatIndex)
+			{
+				UntaggedValue args[1]{I32(0)};
+				UntaggedValue results[1];
+				WAVM_ERROR_UNLESS(!tryInvokeFunction(
+					threadArgs->context, threadArgs->function, invokeSig, args, results));
+			}
+			timer.stop();
+
+			threadArgs->elapsedNanoseconds = timer.getNanoseconds() / F64(numInvokesPerThread);
+
+			return 0;
+		});
+
+	// Benchmark invokeFunctionBatch.
+	runBenchmarkSingleAndMultiThreaded(
+		compartment, function, "invokeFunctionBatch call", [](void* argument) -> I64 {
+			ThreadArgs* threadArgs = (ThreadArgs*)argument;
+
+			FunctionType invokeSig({ValueType::i32}, {ValueType::i32});
+			std::vector<UntaggedValue> args(numInvokesPerBatch, UntaggedValue(I32(0)));
+			std::vector<UntaggedValue> results(numInvokesPerBatch);
+
+			Timing::Timer timer;
+			for(Uptr batchIndex = 0; batchIndex < numInvokesPerThread / numInvokesPerBatch;
+				++batchIndex)
+			{
+				invokeFunctionBatch(threadArgs->context,
+									threadArgs->function,
+									invokeSig,
+									numInvokesPerBatch,
+									args.data(),
+									results.data());
+			}
+			timer.stop();
+
+			threadArgs->elapsedNanoseconds = timer.getNanoseconds() / F64(numInvokesPerThread);
+
+			return 0;
+		});
+
 	// Free the compartment.
 	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(compartment)));
 }
@@ -258,6 +321,899 @@ void runIntrinsicBench()
 	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(compartment)));
 }
 
+static constexpr Uptr numIndirectCallsPerThread = 100000000;
+
+// Returns the WAST for a module that makes indirect calls through a table of 4 functions with the
+// same type. If the table is exported, it may be mutated, so the calls must check the type of the
+// function they call. Otherwise, the table is immutable even though it is the module's default
+// table, so the calls don't check the type, and may be devirtualized to a switch between direct
+// calls.
+static std::string getCallIndirectBenchModuleWAST(bool exportTable)
+{
+	return std::string("(module\n"
+					   "  (type $i32_to_i32 (func (param i32) (result i32)))\n"
+					   "  (table $table 4 4 funcref)\n")
+		   + (exportTable ? "  (export \"table\" (table $table))\n" : "")
+		   + "  (elem (i32.const 0) $inc $dec $double $half)\n"
+			 "  (func $inc (type $i32_to_i32) (i32.add (local.get 0) (i32.const 1)))\n"
+			 "  (func $dec (type $i32_to_i32) (i32.sub (local.get 0) (i32.const 1)))\n"
+			 "  (func $double (type $i32_to_i32) (i32.shl (local.get 0) (i32.const 1)))\n"
+			 "  (func $half (type $i32_to_i32) (i32.shr_u (local.get 0) (i32.const 1)))\n"
+			 "  (func (export \"benchmarkCallIndirectFunc\") (param $numIterations i32)\n"
+			 "    (result i32)\n"
+			 "    (local $i i32)\n"
+			 "    (local $acc i32)\n"
+			 "    loop $loop\n"
+			 "      (local.set $acc (call_indirect (type $i32_to_i32)\n"
+			 "                        (local.get $acc)\n"
+			 "                        (i32.and (local.get $i) (i32.const 3))))\n"
+			 "      (local.set $i (i32.add (local.get $i) (i32.const 1)))\n"
+			 "      (br_if $loop (i32.ne (local.get $i) (local.get $numIterations)))\n"
+			 "    end\n"
+			 "    (local.get $acc)\n"
+			 "  )\n"
+			 ")";
+}
+
+void runCallIndirectBench()
+{
+	static const struct
+	{
+		const char* name;
+		bool exportTable;
+		bool devirtualizeIndirectCalls;
+	} configs[] = {
+		{"call_indirect with type check", true, false},
+		{"call_indirect without type check", false, false},
+		{"call_indirect devirtualized", false, true},
+	};
+
+	for(const auto& config : configs)
+	{
+		// Parse the call_indirect benchmark module.
+		const std::string wast = getCallIndirectBenchModuleWAST(config.exportTable);
+		std::vector<WAST::Error> parseErrors;
+		IR::Module irModule;
+		if(!WAST::parseModule(wast.c_str(), wast.size() + 1, irModule, parseErrors))
+		{
+			WAST::reportParseErrors("call_indirect benchmark module", wast.c_str(), parseErrors);
+			Errors::fatal("Failed to parse call_indirect benchmark module WAST");
+		}
+
+		// Compile and instantiate the module.
+		LLVMJIT::CompileOptions compileOptions;
+		compileOptions.devirtualizeIndirectCalls = config.devirtualizeIndirectCalls;
+		GCPointer<Compartment> compartment = Runtime::createCompartment();
+		auto instance = instantiateModule(compartment,
+										  compileModule(irModule, compileOptions),
+										  {},
+										  "benchmarkCallIndirectModule");
+		auto function = asFunction(getInstanceExport(instance, "benchmarkCallIndirectFunc"));
+
+		// Run the benchmark.
+		runBenchmarkSingleAndMultiThreaded(
+			compartment,
+			function,
+			config.name,
+			[](void* argument) -> I64 {
+				ThreadArgs* threadArgs = (ThreadArgs*)argument;
+
+				FunctionType invokeSig({ValueType::i32}, {ValueType::i32});
+
+				Timing::Timer timer;
+				UntaggedValue args[1]{I32(numIndirectCallsPerThread)};
+				UntaggedValue results[1];
+				invokeFunction(
+					threadArgs->context, threadArgs->function, invokeSig, args, results);
+				timer.stop();
+
+				threadArgs->elapsedNanoseconds
+					= timer.getNanoseconds() / F64(numIndirectCallsPerThread);
+
+				return 0;
+			});
+
+		// Free the compartment.
+		instance = nullptr;
+		function = nullptr;
+		WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(compartment)));
+	}
+}
+
+static constexpr Uptr numAtomicOpsPerThread = 10000000;
+static constexpr Uptr numPingPongsPerThread = 100000;
+
+// Each thread uses its own cache line in the shared memory.
+static constexpr Uptr atomicBenchBytesPerThread = 64;
+
+static constexpr const char* atomicBenchModuleWAST
+	= "(module\n"
+	  "  (memory 1 1 shared)\n"
+	  "  (func (export \"notify\") (param $address i32) (param $numIterations i32) (result i32)\n"
+	  "    (local $i i32)\n"
+	  "    (local $acc i32)\n"
+	  "    loop $loop\n"
+	  "      (local.set $acc (i32.add (local.get $acc)\n"
+	  "                               (memory.atomic.notify (local.get $address) (i32.const 1))))\n"
+	  "      (local.set $i (i32.add (local.get $i) (i32.const 1)))\n"
+	  "      (br_if $loop (i32.ne (local.get $i) (local.get $numIterations)))\n"
+	  "    end\n"
+	  "    (local.get $acc)\n"
+	  "  )\n"
+	  "  (func (export \"waitNotEqual\") (param $address i32) (param $numIterations i32)\n"
+	  "    (result i32)\n"
+	  "    (local $i i32)\n"
+	  "    (local $acc i32)\n"
+	  "    loop $loop\n"
+	  "      (local.set $acc (i32.add (local.get $acc)\n"
+	  "                               (memory.atomic.wait32 (local.get $address)\n"
+	  "                                                     (i32.const -1)\n"
+	  "                                                     (i64.const -1))))\n"
+	  "      (local.set $i (i32.add (local.get $i) (i32.const 1)))\n"
+	  "      (br_if $loop (i32.ne (local.get $i) (local.get $numIterations)))\n"
+	  "    end\n"
+	  "    (local.get $acc)\n"
+	  "  )\n"
+	  "  (func (export \"pingPong\") (param $address i32) (param $numIterations i32)\n"
+	  "    (param $side i32) (result i32)\n"
+	  "    (local $i i32)\n"
+	  "    loop $loop\n"
+	  "      block $ready\n"
+	  "        loop $wait\n"
+	  "          (br_if $ready (i32.eq (i32.atomic.load (local.get $address))\n"
+	  "                                (local.get $side)))\n"
+	  "          (drop (memory.atomic.wait32 (local.get $address)\n"
+	  "                                      (i32.xor (local.get $side) (i32.const 1))\n"
+	  "                                      (i64.const -1)))\n"
+	  "          (br $wait)\n"
+	  "        end\n"
+	  "      end\n"
+	  "      (i32.atomic.store (local.get $address) (i32.xor (local.get $side) (i32.const 1)))\n"
+	  "      (drop (memory.atomic.notify (local.get $address) (i32.const 1)))\n"
+	  "      (local.set $i (i32.add (local.get $i) (i32.const 1)))\n"
+	  "      (br_if $loop (i32.ne (local.get $i) (local.get $numIterations)))\n"
+	  "    end\n"
+	  "    (i32.const 0)\n"
+	  "  )\n"
+	  ")";
+
+static I64 atomicBenchThreadEntry(void* argument)
+{
+	ThreadArgs* threadArgs = (ThreadArgs*)argument;
+
+	FunctionType invokeSig({ValueType::i32}, {ValueType::i32, ValueType::i32});
+
+	Timing::Timer timer;
+	UntaggedValue args[2]{U32(threadArgs->threadIndex * atomicBenchBytesPerThread),
+						  U32(numAtomicOpsPerThread)};
+	UntaggedValue results[1];
+	invokeFunction(threadArgs->context, threadArgs->function, invokeSig, args, results);
+	timer.stop();
+
+	threadArgs->elapsedNanoseconds = timer.getNanoseconds() / F64(numAtomicOpsPerThread);
+
+	return 0;
+}
+
+static I64 pingPongThreadEntry(void* argument)
+{
+	ThreadArgs* threadArgs = (ThreadArgs*)argument;
+
+	FunctionType invokeSig({ValueType::i32}, {ValueType::i32, ValueType::i32, ValueType::i32});
+
+	// Each pair of threads shares an address, and the threads in the pair take opposite sides.
+	Timing::Timer timer;
+	UntaggedValue args[3]{U32(threadArgs->threadIndex / 2 * atomicBenchBytesPerThread),
+						  U32(numPingPongsPerThread),
+						  U32(threadArgs->threadIndex & 1)};
+	UntaggedValue results[1];
+	invokeFunction(threadArgs->context, threadArgs->function, invokeSig, args, results);
+	timer.stop();
+
+	threadArgs->elapsedNanoseconds = timer.getNanoseconds() / F64(numPingPongsPerThread);
+
+	return 0;
+}
+
+void runAtomicWaitNotifyBench()
+{
+	// Parse the atomic benchmark module.
+	std::vector<WAST::Error> parseErrors;
+	IR::Module irModule;
+	irModule.featureSpec.atomics = true;
+	if(!WAST::parseModule(
+		   atomicBenchModuleWAST, strlen(atomicBenchModuleWAST) + 1, irModule, parseErrors))
+	{
+		WAST::reportParseErrors("atomic benchmark module", atomicBenchModuleWAST, parseErrors);
+		Errors::fatal("Failed to parse atomic benchmark module WAST");
+	}
+
+	// Instantiate the WASM module.
+	GCPointer<Compartment> compartment = Runtime::createCompartment();
+	auto module = compileModule(irModule);
+	auto instance = instantiateModule(compartment, module, {}, "atomicBenchmarkModule");
+	auto notifyFunction = asFunction(getInstanceExport(instance, "notify"));
+	auto waitNotEqualFunction = asFunction(getInstanceExport(instance, "waitNotEqual"));
+	auto pingPongFunction = asFunction(getInstanceExport(instance, "pingPong"));
+
+	// Benchmark notifying addresses that no threads are waiting on, and waiting on addresses that
+	// don't contain the expected value. Each thread uses a different address, so these measure
+	// the overhead and contention of the wait table when no thread actually waits.
+	runBenchmarkSingleAndMultiThreaded(
+		compartment, notifyFunction, "memory.atomic.notify", atomicBenchThreadEntry);
+	runBenchmarkSingleAndMultiThreaded(compartment,
+									   waitNotEqualFunction,
+									   "memory.atomic.wait32 (not equal)",
+									   atomicBenchThreadEntry);
+
+	// Benchmark pairs of threads that take turns waking each other.
+	const Uptr numPingPongThreads
+		= std::max(Uptr(2), (Platform::getNumberOfHardwareThreads() / 2) & ~Uptr(1));
+	for(Uptr numThreads : {Uptr(2), numPingPongThreads})
+	{
+		runBenchmark(compartment,
+					 pingPongFunction,
+					 numThreads,
+					 "wait/notify round trip",
+					 pingPongThreadEntry);
+	}
+
+	// Free the compartment.
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(compartment)));
+}
+
+static constexpr Uptr numTrapsPerMeasurement = 10000;
+
+static constexpr const char* trapBenchModuleWAST
+	= "(module\n"
+	  "  (memory 1 1)\n"
+	  "  (table 1 1 funcref)\n"
+	  "  (func (export \"outOfBoundsLoad\") (result i32)\n"
+	  "    (i32.load (i32.const 65536))\n"
+	  "  )\n"
+	  ")";
+
+void runTrapBench()
+{
+	// Parse the trap benchmark module.
+	std::vector<WAST::Error> parseErrors;
+	IR::Module irModule;
+	if(!WAST::parseModule(
+		   trapBenchModuleWAST, strlen(trapBenchModuleWAST) + 1, irModule, parseErrors))
+	{
+		WAST::reportParseErrors("trap benchmark module", trapBenchModuleWAST, parseErrors);
+		Errors::fatal("Failed to parse trap benchmark module WAST");
+	}
+	auto module = compileModule(irModule);
+
+	// Allocate the benchmark's memories outside the memory pool, so that finding the memory that
+	// owns a faulting address has to search all the live memories that aren't in the pool.
+	const Uptr memoryPoolSize = getMemoryPoolStats().numSlots;
+	const bool disabledMemoryPool = setMemoryPoolSize(0);
+
+	GCPointer<Compartment> compartment = Runtime::createCompartment();
+	Context* context = createContext(compartment);
+	const FunctionType invokeSig({ValueType::i32}, {});
+
+	// Measure the time to handle an out-of-bounds memory access as the number of live instances,
+	// each with their own memory, table, and JIT code, increases.
+	std::vector<Instance*> instances;
+	for(Uptr numLiveInstances : {Uptr(1), Uptr(10), Uptr(100), Uptr(1000)})
+	{
+		while(instances.size() < numLiveInstances)
+		{ instances.push_back(instantiateModule(compartment, module, {}, "trapBenchmarkModule")); };
+
+		// Trap in the most recently created instance.
+		Function* function = asFunction(getInstanceExport(instances.back(), "outOfBoundsLoad"));
+
+		Timing::Timer timer;
+		for(Uptr trapIndex = 0; trapIndex < numTrapsPerMeasurement; ++trapIndex)
+		{
+			catchRuntimeExceptions(
+				[&] {
+					UntaggedValue results[1];
+					invokeFunction(context, function, invokeSig, nullptr, results);
+				},
+				[](Exception* exception) { destroyException(exception); });
+		}
+		timer.stop();
+
+		Log::printf(Log::output,
+					"ns/out-of-bounds trap with %" WAVM_PRIuPTR " live instances: %.2f\n",
+					numLiveInstances,
+					timer.getNanoseconds() / F64(numTrapsPerMeasurement));
+	}
+
+	// Free the compartment, and restore the memory pool.
+	instances.clear();
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(compartment)));
+	if(disabledMemoryPool) { WAVM_ERROR_UNLESS(setMemoryPoolSize(memoryPoolSize)); }
+}
+
+static constexpr Uptr numInstantiationsPerMeasurement = 1000;
+
+static constexpr const char* instanceBenchModuleWAST
+	= "(module\n"
+	  "  (memory 1 1)\n"
+	  "  (table 1 1 funcref)\n"
+	  "  (func $f (export \"f\") (result i32) (i32.const 0))\n"
+	  "  (elem (i32.const 0) $f)\n"
+	  ")";
+
+void runInstanceBench()
+{
+	// Parse the instance benchmark module.
+	std::vector<WAST::Error> parseErrors;
+	IR::Module irModule;
+	if(!WAST::parseModule(
+		   instanceBenchModuleWAST, strlen(instanceBenchModuleWAST) + 1, irModule, parseErrors))
+	{
+		WAST::reportParseErrors("instance benchmark module", instanceBenchModuleWAST, parseErrors);
+		Errors::fatal("Failed to parse instance benchmark module WAST");
+	}
+	auto module = compileModule(irModule);
+
+	// Measure the time to create and free an instance as the number of live instances in its
+	// compartment increases, freeing it with tryCollectInstance or collectCompartmentGarbage.
+	GCPointer<Compartment> compartment = Runtime::createCompartment();
+	std::vector<GCPointer<Instance>> liveInstances;
+	for(Uptr numLiveInstances : {Uptr(0), Uptr(10), Uptr(100), Uptr(1000)})
+	{
+		while(liveInstances.size() < numLiveInstances)
+		{ liveInstances.push_back(instantiateModule(compartment, module, {}, "liveInstance")); }
+
+		for(bool useTryCollectInstance : {true, false})
+		{
+			Timing::Timer timer;
+			for(Uptr instantiationIndex = 0; instantiationIndex < numInstantiationsPerMeasurement;
+				++instantiationIndex)
+			{
+				GCPointer<Instance> instance
+					= instantiateModule(compartment, module, {}, "instanceBenchmarkModule");
+				if(useTryCollectInstance)
+				{ WAVM_ERROR_UNLESS(tryCollectInstance(std::move(instance))); }
+				else
+				{
+					instance = nullptr;
+					collectCompartmentGarbage(compartment);
+				}
+			}
+			timer.stop();
+
+			Log::printf(Log::output,
+						"ns/instantiate and %s with %" WAVM_PRIuPTR " live instances: %.2f\n",
+						useTryCollectInstance ? "tryCollectInstance" : "collectCompartmentGarbage",
+						numLiveInstances,
+						timer.getNanoseconds() / F64(numInstantiationsPerMeasurement));
+		}
+	}
+
+	// Free the compartment.
+	liveInstances.clear();
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(compartment)));
+}
+
+// Returns the WAST for a module that imports a function, and defines numFunctions functions that
+// each call the import, grow the memory through a wavmIntrinsic, and are referenced by the table.
+// Every instance of the module must bind the import, the intrinsic, and each function's symbols.
+static std::string getLinkBenchModuleWAST(Uptr numFunctions)
+{
+	std::string wast = "(module\n"
+					   "  (import \"env\" \"f\" (func $import (result i32)))\n"
+					   "  (memory 1 2)\n";
+	wast += "  (table " + std::to_string(numFunctions) + " funcref)\n";
+	for(Uptr functionIndex = 0; functionIndex < numFunctions; ++functionIndex)
+	{
+		const std::string name = "$f" + std::to_string(functionIndex);
+		wast += "  (func " + name + " (result i32)\n"
+				+ "    (i32.add (call $import) (memory.grow (i32.const 0))))\n"
+				+ "  (elem (i32.const " + std::to_string(functionIndex) + ") " + name + ")\n";
+	}
+	wast += ")";
+	return wast;
+}
+
+void runLinkBench()
+{
+	// Instantiate a module that exports the function imported by the benchmark modules.
+	GCPointer<Compartment> compartment = Runtime::createCompartment();
+	static constexpr const char* envModuleWAST
+		= "(module (func (export \"f\") (result i32) (i32.const 0)))";
+	std::vector<WAST::Error> parseErrors;
+	IR::Module envIRModule;
+	if(!WAST::parseModule(envModuleWAST, strlen(envModuleWAST) + 1, envIRModule, parseErrors))
+	{
+		WAST::reportParseErrors("link benchmark env module", envModuleWAST, parseErrors);
+		Errors::fatal("Failed to parse link benchmark env module WAST");
+	}
+	GCPointer<Instance> envInstance
+		= instantiateModule(compartment, compileModule(envIRModule), {}, "env");
+	GCPointer<Function> envFunction = asFunction(getInstanceExport(envInstance, "f"));
+
+	// Measure the time to instantiate and free modules of increasing size. Nearly all of the time
+	// is spent loading and binding the module's object code, so the time for a 1-function module
+	// is dominated by the per-instance cost that doesn't depend on the module's size.
+	for(Uptr numFunctions : {Uptr(1), Uptr(10), Uptr(100), Uptr(1000)})
+	{
+		const std::string wast = getLinkBenchModuleWAST(numFunctions);
+		IR::Module irModule;
+		if(!WAST::parseModule(wast.c_str(), wast.size() + 1, irModule, parseErrors))
+		{
+			WAST::reportParseErrors("link benchmark module", wast.c_str(), parseErrors);
+			Errors::fatal("Failed to parse link benchmark module WAST");
+		}
+		ModuleRef module = compileModule(irModule);
+
+		// Scale the number of instantiations down for the larger modules.
+		const Uptr numInstantiations
+			= std::max(Uptr(10), numInstantiationsPerMeasurement / numFunctions);
+
+		Timing::Timer timer;
+		for(Uptr instantiationIndex = 0; instantiationIndex < numInstantiations;
+			++instantiationIndex)
+		{
+			GCPointer<Instance> instance = instantiateModule(
+				compartment, module, {asObject(envFunction)}, "linkBenchmarkModule");
+			WAVM_ERROR_UNLESS(tryCollectInstance(std::move(instance)));
+		}
+		timer.stop();
+
+		const F64 nanosecondsPerInstantiation
+			= timer.getNanoseconds() / F64(numInstantiations);
+		Log::printf(Log::output,
+					"ns/instantiate with %" WAVM_PRIuPTR " functions: %.2f (%.2f/function)\n",
+					numFunctions,
+					nanosecondsPerInstantiation,
+					nanosecondsPerInstantiation / F64(numFunctions));
+	}
+
+	// Free the compartment.
+	envFunction = nullptr;
+	envInstance = nullptr;
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(compartment)));
+}
+
+static constexpr Uptr exceptionBenchCallDepth = 16;
+
+static constexpr const char* exceptionBenchModuleWAST
+	= "(module\n"
+	  "  (memory 1 1)\n"
+	  "  (func $trapAtDepth (export \"trapAtDepth\") (param i32) (result i32)\n"
+	  "    (if (result i32) (local.get 0)\n"
+	  "      (then (i32.add (call $trapAtDepth (i32.sub (local.get 0) (i32.const 1)))\n"
+	  "                     (i32.const 1)))\n"
+	  "      (else (i32.load (i32.const 65536)))\n"
+	  "    )\n"
+	  "  )\n"
+	  ")";
+
+void runExceptionBench()
+{
+	// Parse the exception benchmark module.
+	std::vector<WAST::Error> parseErrors;
+	IR::Module irModule;
+	if(!WAST::parseModule(
+		   exceptionBenchModuleWAST, strlen(exceptionBenchModuleWAST) + 1, irModule, parseErrors))
+	{
+		WAST::reportParseErrors(
+			"exception benchmark module", exceptionBenchModuleWAST, parseErrors);
+		Errors::fatal("Failed to parse exception benchmark module WAST");
+	}
+
+	GCPointer<Compartment> compartment = Runtime::createCompartment();
+	Context* context = createContext(compartment);
+	Instance* instance
+		= instantiateModule(compartment, compileModule(irModule), {}, "exceptionBenchmarkModule");
+	Function* function = asFunction(getInstanceExport(instance, "trapAtDepth"));
+	const FunctionType invokeSig({ValueType::i32}, {ValueType::i32});
+
+	const Uptr globalDepth = getExceptionCallStackDepth();
+	for(Uptr depth : {Platform::CallStack::maxFrames, Uptr(8), Uptr(0)})
+	{
+		// Measure the round-trip time for a trap in WebAssembly code that is caught by the host.
+		setExceptionCallStackDepth(context, depth);
+		Timing::Timer trapTimer;
+		for(Uptr trapIndex = 0; trapIndex < numTrapsPerMeasurement; ++trapIndex)
+		{
+			catchRuntimeExceptions(
+				[&] {
+					UntaggedValue arguments[1] = {U32(exceptionBenchCallDepth)};
+					UntaggedValue results[1];
+					invokeFunction(context, function, invokeSig, arguments, results);
+				},
+				[](Exception* exception) { destroyException(exception); });
+		}
+		trapTimer.stop();
+
+		// Measure the same trap with tryInvokeFunction, which doesn't unwind the stack.
+		Timing::Timer tryInvokeTimer;
+		for(Uptr trapIndex = 0; trapIndex < numTrapsPerMeasurement; ++trapIndex)
+		{
+			UntaggedValue arguments[1] = {U32(exceptionBenchCallDepth)};
+			UntaggedValue results[1];
+			Exception* exception
+				= tryInvokeFunction(context, function, invokeSig, arguments, results);
+			WAVM_ERROR_UNLESS(exception);
+			destroyException(exception);
+		}
+		tryInvokeTimer.stop();
+
+		// Measure the round-trip time for an exception thrown and caught by the host.
+		setExceptionCallStackDepth(depth);
+		Timing::Timer throwTimer;
+		for(Uptr throwIndex = 0; throwIndex < numTrapsPerMeasurement; ++throwIndex)
+		{
+			catchRuntimeExceptions([] { throwException(ExceptionTypes::calledAbort); },
+								   [](Exception* exception) { destroyException(exception); });
+		}
+		throwTimer.stop();
+
+		Log::printf(Log::output,
+					"ns/trap and catch at call depth %" WAVM_PRIuPTR
+					" with call stack depth %" WAVM_PRIuPTR ": %.2f\n",
+					exceptionBenchCallDepth,
+					depth,
+					trapTimer.getNanoseconds() / F64(numTrapsPerMeasurement));
+		Log::printf(Log::output,
+					"ns/trap and tryInvokeFunction at call depth %" WAVM_PRIuPTR
+					" with call stack depth %" WAVM_PRIuPTR ": %.2f\n",
+					exceptionBenchCallDepth,
+					depth,
+					tryInvokeTimer.getNanoseconds() / F64(numTrapsPerMeasurement));
+		Log::printf(Log::output,
+					"ns/host throw and catch with call stack depth %" WAVM_PRIuPTR ": %.2f\n",
+					depth,
+					throwTimer.getNanoseconds() / F64(numTrapsPerMeasurement));
+	}
+
+	// Restore the global call stack depth, and free the compartment.
+	setExceptionCallStackDepth(globalDepth);
+	instance = nullptr;
+	function = nullptr;
+	context = nullptr;
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(compartment)));
+}
+
+static constexpr Uptr numFuelBenchInvokes = 10;
+
+// Standard kernels to measure the overhead of fuel metering: a tight loop, a recursive function,
+// a matrix multiply with nested loops, and a byte-by-byte memory copy.
+static constexpr const char* fuelBenchModuleWAST
+	= "(module\n"
+	  "  (memory 1 1)\n"
+	  "  (func (export \"sum\") (param $n i32) (result i32)\n"
+	  "    (local $i i32) (local $acc i32)\n"
+	  "    (loop $loop\n"
+	  "      (local.set $acc (i32.add (local.get $acc) (i32.mul (local.get $i) (local.get $i))))\n"
+	  "      (local.set $i (i32.add (local.get $i) (i32.const 1)))\n"
+	  "      (br_if $loop (i32.lt_u (local.get $i) (local.get $n))))\n"
+	  "    (local.get $acc)\n"
+	  "  )\n"
+	  "  (func $fib (export \"fib\") (param $n i32) (result i32)\n"
+	  "    (if (result i32) (i32.lt_u (local.get $n) (i32.const 2))\n"
+	  "      (then (local.get $n))\n"
+	  "      (else (i32.add (call $fib (i32.sub (local.get $n) (i32.const 1)))\n"
+	  "                     (call $fib (i32.sub (local.get $n) (i32.const 2))))))\n"
+	  "  )\n"
+	  "  (func (export \"matmul\") (param $n i32) (result i32)\n"
+	  "    (local $i i32) (local $j i32) (local $k i32) (local $acc i32)\n"
+	  "    (loop $iLoop\n"
+	  "      (local.set $j (i32.const 0))\n"
+	  "      (loop $jLoop\n"
+	  "        (local.set $acc (i32.const 0))\n"
+	  "        (local.set $k (i32.const 0))\n"
+	  "        (loop $kLoop\n"
+	  "          (local.set $acc (i32.add (local.get $acc) (i32.mul\n"
+	  "            (i32.load (i32.shl (i32.add (i32.mul (local.get $i) (local.get $n))\n"
+	  "                                        (local.get $k)) (i32.const 2)))\n"
+	  "            (i32.load offset=16384 (i32.shl (i32.add (i32.mul (local.get $k)\n"
+	  "                                                              (local.get $n))\n"
+	  "                                                     (local.get $j)) (i32.const 2))))))\n"
+	  "          (local.set $k (i32.add (local.get $k) (i32.const 1)))\n"
+	  "          (br_if $kLoop (i32.lt_u (local.get $k) (local.get $n))))\n"
+	  "        (i32.store offset=32768\n"
+	  "          (i32.shl (i32.add (i32.mul (local.get $i) (local.get $n)) (local.get $j))\n"
+	  "                   (i32.const 2))\n"
+	  "          (local.get $acc))\n"
+	  "        (local.set $j (i32.add (local.get $j) (i32.const 1)))\n"
+	  "        (br_if $jLoop (i32.lt_u (local.get $j) (local.get $n))))\n"
+	  "      (local.set $i (i32.add (local.get $i) (i32.const 1)))\n"
+	  "      (br_if $iLoop (i32.lt_u (local.get $i) (local.get $n))))\n"
+	  "    (i32.load offset=32768 (i32.const 0))\n"
+	  "  )\n"
+	  "  (func (export \"copy\") (param $n i32) (result i32)\n"
+	  "    (local $i i32)\n"
+	  "    (loop $loop\n"
+	  "      (i32.store8 offset=32768 (local.get $i) (i32.load8_u (local.get $i)))\n"
+	  "      (local.set $i (i32.add (local.get $i) (i32.const 1)))\n"
+	  "      (br_if $loop (i32.lt_u (local.get $i) (local.get $n))))\n"
+	  "    (local.get $i)\n"
+	  "  )\n"
+	  ")";
+
+void runFuelBench()
+{
+	// Parse the fuel benchmark module.
+	std::vector<WAST::Error> parseErrors;
+	IR::Module irModule;
+	if(!WAST::parseModule(
+		   fuelBenchModuleWAST, strlen(fuelBenchModuleWAST) + 1, irModule, parseErrors))
+	{
+		WAST::reportParseErrors("fuel benchmark module", fuelBenchModuleWAST, parseErrors);
+		Errors::fatal("Failed to parse fuel benchmark module WAST");
+	}
+
+	// Instantiate the module compiled with and without fuel metering.
+	GCPointer<Compartment> compartment = Runtime::createCompartment();
+	Context* context = createContext(compartment);
+	Instance* instances[2];
+	for(Uptr meterFuel = 0; meterFuel < 2; ++meterFuel)
+	{
+		LLVMJIT::CompileOptions compileOptions;
+		compileOptions.meterFuel = meterFuel != 0;
+		instances[meterFuel] = instantiateModule(
+			compartment, compileModule(irModule, compileOptions), {}, "fuelBenchmarkModule");
+	}
+
+	static const struct
+	{
+		const char* name;
+		U32 argument;
+	} kernels[] = {
+		{"sum", 10000000},
+		{"fib", 25},
+		{"matmul", 64},
+		{"copy", 32768},
+	};
+
+	const FunctionType invokeSig({ValueType::i32}, {ValueType::i32});
+	for(const auto& kernel : kernels)
+	{
+		F64 nanosecondsPerInvoke[2];
+		for(Uptr meterFuel = 0; meterFuel < 2; ++meterFuel)
+		{
+			Function* function = asFunction(getInstanceExport(instances[meterFuel], kernel.name));
+
+			// The context's fuel is effectively unlimited, so the metered code never traps.
+			Timing::Timer timer;
+			for(Uptr invokeIndex = 0; invokeIndex < numFuelBenchInvokes; ++invokeIndex)
+			{
+				UntaggedValue arguments[1] = {kernel.argument};
+				UntaggedValue results[1];
+				invokeFunction(context, function, invokeSig, arguments, results);
+			}
+			timer.stop();
+
+			nanosecondsPerInvoke[meterFuel] = timer.getNanoseconds() / F64(numFuelBenchInvokes);
+			Log::printf(Log::output,
+						"ns/%s %s fuel metering: %.2f\n",
+						kernel.name,
+						meterFuel ? "with" : "without",
+						nanosecondsPerInvoke[meterFuel]);
+		}
+
+		Log::printf(Log::output,
+					"%% fuel metering overhead for %s: %.1f\n",
+					kernel.name,
+					(nanosecondsPerInvoke[1] / nanosecondsPerInvoke[0] - 1.0) * 100.0);
+	}
+
+	// Free the compartment.
+	instances[0] = instances[1] = nullptr;
+	context = nullptr;
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(compartment)));
+}
+
+static constexpr Uptr numObjectCacheHitsPerThread = 10000;
+static constexpr Uptr objectCacheBenchObjectBytes = 256 * 1024;
+static constexpr U64 objectCacheBenchCodeKey = 0xbe9c4a2d5e6f7081;
+
+struct ObjectCacheBenchThreadArgs
+{
+	Runtime::ObjectCacheInterface* objectCache;
+	const Runtime::ObjectCacheKey* key;
+	F64 elapsedNanoseconds = 0;
+	Platform::Thread* thread = nullptr;
+};
+
+static I64 objectCacheBenchThreadEntry(void* argument)
+{
+	ObjectCacheBenchThreadArgs* threadArgs = (ObjectCacheBenchThreadArgs*)argument;
+
+	Timing::Timer timer;
+	for(Uptr hitIndex = 0; hitIndex < numObjectCacheHitsPerThread; ++hitIndex)
+	{
+		std::vector<U8> objectCode = threadArgs->objectCache->getCachedObject(
+			*threadArgs->key, []() { return std::vector<U8>(objectCacheBenchObjectBytes, 0); });
+		WAVM_ERROR_UNLESS(objectCode.size() == objectCacheBenchObjectBytes);
+	}
+	timer.stop();
+
+	threadArgs->elapsedNanoseconds = timer.getNanoseconds() / F64(numObjectCacheHitsPerThread);
+	return 0;
+}
+
+void runObjectCacheBench()
+{
+	const char* objectCachePath
+		= WAVM_SCOPED_DISABLE_SECURE_CRT_WARNINGS(getenv("WAVM_OBJECT_CACHE_DIR"));
+	if(!objectCachePath || !*objectCachePath) { return; }
+
+	// Open the object cache with a code key that isn't used by wavm run, so the benchmark's object
+	// doesn't mix with real cached objects.
+	std::shared_ptr<Runtime::ObjectCacheInterface> objectCache;
+	if(ObjectCache::open(
+		   objectCachePath, Uptr(1024) * 1024 * 1024, objectCacheBenchCodeKey, objectCache)
+	   != ObjectCache::OpenResult::success)
+	{
+		Log::printf(Log::error, "Failed to open object cache in \"%s\".\n", objectCachePath);
+		return;
+	}
+
+	// Add an object to the cache for a fake module, which is the same for all benchmark
+	// processes.
+	const std::vector<U8> wasmBytes(4096, 0xbe);
+	Runtime::ObjectCacheKey key;
+	key.wasmBytes = wasmBytes.data();
+	key.numWASMBytes = wasmBytes.size();
+	objectCache->getCachedObject(
+		key, []() { return std::vector<U8>(objectCacheBenchObjectBytes, 0); });
+
+	// Measure the time for a cache hit on one thread, and on many threads at once.
+	for(Uptr numThreads : {Uptr(1), Platform::getNumberOfHardwareThreads() / 2})
+	{
+		std::vector<ObjectCacheBenchThreadArgs*> threads;
+		for(Uptr threadIndex = 0; threadIndex < numThreads; ++threadIndex)
+		{
+			ObjectCacheBenchThreadArgs* threadArgs = new ObjectCacheBenchThreadArgs;
+			threadArgs->objectCache = objectCache.get();
+			threadArgs->key = &key;
+			threadArgs->thread
+				= Platform::createThread(0, objectCacheBenchThreadEntry, threadArgs);
+			threads.push_back(threadArgs);
+		}
+
+		F64 totalElapsedNanoseconds = 0;
+		for(ObjectCacheBenchThreadArgs* threadArgs : threads)
+		{
+			Platform::joinThread(threadArgs->thread);
+			totalElapsedNanoseconds += threadArgs->elapsedNanoseconds;
+			delete threadArgs;
+		}
+
+		Log::printf(Log::output,
+					"ns/object cache hit in %" WAVM_PRIuPTR " threads: %.2f\n",
+					numThreads,
+					totalElapsedNanoseconds / F64(numThreads));
+	}
+}
+
+static constexpr Uptr numIOWaitSleepsPerDuration = 200;
+static constexpr Uptr numIOWaitPingPongs = 10000;
+static constexpr Uptr numIdleIOWaitThreads = 1000;
+
+struct IOWaitPingPongThreadArgs
+{
+	VFS::VFD* pingReadVFD;
+	VFS::VFD* pongWriteVFD;
+};
+
+static void waitToRead(VFS::VFD* vfd)
+{
+	Platform::IOWait ioWait;
+	WAVM_ERROR_UNLESS(vfd->getHostFD(ioWait.hostFD) == VFS::Result::success);
+	ioWait.waitForRead = true;
+	WAVM_ERROR_UNLESS(Platform::waitForIO(&ioWait, 1, Time::infinity()) == 1);
+	WAVM_ERROR_UNLESS(ioWait.result == VFS::Result::success && ioWait.isReadable);
+}
+
+static I64 ioWaitPingPongThreadEntry(void* argument)
+{
+	IOWaitPingPongThreadArgs* threadArgs = (IOWaitPingPongThreadArgs*)argument;
+	for(Uptr pingPongIndex = 0; pingPongIndex < numIOWaitPingPongs; ++pingPongIndex)
+	{
+		U8 byte;
+		waitToRead(threadArgs->pingReadVFD);
+		WAVM_ERROR_UNLESS(threadArgs->pingReadVFD->read(&byte, 1) == VFS::Result::success);
+		WAVM_ERROR_UNLESS(threadArgs->pongWriteVFD->write(&byte, 1) == VFS::Result::success);
+	}
+	return 0;
+}
+
+static I64 idleIOWaitThreadEntry(void* argument)
+{
+	waitToRead((VFS::VFD*)argument);
+	return 0;
+}
+
+void runIOWaitBench()
+{
+	// Measure how much later than requested a wait without any VFDs returns.
+	for(I64 durationNS : {I64(100000), I64(1000000)})
+	{
+		F64 totalOvershootNS = 0;
+		F64 maxOvershootNS = 0;
+		for(Uptr sleepIndex = 0; sleepIndex < numIOWaitSleepsPerDuration; ++sleepIndex)
+		{
+			Timing::Timer timer;
+			Platform::waitForIO(nullptr, 0, Time{durationNS});
+			timer.stop();
+
+			const F64 overshootNS = timer.getNanoseconds() - F64(durationNS);
+			totalOvershootNS += overshootNS;
+			maxOvershootNS = std::max(maxOvershootNS, overshootNS);
+		}
+
+		Log::printf(Log::output,
+					"ns overshoot of %" PRId64 "us I/O wait timeout: %.0f avg, %.0f max\n",
+					durationNS / 1000,
+					totalOvershootNS / F64(numIOWaitSleepsPerDuration),
+					maxOvershootNS);
+	}
+
+	// Measure the latency of waking a thread that is waiting to read from a pipe, by passing a
+	// byte back and forth between two threads through a pair of pipes.
+	VFS::VFD* pingReadVFD;
+	VFS::VFD* pingWriteVFD;
+	VFS::VFD* pongReadVFD;
+	VFS::VFD* pongWriteVFD;
+	WAVM_ERROR_UNLESS(Platform::createPipe(pingReadVFD, pingWriteVFD) == VFS::Result::success);
+	WAVM_ERROR_UNLESS(Platform::createPipe(pongReadVFD, pongWriteVFD) == VFS::Result::success);
+	{
+		IOWaitPingPongThreadArgs threadArgs{pingReadVFD, pongWriteVFD};
+		Platform::Thread* thread
+			= Platform::createThread(512 * 1024, ioWaitPingPongThreadEntry, &threadArgs);
+
+		Timing::Timer timer;
+		for(Uptr pingPongIndex = 0; pingPongIndex < numIOWaitPingPongs; ++pingPongIndex)
+		{
+			U8 byte = 0;
+			WAVM_ERROR_UNLESS(pingWriteVFD->write(&byte, 1) == VFS::Result::success);
+			waitToRead(pongReadVFD);
+			WAVM_ERROR_UNLESS(pongReadVFD->read(&byte, 1) == VFS::Result::success);
+		}
+		timer.stop();
+		Platform::joinThread(thread);
+
+		Log::printf(Log::output,
+					"ns/pipe I/O wait wakeup: %.2f\n",
+					timer.getNanoseconds() / F64(numIOWaitPingPongs * 2));
+	}
+
+	// Measure the CPU time used by many threads waiting for the same pipe, and how long it takes
+	// to wake them all.
+	{
+		std::vector<Platform::Thread*> threads;
+		for(Uptr threadIndex = 0; threadIndex < numIdleIOWaitThreads; ++threadIndex)
+		{
+			threads.push_back(
+				Platform::createThread(64 * 1024, idleIOWaitThreadEntry, pingReadVFD));
+		}
+
+		const Time idleStartCPUTime = Platform::getClockTime(Platform::Clock::processCPUTime);
+		Platform::waitForIO(nullptr, 0, Time{I64(100000000)});
+		const Time idleEndCPUTime = Platform::getClockTime(Platform::Clock::processCPUTime);
+
+		Timing::Timer timer;
+		U8 byte = 0;
+		WAVM_ERROR_UNLESS(pingWriteVFD->write(&byte, 1) == VFS::Result::success);
+		for(Platform::Thread* thread : threads) { Platform::joinThread(thread); }
+		timer.stop();
+
+		Log::printf(Log::output,
+					"CPU ms used by %" WAVM_PRIuPTR " threads waiting for I/O for 100ms: %.2f\n",
+					numIdleIOWaitThreads,
+					F64(idleEndCPUTime.ns - idleStartCPUTime.ns) / 1000000.0);
+		Log::printf(Log::output,
+					"ms to wake %" WAVM_PRIuPTR " threads waiting for I/O: %.2f\n",
+					numIdleIOWaitThreads,
+					timer.getMilliseconds());
+	}
+
+	for(VFS::VFD* vfd : {pingReadVFD, pingWriteVFD, pongReadVFD, pongWriteVFD})
+	{ WAVM_ERROR_UNLESS(vfd->close() == VFS::Result::success); }
+}
+
 int execBenchmark(int argc, char** argv)
 {
 	if(argc != 0)
@@ -274,6 +1230,15 @@ int execBenchmark(int argc, char** argv)
 
 	runInvokeBench();
 	runIntrinsicBench();
+	runCallIndirectBench();
+	runAtomicWaitNotifyBench();
+	runTrapBench();
+	runInstanceBench();
+	runLinkBench();
+	runExceptionBench();
+	runFuelBench();
+	runObjectCacheBench();
+	runIOWaitBench();
 
 	return 0;
 }
@@ -54,6 +54,8 @@ struct Config
 	bool strictAssertInvalid{false};
 	bool strictAssertMalformed{false};
 	bool testCloning{false};
+	MemoryCloneMode memoryCloneMode{MemoryCloneMode::copy};
+	LLVMJIT::CompileOptions compileOptions;
 	bool traceTests{false};
 	bool traceLLVMIR{false};
 	bool traceAssembly{false};
@@ -123,7 +125,8 @@ struct TestScriptState
 	{
 		WAVM_ASSERT(kind == TestScriptStateKind::root);
 
-		Compartment* clonedCompartment = Runtime::cloneCompartment(compartment);
+		Compartment* clonedCompartment
+			= Runtime::cloneCompartment(compartment, "", config.memoryCloneMode);
 		if(!clonedCompartment) { return nullptr; }
 		Context* clonedContext = Runtime::cloneContext(context, clonedCompartment);
 		if(!clonedContext) { WAVM_ERROR_UNLESS(tryCollectCompartment(clonedCompartment)); }
@@ -343,9 +346,12 @@ static bool isExpectedExceptionType(WAST::ExpectedTrapType expectedType,
 	}
 }
 
-static void traceLLVMIR(const char* moduleName, const IR::Module& irModule)
+static void traceLLVMIR(const char* moduleName,
+						const IR::Module& irModule,
+						const LLVMJIT::CompileOptions& compileOptions)
 {
-	std::string llvmIR = LLVMJIT::emitLLVMIR(irModule, LLVMJIT::getHostTargetSpec(), true);
+	std::string llvmIR
+		= LLVMJIT::emitLLVMIR(irModule, LLVMJIT::getHostTargetSpec(), true, compileOptions);
 
 	Log::printf(Log::output, "%s LLVM IR:\n%s\n", moduleName, llvmIR.c_str());
 }
@@ -362,10 +368,11 @@ static void traceAssembly(const char* moduleName, ModuleConstRefParam compiledMo
 
 static void maybeCollectGarbage(TestScriptState& state)
 {
-	// collectCompartmentGarbage assumes that no WebAssembly code is running in the compartment, so
-	// only run it for the root test script state, and if it has no active child threads.
+	// collectCompartmentYoungGarbage assumes that no WebAssembly code is running in the
+	// compartment, so only run it for the root test script state, and if it has no active child
+	// threads. The old objects are freed when the test script's compartment is collected.
 	if(state.kind == TestScriptStateKind::root && !state.threads.size())
-	{ collectCompartmentGarbage(state.compartment); }
+	{ collectCompartmentYoungGarbage(state.compartment); }
 }
 
 static bool processAction(TestScriptState& state, Action* action, std::vector<Value>* outResults)
@@ -390,9 +397,13 @@ static bool processAction(TestScriptState& state, Action* action, std::vector<Va
 				= std::string(state.scriptFilename) + ":" + action->locus.describe();
 
 			if(state.config.traceLLVMIR)
-			{ traceLLVMIR(moduleDebugName.c_str(), *moduleAction->module); }
+			{
+				traceLLVMIR(
+					moduleDebugName.c_str(), *moduleAction->module, state.config.compileOptions);
+			}
 
-			ModuleRef compiledModule = compileModule(*moduleAction->module);
+			ModuleRef compiledModule
+				= compileModule(*moduleAction->module, state.config.compileOptions);
 
 			if(state.config.traceAssembly)
 			{ traceAssembly(moduleDebugName.c_str(), compiledModule); }
@@ -402,10 +413,14 @@ static bool processAction(TestScriptState& state, Action* action, std::vector<Va
 												   compiledModule,
 												   std::move(linkResult.resolvedImports),
 												   std::move(moduleDebugName));
-
-			// Call the module start function, if it has one.
-			Function* startFunction = getStartFunction(state.lastInstance);
-			if(startFunction) { invokeFunction(state.context, startFunction); }
+			if(!state.lastInstance)
+			{ testErrorf(state, moduleAction->locus, "failed to instantiate module"); }
+			else
+			{
+				// Call the module start function, if it has one.
+				Function* startFunction = getStartFunction(state.lastInstance);
+				if(startFunction) { invokeFunction(state.context, startFunction); }
+			}
 		}
 		else
 		{
@@ -469,9 +484,12 @@ static bool processAction(TestScriptState& state, Action* action, std::vector<Va
 		std::vector<UntaggedValue> untaggedResults;
 		untaggedResults.resize(invokeSig.results().size());
 
-		// Invoke the function.
-		invokeFunction(
-			state.context, function, invokeSig, untaggedArgs.data(), untaggedResults.data());
+		// Invoke the function. Use tryInvokeFunction so the test scripts cover the trap path that
+		// doesn't unwind the stack, and rethrow any exception it returns to handle it the same way
+		// as an exception thrown by invokeFunction.
+		if(Exception* exception = tryInvokeFunction(
+			   state.context, function, invokeSig, untaggedArgs.data(), untaggedResults.data()))
+		{ throwException(exception); }
 
 		// Convert the untagged result values to tagged values.
 		if(outResults)
@@ -1078,11 +1096,15 @@ static void processAssertUnlinkable(TestScriptState& state,
 			LinkResult linkResult = linkModule(*assertCommand->moduleAction->module, resolver);
 			if(linkResult.success)
 			{
-				auto instance
-					= instantiateModule(state.compartment,
-										compileModule(*assertCommand->moduleAction->module),
-										std::move(linkResult.resolvedImports),
-										"test module");
+				ModuleRef compiledModule = compileModule(*assertCommand->moduleAction->module,
+														 state.config.compileOptions);
+				auto instance = instantiateModule(state.compartment,
+												  compiledModule,
+												  std::move(linkResult.resolvedImports),
+												  "test module");
+
+				// If the instantiation fails, the assert_unlinkable succeeds.
+				if(!instance) { return; }
 
 				// Call the module start function, if it has one.
 				Function* startFunction = getStartFunction(instance);
@@ -1218,8 +1240,11 @@ static void processBenchmark(TestScriptState& state, const BenchmarkCommand* ben
 	}
 
 	// Compile and instantiate the generated module.
-	Instance* benchmarkInstance = instantiateModule(
-		state.compartment, compileModule(benchmarkModule), {asObject(invokeFunction)}, "benchmark");
+	Instance* benchmarkInstance
+		= instantiateModule(state.compartment,
+							compileModule(benchmarkModule, state.config.compileOptions),
+							{asObject(invokeFunction)},
+							"benchmark");
 	Function* benchmarkFunction = getTypedInstanceExport(
 		benchmarkInstance, "benchmark", FunctionType({}, {ValueType::i32}));
 
@@ -1646,6 +1671,14 @@ static void showHelp()
 		"                             module was invalid\n"
 		"  --test-cloning             Run each test command in the original compartment\n"
 		"                             and a clone of it, and compare the resulting state\n"
+		"  --test-cow-cloning         Like --test-cloning, but clones memories\n"
+		"                             copy-on-write\n"
+		"  --bounds-checks=<mode>     Compiles modules with the specified bounds-check\n"
+		"                             mode: guard-pages, reduced-reservation, clamp, or\n"
+		"                             explicit\n"
+		"  --devirtualize-indirect-calls\n"
+		"                             Compiles modules with\n"
+		"                             CompileOptions::devirtualizeIndirectCalls\n"
 		"  --trace                    Prints instructions to stdout as they are compiled.\n"
 		"  --trace-tests              Prints test commands to stdout as they are executed.\n"
 		"  --trace-llvmir             Prints the LLVM IR for modules as they are compiled.\n"
@@ -1694,6 +1727,27 @@ int execRunTestScript(int argc, char** argv)
 		{
 			config.testCloning = true;
 		}
+		else if(!strcmp(argv[argIndex], "--test-cow-cloning"))
+		{
+			config.testCloning = true;
+			config.memoryCloneMode = MemoryCloneMode::copyOnWrite;
+		}
+		else if(!strncmp(argv[argIndex], "--bounds-checks=", strlen("--bounds-checks=")))
+		{
+			const char* boundsCheckModeString = argv[argIndex] + strlen("--bounds-checks=");
+			if(!parseBoundsCheckMode(boundsCheckModeString, config.compileOptions.boundsCheckMode))
+			{
+				Log::printf(Log::error,
+							"Invalid bounds-check mode '%s'. Expected guard-pages,"
+							" reduced-reservation, clamp, or explicit.\n",
+							boundsCheckModeString);
+				return EXIT_FAILURE;
+			}
+		}
+		else if(!strcmp(argv[argIndex], "--devirtualize-indirect-calls"))
+		{
+			config.compileOptions.devirtualizeIndirectCalls = true;
+		}
 		else if(!strcmp(argv[argIndex], "--trace"))
 		{
 			Log::setCategoryEnabled(Log::traceValidation, true);
@@ -0,0 +1,109 @@
+#include <stdlib.h>
+#include <utility>
+#include <vector>
+#include "WAVM/Inline/AddressRangeMap.h"
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Timing.h"
+#include "wavm-test.h"
+
+using namespace WAVM;
+
+// Returns the value of the range containing an address, or UINTPTR_MAX if there isn't one.
+static Uptr lookup(const AddressRangeMap<Uptr>& map, Uptr address, Uptr* outBegin = nullptr)
+{
+	const Uptr* value = map.get(address, outBegin);
+	return value ? *value : UINTPTR_MAX;
+}
+
+static void testAdjacentRanges()
+{
+	AddressRangeMap<Uptr> map;
+	map.addOrFail(0x1000, 0x2000, 1);
+	map.addOrFail(0x2000, 0x3000, 2);
+	map.addOrFail(0x5000, 0x6000, 3);
+	WAVM_ERROR_UNLESS(map.size() == 3);
+
+	Uptr begin = 0;
+	WAVM_ERROR_UNLESS(lookup(map, 0x0fff) == UINTPTR_MAX);
+	WAVM_ERROR_UNLESS(lookup(map, 0x1000, &begin) == 1 && begin == 0x1000);
+	WAVM_ERROR_UNLESS(lookup(map, 0x1fff) == 1);
+	WAVM_ERROR_UNLESS(lookup(map, 0x2000, &begin) == 2 && begin == 0x2000);
+	WAVM_ERROR_UNLESS(lookup(map, 0x2fff) == 2);
+	WAVM_ERROR_UNLESS(lookup(map, 0x3000) == UINTPTR_MAX);
+	WAVM_ERROR_UNLESS(lookup(map, 0x4fff) == UINTPTR_MAX);
+	WAVM_ERROR_UNLESS(lookup(map, 0x5800) == 3);
+	WAVM_ERROR_UNLESS(lookup(map, 0x6000) == UINTPTR_MAX);
+
+	WAVM_ERROR_UNLESS(!map.remove(0x1000, 0x3000));
+	WAVM_ERROR_UNLESS(!map.remove(0x1800, 0x2000));
+	WAVM_ERROR_UNLESS(map.remove(0x1000, 0x2000));
+	WAVM_ERROR_UNLESS(!map.remove(0x1000, 0x2000));
+	WAVM_ERROR_UNLESS(map.size() == 2);
+
+	WAVM_ERROR_UNLESS(lookup(map, 0x1000) == UINTPTR_MAX);
+	WAVM_ERROR_UNLESS(lookup(map, 0x2000) == 2);
+}
+
+static void testRandomRanges()
+{
+	static constexpr Uptr numRanges = 1000;
+	static constexpr Uptr numBytesPerSlot = 0x10000;
+
+	// Create a range at a random offset and size within each slot of a sparse address space.
+	struct Range
+	{
+		Uptr begin;
+		Uptr end;
+	};
+	std::vector<Range> ranges;
+	srand(0);
+	for(Uptr rangeIndex = 0; rangeIndex < numRanges; ++rangeIndex)
+	{
+		const Uptr slotBegin = rangeIndex * numBytesPerSlot;
+		const Uptr begin = slotBegin + Uptr(rand()) % (numBytesPerSlot / 2);
+		const Uptr end = begin + 1 + Uptr(rand()) % (numBytesPerSlot / 2 - 1);
+		ranges.push_back({begin, end});
+	}
+
+	// Add the ranges in a shuffled order.
+	std::vector<Uptr> order;
+	for(Uptr rangeIndex = 0; rangeIndex < numRanges; ++rangeIndex) { order.push_back(rangeIndex); }
+	for(Uptr i = numRanges - 1; i > 0; --i) { std::swap(order[i], order[Uptr(rand()) % (i + 1)]); }
+
+	AddressRangeMap<Uptr> map;
+	for(Uptr rangeIndex : order)
+	{ map.addOrFail(ranges[rangeIndex].begin, ranges[rangeIndex].end, rangeIndex); }
+	WAVM_ERROR_UNLESS(map.size() == numRanges);
+
+	// Check the boundaries of each range.
+	for(Uptr rangeIndex = 0; rangeIndex < numRanges; ++rangeIndex)
+	{
+		const Range& range = ranges[rangeIndex];
+		Uptr begin = 0;
+		WAVM_ERROR_UNLESS(lookup(map, range.begin - 1) == UINTPTR_MAX);
+		WAVM_ERROR_UNLESS(lookup(map, range.begin, &begin) == rangeIndex);
+		WAVM_ERROR_UNLESS(begin == range.begin);
+		WAVM_ERROR_UNLESS(lookup(map, range.end - 1) == rangeIndex);
+		WAVM_ERROR_UNLESS(lookup(map, range.end) == UINTPTR_MAX);
+	}
+
+	// Remove every other range, and check that only the remaining ranges are found.
+	for(Uptr rangeIndex = 0; rangeIndex < numRanges; rangeIndex += 2)
+	{ WAVM_ERROR_UNLESS(map.remove(ranges[rangeIndex].begin, ranges[rangeIndex].end)); }
+	WAVM_ERROR_UNLESS(map.size() == numRanges / 2);
+	for(Uptr rangeIndex = 0; rangeIndex < numRanges; ++rangeIndex)
+	{
+		const Uptr expectedValue = (rangeIndex & 1) ? rangeIndex : UINTPTR_MAX;
+		WAVM_ERROR_UNLESS(lookup(map, ranges[rangeIndex].begin) == expectedValue);
+	}
+}
+
+I32 execAddressRangeMapTest(int argc, char** argv)
+{
+	Timing::Timer timer;
+	testAdjacentRanges();
+	testRandomRanges();
+	Timing::logTimer("AddressRangeMapTest", timer);
+	return 0;
+}
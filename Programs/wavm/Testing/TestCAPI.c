@@ -17,7 +17,11 @@ own wasm_trap_t* hello_callback(const wasm_val_t args[], wasm_val_t results[])
 int execCAPITest(int argc, char** argv)
 {
 	// Initialize.
-	wasm_engine_t* engine = wasm_engine_new();
+	own wasm_config_t* config = wasm_config_new();
+	if(!wasm_config_set_optimization_level(config, WASM_OPTIMIZATION_LEVEL_BALANCED)) { return 1; }
+	if(wasm_config_set_optimization_level(config, WASM_OPTIMIZATION_LEVEL_AGGRESSIVE + 1))
+	{ return 1; }
+	wasm_engine_t* engine = wasm_engine_new_with_config(config);
 	wasm_compartment_t* compartment = wasm_compartment_new(engine, "compartment");
 	wasm_store_t* store = wasm_store_new(compartment, "store");
 
@@ -60,13 +64,18 @@ int execCAPITest(int argc, char** argv)
 	// Call.
 	if(wasm_func_call(store, run_func, NULL, NULL)) { return 1; }
 
+	// Call in a batch.
+	size_t num_completed_calls = 0;
+	if(wasm_func_call_batch(store, run_func, 3, NULL, NULL, &num_completed_calls)) { return 1; }
+	if(num_completed_calls != 3) { return 1; }
+
 	// Shut down.
 	wasm_store_delete(store);
 	wasm_compartment_delete(compartment);
 	wasm_engine_delete(engine);
 
-	// Assert that the callback was called exactly once.
-	if(numCallbacks != 1) { return 1; }
+	// Assert that the callback was called once by each call.
+	if(numCallbacks != 4) { return 1; }
 
 	return 0;
 }
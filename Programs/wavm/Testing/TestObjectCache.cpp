@@ -0,0 +1,496 @@
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "WAVM/IR/FeatureSpec.h"
+#include "WAVM/IR/Module.h"
+#include "WAVM/IR/Types.h"
+#include "WAVM/IR/Value.h"
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/CLI.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/Time.h"
+#include "WAVM/Inline/Timing.h"
+#include "WAVM/ObjectCache/ObjectCache.h"
+#include "WAVM/Platform/Event.h"
+#include "WAVM/Platform/File.h"
+#include "WAVM/Platform/Random.h"
+#include "WAVM/Platform/Thread.h"
+#include "WAVM/Runtime/Runtime.h"
+#include "WAVM/VFS/VFS.h"
+#include "WAVM/WASM/WASM.h"
+#include "WAVM/WASTParse/WASTParse.h"
+#include "wavm-test.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+
+static constexpr U64 testCodeKey = 0x7e57c0de0b1ec7ull;
+static constexpr Uptr testCacheMaxBytes = 64 * 1024 * 1024;
+
+// A module with a function that returns 42. Its code ends with the bytes in returnConstantCode.
+static const char* testModuleWAST = "(module (func (export \"f\") (result i32) (i32.const 42)))";
+static const U8 returnConstantCode[] = {0x41, 0x2a, 0x0b};
+
+// An empty directory for an object cache, which is deleted with the cache's files when the test
+// is done with it.
+struct TestCacheDir
+{
+	std::string path;
+
+	TestCacheDir()
+	{
+		U8 randomBytes[8];
+		Platform::getCryptographicRNG(randomBytes, sizeof(randomBytes));
+		U64 randomU64;
+		memcpy(&randomU64, randomBytes, sizeof(randomU64));
+
+		path = Platform::getCurrentWorkingDirectory() + "/objectcache-test-"
+			   + std::to_string(randomU64);
+		WAVM_ERROR_UNLESS(Platform::getHostFS().createDir(path) == VFS::Result::success);
+	}
+
+	~TestCacheDir()
+	{
+		VFS::FileSystem& hostFS = Platform::getHostFS();
+		for(const char* fileName : {"/data.mdb", "/lock.mdb"})
+		{ hostFS.unlinkFile(path + fileName); }
+		WAVM_ERROR_UNLESS(hostFS.removeDir(path) == VFS::Result::success);
+	}
+};
+
+static std::shared_ptr<ObjectCacheInterface> openTestCache(const TestCacheDir& dir,
+														   I32 compressionLevel = 0,
+														   Uptr maxBytes = testCacheMaxBytes)
+{
+	std::shared_ptr<ObjectCacheInterface> objectCache;
+	WAVM_ERROR_UNLESS(ObjectCache::open(dir.path.c_str(),
+										maxBytes,
+										testCodeKey,
+										objectCache,
+										compressionLevel)
+					  == ObjectCache::OpenResult::success);
+	return objectCache;
+}
+
+static std::vector<U8> getTestModuleWASM()
+{
+	IR::Module irModule;
+	std::vector<WAST::Error> parseErrors;
+	if(!WAST::parseModule(testModuleWAST, strlen(testModuleWAST) + 1, irModule, parseErrors))
+	{
+		WAST::reportParseErrors("test module", testModuleWAST, parseErrors);
+		Errors::fatal("Failed to parse test module");
+	}
+	return WASM::saveBinaryModule(irModule);
+}
+
+// Instantiates a module created from testModuleWAST, and checks that its function returns 42.
+static void checkTestModule(ModuleConstRefParam module)
+{
+	GCPointer<Compartment> compartment = createCompartment("checkTestModule");
+	Instance* instance = instantiateModule(compartment, module, {}, "test");
+	WAVM_ERROR_UNLESS(instance);
+
+	UntaggedValue result;
+	invokeFunction(createContext(compartment),
+				   asFunction(getInstanceExport(instance, "f")),
+				   FunctionType({ValueType::i32}, {}),
+				   nullptr,
+				   &result);
+	WAVM_ERROR_UNLESS(result.i32 == 42);
+
+	instance = nullptr;
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(compartment)));
+}
+
+// An object cache that finds the same object code for every module.
+struct HitEveryModuleObjectCache : ObjectCacheInterface
+{
+	std::vector<U8> objectCode;
+
+	HitEveryModuleObjectCache(std::vector<U8>&& inObjectCode)
+	: objectCode(std::move(inObjectCode))
+	{
+	}
+
+	virtual std::vector<U8> getCachedObject(
+		const ObjectCacheKey& key,
+		std::function<std::vector<U8>()>&& compileThunk) override
+	{
+		return objectCode;
+	}
+
+	virtual bool loadCachedObject(const ObjectCacheKey& key,
+								  std::function<bool(bool isCached)>&& loadThunk,
+								  std::function<std::vector<U8>()>&& compileThunk,
+								  std::vector<U8>& outObjectCode) override
+	{
+		outObjectCode = objectCode;
+		return loadThunk(true);
+	}
+};
+
+static void testLoadCachedModule()
+{
+	TestCacheDir dir;
+	std::shared_ptr<ObjectCacheInterface> objectCache = openTestCache(dir);
+	setGlobalObjectCache(std::shared_ptr<ObjectCacheInterface>(objectCache));
+
+	// The first load of the module misses the cache, and the second hits it.
+	const std::vector<U8> wasmBytes = getTestModuleWASM();
+	const IR::FeatureSpec featureSpec;
+	ModuleRef module;
+	WAVM_ERROR_UNLESS(loadBinaryModule(wasmBytes.data(), wasmBytes.size(), module, featureSpec));
+	WAVM_ERROR_UNLESS(objectCache->getStats().numMisses == 1);
+	WAVM_ERROR_UNLESS(objectCache->getStats().numHits == 0);
+	checkTestModule(module);
+
+	WAVM_ERROR_UNLESS(loadBinaryModule(wasmBytes.data(), wasmBytes.size(), module, featureSpec));
+	WAVM_ERROR_UNLESS(objectCache->getStats().numMisses == 1);
+	WAVM_ERROR_UNLESS(objectCache->getStats().numHits == 1);
+	checkTestModule(module);
+
+	// Loading the module with a different feature spec must miss the cache: the module's function
+	// bodies weren't validated with that feature spec.
+	const IR::FeatureSpec proposedFeatureSpec(IR::FeatureLevel::proposed);
+	WAVM_ERROR_UNLESS(
+		loadBinaryModule(wasmBytes.data(), wasmBytes.size(), module, proposedFeatureSpec));
+	WAVM_ERROR_UNLESS(objectCache->getStats().numMisses == 2);
+	WAVM_ERROR_UNLESS(objectCache->getStats().numHits == 1);
+	checkTestModule(module);
+
+	// Make the function return an i64 instead of an i32. The module is invalid, but its function
+	// bodies are only validated if the cache doesn't have its object code.
+	std::vector<U8> invalidWASMBytes = wasmBytes;
+	auto codeIt = std::search(invalidWASMBytes.begin(),
+							  invalidWASMBytes.end(),
+							  std::begin(returnConstantCode),
+							  std::end(returnConstantCode));
+	WAVM_ERROR_UNLESS(codeIt != invalidWASMBytes.end());
+	*codeIt = 0x42;
+
+	// The invalid module isn't in the cache, so it must fail validation. An object cache that finds
+	// object code for it skips validating it.
+	WAVM_ERROR_UNLESS(!loadBinaryModule(
+		invalidWASMBytes.data(), invalidWASMBytes.size(), module, featureSpec));
+
+	setGlobalObjectCache(std::make_shared<HitEveryModuleObjectCache>(getObjectCode(module)));
+	WAVM_ERROR_UNLESS(
+		loadBinaryModule(invalidWASMBytes.data(), invalidWASMBytes.size(), module, featureSpec));
+
+	setGlobalObjectCache(nullptr);
+}
+
+// The cache sleeps between polls of another process's compile lease with a timed wait on an event
+// that nothing signals. The wait must time out after its duration, instead of returning at once.
+static void testEventWaitTimeout()
+{
+	const I64 waitNS = I64(50) * 1000000;
+	Platform::Event event;
+	Timing::Timer timer;
+	WAVM_ERROR_UNLESS(!event.wait(Time{I128(waitNS)}));
+	WAVM_ERROR_UNLESS(timer.getNanoseconds() >= F64(waitNS));
+}
+
+static constexpr Uptr numConcurrentCompileThreads = 8;
+
+// How long a compile thunk takes, so the threads that miss the cache for the same module overlap.
+static constexpr I64 concurrentCompileNS = I64(100) * 1000000;
+
+struct TestCompileException
+{
+};
+
+// The state shared by threads that get the same object from the cache at once.
+struct ConcurrentCompileTest
+{
+	std::shared_ptr<ObjectCacheInterface> objectCache;
+	std::vector<U8> wasmBytes;
+	ObjectCacheKey key;
+	std::vector<U8> objectCode;
+	std::atomic<Uptr> numCompiles{0};
+	std::atomic<bool> hasCompileStarted{false};
+
+	ConcurrentCompileTest(const TestCacheDir& dir)
+	: objectCache(openTestCache(dir)), wasmBytes(getTestModuleWASM()), objectCode(64 * 1024)
+	{
+		key.wasmBytes = wasmBytes.data();
+		key.numWASMBytes = wasmBytes.size();
+		for(Uptr byteIndex = 0; byteIndex < objectCode.size(); ++byteIndex)
+		{ objectCode[byteIndex] = U8(byteIndex * 7); }
+	}
+};
+
+struct CompileThreadArgs
+{
+	ConcurrentCompileTest* test = nullptr;
+	bool throwFromCompile = false;
+	bool threw = false;
+	std::vector<U8> objectCode;
+	Platform::Thread* thread = nullptr;
+};
+
+static I64 compileThreadEntry(void* argument)
+{
+	CompileThreadArgs& args = *(CompileThreadArgs*)argument;
+	ConcurrentCompileTest& test = *args.test;
+	try
+	{
+		args.objectCode = test.objectCache->getCachedObject(test.key, [&]() {
+			++test.numCompiles;
+			test.hasCompileStarted.store(true);
+
+			// Nothing signals the event: it's just used to sleep.
+			Platform::Event sleepEvent;
+			sleepEvent.wait(Time{I128(concurrentCompileNS)});
+
+			if(args.throwFromCompile) { throw TestCompileException(); }
+			return test.objectCode;
+		});
+	}
+	catch(TestCompileException const&)
+	{
+		args.threw = true;
+	}
+	return 0;
+}
+
+static void startCompileThread(CompileThreadArgs& args)
+{
+	args.thread = Platform::createThread(512 * 1024, compileThreadEntry, &args);
+}
+
+static void testConcurrentCompile()
+{
+	TestCacheDir dir;
+	ConcurrentCompileTest test(dir);
+
+	// Threads that miss the cache for the same module at once only compile it once, and all get
+	// the same object code.
+	CompileThreadArgs threadArgs[numConcurrentCompileThreads];
+	for(CompileThreadArgs& args : threadArgs)
+	{
+		args.test = &test;
+		startCompileThread(args);
+	}
+	for(CompileThreadArgs& args : threadArgs)
+	{
+		Platform::joinThread(args.thread);
+		WAVM_ERROR_UNLESS(!args.threw);
+		WAVM_ERROR_UNLESS(args.objectCode == test.objectCode);
+	}
+	WAVM_ERROR_UNLESS(test.numCompiles == 1);
+
+	const ObjectCacheStats stats = test.objectCache->getStats();
+	WAVM_ERROR_UNLESS(stats.numHits + stats.numMisses == numConcurrentCompileThreads);
+	WAVM_ERROR_UNLESS(stats.numCachedObjects == 1);
+}
+
+static void testConcurrentCompileException()
+{
+	TestCacheDir dir;
+	ConcurrentCompileTest test(dir);
+
+	// Start a compile that throws an exception, and wait for it to start before starting the
+	// threads that wait for it.
+	CompileThreadArgs throwingThreadArgs;
+	throwingThreadArgs.test = &test;
+	throwingThreadArgs.throwFromCompile = true;
+	Timing::Timer timer;
+	startCompileThread(throwingThreadArgs);
+	while(!test.hasCompileStarted.load()) { Platform::yieldToAnotherThread(); }
+
+	CompileThreadArgs threadArgs[numConcurrentCompileThreads];
+	for(CompileThreadArgs& args : threadArgs)
+	{
+		args.test = &test;
+		startCompileThread(args);
+	}
+
+	// The exception must wake the waiting threads, and release the compile's lease in the cache,
+	// so one of them compiles the module without waiting for the lease to expire.
+	Platform::joinThread(throwingThreadArgs.thread);
+	WAVM_ERROR_UNLESS(throwingThreadArgs.threw);
+	for(CompileThreadArgs& args : threadArgs)
+	{
+		Platform::joinThread(args.thread);
+		WAVM_ERROR_UNLESS(!args.threw);
+		WAVM_ERROR_UNLESS(args.objectCode == test.objectCode);
+	}
+	WAVM_ERROR_UNLESS(test.numCompiles == 2);
+	WAVM_ERROR_UNLESS(timer.getMilliseconds() < 10000.0);
+}
+
+// Returns object code that compresses well, or random object code that doesn't compress.
+static std::vector<U8> createTestObjectCode(Uptr numBytes, bool compressible)
+{
+	std::vector<U8> objectCode(numBytes);
+	if(!compressible) { Platform::getCryptographicRNG(objectCode.data(), numBytes); }
+	else
+	{
+		for(Uptr byteIndex = 0; byteIndex < numBytes; ++byteIndex)
+		{ objectCode[byteIndex] = U8(byteIndex / 64); }
+	}
+	return objectCode;
+}
+
+// Gets a module's object code from the cache, and checks that it is the expected object code, and
+// whether it was compiled.
+static void checkCachedObject(ObjectCacheInterface& objectCache,
+							  U64 moduleId,
+							  const std::vector<U8>& expectedObjectCode,
+							  bool expectCompile)
+{
+	ObjectCacheKey key;
+	key.wasmBytes = (const U8*)&moduleId;
+	key.numWASMBytes = sizeof(moduleId);
+
+	bool compiled = false;
+	WAVM_ERROR_UNLESS(objectCache.getCachedObject(key,
+												  [&]() {
+													  compiled = true;
+													  return expectedObjectCode;
+												  })
+					  == expectedObjectCode);
+	WAVM_ERROR_UNLESS(compiled == expectCompile);
+}
+
+static void testCompressedObjects()
+{
+	TestCacheDir dir;
+	const std::vector<U8> compressibleObjectCode = createTestObjectCode(64 * 1024, true);
+	const std::vector<U8> randomObjectCode = createTestObjectCode(64 * 1024, false);
+
+	// Object code that compresses is stored compressed.
+	std::shared_ptr<ObjectCacheInterface> objectCache = openTestCache(dir, 3);
+	checkCachedObject(*objectCache, 0, compressibleObjectCode, true);
+	ObjectCacheStats stats = objectCache->getStats();
+	WAVM_ERROR_UNLESS(stats.numMisses == 1 && stats.numHits == 0);
+	WAVM_ERROR_UNLESS(stats.numCachedObjects == 1);
+	WAVM_ERROR_UNLESS(stats.numCachedObjectBytes == compressibleObjectCode.size());
+	WAVM_ERROR_UNLESS(stats.numStoredObjectBytes < compressibleObjectCode.size() / 2);
+
+	// Object code that doesn't compress is stored uncompressed.
+	const U64 numCompressedBytes = stats.numStoredObjectBytes;
+	checkCachedObject(*objectCache, 1, randomObjectCode, true);
+	stats = objectCache->getStats();
+	WAVM_ERROR_UNLESS(stats.numCachedObjects == 2);
+	WAVM_ERROR_UNLESS(stats.numStoredObjectBytes - numCompressedBytes > randomObjectCode.size());
+
+	// A cache opened without compression stores object code uncompressed, and reads the compressed
+	// objects.
+	objectCache.reset();
+	objectCache = openTestCache(dir, 0);
+	checkCachedObject(*objectCache, 0, compressibleObjectCode, false);
+	checkCachedObject(*objectCache, 2, compressibleObjectCode, true);
+	stats = objectCache->getStats();
+	WAVM_ERROR_UNLESS(stats.numHits == 1 && stats.numMisses == 1);
+	WAVM_ERROR_UNLESS(stats.decompressNanoseconds > 0);
+	WAVM_ERROR_UNLESS(stats.numCachedObjects == 3);
+	WAVM_ERROR_UNLESS(stats.numCachedObjectBytes == 3 * compressibleObjectCode.size());
+	WAVM_ERROR_UNLESS(stats.numStoredObjectBytes
+					  > numCompressedBytes + randomObjectCode.size()
+							+ compressibleObjectCode.size());
+
+	// A cache opened with compression reads the uncompressed objects.
+	objectCache.reset();
+	objectCache = openTestCache(dir, 3);
+	checkCachedObject(*objectCache, 1, randomObjectCode, false);
+	checkCachedObject(*objectCache, 2, compressibleObjectCode, false);
+	stats = objectCache->getStats();
+	WAVM_ERROR_UNLESS(stats.numHits == 2 && stats.numMisses == 0);
+}
+
+// The ways the tests corrupt a cached object's entry, which is stored with a 9 byte header: a
+// compression byte, then the size of the object code.
+enum class ObjectCorruption
+{
+	truncated,
+	unknownCompression,
+	invalidCompressedData,
+};
+
+static void testCorruptObject(ObjectCorruption corruption)
+{
+	TestCacheDir dir;
+	const std::vector<U8> objectCode = createTestObjectCode(16 * 1024, false);
+	std::shared_ptr<ObjectCacheInterface> objectCache = openTestCache(dir);
+	checkCachedObject(*objectCache, 0, objectCode, true);
+	objectCache.reset();
+
+	// Find the object's entry in the closed database's file.
+	const std::string databasePath = dir.path + "/data.mdb";
+	std::vector<U8> databaseBytes;
+	WAVM_ERROR_UNLESS(loadFile(databasePath.c_str(), databaseBytes));
+
+	std::vector<U8> entryPrefix(9);
+	const U64 numObjectBytes = objectCode.size();
+	memcpy(entryPrefix.data() + 1, &numObjectBytes, sizeof(numObjectBytes));
+	entryPrefix.insert(entryPrefix.end(), objectCode.begin(), objectCode.begin() + 64);
+	auto entryIt = std::search(
+		databaseBytes.begin(), databaseBytes.end(), entryPrefix.begin(), entryPrefix.end());
+	WAVM_ERROR_UNLESS(entryIt != databaseBytes.end());
+
+	switch(corruption)
+	{
+	case ObjectCorruption::truncated: {
+		// Record a larger size in the header than the stored object code.
+		const U64 corruptNumObjectBytes = numObjectBytes + 1;
+		memcpy(&*entryIt + 1, &corruptNumObjectBytes, sizeof(corruptNumObjectBytes));
+		break;
+	}
+	case ObjectCorruption::unknownCompression: *entryIt = 0xff; break;
+	case ObjectCorruption::invalidCompressedData: *entryIt = 1; break;
+	default: WAVM_UNREACHABLE();
+	};
+	WAVM_ERROR_UNLESS(saveFile(databasePath.c_str(), databaseBytes.data(), databaseBytes.size()));
+
+	// The corrupt entry is treated as a miss, and replaced by compiling the module again.
+	objectCache = openTestCache(dir);
+	checkCachedObject(*objectCache, 0, objectCode, true);
+	checkCachedObject(*objectCache, 0, objectCode, false);
+	const ObjectCacheStats stats = objectCache->getStats();
+	WAVM_ERROR_UNLESS(stats.numHits == 1 && stats.numMisses == 1);
+	WAVM_ERROR_UNLESS(stats.numCachedObjects == 1);
+}
+
+static void testEviction()
+{
+	// Add more object code than fits in the cache.
+	TestCacheDir dir;
+	const Uptr maxBytes = 1024 * 1024;
+	std::shared_ptr<ObjectCacheInterface> objectCache = openTestCache(dir, 0, maxBytes);
+	const std::vector<U8> objectCode = createTestObjectCode(256 * 1024, false);
+	for(U64 moduleId = 0; moduleId < 8; ++moduleId)
+	{ checkCachedObject(*objectCache, moduleId, objectCode, true); }
+
+	// The least recently used objects were evicted to make room for the newer objects.
+	const ObjectCacheStats stats = objectCache->getStats();
+	WAVM_ERROR_UNLESS(stats.numEvictions > 0);
+	WAVM_ERROR_UNLESS(stats.numCachedObjects + stats.numEvictions == 8);
+	WAVM_ERROR_UNLESS(stats.numStoredObjectBytes < maxBytes);
+	checkCachedObject(*objectCache, 7, objectCode, false);
+	checkCachedObject(*objectCache, 0, objectCode, true);
+}
+
+I32 execObjectCacheTest(int argc, char** argv)
+{
+	Timing::Timer timer;
+	testLoadCachedModule();
+	testEventWaitTimeout();
+	testConcurrentCompile();
+	testConcurrentCompileException();
+	testCompressedObjects();
+	testCorruptObject(ObjectCorruption::truncated);
+	testCorruptObject(ObjectCorruption::unknownCompression);
+	testCorruptObject(ObjectCorruption::invalidCompressedData);
+	testEviction();
+	Timing::logTimer("ObjectCacheTest", timer);
+	return 0;
+}
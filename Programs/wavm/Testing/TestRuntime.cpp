@@ -0,0 +1,995 @@
+#include <string.h>
+#include <functional>
+#include <string>
+#include <vector>
+#include "WAVM/IR/Module.h"
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Time.h"
+#include "WAVM/Inline/Timing.h"
+#include "WAVM/LLVMJIT/LLVMJIT.h"
+#include "WAVM/Platform/Event.h"
+#include "WAVM/Platform/Memory.h"
+#include "WAVM/Platform/Thread.h"
+#include "WAVM/Runtime/Runtime.h"
+#include "WAVM/RuntimeABI/RuntimeABI.h"
+#include "WAVM/WASTParse/WASTParse.h"
+#include "wavm-test.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+
+static IR::Module parseModule(const char* wast)
+{
+	IR::Module irModule;
+	std::vector<WAST::Error> parseErrors;
+	if(!WAST::parseModule(wast, strlen(wast) + 1, irModule, parseErrors))
+	{
+		WAST::reportParseErrors("test module", wast, parseErrors);
+		Errors::fatal("Failed to parse test module");
+	}
+	return irModule;
+}
+
+static void testImportedMemoryReservation()
+{
+	LLVMJIT::CompileOptions clampOptions;
+	clampOptions.boundsCheckMode = LLVMJIT::BoundsCheckMode::clamp;
+
+	GCPointer<Compartment> compartment = createCompartment("testImportedMemoryReservation");
+
+	// Create a memory that only reserves the address space needed by the clamp bounds-check mode.
+	ModuleRef exporterModule
+		= compileModule(parseModule("(module (memory (export \"m\") 1 1))"), clampOptions);
+	Instance* exporterInstance = instantiateModule(compartment, exporterModule, {}, "exporter");
+	WAVM_ERROR_UNLESS(exporterInstance);
+	Memory* memory = asMemoryNullable(getInstanceExport(exporterInstance, "m"));
+	WAVM_ERROR_UNLESS(memory);
+
+	// A module compiled to rely on guard pages must fail to instantiate with the memory.
+	const IR::Module importerIR = parseModule("(module (import \"e\" \"m\" (memory 1 1)))");
+	WAVM_ERROR_UNLESS(
+		!instantiateModule(compartment, compileModule(importerIR), {asObject(memory)}, "guarded"));
+
+	// The same module compiled with the clamp bounds-check mode may be instantiated with it.
+	WAVM_ERROR_UNLESS(instantiateModule(
+		compartment, compileModule(importerIR, clampOptions), {asObject(memory)}, "clamped"));
+
+	exporterInstance = nullptr;
+	memory = nullptr;
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(compartment)));
+}
+
+// Invokes a function, and returns whether it threw an outOfFuel exception.
+static bool invokeRunsOutOfFuel(Context* context,
+								Function* function,
+								const FunctionType& invokeSig,
+								const UntaggedValue* arguments,
+								UntaggedValue* results)
+{
+	bool ranOutOfFuel = false;
+	catchRuntimeExceptions(
+		[&] { invokeFunction(context, function, invokeSig, arguments, results); },
+		[&](Exception* exception) {
+			WAVM_ERROR_UNLESS(getExceptionType(exception) == ExceptionTypes::outOfFuel);
+			destroyException(exception);
+			ranOutOfFuel = true;
+		});
+	return ranOutOfFuel;
+}
+
+static void testFuel()
+{
+	GCPointer<Compartment> compartment = createCompartment("testFuel");
+	Context* context = createContext(compartment);
+
+	// Check that the fuel may be set and added to, and that adding saturates instead of
+	// overflowing.
+	WAVM_ERROR_UNLESS(getContextFuel(context) == INT64_MAX);
+	setContextFuel(context, 100);
+	WAVM_ERROR_UNLESS(getContextFuel(context) == 100);
+	addContextFuel(context, 50);
+	WAVM_ERROR_UNLESS(getContextFuel(context) == 150);
+	addContextFuel(context, -200);
+	WAVM_ERROR_UNLESS(getContextFuel(context) == -50);
+	addContextFuel(context, INT64_MAX);
+	WAVM_ERROR_UNLESS(getContextFuel(context) == INT64_MAX - 50);
+	addContextFuel(context, INT64_MAX);
+	WAVM_ERROR_UNLESS(getContextFuel(context) == INT64_MAX);
+	setContextFuel(context, -50);
+	addContextFuel(context, INT64_MIN);
+	WAVM_ERROR_UNLESS(getContextFuel(context) == INT64_MIN);
+
+	LLVMJIT::CompileOptions fuelOptions;
+	fuelOptions.meterFuel = true;
+	Instance* instance
+		= instantiateModule(compartment,
+							compileModule(parseModule("(module\n"
+													  "  (func (export \"add\")\n"
+													  "    (param i32 i32) (result i32)\n"
+													  "    (i32.add (local.get 0) (local.get 1)))\n"
+													  "  (func (export \"spin\")\n"
+													  "    (loop $loop (br $loop)))\n"
+													  ")"),
+										  fuelOptions),
+							{},
+							"fuel");
+	WAVM_ERROR_UNLESS(instance);
+	Function* addFunction = asFunction(getInstanceExport(instance, "add"));
+	Function* spinFunction = asFunction(getInstanceExport(instance, "spin"));
+	const FunctionType addSig({ValueType::i32}, {ValueType::i32, ValueType::i32});
+	const FunctionType spinSig;
+
+	// Running code consumes fuel, but doesn't trap while there is fuel remaining.
+	UntaggedValue addArgs[2] = {U32(1), U32(2)};
+	UntaggedValue addResults[1];
+	setContextFuel(context, 1000);
+	WAVM_ERROR_UNLESS(!invokeRunsOutOfFuel(context, addFunction, addSig, addArgs, addResults));
+	WAVM_ERROR_UNLESS(addResults[0].u32 == 3);
+	WAVM_ERROR_UNLESS(getContextFuel(context) >= 0 && getContextFuel(context) < 1000);
+
+	// An infinite loop traps at its loop header once the fuel runs out.
+	WAVM_ERROR_UNLESS(invokeRunsOutOfFuel(context, spinFunction, spinSig, nullptr, nullptr));
+	WAVM_ERROR_UNLESS(getContextFuel(context) < 0);
+
+	// Calls trap on entry while the context is out of fuel, and run again once it is refilled.
+	WAVM_ERROR_UNLESS(invokeRunsOutOfFuel(context, addFunction, addSig, addArgs, addResults));
+	addContextFuel(context, 1000);
+	WAVM_ERROR_UNLESS(!invokeRunsOutOfFuel(context, addFunction, addSig, addArgs, addResults));
+
+	instance = nullptr;
+	context = nullptr;
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(compartment)));
+}
+
+static void testCopyOnWriteClone()
+{
+	GCPointer<Compartment> compartment = createCompartment("testCopyOnWriteClone");
+	Memory* memory = createMemory(compartment, MemoryType(false, IndexType::i32, {4, 4}), "m");
+	WAVM_ERROR_UNLESS(memory);
+
+	// Clones the compartment with a copy-on-write mode, and returns the cloned memory.
+	auto cloneTestMemory = [&](GCPointer<Compartment>& outClonedCompartment,
+							   MemoryCloneMode memoryCloneMode) {
+		outClonedCompartment = cloneCompartment(compartment, "clone", memoryCloneMode);
+		WAVM_ERROR_UNLESS(outClonedCompartment);
+		return remapToClonedCompartment(memory, outClonedCompartment);
+	};
+
+	// Each clone sees the contents of the original memory at the time it was cloned.
+	getMemoryBaseAddress(memory)[0] = 'a';
+	GCPointer<Compartment> clonedCompartmentA;
+	Memory* clonedMemoryA = cloneTestMemory(clonedCompartmentA, MemoryCloneMode::copyOnWrite);
+	getMemoryBaseAddress(memory)[0] = 'b';
+	GCPointer<Compartment> clonedCompartmentB;
+	Memory* clonedMemoryB = cloneTestMemory(clonedCompartmentB, MemoryCloneMode::copyOnWrite);
+	GCPointer<Compartment> clonedCompartmentC;
+	Memory* clonedMemoryC = cloneTestMemory(clonedCompartmentC, MemoryCloneMode::copyOnWrite);
+	WAVM_ERROR_UNLESS(getMemoryBaseAddress(clonedMemoryA)[0] == 'a');
+	WAVM_ERROR_UNLESS(getMemoryBaseAddress(clonedMemoryB)[0] == 'b');
+	WAVM_ERROR_UNLESS(getMemoryBaseAddress(clonedMemoryC)[0] == 'b');
+
+	// Writing a clone copies only the written page, and doesn't change the original memory or the
+	// other clones.
+	const Uptr bytesPerPage = Platform::getBytesPerPage();
+	getMemoryBaseAddress(clonedMemoryB)[bytesPerPage] = 'c';
+	WAVM_ERROR_UNLESS(getMemoryBaseAddress(memory)[bytesPerPage] == 0);
+	WAVM_ERROR_UNLESS(getMemoryBaseAddress(clonedMemoryC)[bytesPerPage] == 0);
+	const MemoryCopyOnWriteStats stats = getMemoryCopyOnWriteStats(clonedMemoryB);
+	WAVM_ERROR_UNLESS(stats.numSnapshotPages == (4 * IR::numBytesPerPage) / bytesPerPage);
+	WAVM_ERROR_UNLESS(stats.numCopiedPages == 1 || stats.numCopiedPages == UINTPTR_MAX);
+
+	// The original memory is remapped from the snapshot that B and C were mapped from, so writing
+	// it copies the written page, and doesn't change the clones.
+	const MemoryCopyOnWriteStats originalStats = getMemoryCopyOnWriteStats(memory);
+	WAVM_ERROR_UNLESS(originalStats.numSnapshotPages == (4 * IR::numBytesPerPage) / bytesPerPage);
+	WAVM_ERROR_UNLESS(originalStats.numCopiedPages == 0
+					  || originalStats.numCopiedPages == UINTPTR_MAX);
+	getMemoryBaseAddress(memory)[bytesPerPage * 2] = 'e';
+	WAVM_ERROR_UNLESS(getMemoryBaseAddress(clonedMemoryB)[bytesPerPage * 2] == 0);
+	WAVM_ERROR_UNLESS(getMemoryBaseAddress(clonedMemoryC)[bytesPerPage * 2] == 0);
+	const Uptr numCopiedPages = getMemoryCopyOnWriteStats(memory).numCopiedPages;
+	WAVM_ERROR_UNLESS(numCopiedPages == 1 || numCopiedPages == UINTPTR_MAX);
+
+	// A write through a pointer that the host got before a clone is seen by the next clone.
+	U8* memoryBase = getMemoryBaseAddress(memory);
+	GCPointer<Compartment> clonedCompartmentD;
+	Memory* clonedMemoryD = cloneTestMemory(clonedCompartmentD, MemoryCloneMode::copyOnWrite);
+	memoryBase[0] = 'd';
+	GCPointer<Compartment> clonedCompartmentE;
+	Memory* clonedMemoryE = cloneTestMemory(clonedCompartmentE, MemoryCloneMode::copyOnWrite);
+	WAVM_ERROR_UNLESS(getMemoryBaseAddress(clonedMemoryD)[0] == 'b');
+	WAVM_ERROR_UNLESS(getMemoryBaseAddress(clonedMemoryD)[bytesPerPage * 2] == 'e');
+	WAVM_ERROR_UNLESS(getMemoryBaseAddress(clonedMemoryE)[0] == 'd');
+
+	// Clones of a clone see its contents, including the pages it has written.
+	getMemoryBaseAddress(clonedMemoryE)[bytesPerPage * 3] = 'f';
+	GCPointer<Compartment> clonedCompartmentF
+		= cloneCompartment(clonedCompartmentE, "clone", MemoryCloneMode::copyOnWrite);
+	WAVM_ERROR_UNLESS(clonedCompartmentF);
+	Memory* clonedMemoryF = remapToClonedCompartment(clonedMemoryE, clonedCompartmentF);
+	WAVM_ERROR_UNLESS(getMemoryBaseAddress(clonedMemoryF)[0] == 'd');
+	WAVM_ERROR_UNLESS(getMemoryBaseAddress(clonedMemoryF)[bytesPerPage * 3] == 'f');
+	WAVM_ERROR_UNLESS(getMemoryBaseAddress(memory)[bytesPerPage * 3] == 0);
+
+	clonedMemoryA = clonedMemoryB = clonedMemoryC = nullptr;
+	clonedMemoryD = clonedMemoryE = clonedMemoryF = nullptr;
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(clonedCompartmentA)));
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(clonedCompartmentB)));
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(clonedCompartmentC)));
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(clonedCompartmentD)));
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(clonedCompartmentE)));
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(clonedCompartmentF)));
+	memory = nullptr;
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(compartment)));
+}
+
+static void testTierUp()
+{
+	LLVMJIT::CompileOptions baselineOptions;
+	baselineOptions.optimizationLevel = LLVMJIT::OptimizationLevel::none;
+	const IR::Module irModule = parseModule(
+		"(module (func (export \"f\") (param i32) (result i32)"
+		" (i32.add (i32.mul (local.get 0) (i32.const 3)) (i32.const 1))))");
+
+	GCPointer<Compartment> compartment = createCompartment("testTierUp");
+	Context* context = createContext(compartment);
+	const FunctionType invokeSig({ValueType::i32}, {ValueType::i32});
+	auto invokeF = [&](Instance* instance) {
+		UntaggedValue arguments[1] = {U32(5)};
+		UntaggedValue results[1];
+		invokeFunction(context,
+					   asFunction(getInstanceExport(instance, "f")),
+					   invokeSig,
+					   arguments,
+					   results);
+		return results[0].u32;
+	};
+
+	// Instantiate the module with the baseline tier, and start optimizing it in the background.
+	ModuleRef module = compileModule(irModule, baselineOptions);
+	const std::vector<U8> baselineObjectCode = getObjectCode(module);
+	Instance* baselineInstance = instantiateModule(compartment, module, {}, "baseline");
+	WAVM_ERROR_UNLESS(baselineInstance);
+	optimizeModuleInBackground(module, LLVMJIT::CompileOptions());
+
+	// Wait for the optimized object code to replace the baseline object code.
+	Platform::Event pollEvent;
+	Uptr numPolls = 0;
+	while(getObjectCode(module) == baselineObjectCode)
+	{
+		WAVM_ERROR_UNLESS(++numPolls < 60000);
+		pollEvent.wait(Time{I128(1000000)});
+	};
+
+	// Instances created after the tier-up use the optimized object code, and instances created
+	// before it continue to run the baseline object code.
+	Instance* optimizedInstance = instantiateModule(compartment, module, {}, "optimized");
+	WAVM_ERROR_UNLESS(optimizedInstance);
+	WAVM_ERROR_UNLESS(invokeF(baselineInstance) == 16);
+	WAVM_ERROR_UNLESS(invokeF(optimizedInstance) == 16);
+
+	// An instance of a module compiled with CompileOptions::tierUp forwards calls to its hot
+	// functions to optimized code while it is running.
+	LLVMJIT::CompileOptions tierUpOptions = baselineOptions;
+	tierUpOptions.tierUp = true;
+	ModuleRef tierUpModule = compileModule(irModule, tierUpOptions);
+	Instance* tierUpInstance = instantiateModule(compartment, tierUpModule, {}, "tierUp");
+	WAVM_ERROR_UNLESS(tierUpInstance);
+	Function* tierUpFunction = asFunction(getInstanceExport(tierUpInstance, "f"));
+	numPolls = 0;
+	while(!tierUpFunction->mutableData->tierUp.code.load(std::memory_order_acquire))
+	{
+		WAVM_ERROR_UNLESS(++numPolls < 60000);
+		for(Uptr callIndex = 0; callIndex < FunctionTierUp::callInterval; ++callIndex)
+		{ WAVM_ERROR_UNLESS(invokeF(tierUpInstance) == 16); }
+		pollEvent.wait(Time{I128(1000000)});
+	};
+	WAVM_ERROR_UNLESS(invokeF(tierUpInstance) == 16);
+
+	// Releasing a module while it's being optimized doesn't wait for the optimization.
+	ModuleRef releasedModule = compileModule(irModule, baselineOptions);
+	optimizeModuleInBackground(releasedModule, LLVMJIT::CompileOptions());
+	releasedModule.reset();
+
+	baselineInstance = optimizedInstance = tierUpInstance = nullptr;
+	context = nullptr;
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(compartment)));
+}
+
+static void testTryCollectInstance()
+{
+	GCPointer<Compartment> compartment = createCompartment("testTryCollectInstance");
+	Context* context = createContext(compartment);
+	ModuleRef exporterModule = compileModule(
+		parseModule("(module (func (export \"f\") (param i32) (result i32) (local.get 0)))"));
+
+	// An instance that nothing else references is freed without collecting its compartment.
+	GCPointer<Instance> exporter = instantiateModule(compartment, exporterModule, {}, "exporter");
+	WAVM_ERROR_UNLESS(exporter);
+	WAVM_ERROR_UNLESS(tryCollectInstance(std::move(exporter)));
+
+	// An instance that imports another instance's function may be freed, but the instance that
+	// exported the function is conservatively assumed to still be referenced.
+	exporter = instantiateModule(compartment, exporterModule, {}, "exporter");
+	WAVM_ERROR_UNLESS(exporter);
+	ModuleRef importerModule = compileModule(
+		parseModule("(module (import \"e\" \"f\" (func (param i32) (result i32))))"));
+	GCPointer<Instance> importer = instantiateModule(
+		compartment, importerModule, {getInstanceExport(exporter, "f")}, "importer");
+	WAVM_ERROR_UNLESS(importer);
+	WAVM_ERROR_UNLESS(tryCollectInstance(std::move(importer)));
+	WAVM_ERROR_UNLESS(!tryCollectInstance(std::move(exporter)));
+
+	// An instance that only defines a table may call another instance's function written to the
+	// table by the host, and pass it a reference to its own function that the callee keeps.
+	GCPointer<Instance> storer
+		= instantiateModule(compartment,
+							compileModule(parseModule(
+								"(module\n"
+								"  (global $g (export \"g\") (mut funcref) (ref.null func))\n"
+								"  (func (export \"store\") (param funcref)\n"
+								"    (global.set $g (local.get 0)))\n"
+								")")),
+							{},
+							"storer");
+	WAVM_ERROR_UNLESS(storer);
+	GCPointer<Instance> passer
+		= instantiateModule(compartment,
+							compileModule(parseModule(
+								"(module\n"
+								"  (type $store (func (param funcref)))\n"
+								"  (table (export \"t\") 1 funcref)\n"
+								"  (func $pass (export \"pass\")\n"
+								"    (call_indirect (type $store)\n"
+								"      (ref.func $pass) (i32.const 0)))\n"
+								")")),
+							{},
+							"passer");
+	WAVM_ERROR_UNLESS(passer);
+	setTableElement(
+		asTable(getInstanceExport(passer, "t")), 0, getInstanceExport(storer, "store"));
+	invokeFunction(context, asFunction(getInstanceExport(passer, "pass")), FunctionType());
+	Global* storedGlobal = asGlobal(getInstanceExport(storer, "g"));
+	WAVM_ERROR_UNLESS(getGlobalValue(context, storedGlobal).object
+					  == getInstanceExport(passer, "pass"));
+	WAVM_ERROR_UNLESS(!tryCollectInstance(std::move(passer)));
+	storedGlobal = nullptr;
+	storer = nullptr;
+
+	context = nullptr;
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(compartment)));
+}
+
+static void testMemoryPool()
+{
+	// Use a pool with two slots, so the test can exhaust it.
+	const Uptr defaultPoolSize = getMemoryPoolStats().numSlots;
+	WAVM_ERROR_UNLESS(setMemoryPoolSize(2));
+
+	GCPointer<Compartment> compartment = createCompartment("testMemoryPool");
+	const MemoryType memoryType(false, IndexType::i32, {1, 2});
+	const MemoryPoolStats initialStats = getMemoryPoolStats();
+	WAVM_ERROR_UNLESS(initialStats.numSlots == 2 && initialStats.numAllocatedSlots == 0);
+
+	// 32-bit memories are allocated from the pool until it is exhausted.
+	GCPointer<Memory> memoryA = createMemory(compartment, memoryType, "a");
+	GCPointer<Memory> memoryB = createMemory(compartment, memoryType, "b");
+	GCPointer<Memory> memoryC = createMemory(compartment, memoryType, "c");
+	WAVM_ERROR_UNLESS(memoryA && memoryB && memoryC);
+	MemoryPoolStats stats = getMemoryPoolStats();
+	WAVM_ERROR_UNLESS(stats.numAllocatedSlots == 2);
+	WAVM_ERROR_UNLESS(stats.numHits == initialStats.numHits + 2);
+	WAVM_ERROR_UNLESS(stats.numMisses == initialStats.numMisses + 1);
+
+	// An out-of-bounds access to a pooled memory is attributed to the memory.
+	Context* context = createContext(compartment);
+	Instance* instance = instantiateModule(
+		compartment,
+		compileModule(parseModule("(module (import \"e\" \"m\" (memory 1 2))\n"
+								  "  (func (export \"load\") (param i32) (result i32)\n"
+								  "    (i32.load8_u (local.get 0))))")),
+		{asObject(memoryA)},
+		"load");
+	WAVM_ERROR_UNLESS(instance);
+	const Uptr outOfBoundsAddress = 2 * IR::numBytesPerPage + 1;
+	UntaggedValue loadArgs[1] = {U32(outOfBoundsAddress)};
+	UntaggedValue loadResults[1];
+	bool trapped = false;
+	catchRuntimeExceptions(
+		[&] {
+			invokeFunction(context,
+						   asFunction(getInstanceExport(instance, "load")),
+						   FunctionType({ValueType::i32}, {ValueType::i32}),
+						   loadArgs,
+						   loadResults);
+		},
+		[&](Exception* exception) {
+			WAVM_ERROR_UNLESS(getExceptionType(exception)
+							  == ExceptionTypes::outOfBoundsMemoryAccess);
+			WAVM_ERROR_UNLESS(getExceptionArgument(exception, 0).object == asObject(memoryA));
+			WAVM_ERROR_UNLESS(getExceptionArgument(exception, 1).u64 == outOfBoundsAddress);
+			destroyException(exception);
+			trapped = true;
+		});
+	WAVM_ERROR_UNLESS(trapped);
+
+	// Freeing a pooled memory returns its slot to the pool, and the next memory reuses the slot.
+	WAVM_ERROR_UNLESS(growMemory(memoryA, 1) == GrowResult::success);
+	U8* freedBaseAddress = getMemoryBaseAddress(memoryA);
+	freedBaseAddress[0] = 1;
+	freedBaseAddress[IR::numBytesPerPage] = 1;
+	instance = nullptr;
+	context = nullptr;
+	memoryA = nullptr;
+	collectCompartmentGarbage(compartment);
+	WAVM_ERROR_UNLESS(getMemoryPoolStats().numAllocatedSlots == 1);
+
+	GCPointer<Memory> memoryD = createMemory(compartment, memoryType, "d");
+	WAVM_ERROR_UNLESS(memoryD);
+	WAVM_ERROR_UNLESS(getMemoryBaseAddress(memoryD) == freedBaseAddress);
+	stats = getMemoryPoolStats();
+	WAVM_ERROR_UNLESS(stats.numAllocatedSlots == 2);
+	WAVM_ERROR_UNLESS(stats.numHits == initialStats.numHits + 3);
+
+	// The reused slot's pages are zeroed, including the pages that the new memory grows into.
+	WAVM_ERROR_UNLESS(getMemoryNumPages(memoryD) == 1);
+	WAVM_ERROR_UNLESS(getMemoryBaseAddress(memoryD)[0] == 0);
+	WAVM_ERROR_UNLESS(growMemory(memoryD, 1) == GrowResult::success);
+	WAVM_ERROR_UNLESS(getMemoryBaseAddress(memoryD)[IR::numBytesPerPage] == 0);
+
+	memoryB = nullptr;
+	memoryC = nullptr;
+	memoryD = nullptr;
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(compartment)));
+	WAVM_ERROR_UNLESS(getMemoryPoolStats().numAllocatedSlots == 0);
+	WAVM_ERROR_UNLESS(setMemoryPoolSize(defaultPoolSize));
+}
+
+// Calls a thunk, and returns the type of the runtime exception it throws, or null.
+static Runtime::ExceptionType* getThrownExceptionType(const std::function<void()>& thunk)
+{
+	Runtime::ExceptionType* exceptionType = nullptr;
+	catchRuntimeExceptions(thunk, [&](Exception* exception) {
+		exceptionType = getExceptionType(exception);
+		destroyException(exception);
+	});
+	return exceptionType;
+}
+
+static void testResourceQuota()
+{
+	GCPointer<Compartment> compartment = createCompartment("testResourceQuota");
+
+	// Growing a memory or table past the quota fails, and freeing it makes room for another.
+	ResourceQuotaRef resourceQuota = createResourceQuota();
+	setResourceQuotaMaxMemoryPages(resourceQuota, 2);
+	setResourceQuotaMaxTableElems(resourceQuota, 2);
+	const MemoryType memoryType(false, IndexType::i32, {1, 4});
+	const TableType tableType(ReferenceType::funcref, false, IndexType::i32, {1, 4});
+
+	GCPointer<Memory> memory = createMemory(compartment, memoryType, "memory", resourceQuota);
+	GCPointer<Table> table = createTable(compartment, tableType, nullptr, "table", resourceQuota);
+	WAVM_ERROR_UNLESS(memory && table);
+	WAVM_ERROR_UNLESS(growMemory(memory, 1) == GrowResult::success);
+	WAVM_ERROR_UNLESS(growTable(table, 1) == GrowResult::success);
+	WAVM_ERROR_UNLESS(getResourceQuotaCurrentMemoryPages(resourceQuota) == 2);
+	WAVM_ERROR_UNLESS(getResourceQuotaCurrentTableElems(resourceQuota) == 2);
+	WAVM_ERROR_UNLESS(growMemory(memory, 1) == GrowResult::outOfQuota);
+	WAVM_ERROR_UNLESS(growTable(table, 1) == GrowResult::outOfQuota);
+	WAVM_ERROR_UNLESS(!createMemory(compartment, memoryType, "memory", resourceQuota));
+	WAVM_ERROR_UNLESS(!createTable(compartment, tableType, nullptr, "table", resourceQuota));
+
+	memory = nullptr;
+	table = nullptr;
+	collectCompartmentGarbage(compartment);
+	WAVM_ERROR_UNLESS(getResourceQuotaCurrentMemoryPages(resourceQuota) == 0);
+	WAVM_ERROR_UNLESS(getResourceQuotaCurrentTableElems(resourceQuota) == 0);
+	memory = createMemory(compartment, memoryType, "memory", resourceQuota);
+	table = createTable(compartment, tableType, nullptr, "table", resourceQuota);
+	WAVM_ERROR_UNLESS(memory && table);
+	memory = nullptr;
+	table = nullptr;
+
+	// Instantiating more instances than the quota allows throws an outOfMemory exception.
+	ModuleRef module = compileModule(
+		parseModule("(module\n"
+					"  (func (export \"spin\") (param i32)\n"
+					"    (loop $loop\n"
+					"      (br_if $loop (local.tee 0 (i32.sub (local.get 0) (i32.const 1))))))\n"
+					")"));
+	resourceQuota = createResourceQuota();
+	setResourceQuotaMaxInstances(resourceQuota, 1);
+	GCPointer<Instance> instance = instantiateModule(compartment, module, {}, "a", resourceQuota);
+	WAVM_ERROR_UNLESS(instance);
+	WAVM_ERROR_UNLESS(getResourceQuotaCurrentInstances(resourceQuota) == 1);
+	WAVM_ERROR_UNLESS(getThrownExceptionType([&] {
+						  instantiateModule(compartment, module, {}, "b", resourceQuota);
+					  })
+					  == ExceptionTypes::outOfMemory);
+	WAVM_ERROR_UNLESS(tryCollectInstance(std::move(instance)));
+	WAVM_ERROR_UNLESS(getResourceQuotaCurrentInstances(resourceQuota) == 0);
+	instance = instantiateModule(compartment, module, {}, "c", resourceQuota);
+	WAVM_ERROR_UNLESS(instance);
+	WAVM_ERROR_UNLESS(tryCollectInstance(std::move(instance)));
+
+	// Loading more code than the quota allows also throws an outOfMemory exception, without
+	// charging the instance that failed to the quota.
+	resourceQuota = createResourceQuota();
+	instance = instantiateModule(compartment, module, {}, "a", resourceQuota);
+	const Uptr numCodeBytesPerInstance = getResourceQuotaCurrentCodeBytes(resourceQuota);
+	WAVM_ERROR_UNLESS(numCodeBytesPerInstance > 0);
+	setResourceQuotaMaxCodeBytes(resourceQuota, numCodeBytesPerInstance * 2 - 1);
+	WAVM_ERROR_UNLESS(getThrownExceptionType([&] {
+						  instantiateModule(compartment, module, {}, "b", resourceQuota);
+					  })
+					  == ExceptionTypes::outOfMemory);
+	WAVM_ERROR_UNLESS(getResourceQuotaCurrentInstances(resourceQuota) == 1);
+	WAVM_ERROR_UNLESS(getResourceQuotaCurrentCodeBytes(resourceQuota) == numCodeBytesPerInstance);
+	WAVM_ERROR_UNLESS(tryCollectInstance(std::move(instance)));
+	WAVM_ERROR_UNLESS(getResourceQuotaCurrentCodeBytes(resourceQuota) == 0);
+	instance = instantiateModule(compartment, module, {}, "c", resourceQuota);
+	WAVM_ERROR_UNLESS(instance);
+	WAVM_ERROR_UNLESS(tryCollectInstance(std::move(instance)));
+
+	// Invocations are charged for the CPU time they use, and once the quota's CPU time is used up,
+	// invoking its instances' functions throws an outOfCPUTime exception.
+	resourceQuota = createResourceQuota();
+	setResourceQuotaMaxCPUTimeNanoseconds(resourceQuota, 1000000);
+	instance = instantiateModule(compartment, module, {}, "spin", resourceQuota);
+	Function* spinFunction = asFunction(getInstanceExport(instance, "spin"));
+	Context* context = createContext(compartment);
+	const FunctionType spinSig({}, {ValueType::i32});
+	UntaggedValue spinArgs[1] = {U32(1000000)};
+	Runtime::ExceptionType* spinExceptionType = nullptr;
+	for(Uptr invokeIndex = 0; invokeIndex < 100000 && !spinExceptionType; ++invokeIndex)
+	{
+		spinExceptionType = getThrownExceptionType(
+			[&] { invokeFunction(context, spinFunction, spinSig, spinArgs); });
+	}
+	WAVM_ERROR_UNLESS(spinExceptionType == ExceptionTypes::outOfCPUTime);
+	const U64 usedCPUTimeNanoseconds = getResourceQuotaCurrentCPUTimeNanoseconds(resourceQuota);
+	WAVM_ERROR_UNLESS(usedCPUTimeNanoseconds >= 1000000);
+
+	// Raising the quota's CPU time lets its functions run again.
+	setResourceQuotaMaxCPUTimeNanoseconds(resourceQuota, usedCPUTimeNanoseconds + 1000000000);
+	WAVM_ERROR_UNLESS(!getThrownExceptionType(
+		[&] { invokeFunction(context, spinFunction, spinSig, spinArgs); }));
+	WAVM_ERROR_UNLESS(getResourceQuotaCurrentCPUTimeNanoseconds(resourceQuota)
+					  > usedCPUTimeNanoseconds);
+
+	spinFunction = nullptr;
+	context = nullptr;
+	instance = nullptr;
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(compartment)));
+}
+
+static constexpr Uptr numMultithreadedCompileFunctions = 16;
+
+// Invokes a function that takes and returns i32s, and returns its result.
+static I32 invokeI32Function(Context* context, Instance* instance, const char* name, I32 a, I32 b)
+{
+	Function* function = asFunction(getInstanceExport(instance, name));
+	const FunctionType functionType = getFunctionType(function);
+	UntaggedValue arguments[2] = {a, b};
+	UntaggedValue result;
+	invokeFunction(context, function, functionType, arguments, &result);
+	return result.i32;
+}
+
+static void testMultithreadedCompile()
+{
+	// Generate a module whose functions call each other directly and through a table, so calls
+	// cross the partitions that the module is compiled in.
+	std::string wast = "(module\n"
+					   "  (type $i32_to_i32 (func (param i32) (result i32)))\n"
+					   "  (memory 1 1)\n"
+					   "  (data (i32.const 0) \"\\05\\00\\00\\00\")\n"
+					   "  (table $table "
+					   + std::to_string(numMultithreadedCompileFunctions) + " funcref)\n";
+	for(Uptr functionIndex = 0; functionIndex < numMultithreadedCompileFunctions; ++functionIndex)
+	{
+		const std::string name = "f" + std::to_string(functionIndex);
+		wast += "  (func $" + name + " (export \"" + name + "\") (type $i32_to_i32)\n";
+		wast += "    (i32.mul (local.get 0) (i32.const " + std::to_string(functionIndex + 3)
+				+ "))\n";
+		if(functionIndex == 0) { wast += "    (i32.load (i32.const 0))\n"; }
+		else
+		{
+			wast += "    (call $f" + std::to_string(functionIndex - 1)
+					+ " (i32.xor (local.get 0) (i32.const 1)))\n";
+		}
+		wast += "    (i32.add))\n";
+		wast += "  (elem (i32.const " + std::to_string(functionIndex) + ") $" + name + ")\n";
+	}
+	wast += "  (func (export \"indirect\") (param i32 i32) (result i32)\n"
+			"    (call_indirect $table (type $i32_to_i32) (local.get 1) (local.get 0)))\n"
+			")";
+	const IR::Module irModule = parseModule(wast.c_str());
+
+	// Compile the module on one thread, and on several threads.
+	LLVMJIT::CompileOptions singleThreadedOptions;
+	singleThreadedOptions.numThreads = 1;
+	LLVMJIT::CompileOptions multithreadedOptions;
+	multithreadedOptions.numThreads = 4;
+
+	GCPointer<Compartment> compartment = createCompartment("testMultithreadedCompile");
+	Context* context = createContext(compartment);
+	Instance* singleThreadedInstance = instantiateModule(
+		compartment, compileModule(irModule, singleThreadedOptions), {}, "singleThreaded");
+	Instance* multithreadedInstance = instantiateModule(
+		compartment, compileModule(irModule, multithreadedOptions), {}, "multithreaded");
+	WAVM_ERROR_UNLESS(singleThreadedInstance && multithreadedInstance);
+
+	// Every function must return the same results in both instances.
+	for(I32 argument : {0, 1, -7, 12345})
+	{
+		for(Uptr functionIndex = 0; functionIndex < numMultithreadedCompileFunctions;
+			++functionIndex)
+		{
+			const std::string name = "f" + std::to_string(functionIndex);
+			const I32 singleThreadedResult = invokeI32Function(
+				context, singleThreadedInstance, name.c_str(), argument, 0);
+			WAVM_ERROR_UNLESS(
+				invokeI32Function(context, multithreadedInstance, name.c_str(), argument, 0)
+				== singleThreadedResult);
+			const I32 indirectResult = invokeI32Function(
+				context, multithreadedInstance, "indirect", I32(functionIndex), argument);
+			WAVM_ERROR_UNLESS(indirectResult == singleThreadedResult);
+		}
+	}
+
+	singleThreadedInstance = nullptr;
+	multithreadedInstance = nullptr;
+	context = nullptr;
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(compartment)));
+}
+
+static constexpr Uptr numProfileThreads = 4;
+static constexpr I32 numProfileLoopIterations = 10000;
+
+struct ProfileThreadArgs
+{
+	Context* context = nullptr;
+	Function* function = nullptr;
+	Platform::Thread* thread = nullptr;
+};
+
+static I64 profileThreadEntry(void* argument)
+{
+	ProfileThreadArgs& args = *(ProfileThreadArgs*)argument;
+	UntaggedValue countDownArgs[1] = {numProfileLoopIterations};
+	invokeFunction(args.context, args.function, FunctionType({}, {ValueType::i32}), countDownArgs);
+	return 0;
+}
+
+static void testProfile()
+{
+	const char* moduleWAST
+		= "(module\n"
+		  "  (func (export \"select\") (param i32) (result i32)\n"
+		  "    (if (result i32) (local.get 0) (then (i32.const 1)) (else (i32.const 2))))\n"
+		  "  (func (export \"countDown\") (param i32)\n"
+		  "    (loop $loop\n"
+		  "      (br_if $loop (local.tee 0 (i32.sub (local.get 0) (i32.const 1)))))))";
+	const IR::Module irModule = parseModule(moduleWAST);
+
+	// Each function has a counter for its entry, followed by a pair of counters for each if or
+	// br_if: the number of times it was executed, and the number of times its condition was true.
+	WAVM_ERROR_UNLESS(LLVMJIT::getNumProfileCounters(irModule) == 6);
+
+	LLVMJIT::CompileOptions instrumentOptions;
+	instrumentOptions.instrumentProfile = true;
+	ModuleRef instrumentedModule = compileModule(irModule, instrumentOptions);
+
+	GCPointer<Compartment> compartment = createCompartment("testProfile");
+	Context* context = createContext(compartment);
+	Instance* instance = instantiateModule(compartment, instrumentedModule, {}, "instrumented");
+	WAVM_ERROR_UNLESS(instance);
+	WAVM_ERROR_UNLESS(invokeI32Function(context, instance, "select", 1, 0) == 1);
+	WAVM_ERROR_UNLESS(invokeI32Function(context, instance, "select", 0, 0) == 2);
+	WAVM_ERROR_UNLESS(invokeI32Function(context, instance, "select", 7, 0) == 1);
+
+	// Run the loop on several threads at once: the counters are shared by all of them, and must
+	// not lose any of their increments.
+	ProfileThreadArgs threadArgs[numProfileThreads];
+	for(ProfileThreadArgs& args : threadArgs)
+	{
+		args.context = createContext(compartment);
+		args.function = asFunction(getInstanceExport(instance, "countDown"));
+		args.thread = Platform::createThread(512 * 1024, profileThreadEntry, &args);
+	}
+	for(ProfileThreadArgs& args : threadArgs) { Platform::joinThread(args.thread); }
+
+	LLVMJIT::ModuleProfile profile;
+	WAVM_ERROR_UNLESS(getModuleProfile(instrumentedModule, profile));
+	WAVM_ERROR_UNLESS(profile.moduleHash == LLVMJIT::getProfileModuleHash(irModule));
+	const U64 numLoopIterations = U64(numProfileThreads) * U64(numProfileLoopIterations);
+	const std::vector<U64> expectedCounters
+		= {3, 3, 2, numProfileThreads, numLoopIterations, numLoopIterations - numProfileThreads};
+	WAVM_ERROR_UNLESS(profile.counters == expectedCounters);
+
+	// A module compiled without instrumentation doesn't have a profile.
+	LLVMJIT::ModuleProfile uninstrumentedProfile;
+	WAVM_ERROR_UNLESS(!getModuleProfile(compileModule(irModule), uninstrumentedProfile));
+
+	// The profile survives serialization.
+	LLVMJIT::ModuleProfile deserializedProfile;
+	WAVM_ERROR_UNLESS(LLVMJIT::deserializeModuleProfile(
+		LLVMJIT::serializeModuleProfile(profile), deserializedProfile));
+	WAVM_ERROR_UNLESS(deserializedProfile.moduleHash == profile.moduleHash);
+	WAVM_ERROR_UNLESS(deserializedProfile.counters == profile.counters);
+
+	// A serialized profile with bytes after its counters isn't deserialized.
+	std::vector<U8> paddedProfileBytes = LLVMJIT::serializeModuleProfile(profile);
+	paddedProfileBytes.push_back(0);
+	WAVM_ERROR_UNLESS(!LLVMJIT::deserializeModuleProfile(paddedProfileBytes, deserializedProfile));
+
+	// The profile isn't matched to a module that only differs in an operator's immediates.
+	std::string otherImmediatesWAST = moduleWAST;
+	const Uptr constantOffset = otherImmediatesWAST.find("(i32.const 2)");
+	WAVM_ERROR_UNLESS(constantOffset != std::string::npos);
+	otherImmediatesWAST.replace(constantOffset, 13, "(i32.const 3)");
+	WAVM_ERROR_UNLESS(LLVMJIT::getProfileModuleHash(parseModule(otherImmediatesWAST.c_str()))
+					  != profile.moduleHash);
+
+	// Recompiling the module with the profile produces code that behaves the same.
+	LLVMJIT::CompileOptions profileOptions;
+	profileOptions.profile = std::make_shared<LLVMJIT::ModuleProfile>(deserializedProfile);
+	Instance* profiledInstance = instantiateModule(
+		compartment, compileModule(irModule, profileOptions), {}, "profiled");
+	WAVM_ERROR_UNLESS(profiledInstance);
+	WAVM_ERROR_UNLESS(invokeI32Function(context, profiledInstance, "select", 1, 0) == 1);
+	WAVM_ERROR_UNLESS(invokeI32Function(context, profiledInstance, "select", 0, 0) == 2);
+	UntaggedValue countDownArgs[1] = {I32(100)};
+	invokeFunction(context,
+				   asFunction(getInstanceExport(profiledInstance, "countDown")),
+				   FunctionType({}, {ValueType::i32}),
+				   countDownArgs);
+
+	for(ProfileThreadArgs& args : threadArgs) { args = ProfileThreadArgs(); }
+	profiledInstance = nullptr;
+	instance = nullptr;
+	context = nullptr;
+	instrumentedModule = nullptr;
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(compartment)));
+}
+
+static void testHostMutatedDefaultTable()
+{
+	// The first module's table isn't exported or mutated by its code, so its code assumes that the
+	// table is immutable, and the host can't mutate it as the default table. The second module
+	// exports its table, so the host can mutate it.
+	const char* moduleWASTPrefix
+		= "(module\n"
+		  "  (type $i32_to_i32 (func (param i32) (result i32)))\n";
+	const char* moduleWASTSuffix
+		= "  (elem (i32.const 0) $double $double)\n"
+		  "  (func $double (type $i32_to_i32) (i32.mul (local.get 0) (i32.const 2)))\n"
+		  "  (func (export \"nop\"))\n"
+		  "  (func (export \"triple\") (type $i32_to_i32) (i32.mul (local.get 0) (i32.const 3)))\n"
+		  "  (func (export \"callIndirect\") (param i32 i32) (result i32)\n"
+		  "    (call_indirect (type $i32_to_i32) (local.get 1) (local.get 0)))\n"
+		  "  (func (export \"callFirst\") (param i32) (result i32)\n"
+		  "    (call_indirect (type $i32_to_i32) (local.get 0) (i32.const 0))))";
+	const IR::Module immutableIRModule = parseModule(
+		(std::string(moduleWASTPrefix) + "  (table 2 funcref)\n" + moduleWASTSuffix).c_str());
+	const IR::Module exportedIRModule = parseModule(
+		(std::string(moduleWASTPrefix) + "  (table (export \"t\") 2 funcref)\n" + moduleWASTSuffix)
+			.c_str());
+
+	// Devirtualize the call_indirects through tables that the code assumes are immutable.
+	LLVMJIT::CompileOptions compileOptions;
+	compileOptions.devirtualizeIndirectCalls = true;
+
+	GCPointer<Compartment> compartment = createCompartment("testHostMutatedDefaultTable");
+	Context* context = createContext(compartment);
+
+	// Writing or growing the immutable table fails, and doesn't change what the code calls.
+	Instance* immutableInstance = instantiateModule(
+		compartment, compileModule(immutableIRModule, compileOptions), {}, "immutable");
+	WAVM_ERROR_UNLESS(immutableInstance);
+	Table* immutableTable = getDefaultTable(immutableInstance);
+	WAVM_ERROR_UNLESS(immutableTable);
+	WAVM_ERROR_UNLESS(getThrownExceptionType([&] {
+						  setTableElement(
+							  immutableTable, 1, getInstanceExport(immutableInstance, "nop"));
+					  })
+					  == ExceptionTypes::invalidArgument);
+	WAVM_ERROR_UNLESS(growTable(immutableTable, 1) == GrowResult::outOfMaxSize);
+	WAVM_ERROR_UNLESS(getTableNumElements(immutableTable) == 2);
+	WAVM_ERROR_UNLESS(invokeI32Function(context, immutableInstance, "callIndirect", 1, 5) == 10);
+	WAVM_ERROR_UNLESS(invokeI32Function(context, immutableInstance, "callFirst", 5, 0) == 10);
+
+	// A clone of the immutable table is also immutable.
+	GCPointer<Compartment> clonedCompartment = cloneCompartment(compartment, "clone");
+	WAVM_ERROR_UNLESS(clonedCompartment);
+	Table* clonedTable = remapToClonedCompartment(immutableTable, clonedCompartment);
+	WAVM_ERROR_UNLESS(getThrownExceptionType([&] { setTableElement(clonedTable, 1, nullptr); })
+					  == ExceptionTypes::invalidArgument);
+
+	// Calling a function of the wrong type that the host wrote to the exported table must trap.
+	Instance* exportedInstance = instantiateModule(
+		compartment, compileModule(exportedIRModule, compileOptions), {}, "exported");
+	WAVM_ERROR_UNLESS(exportedInstance);
+	Table* exportedTable = getDefaultTable(exportedInstance);
+	WAVM_ERROR_UNLESS(exportedTable);
+	WAVM_ERROR_UNLESS(invokeI32Function(context, exportedInstance, "callIndirect", 1, 5) == 10);
+	setTableElement(exportedTable, 1, getInstanceExport(exportedInstance, "nop"));
+	WAVM_ERROR_UNLESS(getThrownExceptionType([&] {
+						  invokeI32Function(context, exportedInstance, "callIndirect", 1, 5);
+					  })
+					  == ExceptionTypes::indirectCallSignatureMismatch);
+
+	// A call_indirect with a constant element index must call the function the host wrote to the
+	// exported table, rather than the function the module's elem segment put there.
+	WAVM_ERROR_UNLESS(invokeI32Function(context, exportedInstance, "callFirst", 5, 0) == 10);
+	setTableElement(exportedTable, 0, getInstanceExport(exportedInstance, "triple"));
+	WAVM_ERROR_UNLESS(invokeI32Function(context, exportedInstance, "callFirst", 5, 0) == 15);
+
+	clonedTable = nullptr;
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(clonedCompartment)));
+	immutableTable = exportedTable = nullptr;
+	immutableInstance = exportedInstance = nullptr;
+	context = nullptr;
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(compartment)));
+}
+
+// Returns the number of direct calls to a function definition in a module's unoptimized LLVM IR.
+static Uptr countDirectCalls(const IR::Module& irModule,
+							 const LLVMJIT::CompileOptions& compileOptions,
+							 Uptr functionDefIndex)
+{
+	const std::string llvmIR
+		= LLVMJIT::emitLLVMIR(irModule, LLVMJIT::getHostTargetSpec(), false, compileOptions);
+	const std::string calleeName = "@functionDef" + std::to_string(functionDefIndex) + "(";
+
+	Uptr numDirectCalls = 0;
+	Uptr lineBegin = 0;
+	while(lineBegin < llvmIR.size())
+	{
+		Uptr lineEnd = llvmIR.find('\n', lineBegin);
+		if(lineEnd == std::string::npos) { lineEnd = llvmIR.size(); }
+		const std::string line = llvmIR.substr(lineBegin, lineEnd - lineBegin);
+		const bool isCall = line.find("call ") != std::string::npos
+							|| line.find("invoke ") != std::string::npos;
+		if(isCall && line.find(calleeName) != std::string::npos) { ++numDirectCalls; }
+		lineBegin = lineEnd + 1;
+	};
+	return numDirectCalls;
+}
+
+static void testDevirtualizedCallIndirect()
+{
+	// The module's call_indirects through its immutable table, which is its default table, are
+	// compiled to direct calls of $double when devirtualization is enabled. The call_indirects
+	// through the exported table are never devirtualized.
+	const IR::Module irModule = parseModule(
+		"(module\n"
+		"  (type $i32_to_i32 (func (param i32) (result i32)))\n"
+		"  (table $immutable 2 2 funcref)\n"
+		"  (table $exported (export \"t\") 2 2 funcref)\n"
+		"  (elem (table $immutable) (i32.const 0) func $double $double)\n"
+		"  (elem (table $exported) (i32.const 0) func $double $double)\n"
+		"  (func $double (type $i32_to_i32) (i32.mul (local.get 0) (i32.const 2)))\n"
+		"  (func (export \"callImmutableFirst\") (param i32 i32) (result i32)\n"
+		"    (call_indirect $immutable (type $i32_to_i32) (local.get 0) (i32.const 0)))\n"
+		"  (func (export \"callImmutableMasked\") (param i32 i32) (result i32)\n"
+		"    (call_indirect $immutable (type $i32_to_i32)\n"
+		"      (local.get 1) (i32.and (local.get 0) (i32.const 1))))\n"
+		"  (func (export \"callExportedFirst\") (param i32 i32) (result i32)\n"
+		"    (call_indirect $exported (type $i32_to_i32) (local.get 0) (i32.const 0))))");
+
+	LLVMJIT::CompileOptions compileOptions;
+	WAVM_ERROR_UNLESS(countDirectCalls(irModule, compileOptions, 0) == 0);
+	compileOptions.devirtualizeIndirectCalls = true;
+	WAVM_ERROR_UNLESS(countDirectCalls(irModule, compileOptions, 0) == 2);
+
+	// The devirtualized calls call the same functions as the indirect calls.
+	GCPointer<Compartment> compartment = createCompartment("testDevirtualizedCallIndirect");
+	Context* context = createContext(compartment);
+	Instance* instance
+		= instantiateModule(compartment, compileModule(irModule, compileOptions), {}, "devirt");
+	WAVM_ERROR_UNLESS(instance);
+	WAVM_ERROR_UNLESS(invokeI32Function(context, instance, "callImmutableFirst", 5, 0) == 10);
+	WAVM_ERROR_UNLESS(invokeI32Function(context, instance, "callImmutableMasked", 3, 5) == 10);
+	WAVM_ERROR_UNLESS(invokeI32Function(context, instance, "callExportedFirst", 5, 0) == 10);
+
+	instance = nullptr;
+	context = nullptr;
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(compartment)));
+}
+
+// Invokes a function that traps, and returns the number of frames in the trap's call stack.
+static Uptr getTrapCallStackNumFrames(Context* context, Function* function)
+{
+	Uptr numFrames = UINTPTR_MAX;
+	catchRuntimeExceptions(
+		[&] { invokeFunction(context, function, FunctionType()); },
+		[&](Exception* exception) {
+			WAVM_ERROR_UNLESS(getExceptionType(exception) == ExceptionTypes::reachedUnreachable);
+			numFrames = getExceptionCallStack(exception).frames.size();
+			destroyException(exception);
+		});
+	WAVM_ERROR_UNLESS(numFrames != UINTPTR_MAX);
+	return numFrames;
+}
+
+static void testExceptionCallStackDepth()
+{
+	GCPointer<Compartment> compartment = createCompartment("testExceptionCallStackDepth");
+	Context* context = createContext(compartment);
+	Context* otherContext = createContext(compartment);
+
+	// The exported function traps in a function it calls through two others.
+	const IR::Module irModule = parseModule(
+		"(module\n"
+		"  (func $trap unreachable)\n"
+		"  (func $call1 (call $trap))\n"
+		"  (func $call2 (call $call1))\n"
+		"  (func (export \"trap\") (call $call2)))");
+	Instance* instance
+		= instantiateModule(compartment, compileModule(irModule), {}, "exceptionCallStackDepth");
+	WAVM_ERROR_UNLESS(instance);
+	Function* trapFunction = asFunction(getInstanceExport(instance, "trap"));
+
+	// By default, the call stack includes at least the trapping function and its callers.
+	const Uptr oldDepth = getExceptionCallStackDepth();
+	WAVM_ERROR_UNLESS(oldDepth == Platform::CallStack::maxFrames);
+	WAVM_ERROR_UNLESS(getTrapCallStackNumFrames(context, trapFunction) >= 4);
+
+	// The global depth limits the number of frames captured, and 0 captures none.
+	setExceptionCallStackDepth(0);
+	WAVM_ERROR_UNLESS(getExceptionCallStackDepth() == 0);
+	WAVM_ERROR_UNLESS(getTrapCallStackNumFrames(context, trapFunction) == 0);
+	setExceptionCallStackDepth(2);
+	Uptr numFrames = getTrapCallStackNumFrames(context, trapFunction);
+	WAVM_ERROR_UNLESS(numFrames > 0 && numFrames <= 2);
+
+	// A context's depth overrides the global depth, but only for that context.
+	setExceptionCallStackDepth(context, 0);
+	WAVM_ERROR_UNLESS(getTrapCallStackNumFrames(context, trapFunction) == 0);
+	numFrames = getTrapCallStackNumFrames(otherContext, trapFunction);
+	WAVM_ERROR_UNLESS(numFrames > 0 && numFrames <= 2);
+	setExceptionCallStackDepth(Platform::CallStack::maxFrames);
+	WAVM_ERROR_UNLESS(getTrapCallStackNumFrames(context, trapFunction) == 0);
+	setExceptionCallStackDepth(0);
+	setExceptionCallStackDepth(context, 1);
+	WAVM_ERROR_UNLESS(getTrapCallStackNumFrames(context, trapFunction) == 1);
+	WAVM_ERROR_UNLESS(getTrapCallStackNumFrames(otherContext, trapFunction) == 0);
+
+	// Setting a context's depth to UINTPTR_MAX makes it use the global depth again.
+	setExceptionCallStackDepth(context, UINTPTR_MAX);
+	WAVM_ERROR_UNLESS(getTrapCallStackNumFrames(context, trapFunction) == 0);
+
+	// Restoring the global depth captures the full call stack again.
+	setExceptionCallStackDepth(oldDepth);
+	WAVM_ERROR_UNLESS(getExceptionCallStackDepth() == oldDepth);
+	WAVM_ERROR_UNLESS(getTrapCallStackNumFrames(context, trapFunction) >= 4);
+	WAVM_ERROR_UNLESS(getTrapCallStackNumFrames(otherContext, trapFunction) >= 4);
+
+	instance = nullptr;
+	context = nullptr;
+	otherContext = nullptr;
+	WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(compartment)));
+}
+
+I32 execRuntimeTest(int argc, char** argv)
+{
+	Timing::Timer timer;
+	testImportedMemoryReservation();
+	testFuel();
+	testCopyOnWriteClone();
+	testTierUp();
+	testTryCollectInstance();
+	testMemoryPool();
+	testResourceQuota();
+	testMultithreadedCompile();
+	testProfile();
+	testHostMutatedDefaultTable();
+	testDevirtualizedCallIndirect();
+	testExceptionCallStackDepth();
+	Timing::logTimer("RuntimeTest", timer);
+	return 0;
+}
@@ -0,0 +1,356 @@
+#include <string.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "WAVM/IR/Module.h"
+#include "WAVM/IR/Types.h"
+#include "WAVM/IR/Value.h"
+#include "WAVM/Inline/Assert.h"
+#include "WAVM/Inline/BasicTypes.h"
+#include "WAVM/Inline/Errors.h"
+#include "WAVM/Inline/Time.h"
+#include "WAVM/Inline/Timing.h"
+#include "WAVM/Platform/Clock.h"
+#include "WAVM/Platform/File.h"
+#include "WAVM/Platform/Thread.h"
+#include "WAVM/Runtime/Linker.h"
+#include "WAVM/Runtime/Runtime.h"
+#include "WAVM/VFS/VFS.h"
+#include "WAVM/WASI/WASI.h"
+#include "WAVM/WASI/WASIABI.h"
+#include "WAVM/WASTParse/WASTParse.h"
+#include "wavm-test.h"
+
+using namespace WAVM;
+using namespace WAVM::IR;
+using namespace WAVM::Runtime;
+
+// A module that re-exports the WASI syscalls the tests call, so they can be invoked directly.
+static const char* syscallModuleWAST
+	= "(module\n"
+	  "  (import \"wasi_snapshot_preview1\" \"poll_oneoff\"\n"
+	  "    (func $poll_oneoff (param i32 i32 i32 i32) (result i32)))\n"
+	  "  (import \"wasi_snapshot_preview1\" \"fd_fdstat_set_rights\"\n"
+	  "    (func $fd_fdstat_set_rights (param i32 i64 i64) (result i32)))\n"
+	  "  (import \"wasi_snapshot_preview1\" \"fd_close\"\n"
+	  "    (func $fd_close (param i32) (result i32)))\n"
+	  "  (memory (export \"memory\") 1)\n"
+	  "  (export \"poll_oneoff\" (func $poll_oneoff))\n"
+	  "  (export \"fd_fdstat_set_rights\" (func $fd_fdstat_set_rights))\n"
+	  "  (export \"fd_close\" (func $fd_close))\n"
+	  ")";
+
+// The addresses in the process memory that the tests pass to poll_oneoff.
+static constexpr U32 subscriptionsAddress = 0;
+static constexpr U32 eventsAddress = 16384;
+static constexpr U32 numEventsAddress = 32768;
+
+// A WASI process with pipes as its stdin, stdout, and stderr, and an instance of the syscall
+// module.
+struct WASITestProcess
+{
+	GCPointer<Compartment> compartment;
+	std::shared_ptr<WASI::Process> process;
+	VFS::VFD* stdinWriteVFD = nullptr;
+	VFS::VFD* stdoutReadVFD = nullptr;
+	VFS::VFD* stderrReadVFD = nullptr;
+	Memory* memory = nullptr;
+	Instance* instance = nullptr;
+
+	WASITestProcess(const char* debugName)
+	{
+		compartment = createCompartment(debugName);
+
+		VFS::VFD* stdinReadVFD;
+		VFS::VFD* stdoutWriteVFD;
+		VFS::VFD* stderrWriteVFD;
+		WAVM_ERROR_UNLESS(Platform::createPipe(stdinReadVFD, stdinWriteVFD)
+						  == VFS::Result::success);
+		WAVM_ERROR_UNLESS(Platform::createPipe(stdoutReadVFD, stdoutWriteVFD)
+						  == VFS::Result::success);
+		WAVM_ERROR_UNLESS(Platform::createPipe(stderrReadVFD, stderrWriteVFD)
+						  == VFS::Result::success);
+		process = WASI::createProcess(compartment,
+									  {debugName},
+									  {},
+									  nullptr,
+									  stdinReadVFD,
+									  stdoutWriteVFD,
+									  stderrWriteVFD);
+
+		IR::Module irModule;
+		std::vector<WAST::Error> parseErrors;
+		if(!WAST::parseModule(
+			   syscallModuleWAST, strlen(syscallModuleWAST) + 1, irModule, parseErrors))
+		{
+			WAST::reportParseErrors("syscall module", syscallModuleWAST, parseErrors);
+			Errors::fatal("Failed to parse syscall module");
+		}
+		LinkResult linkResult = linkModule(irModule, WASI::getProcessResolver(*process));
+		WAVM_ERROR_UNLESS(linkResult.success);
+		instance = instantiateModule(compartment,
+									 compileModule(irModule),
+									 std::move(linkResult.resolvedImports),
+									 "syscalls");
+		WAVM_ERROR_UNLESS(instance);
+		memory = asMemory(getInstanceExport(instance, "memory"));
+		WASI::setProcessMemory(*process, memory);
+	}
+
+	~WASITestProcess()
+	{
+		// Destroying the process closes the ends of the pipes it was given.
+		instance = nullptr;
+		memory = nullptr;
+		process.reset();
+		WAVM_ERROR_UNLESS(stdinWriteVFD->close() == VFS::Result::success);
+		WAVM_ERROR_UNLESS(stdoutReadVFD->close() == VFS::Result::success);
+		WAVM_ERROR_UNLESS(stderrReadVFD->close() == VFS::Result::success);
+		WAVM_ERROR_UNLESS(tryCollectCompartment(std::move(compartment)));
+	}
+
+	U32 callSyscall(Context* context,
+					const char* name,
+					const FunctionType& sig,
+					const UntaggedValue* arguments)
+	{
+		UntaggedValue result;
+		invokeFunction(
+			context, asFunction(getInstanceExport(instance, name)), sig, arguments, &result);
+		return result.u32;
+	}
+
+	// Calls poll_oneoff with the given subscriptions, and returns the error it returned. If it
+	// succeeded, outEvents is set to the events it wrote.
+	U32 pollOneoff(Context* context,
+				   const std::vector<__wasi_subscription_t>& subscriptions,
+				   std::vector<__wasi_event_t>& outEvents)
+	{
+		memcpy(getMemoryBaseAddress(memory) + subscriptionsAddress,
+			   subscriptions.data(),
+			   subscriptions.size() * sizeof(__wasi_subscription_t));
+
+		const UntaggedValue arguments[4] = {subscriptionsAddress,
+											eventsAddress,
+											U32(subscriptions.size()),
+											numEventsAddress};
+		const U32 result = callSyscall(
+			context,
+			"poll_oneoff",
+			FunctionType({ValueType::i32},
+						 {ValueType::i32, ValueType::i32, ValueType::i32, ValueType::i32}),
+			arguments);
+
+		outEvents.clear();
+		if(result == __WASI_ESUCCESS)
+		{
+			U32 numEvents;
+			memcpy(&numEvents, getMemoryBaseAddress(memory) + numEventsAddress, sizeof(U32));
+			WAVM_ERROR_UNLESS(numEvents <= subscriptions.size());
+			outEvents.resize(numEvents);
+			memcpy(outEvents.data(),
+				   getMemoryBaseAddress(memory) + eventsAddress,
+				   numEvents * sizeof(__wasi_event_t));
+		}
+		return result;
+	}
+};
+
+static __wasi_subscription_t clockSubscription(__wasi_userdata_t userdata, U64 timeoutNS)
+{
+	__wasi_subscription_t subscription;
+	memset(&subscription, 0, sizeof(subscription));
+	subscription.userdata = userdata;
+	subscription.type = __WASI_EVENTTYPE_CLOCK;
+	subscription.u.clock.clock_id = __WASI_CLOCK_MONOTONIC;
+	subscription.u.clock.timeout = timeoutNS;
+	return subscription;
+}
+
+static __wasi_subscription_t fdSubscription(__wasi_userdata_t userdata,
+											__wasi_eventtype_t type,
+											__wasi_fd_t fd)
+{
+	__wasi_subscription_t subscription;
+	memset(&subscription, 0, sizeof(subscription));
+	subscription.userdata = userdata;
+	subscription.type = type;
+	subscription.u.fd_readwrite.fd = fd;
+	return subscription;
+}
+
+static void testPollOneoffClock()
+{
+	WASITestProcess testProcess("testPollOneoffClock");
+	Context* context = createContext(testProcess.compartment);
+	std::vector<__wasi_event_t> events;
+
+	// A clock subscription doesn't have an event until its timeout has elapsed.
+	const Time startTime = Platform::getClockTime(Platform::Clock::monotonic);
+	WAVM_ERROR_UNLESS(testProcess.pollOneoff(context, {clockSubscription(1, 5000000)}, events)
+					  == __WASI_ESUCCESS);
+	const Time endTime = Platform::getClockTime(Platform::Clock::monotonic);
+	WAVM_ERROR_UNLESS(endTime.ns - startTime.ns >= 5000000);
+	WAVM_ERROR_UNLESS(events.size() == 1);
+	WAVM_ERROR_UNLESS(events[0].userdata == 1);
+	WAVM_ERROR_UNLESS(events[0].error == __WASI_ESUCCESS);
+	WAVM_ERROR_UNLESS(events[0].type == __WASI_EVENTTYPE_CLOCK);
+
+	// Only the earliest of several clock subscriptions has an event.
+	WAVM_ERROR_UNLESS(
+		testProcess.pollOneoff(
+			context, {clockSubscription(2, 1000000000), clockSubscription(3, 0)}, events)
+		== __WASI_ESUCCESS);
+	WAVM_ERROR_UNLESS(events.size() == 1);
+	WAVM_ERROR_UNLESS(events[0].userdata == 3);
+
+	// poll_oneoff requires at least one subscription.
+	WAVM_ERROR_UNLESS(testProcess.pollOneoff(context, {}, events) == __WASI_EINVAL);
+
+	context = nullptr;
+}
+
+static void testPollOneoffPipe()
+{
+	WASITestProcess testProcess("testPollOneoffPipe");
+	Context* context = createContext(testProcess.compartment);
+	std::vector<__wasi_event_t> events;
+
+	// The stdin pipe isn't readable until something is written to it.
+	WAVM_ERROR_UNLESS(
+		testProcess.pollOneoff(
+			context,
+			{fdSubscription(1, __WASI_EVENTTYPE_FD_READ, 0), clockSubscription(2, 1000000)},
+			events)
+		== __WASI_ESUCCESS);
+	WAVM_ERROR_UNLESS(events.size() == 1);
+	WAVM_ERROR_UNLESS(events[0].userdata == 2);
+
+	const U8 bytes[3] = {1, 2, 3};
+	WAVM_ERROR_UNLESS(testProcess.stdinWriteVFD->write(bytes, sizeof(bytes))
+					  == VFS::Result::success);
+	WAVM_ERROR_UNLESS(testProcess.pollOneoff(
+						  context, {fdSubscription(3, __WASI_EVENTTYPE_FD_READ, 0)}, events)
+					  == __WASI_ESUCCESS);
+	WAVM_ERROR_UNLESS(events.size() == 1);
+	WAVM_ERROR_UNLESS(events[0].userdata == 3);
+	WAVM_ERROR_UNLESS(events[0].error == __WASI_ESUCCESS);
+	WAVM_ERROR_UNLESS(events[0].type == __WASI_EVENTTYPE_FD_READ);
+	WAVM_ERROR_UNLESS(events[0].u.fd_readwrite.nbytes == sizeof(bytes));
+	WAVM_ERROR_UNLESS(!(events[0].u.fd_readwrite.flags & __WASI_EVENT_FD_READWRITE_HANGUP));
+
+	// The stdout pipe is writable.
+	WAVM_ERROR_UNLESS(testProcess.pollOneoff(
+						  context, {fdSubscription(4, __WASI_EVENTTYPE_FD_WRITE, 1)}, events)
+					  == __WASI_ESUCCESS);
+	WAVM_ERROR_UNLESS(events.size() == 1);
+	WAVM_ERROR_UNLESS(events[0].userdata == 4);
+	WAVM_ERROR_UNLESS(events[0].error == __WASI_ESUCCESS);
+	WAVM_ERROR_UNLESS(events[0].type == __WASI_EVENTTYPE_FD_WRITE);
+
+	context = nullptr;
+}
+
+static void testPollOneoffErrors()
+{
+	WASITestProcess testProcess("testPollOneoffErrors");
+	Context* context = createContext(testProcess.compartment);
+	std::vector<__wasi_event_t> events;
+
+	// Subscribing to an FD that isn't open produces an EBADF event.
+	WAVM_ERROR_UNLESS(testProcess.pollOneoff(
+						  context, {fdSubscription(1, __WASI_EVENTTYPE_FD_READ, 100)}, events)
+					  == __WASI_ESUCCESS);
+	WAVM_ERROR_UNLESS(events.size() == 1);
+	WAVM_ERROR_UNLESS(events[0].userdata == 1);
+	WAVM_ERROR_UNLESS(events[0].error == __WASI_EBADF);
+
+	// Subscribing to an FD without the right to poll it produces an ENOTCAPABLE event.
+	const UntaggedValue setRightsArguments[3] = {U32(1), U64(__WASI_RIGHT_FD_WRITE), U64(0)};
+	WAVM_ERROR_UNLESS(
+		testProcess.callSyscall(
+			context,
+			"fd_fdstat_set_rights",
+			FunctionType({ValueType::i32}, {ValueType::i32, ValueType::i64, ValueType::i64}),
+			setRightsArguments)
+		== __WASI_ESUCCESS);
+	WAVM_ERROR_UNLESS(testProcess.pollOneoff(
+						  context, {fdSubscription(2, __WASI_EVENTTYPE_FD_WRITE, 1)}, events)
+					  == __WASI_ESUCCESS);
+	WAVM_ERROR_UNLESS(events.size() == 1);
+	WAVM_ERROR_UNLESS(events[0].userdata == 2);
+	WAVM_ERROR_UNLESS(events[0].error == __WASI_ENOTCAPABLE);
+
+	// An invalid subscription type produces an EINVAL event.
+	WAVM_ERROR_UNLESS(
+		testProcess.pollOneoff(context, {fdSubscription(3, 0xff, 0)}, events) == __WASI_ESUCCESS);
+	WAVM_ERROR_UNLESS(events.size() == 1);
+	WAVM_ERROR_UNLESS(events[0].userdata == 3);
+	WAVM_ERROR_UNLESS(events[0].error == __WASI_EINVAL);
+
+	context = nullptr;
+}
+
+struct PollThreadArgs
+{
+	WASITestProcess* testProcess;
+	Context* context;
+	U32 result;
+	std::vector<__wasi_event_t> events;
+};
+
+static I64 pollThreadEntry(void* argument)
+{
+	PollThreadArgs* args = (PollThreadArgs*)argument;
+	args->result = args->testProcess->pollOneoff(
+		args->context, {fdSubscription(1, __WASI_EVENTTYPE_FD_READ, 0)}, args->events);
+	return 0;
+}
+
+static void testPollOneoffClose()
+{
+	WASITestProcess testProcess("testPollOneoffClose");
+	Context* context = createContext(testProcess.compartment);
+
+	// Wait for the stdin pipe to be readable on another thread, which waits forever since nothing
+	// is written to the pipe.
+	PollThreadArgs threadArgs;
+	threadArgs.testProcess = &testProcess;
+	threadArgs.context = createContext(testProcess.compartment);
+	threadArgs.result = __WASI_EINVAL;
+	Platform::Thread* thread = Platform::createThread(512 * 1024, pollThreadEntry, &threadArgs);
+
+	// Closing stdin while it is being waited for doesn't block, and wakes the waiting thread with
+	// an EBADF event.
+	Platform::waitForIO(nullptr, 0, Time{I128(10000000)});
+	const UntaggedValue closeArguments[1] = {U32(0)};
+	WAVM_ERROR_UNLESS(testProcess.callSyscall(context,
+											  "fd_close",
+											  FunctionType({ValueType::i32}, {ValueType::i32}),
+											  closeArguments)
+					  == __WASI_ESUCCESS);
+	Platform::joinThread(thread);
+	WAVM_ERROR_UNLESS(threadArgs.result == __WASI_ESUCCESS);
+	WAVM_ERROR_UNLESS(threadArgs.events.size() == 1);
+	WAVM_ERROR_UNLESS(threadArgs.events[0].userdata == 1);
+	WAVM_ERROR_UNLESS(threadArgs.events[0].error == __WASI_EBADF);
+
+	threadArgs.context = nullptr;
+	context = nullptr;
+}
+
+I32 execWASITest(int argc, char** argv)
+{
+	Timing::Timer timer;
+	testPollOneoffClock();
+	testPollOneoffErrors();
+
+	// Waiting for I/O readiness isn't implemented on Windows.
+#ifndef WIN32
+	testPollOneoffPipe();
+	testPollOneoffClose();
+#endif
+
+	Timing::logTimer("WASITest", timer);
+	return 0;
+}
@@ -9,6 +9,7 @@ enum class TestCommand
 {
 	invalid,
 
+	addressRangeMap,
 	dumpModules,
 	hashMap,
 	hashSet,
@@ -17,7 +18,10 @@ enum class TestCommand
 #if WAVM_ENABLE_RUNTIME
 	cAPI,
 	benchmark,
+	objectCache,
+	runtime,
 	script,
+	wasi,
 #endif
 };
 
@@ -25,15 +29,19 @@ static const char* getTestCommandListHelpText()
 {
 	return "TestCommands:\n"
 #if WAVM_ENABLE_RUNTIME
-		   "  c-api         Test the C API\n"
+		   "  c-api            Test the C API\n"
 #endif
-		   "  dumpmodules   Dump WAST/WASM modules from WAST test scripts\n"
-		   "  hashmap       Test HashMap\n"
-		   "  hashset       Test HashSet\n"
-		   "  i128          Test I128\n"
+		   "  addressrangemap  Test AddressRangeMap\n"
+		   "  dumpmodules      Dump WAST/WASM modules from WAST test scripts\n"
+		   "  hashmap          Test HashMap\n"
+		   "  hashset          Test HashSet\n"
+		   "  i128             Test I128\n"
 #if WAVM_ENABLE_RUNTIME
-		   "  benchmark     Benchmark WAVM\n"
-		   "  script        Run WAST test scripts\n"
+		   "  benchmark        Benchmark WAVM\n"
+		   "  objectcache      Test the object cache\n"
+		   "  runtime          Test the Runtime\n"
+		   "  script           Run WAST test scripts\n"
+		   "  wasi             Test WASI\n"
 #endif
 		;
 }
@@ -49,7 +57,11 @@ void showTestHelp(Log::Category outputCategory)
 
 static TestCommand parseTestCommand(const char* string)
 {
-	if(!strcmp(string, "dumpmodules")) { return TestCommand::dumpModules; }
+	if(!strcmp(string, "addressrangemap")) { return TestCommand::addressRangeMap; }
+	else if(!strcmp(string, "dumpmodules"))
+	{
+		return TestCommand::dumpModules;
+	}
 	else if(!strcmp(string, "hashmap"))
 	{
 		return TestCommand::hashMap;
@@ -71,10 +83,22 @@ static TestCommand parseTestCommand(const char* string)
 	{
 		return TestCommand::benchmark;
 	}
+	else if(!strcmp(string, "objectcache"))
+	{
+		return TestCommand::objectCache;
+	}
+	else if(!strcmp(string, "runtime"))
+	{
+		return TestCommand::runtime;
+	}
 	else if(!strcmp(string, "script"))
 	{
 		return TestCommand::script;
 	}
+	else if(!strcmp(string, "wasi"))
+	{
+		return TestCommand::wasi;
+	}
 #endif
 	else
 	{
@@ -94,6 +118,7 @@ int execTestCommand(int argc, char** argv)
 		const TestCommand command = parseTestCommand(argv[0]);
 		switch(command)
 		{
+		case TestCommand::addressRangeMap: return execAddressRangeMapTest(argc - 1, argv + 1);
 		case TestCommand::dumpModules: return execDumpTestModules(argc - 1, argv + 1);
 		case TestCommand::hashMap: return execHashMapTest(argc - 1, argv + 1);
 		case TestCommand::hashSet: return execHashSetTest(argc - 1, argv + 1);
@@ -101,7 +126,10 @@ int execTestCommand(int argc, char** argv)
 #if WAVM_ENABLE_RUNTIME
 		case TestCommand::cAPI: return execCAPITest(argc - 1, argv + 1);
 		case TestCommand::benchmark: return execBenchmark(argc - 1, argv + 1);
+		case TestCommand::objectCache: return execObjectCacheTest(argc - 1, argv + 1);
+		case TestCommand::runtime: return execRuntimeTest(argc - 1, argv + 1);
 		case TestCommand::script: return execRunTestScript(argc - 1, argv + 1);
+		case TestCommand::wasi: return execWASITest(argc - 1, argv + 1);
 #endif
 
 		case TestCommand::invalid:
@@ -2,6 +2,7 @@
 
 #include "WAVM/Inline/Config.h"
 
+int execAddressRangeMapTest(int argc, char** argv);
 int execDumpTestModules(int argc, char** argv);
 int execHashMapTest(int argc, char** argv);
 int execHashSetTest(int argc, char** argv);
@@ -9,7 +10,10 @@ int execI128Test(int argc, char** argv);
 
 #if WAVM_ENABLE_RUNTIME
 int execBenchmark(int argc, char** argv);
+int execObjectCacheTest(int argc, char** argv);
 int execRunTestScript(int argc, char** argv);
+int execRuntimeTest(int argc, char** argv);
+int execWASITest(int argc, char** argv);
 
 #ifdef __cplusplus
 extern "C"
@@ -77,6 +77,17 @@ void showCompileHelp(Log::Category outputCategory)
 				"                            supported features below.\n"
 				"  --format=<format>         Specifies the format of the output file. See the\n"
 				"                            list of supported output formats below.\n"
+				"  --compile-threads=<n>     Compile the module on <n> threads. If 0, uses one\n"
+				"                            thread per hardware thread. Ignored for the object\n"
+				"                            output format. (default: 1)\n"
+				"  --opt-level=<level>       Sets the optimization level: none, fast, balanced,\n"
+				"                            or aggressive (default: fast)\n"
+				"  --bounds-checks=<mode>    Sets how memory accesses are bounds checked:\n"
+				"                            guard-pages, reduced-reservation, clamp, or\n"
+				"                            explicit (default: guard-pages)\n"
+				"  --profile-use=<file>      Optimize the module with a profile written by\n"
+				"                            'wavm run --profile-generate'. Ignored for the LLVM\n"
+				"                            IR output formats.\n"
 				"\n"
 				"Output formats:\n"
 				"%s"
@@ -114,6 +125,7 @@ int execCompileCommand(int argc, char** argv)
 	LLVMJIT::TargetSpec targetSpec;
 	IR::FeatureSpec featureSpec;
 	OutputFormat outputFormat = OutputFormat::unspecified;
+	LLVMJIT::CompileOptions compileOptions;
 	for(int argIndex = 0; argIndex < argc; ++argIndex)
 	{
 		if(!strcmp(argv[argIndex], "--target-triple"))
@@ -191,6 +203,49 @@ int execCompileCommand(int argc, char** argv)
 				return EXIT_FAILURE;
 			}
 		}
+		else if(stringStartsWith(argv[argIndex], "--compile-threads="))
+		{
+			const char* numThreadsString = argv[argIndex] + strlen("--compile-threads=");
+			const int numThreads = atoi(numThreadsString);
+			if(numThreads < 0 || (numThreads == 0 && strcmp(numThreadsString, "0")))
+			{
+				Log::printf(Log::error,
+							"Invalid compile thread count '%s'. Expected a non-negative"
+							" integer.\n",
+							numThreadsString);
+				return EXIT_FAILURE;
+			}
+			compileOptions.numThreads = Uptr(numThreads);
+		}
+		else if(stringStartsWith(argv[argIndex], "--opt-level="))
+		{
+			const char* optimizationLevelString = argv[argIndex] + strlen("--opt-level=");
+			if(!parseOptimizationLevel(optimizationLevelString, compileOptions.optimizationLevel))
+			{
+				Log::printf(Log::error,
+							"Invalid optimization level '%s'. Expected none, fast, balanced, or"
+							" aggressive.\n",
+							optimizationLevelString);
+				return EXIT_FAILURE;
+			}
+		}
+		else if(stringStartsWith(argv[argIndex], "--bounds-checks="))
+		{
+			const char* boundsCheckModeString = argv[argIndex] + strlen("--bounds-checks=");
+			if(!parseBoundsCheckMode(boundsCheckModeString, compileOptions.boundsCheckMode))
+			{
+				Log::printf(Log::error,
+							"Invalid bounds-check mode '%s'. Expected guard-pages,"
+							" reduced-reservation, clamp, or explicit.\n",
+							boundsCheckModeString);
+				return EXIT_FAILURE;
+			}
+		}
+		else if(stringStartsWith(argv[argIndex], "--profile-use="))
+		{
+			const char* profileFilename = argv[argIndex] + strlen("--profile-use=");
+			if(!loadModuleProfile(profileFilename, compileOptions.profile)) { return EXIT_FAILURE; }
+		}
 		else if(!inputFilename)
 		{
 			inputFilename = argv[argIndex];
@@ -263,12 +318,24 @@ int execCompileCommand(int argc, char** argv)
 	{
 	case OutputFormat::precompiledModule: {
 		// Compile the module to object code.
-		std::vector<U8> objectCode = LLVMJIT::compileModule(irModule, targetSpec);
+		std::vector<U8> objectCode = LLVMJIT::compileModule(irModule, targetSpec, compileOptions);
 
 		// Extract the compiled object code and add it to the IR module as a user section.
 		irModule.customSections.push_back(CustomSection{
 			OrderedSectionID::moduleBeginning, "wavm.precompiled_object", std::move(objectCode)});
 
+		// If the object code doesn't use the default bounds-check mode, record the mode it uses,
+		// so the runtime can reserve the address space it requires for memories.
+		if(compileOptions.boundsCheckMode != LLVMJIT::BoundsCheckMode::guardPages)
+		{
+			const char* boundsCheckModeString = LLVMJIT::asString(compileOptions.boundsCheckMode);
+			irModule.customSections.push_back(CustomSection{
+				OrderedSectionID::moduleBeginning,
+				"wavm.precompiled_bounds_checks",
+				std::vector<U8>(boundsCheckModeString,
+								boundsCheckModeString + strlen(boundsCheckModeString))});
+		}
+
 		// Serialize the WASM module.
 		Timing::Timer saveTimer;
 		std::vector<U8> wasmBytes = WASM::saveBinaryModule(irModule);
@@ -281,8 +348,12 @@ int execCompileCommand(int argc, char** argv)
 																			: EXIT_FAILURE;
 	}
 	case OutputFormat::object: {
-		// Compile the module to object code.
-		std::vector<U8> objectCode = LLVMJIT::compileModule(irModule, targetSpec);
+		// Compile the module to object code. Compiling on multiple threads produces multiple
+		// object files, which can't be written as a single native object file.
+		LLVMJIT::CompileOptions objectCompileOptions = compileOptions;
+		objectCompileOptions.numThreads = 1;
+		std::vector<U8> objectCode
+			= LLVMJIT::compileModule(irModule, targetSpec, objectCompileOptions);
 
 		// Write the object code to the output file.
 		return saveFile(outputFilename, objectCode.data(), objectCode.size()) ? EXIT_SUCCESS
@@ -290,7 +361,7 @@ int execCompileCommand(int argc, char** argv)
 	}
 	case OutputFormat::assembly: {
 		// Compile the module to object code.
-		std::vector<U8> objectCode = LLVMJIT::compileModule(irModule, targetSpec);
+		std::vector<U8> objectCode = LLVMJIT::compileModule(irModule, targetSpec, compileOptions);
 
 		// Disassemble the object code.
 		std::string disassembly = LLVMJIT::disassembleObject(targetSpec, objectCode);
@@ -303,7 +374,7 @@ int execCompileCommand(int argc, char** argv)
 	case OutputFormat::unoptimizedLLVMIR: {
 		// Compile the module to LLVM IR.
 		std::string llvmIR = LLVMJIT::emitLLVMIR(
-			irModule, targetSpec, outputFormat == OutputFormat::optimizedLLVMIR);
+			irModule, targetSpec, outputFormat == OutputFormat::optimizedLLVMIR, compileOptions);
 
 		// Write the LLVM IR to the output file.
 		return saveFile(outputFilename, llvmIR.data(), llvmIR.size()) ? EXIT_SUCCESS : EXIT_FAILURE;
@@ -1,3 +1,4 @@
+#include <errno.h>
 #include <inttypes.h>
 #include <stdlib.h>
 #include <string.h>
@@ -71,6 +72,7 @@ private:
 static bool loadTextOrBinaryModule(const char* filename,
 								   std::vector<U8>&& fileBytes,
 								   const IR::FeatureSpec& featureSpec,
+								   const LLVMJIT::CompileOptions& compileOptions,
 								   ModuleRef& outModule)
 {
 	// If the file starts with the WASM binary magic number, load it as a binary module.
@@ -78,8 +80,12 @@ static bool loadTextOrBinaryModule(const char* filename,
 	   && !memcmp(fileBytes.data(), WASM::magicNumber, sizeof(WASM::magicNumber)))
 	{
 		WASM::LoadError loadError;
-		if(Runtime::loadBinaryModule(
-			   fileBytes.data(), fileBytes.size(), outModule, featureSpec, &loadError))
+		if(Runtime::loadBinaryModule(fileBytes.data(),
+									 fileBytes.size(),
+									 outModule,
+									 featureSpec,
+									 compileOptions,
+									 &loadError))
 		{ return true; }
 		else
 		{
@@ -106,7 +112,7 @@ static bool loadTextOrBinaryModule(const char* filename,
 		}
 
 		// Compile the IR.
-		outModule = Runtime::compileModule(irModule);
+		outModule = Runtime::compileModule(irModule, compileOptions);
 
 		return true;
 	}
@@ -127,14 +133,26 @@ static bool loadPrecompiledModule(std::vector<U8>&& fileBytes,
 		return false;
 	}
 
-	// Check for a precompiled object section.
+	// Check for a precompiled object section, and the section that records the bounds-check mode
+	// it was compiled with.
 	const CustomSection* precompiledObjectSection = nullptr;
+	LLVMJIT::CompileOptions compileOptions;
 	for(const CustomSection& customSection : irModule.customSections)
 	{
 		if(customSection.name == "wavm.precompiled_object")
+		{ precompiledObjectSection = &customSection; }
+		else if(customSection.name == "wavm.precompiled_bounds_checks")
 		{
-			precompiledObjectSection = &customSection;
-			break;
+			const std::string boundsCheckModeString(customSection.data.begin(),
+													customSection.data.end());
+			if(!parseBoundsCheckMode(boundsCheckModeString.c_str(),
+									 compileOptions.boundsCheckMode))
+			{
+				Log::printf(Log::error,
+							"Invalid 'wavm.precompiled_bounds_checks' section: \"%s\".\n",
+							boundsCheckModeString.c_str());
+				return false;
+			}
 		}
 	}
 	if(!precompiledObjectSection)
@@ -145,7 +163,8 @@ static bool loadPrecompiledModule(std::vector<U8>&& fileBytes,
 	else
 	{
 		// Load the IR + precompiled object code as a runtime module.
-		outModule = Runtime::loadPrecompiledModule(irModule, precompiledObjectSection->data);
+		outModule = Runtime::loadPrecompiledModule(
+			irModule, precompiledObjectSection->data, compileOptions);
 		return true;
 	}
 }
@@ -181,6 +200,22 @@ void showRunHelp(Log::Category outputCategory)
 				"  --function=<name>     Specify function name to run in module (default:main)\n"
 				"  --precompiled         Use precompiled object code in program file\n"
 				"  --nocache             Don't use the WAVM object cache\n"
+				"  --compile-threads=<n> Compile the module on <n> threads. If 0, uses one\n"
+				"                        thread per hardware thread. (default: 1)\n"
+				"  --opt-level=<level>   Sets the optimization level: none, fast, balanced, or\n"
+				"                        aggressive (default: fast)\n"
+				"  --bounds-checks=<mode> Sets how memory accesses are bounds checked:\n"
+				"                        guard-pages, reduced-reservation, clamp, or explicit\n"
+				"                        (default: guard-pages)\n"
+				"  --tiered              Compile the module with the fast baseline tier, and\n"
+				"                        compile optimized code in the background to store in\n"
+				"                        the object cache for later runs\n"
+				"  --profile-generate=<file> Compile the module with profile instrumentation, and\n"
+				"                        write the profile to <file> when the program exits\n"
+				"  --profile-use=<file>  Optimize the module with a profile written by\n"
+				"                        --profile-generate\n"
+				"  --fuel=<n>            Compile the module with fuel metering, and trap once\n"
+				"                        the program has executed about <n> operators\n"
 				"  --enable <feature>    Enable the specified feature. See the list of supported\n"
 				"                        features below.\n"
 				"  --abi=<abi>           Specifies the ABI used by the WASM module. See the list\n"
@@ -229,6 +264,7 @@ enum class ABI
 struct State
 {
 	IR::FeatureSpec featureSpec;
+	LLVMJIT::CompileOptions compileOptions;
 
 	// Command-line options.
 	const char* filename = nullptr;
@@ -237,7 +273,11 @@ struct State
 	std::vector<std::string> runArgs;
 	ABI abi = ABI::detect;
 	bool precompiled = false;
+	bool boundsCheckModeSpecified = false;
 	bool allowCaching = true;
+	bool tiered = false;
+	const char* profileGenerateFilename = nullptr;
+	I64 fuel = INT64_MAX;
 	WASI::SyscallTraceLevel wasiTraceLavel = WASI::SyscallTraceLevel::none;
 
 	// Objects that need to be cleaned up before exiting.
@@ -245,6 +285,7 @@ struct State
 	std::shared_ptr<Emscripten::Process> emscriptenProcess;
 	std::shared_ptr<WASI::Process> wasiProcess;
 	std::shared_ptr<VFS::FileSystem> sandboxFS;
+	std::shared_ptr<Runtime::ObjectCacheInterface> objectCache;
 
 	~State()
 	{
@@ -327,6 +368,75 @@ struct State
 			{
 				allowCaching = false;
 			}
+			else if(stringStartsWith(*nextArg, "--opt-level="))
+			{
+				const char* optimizationLevelString = *nextArg + strlen("--opt-level=");
+				if(!parseOptimizationLevel(optimizationLevelString,
+										   compileOptions.optimizationLevel))
+				{
+					Log::printf(Log::error,
+								"Invalid optimization level \"%s\". Expected none, fast, balanced,"
+								" or aggressive.\n",
+								optimizationLevelString);
+					return false;
+				}
+			}
+			else if(stringStartsWith(*nextArg, "--bounds-checks="))
+			{
+				const char* boundsCheckModeString = *nextArg + strlen("--bounds-checks=");
+				if(!parseBoundsCheckMode(boundsCheckModeString, compileOptions.boundsCheckMode))
+				{
+					Log::printf(Log::error,
+								"Invalid bounds-check mode \"%s\". Expected guard-pages,"
+								" reduced-reservation, clamp, or explicit.\n",
+								boundsCheckModeString);
+					return false;
+				}
+				boundsCheckModeSpecified = true;
+			}
+			else if(!strcmp(*nextArg, "--tiered"))
+			{
+				tiered = true;
+			}
+			else if(stringStartsWith(*nextArg, "--profile-generate="))
+			{
+				profileGenerateFilename = *nextArg + strlen("--profile-generate=");
+				compileOptions.instrumentProfile = true;
+			}
+			else if(stringStartsWith(*nextArg, "--profile-use="))
+			{
+				const char* profileFilename = *nextArg + strlen("--profile-use=");
+				if(!loadModuleProfile(profileFilename, compileOptions.profile)) { return false; }
+			}
+			else if(stringStartsWith(*nextArg, "--fuel="))
+			{
+				const char* fuelString = *nextArg + strlen("--fuel=");
+				char* fuelEnd = nullptr;
+				errno = 0;
+				fuel = I64(strtoll(fuelString, &fuelEnd, 10));
+				if(fuel < 0 || errno || fuelEnd == fuelString || *fuelEnd)
+				{
+					Log::printf(Log::error,
+								"Invalid fuel \"%s\". Expected a non-negative integer.\n",
+								fuelString);
+					return false;
+				}
+				compileOptions.meterFuel = true;
+			}
+			else if(stringStartsWith(*nextArg, "--compile-threads="))
+			{
+				const char* numThreadsString = *nextArg + strlen("--compile-threads=");
+				const int numThreads = atoi(numThreadsString);
+				if(numThreads < 0 || (numThreads == 0 && strcmp(numThreadsString, "0")))
+				{
+					Log::printf(Log::error,
+								"Invalid compile thread count \"%s\". Expected a non-negative"
+								" integer.\n",
+								numThreadsString);
+					return false;
+				}
+				compileOptions.numThreads = Uptr(numThreads);
+			}
 			else if(!strcmp(*nextArg, "--mount-root"))
 			{
 				if(rootMountPath)
@@ -392,6 +502,31 @@ struct State
 
 		while(*nextArg) { runArgs.push_back(*nextArg++); };
 
+		// Profile instrumentation is only compiled into the module when it is loaded, and
+		// shouldn't be replaced by the optimized code compiled in the background.
+		if(profileGenerateFilename && (precompiled || tiered))
+		{
+			Log::printf(Log::error,
+						"'--profile-generate' may not be combined with '--precompiled' or"
+						" '--tiered'.\n");
+			return false;
+		}
+
+		// Precompiled object code was compiled with the bounds-check mode recorded in the module.
+		if(boundsCheckModeSpecified && precompiled)
+		{
+			Log::printf(Log::error,
+						"'--bounds-checks' may not be combined with '--precompiled'.\n");
+			return false;
+		}
+
+		// Precompiled object code may not have been compiled with fuel metering.
+		if(compileOptions.meterFuel && precompiled)
+		{
+			Log::printf(Log::error, "'--fuel' may not be combined with '--precompiled'.\n");
+			return false;
+		}
+
 		// Check that the requested features are supported by the host CPU.
 		switch(LLVMJIT::validateTarget(LLVMJIT::getHostTargetSpec(), featureSpec))
 		{
@@ -441,6 +576,26 @@ struct State
 				maxBytes = Uptr(maxMegabytes) * 1000000;
 			}
 
+			I32 compressionLevel = 0;
+			const char* compressionLevelEnv = WAVM_SCOPED_DISABLE_SECURE_CRT_WARNINGS(
+				getenv("WAVM_OBJECT_CACHE_COMPRESSION_LEVEL"));
+			if(compressionLevelEnv && *compressionLevelEnv)
+			{
+				char* compressionLevelEnd = nullptr;
+				const long parsedCompressionLevel
+					= strtol(compressionLevelEnv, &compressionLevelEnd, 10);
+				if(*compressionLevelEnd || parsedCompressionLevel < INT32_MIN
+				   || parsedCompressionLevel > INT32_MAX)
+				{
+					Log::printf(Log::error,
+								"Invalid object cache compression level \"%s\". Expected an"
+								" integer.\n",
+								compressionLevelEnv);
+					return false;
+				}
+				compressionLevel = I32(parsedCompressionLevel);
+			}
+
 			// Calculate a "code key" that identifies the code involved in compiling WebAssembly to
 			// object code in the cache. If recompiling the module would produce different object
 			// code, the code key should be different, and if recompiling the module would produce
@@ -456,9 +611,8 @@ struct State
 			codeKey = Hash<U64>()(WAVM_VERSION_PATCH, codeKey);
 
 			// Initialize the object cache.
-			std::shared_ptr<Runtime::ObjectCacheInterface> objectCache;
-			ObjectCache::OpenResult openResult
-				= ObjectCache::open(objectCachePath, maxBytes, codeKey, objectCache);
+			ObjectCache::OpenResult openResult = ObjectCache::open(
+				objectCachePath, maxBytes, codeKey, objectCache, compressionLevel);
 			switch(openResult)
 			{
 			case ObjectCache::OpenResult::doesNotExist:
@@ -485,7 +639,8 @@ struct State
 				return false;
 
 			case ObjectCache::OpenResult::success:
-				Runtime::setGlobalObjectCache(std::move(objectCache));
+				Runtime::setGlobalObjectCache(
+					std::shared_ptr<Runtime::ObjectCacheInterface>(objectCache));
 				break;
 			default: WAVM_UNREACHABLE();
 			};
@@ -630,6 +785,7 @@ struct State
 	{
 		// Create a WASM execution context.
 		Context* context = Runtime::createContext(compartment);
+		if(compileOptions.meterFuel) { setContextFuel(context, fuel); }
 
 		// Call the module start function, if it has one.
 		Function* startFunction = getStartFunction(instance);
@@ -764,9 +920,23 @@ struct State
 			if(!loadPrecompiledModule(std::move(fileBytes), featureSpec, module))
 			{ return EXIT_FAILURE; }
 		}
-		else if(!loadTextOrBinaryModule(filename, std::move(fileBytes), featureSpec, module))
+		else
 		{
-			return EXIT_FAILURE;
+			// With tiered compilation, compile the module with the baseline tier, then start
+			// compiling optimized code for it in the background. The baseline code forwards calls
+			// to its hot functions to the optimized code once it's ready.
+			LLVMJIT::CompileOptions loadCompileOptions = compileOptions;
+			if(tiered)
+			{
+				loadCompileOptions.optimizationLevel = LLVMJIT::OptimizationLevel::none;
+				loadCompileOptions.tierUp = true;
+			}
+
+			if(!loadTextOrBinaryModule(
+				   filename, std::move(fileBytes), featureSpec, loadCompileOptions, module))
+			{ return EXIT_FAILURE; }
+
+			if(tiered) { Runtime::optimizeModuleInBackground(module, compileOptions); }
 		}
 		const IR::Module& irModule = Runtime::getModuleIR(module);
 
@@ -833,11 +1003,48 @@ struct State
 		}
 		Timing::logTimer("Executed program", executionTimer);
 
+		// Write the profile collected by the instrumented module.
+		if(profileGenerateFilename)
+		{
+			LLVMJIT::ModuleProfile profile;
+			WAVM_ERROR_UNLESS(Runtime::getModuleProfile(module, profile));
+			std::vector<U8> profileBytes = LLVMJIT::serializeModuleProfile(profile);
+			if(!saveFile(profileGenerateFilename, profileBytes.data(), profileBytes.size()))
+			{ return EXIT_FAILURE; }
+		}
+
 		// Log the peak memory usage.
 		Uptr peakMemoryUsage = Platform::getPeakMemoryUsageBytes();
 		Log::printf(
 			Log::metrics, "Peak memory usage: %" WAVM_PRIuPTR "KiB\n", peakMemoryUsage / 1024);
 
+		// Log how many memories were allocated from the memory pool.
+		const Runtime::MemoryPoolStats memoryPoolStats = Runtime::getMemoryPoolStats();
+		Log::printf(Log::metrics,
+					"Memory pool: %" PRIu64 " hits, %" PRIu64 " misses\n",
+					memoryPoolStats.numHits,
+					memoryPoolStats.numMisses);
+
+		// Log the object cache's hit rate and how much space compression saved.
+		if(objectCache)
+		{
+			const Runtime::ObjectCacheStats objectCacheStats = objectCache->getStats();
+			Log::printf(Log::metrics,
+						"Object cache: %" PRIu64 " hits, %" PRIu64 " misses (%" PRIu64
+						" deduplicated compiles), %" PRIu64 " evictions, %.2fms decompressing\n",
+						objectCacheStats.numHits,
+						objectCacheStats.numMisses,
+						objectCacheStats.numDeduplicatedCompiles,
+						objectCacheStats.numEvictions,
+						objectCacheStats.decompressNanoseconds / 1000000.0);
+			Log::printf(Log::metrics,
+						"Object cache: %" WAVM_PRIuPTR " objects, %" PRIu64
+						"KiB of object code stored in %" PRIu64 "KiB\n",
+						objectCacheStats.numCachedObjects,
+						objectCacheStats.numCachedObjectBytes / 1024,
+						objectCacheStats.numStoredObjectBytes / 1024);
+		}
+
 		return result;
 	}
 
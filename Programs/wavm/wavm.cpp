@@ -1,6 +1,7 @@
 #include "wavm.h"
 #include <stdlib.h>
 #include <string.h>
+#include <vector>
 #include "WAVM/IR/FeatureSpec.h"
 #include "WAVM/Inline/Assert.h"
 #include "WAVM/Inline/CLI.h"
@@ -8,6 +9,10 @@
 #include "WAVM/Inline/Version.h"
 #include "WAVM/Logging/Logging.h"
 
+#if WAVM_ENABLE_RUNTIME
+#include "WAVM/LLVMJIT/LLVMJIT.h"
+#endif
+
 using namespace WAVM;
 
 enum class Command
@@ -152,6 +157,57 @@ bool parseAndSetFeature(const char* featureName, IR::FeatureSpec& featureSpec, b
 	return false;
 }
 
+#if WAVM_ENABLE_RUNTIME
+bool parseOptimizationLevel(const char* string, LLVMJIT::OptimizationLevel& outOptimizationLevel)
+{
+	for(LLVMJIT::OptimizationLevel optimizationLevel : {LLVMJIT::OptimizationLevel::none,
+														LLVMJIT::OptimizationLevel::fast,
+														LLVMJIT::OptimizationLevel::balanced,
+														LLVMJIT::OptimizationLevel::aggressive})
+	{
+		if(!strcmp(string, LLVMJIT::asString(optimizationLevel)))
+		{
+			outOptimizationLevel = optimizationLevel;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool parseBoundsCheckMode(const char* string, LLVMJIT::BoundsCheckMode& outBoundsCheckMode)
+{
+	for(LLVMJIT::BoundsCheckMode boundsCheckMode : {LLVMJIT::BoundsCheckMode::guardPages,
+													LLVMJIT::BoundsCheckMode::reducedReservation,
+													LLVMJIT::BoundsCheckMode::clamp,
+													LLVMJIT::BoundsCheckMode::explicitChecks})
+	{
+		if(!strcmp(string, LLVMJIT::asString(boundsCheckMode)))
+		{
+			outBoundsCheckMode = boundsCheckMode;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool loadModuleProfile(const char* filename,
+					   std::shared_ptr<const LLVMJIT::ModuleProfile>& outProfile)
+{
+	std::vector<U8> profileBytes;
+	if(!loadFile(filename, profileBytes)) { return false; }
+
+	std::shared_ptr<LLVMJIT::ModuleProfile> profile = std::make_shared<LLVMJIT::ModuleProfile>();
+	if(!LLVMJIT::deserializeModuleProfile(profileBytes, *profile))
+	{
+		Log::printf(Log::error, "'%s' is not a valid WAVM profile.\n", filename);
+		return false;
+	}
+
+	outProfile = std::move(profile);
+	return true;
+}
+#endif
+
 static void showTopLevelHelp(Log::Category outputCategory)
 {
 	Log::printf(outputCategory,
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <memory>
 #include <string>
 #include "WAVM/Logging/Logging.h"
 
@@ -8,6 +9,12 @@ namespace WAVM { namespace IR {
 	struct FeatureSpec;
 }};
 
+namespace WAVM { namespace LLVMJIT {
+	enum class OptimizationLevel;
+	enum class BoundsCheckMode;
+	struct ModuleProfile;
+}};
+
 int execAssembleCommand(int argc, char** argv);
 int execDisassembleCommand(int argc, char** argv);
 int execTestCommand(int argc, char** argv);
@@ -24,6 +31,12 @@ int execRunCommand(int argc, char** argv);
 
 void showCompileHelp(WAVM::Log::Category outputCategory);
 void showRunHelp(WAVM::Log::Category outputCategory);
+
+bool parseOptimizationLevel(const char* string,
+							WAVM::LLVMJIT::OptimizationLevel& outOptimizationLevel);
+bool parseBoundsCheckMode(const char* string, WAVM::LLVMJIT::BoundsCheckMode& outBoundsCheckMode);
+bool loadModuleProfile(const char* filename,
+					   std::shared_ptr<const WAVM::LLVMJIT::ModuleProfile>& outProfile);
 #endif
 
 std::string getFeatureListHelpText();
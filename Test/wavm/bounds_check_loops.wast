@@ -0,0 +1,75 @@
+;; With --bounds-checks=explicit, the bounds checks of accesses in a loop whose address increases by
+;; a constant each iteration are hoisted out of the loop: a check before the loop runs a copy of it
+;; without the checks if none of the accesses can be out of bounds, and the original loop
+;; otherwise. These tests check that the original loop still traps on the first out-of-bounds
+;; access, after the accesses before it, and that the copy is used when it's safe.
+
+(module
+  (memory 1 2)
+
+  ;; Stores count i32s, starting at the address base.
+  (func (export "fill") (param $base i32) (param $count i32)
+    (local $i i32)
+    (block $done
+      (br_if $done (i32.eqz (local.get $count)))
+      (loop $loop
+        (i32.store offset=4
+          (i32.add (local.get $base) (i32.shl (local.get $i) (i32.const 2)))
+          (i32.add (local.get $i) (i32.const 1)))
+        (local.set $i (i32.add (local.get $i) (i32.const 1)))
+        (br_if $loop (i32.lt_u (local.get $i) (local.get $count))))))
+
+  ;; Sums count i32s, starting at the address base.
+  (func (export "sum") (param $base i32) (param $count i32) (result i32)
+    (local $i i32) (local $sum i32)
+    (block $done
+      (br_if $done (i32.eqz (local.get $count)))
+      (loop $loop
+        (local.set $sum
+          (i32.add (local.get $sum)
+                   (i32.load offset=4
+                     (i32.add (local.get $base) (i32.shl (local.get $i) (i32.const 2))))))
+        (local.set $i (i32.add (local.get $i) (i32.const 1)))
+        (br_if $loop (i32.lt_u (local.get $i) (local.get $count)))))
+    (local.get $sum))
+
+  ;; Like fill, but grows the memory by a page before the first store.
+  (func (export "grow-and-fill") (param $base i32) (param $count i32)
+    (local $i i32)
+    (block $done
+      (br_if $done (i32.eqz (local.get $count)))
+      (loop $loop
+        (if (i32.eqz (local.get $i)) (then (drop (memory.grow (i32.const 1)))))
+        (i32.store
+          (i32.add (local.get $base) (i32.shl (local.get $i) (i32.const 2)))
+          (i32.add (local.get $i) (i32.const 1)))
+        (local.set $i (i32.add (local.get $i) (i32.const 1)))
+        (br_if $loop (i32.lt_u (local.get $i) (local.get $count))))))
+
+  (func (export "load") (param $address i32) (result i32)
+    (i32.load (local.get $address)))
+)
+
+;; Loops whose accesses are all in bounds.
+(invoke "fill" (i32.const 0) (i32.const 100))
+(assert_return (invoke "sum" (i32.const 0) (i32.const 100)) (i32.const 5050))
+(invoke "fill" (i32.const 65132) (i32.const 100))
+(assert_return (invoke "sum" (i32.const 65132) (i32.const 100)) (i32.const 5050))
+(assert_return (invoke "load" (i32.const 65532)) (i32.const 100))
+(invoke "fill" (i32.const 65536) (i32.const 0))
+
+;; A loop that runs out of bounds traps on the first out-of-bounds access, after the accesses
+;; before it.
+(invoke "fill" (i32.const 0) (i32.const 16))
+(assert_trap (invoke "fill" (i32.const 65232) (i32.const 100)) "out of bounds memory access")
+(assert_return (invoke "load" (i32.const 65532)) (i32.const 75))
+(assert_trap (invoke "sum" (i32.const 65232) (i32.const 100)) "out of bounds memory access")
+
+;; An address that wraps around to the start of the memory is out of bounds.
+(assert_trap (invoke "fill" (i32.const 0xfffffff0) (i32.const 8)) "out of bounds memory access")
+(assert_return (invoke "sum" (i32.const 0) (i32.const 16)) (i32.const 136))
+
+;; A loop that grows the memory may access the new pages, even though they weren't in bounds when
+;; the loop started.
+(invoke "grow-and-fill" (i32.const 65528) (i32.const 4))
+(assert_return (invoke "load" (i32.const 65540)) (i32.const 4))
@@ -0,0 +1,294 @@
+;; call_indirect through a table that isn't imported, exported, or mutated, and whose elements are
+;; all known to be functions of the callee type, is compiled without a type check. This includes
+;; the module's default table: the runtime doesn't let the host write to such a table through
+;; Runtime::getDefaultTable. These tests check that those calls still trap on out-of-bounds
+;; indices, and that the type check is kept for tables that don't meet those conditions.
+;;
+;; With --devirtualize-indirect-calls, call_indirect through such a table with a constant element
+;; index, or an element index that is known to be within a small range, is compiled to direct
+;; calls. These tests are run with and without that option. The tests at the end check that those
+;; calls still trap on elements that are out of bounds, null, or have a different type.
+
+;; An immutable table whose elements all have the callee type.
+(module
+  (type $i32_to_i32 (func (param i32) (result i32)))
+  (table 4 4 funcref)
+  (elem (i32.const 0) $inc $dec $double $square)
+  (func $inc (type $i32_to_i32) (i32.add (local.get 0) (i32.const 1)))
+  (func $dec (type $i32_to_i32) (i32.sub (local.get 0) (i32.const 1)))
+  (func $double (type $i32_to_i32) (i32.mul (local.get 0) (i32.const 2)))
+  (func $square (type $i32_to_i32) (i32.mul (local.get 0) (local.get 0)))
+  (func (export "call") (param $index i32) (param $x i32) (result i32)
+    (call_indirect (type $i32_to_i32) (local.get $x) (local.get $index)))
+)
+
+(assert_return (invoke "call" (i32.const 0) (i32.const 5)) (i32.const 6))
+(assert_return (invoke "call" (i32.const 1) (i32.const 5)) (i32.const 4))
+(assert_return (invoke "call" (i32.const 2) (i32.const 5)) (i32.const 10))
+(assert_return (invoke "call" (i32.const 3) (i32.const 5)) (i32.const 25))
+(assert_trap (invoke "call" (i32.const 4) (i32.const 5)) "undefined element")
+(assert_trap (invoke "call" (i32.const -1) (i32.const 5)) "undefined element")
+
+;; An immutable table with a null element.
+(module
+  (type $i32_to_i32 (func (param i32) (result i32)))
+  (table 3 3 funcref)
+  (elem (i32.const 0) $inc)
+  (elem (i32.const 2) $inc)
+  (func $inc (type $i32_to_i32) (i32.add (local.get 0) (i32.const 1)))
+  (func (export "call") (param $index i32) (param $x i32) (result i32)
+    (call_indirect (type $i32_to_i32) (local.get $x) (local.get $index)))
+)
+
+(assert_return (invoke "call" (i32.const 0) (i32.const 5)) (i32.const 6))
+(assert_trap (invoke "call" (i32.const 1) (i32.const 5)) "uninitialized element")
+(assert_return (invoke "call" (i32.const 2) (i32.const 5)) (i32.const 6))
+(assert_trap (invoke "call" (i32.const 3) (i32.const 5)) "undefined element")
+
+;; An immutable table with elements of different types.
+(module
+  (type $i32_to_i32 (func (param i32) (result i32)))
+  (type $void (func))
+  (table 2 2 funcref)
+  (elem (i32.const 0) $inc $nop)
+  (func $inc (type $i32_to_i32) (i32.add (local.get 0) (i32.const 1)))
+  (func $nop (type $void))
+  (func (export "call") (param $index i32) (param $x i32) (result i32)
+    (call_indirect (type $i32_to_i32) (local.get $x) (local.get $index)))
+)
+
+(assert_return (invoke "call" (i32.const 0) (i32.const 5)) (i32.const 6))
+(assert_trap (invoke "call" (i32.const 1) (i32.const 5)) "indirect call type mismatch")
+
+;; A table that is mutated by table.set.
+(module
+  (type $i32_to_i32 (func (param i32) (result i32)))
+  (type $void (func))
+  (table 1 1 funcref)
+  (elem (i32.const 0) $inc)
+  (elem declare func $nop)
+  (func $inc (type $i32_to_i32) (i32.add (local.get 0) (i32.const 1)))
+  (func $nop (type $void))
+  (func (export "set-nop") (table.set (i32.const 0) (ref.func $nop)))
+  (func (export "call") (param $index i32) (param $x i32) (result i32)
+    (call_indirect (type $i32_to_i32) (local.get $x) (local.get $index)))
+)
+
+(assert_return (invoke "call" (i32.const 0) (i32.const 5)) (i32.const 6))
+(invoke "set-nop")
+(assert_trap (invoke "call" (i32.const 0) (i32.const 5)) "indirect call type mismatch")
+
+;; A table whose contents depend on an imported global.
+(module
+  (type $i32_to_i32 (func (param i32) (result i32)))
+  (global $offset (import "spectest" "global_i32") i32)
+  (table 1000 1000 funcref)
+  (elem (global.get $offset) $inc)
+  (func $inc (type $i32_to_i32) (i32.add (local.get 0) (i32.const 1)))
+  (func (export "call") (param $index i32) (param $x i32) (result i32)
+    (call_indirect (type $i32_to_i32) (local.get $x) (local.get $index)))
+)
+
+(assert_return (invoke "call" (i32.const 666) (i32.const 5)) (i32.const 6))
+(assert_trap (invoke "call" (i32.const 0) (i32.const 5)) "uninitialized element")
+
+;; An immutable table that contains an imported function.
+(module
+  (type $i32_to_void (func (param i32)))
+  (import "spectest" "print_i32" (func $print_i32 (type $i32_to_void)))
+  (table 1 1 funcref)
+  (elem (i32.const 0) $print_i32)
+  (func (export "call") (param $index i32) (param $x i32)
+    (call_indirect (type $i32_to_void) (local.get $x) (local.get $index)))
+)
+
+(assert_return (invoke "call" (i32.const 0) (i32.const 5)))
+(assert_trap (invoke "call" (i32.const 1) (i32.const 5)) "undefined element")
+
+;; call_indirect with constant element indices through an immutable table.
+(module
+  (type $i32_to_i32 (func (param i32) (result i32)))
+  (type $void (func))
+  (table 4 4 funcref)
+  (elem (i32.const 0) $inc $nop)
+  (elem (i32.const 3) $dec)
+  (func $inc (type $i32_to_i32) (i32.add (local.get 0) (i32.const 1)))
+  (func $dec (type $i32_to_i32) (i32.sub (local.get 0) (i32.const 1)))
+  (func $nop (type $void))
+  (func (export "call-0") (param $x i32) (result i32)
+    (call_indirect (type $i32_to_i32) (local.get $x) (i32.const 0)))
+  (func (export "call-1") (param $x i32) (result i32)
+    (call_indirect (type $i32_to_i32) (local.get $x) (i32.const 1)))
+  (func (export "call-2") (param $x i32) (result i32)
+    (call_indirect (type $i32_to_i32) (local.get $x) (i32.const 2)))
+  (func (export "call-3") (param $x i32) (result i32)
+    (call_indirect (type $i32_to_i32) (local.get $x) (i32.const 3)))
+  (func (export "call-4") (param $x i32) (result i32)
+    (call_indirect (type $i32_to_i32) (local.get $x) (i32.const 4)))
+  (func (export "call-1-void")
+    (call_indirect (type $void) (i32.const 1)))
+)
+
+(assert_return (invoke "call-0" (i32.const 5)) (i32.const 6))
+(assert_trap (invoke "call-1" (i32.const 5)) "indirect call type mismatch")
+(assert_trap (invoke "call-2" (i32.const 5)) "uninitialized element")
+(assert_return (invoke "call-3" (i32.const 5)) (i32.const 4))
+(assert_trap (invoke "call-4" (i32.const 5)) "undefined element")
+(assert_return (invoke "call-1-void"))
+
+;; call_indirect with element indices in a small range through an immutable table.
+(module
+  (type $i32_to_i32 (func (param i32) (result i32)))
+  (type $i32_to_i32_i32 (func (param i32) (result i32 i32)))
+  (type $void (func))
+  (table 6 6 funcref)
+  (elem (i32.const 0) $inc $dec $inc $nop $split)
+  (func $inc (type $i32_to_i32) (i32.add (local.get 0) (i32.const 1)))
+  (func $dec (type $i32_to_i32) (i32.sub (local.get 0) (i32.const 1)))
+  (func $nop (type $void))
+  (func $split (type $i32_to_i32_i32)
+    (i32.shr_u (local.get 0) (i32.const 16))
+    (i32.and (local.get 0) (i32.const 0xffff)))
+
+  ;; The element index is in [0, 7], which extends past the end of the table.
+  (func (export "call-masked") (param $index i32) (param $x i32) (result i32)
+    (call_indirect (type $i32_to_i32)
+      (local.get $x)
+      (i32.and (local.get $index) (i32.const 7))))
+
+  ;; The element index is in [4, 5].
+  (func (export "call-split") (param $index i32) (param $x i32) (result i32 i32)
+    (call_indirect (type $i32_to_i32_i32)
+      (local.get $x)
+      (i32.or (i32.and (local.get $index) (i32.const 1)) (i32.const 4))))
+
+  ;; The element index is in [0, 3], and the call is in a loop that sums the results.
+  (func (export "sum") (param $n i32) (result i32)
+    (local $i i32)
+    (local $acc i32)
+    (block $done
+      (loop $loop
+        (br_if $done (i32.ge_u (local.get $i) (local.get $n)))
+        (local.set $acc
+          (call_indirect (type $i32_to_i32)
+            (local.get $acc)
+            (i32.and (local.get $i) (i32.const 1))))
+        (local.set $i (i32.add (local.get $i) (i32.const 1)))
+        (br $loop)))
+    (local.get $acc))
+)
+
+(assert_return (invoke "call-masked" (i32.const 0) (i32.const 5)) (i32.const 6))
+(assert_return (invoke "call-masked" (i32.const 1) (i32.const 5)) (i32.const 4))
+(assert_return (invoke "call-masked" (i32.const 2) (i32.const 5)) (i32.const 6))
+(assert_trap (invoke "call-masked" (i32.const 3) (i32.const 5)) "indirect call type mismatch")
+(assert_trap (invoke "call-masked" (i32.const 4) (i32.const 5)) "indirect call type mismatch")
+(assert_trap (invoke "call-masked" (i32.const 5) (i32.const 5)) "uninitialized element")
+(assert_trap (invoke "call-masked" (i32.const 6) (i32.const 5)) "undefined element")
+(assert_return (invoke "call-masked" (i32.const 8) (i32.const 5)) (i32.const 6))
+(assert_return (invoke "call-split" (i32.const 0) (i32.const 0x12345))
+  (i32.const 0x1) (i32.const 0x2345))
+(assert_trap (invoke "call-split" (i32.const 1) (i32.const 0x12345)) "uninitialized element")
+(assert_return (invoke "sum" (i32.const 0)) (i32.const 0))
+(assert_return (invoke "sum" (i32.const 5)) (i32.const 1))
+(assert_return (invoke "sum" (i32.const 6)) (i32.const 0))
+
+;; call_indirect with a constant element index through a table that is mutated by table.set.
+(module
+  (type $i32_to_i32 (func (param i32) (result i32)))
+  (table 1 1 funcref)
+  (elem (i32.const 0) $inc)
+  (elem declare func $dec)
+  (func $inc (type $i32_to_i32) (i32.add (local.get 0) (i32.const 1)))
+  (func $dec (type $i32_to_i32) (i32.sub (local.get 0) (i32.const 1)))
+  (func (export "set-dec") (table.set (i32.const 0) (ref.func $dec)))
+  (func (export "call-0") (param $x i32) (result i32)
+    (call_indirect (type $i32_to_i32) (local.get $x) (i32.const 0)))
+)
+
+(assert_return (invoke "call-0" (i32.const 5)) (i32.const 6))
+(invoke "set-dec")
+(assert_return (invoke "call-0" (i32.const 5)) (i32.const 4))
+
+;; A module with an exported table at index 0, which other modules may mutate, and an immutable
+;; table at index 1. call_indirect through the immutable table is compiled without a type check,
+;; and devirtualized with --devirtualize-indirect-calls, while call_indirect through the exported
+;; table keeps its type check.
+(module $multi_table
+  (type $i32_to_i32 (func (param i32) (result i32)))
+  (type $void (func))
+  (table $exported (export "table") 2 2 funcref)
+  (table $immutable 3 3 funcref)
+  (elem (table $exported) (i32.const 0) func $inc $inc)
+  (elem (table $immutable) (i32.const 0) func $double $square $double)
+  (func $inc (type $i32_to_i32) (i32.add (local.get 0) (i32.const 1)))
+  (func $double (type $i32_to_i32) (i32.mul (local.get 0) (i32.const 2)))
+  (func $square (type $i32_to_i32) (i32.mul (local.get 0) (local.get 0)))
+  (func (export "call-exported") (param $index i32) (param $x i32) (result i32)
+    (call_indirect $exported (type $i32_to_i32) (local.get $x) (local.get $index)))
+  (func (export "call-immutable") (param $index i32) (param $x i32) (result i32)
+    (call_indirect $immutable (type $i32_to_i32) (local.get $x) (local.get $index)))
+  (func (export "call-immutable-1") (param $x i32) (result i32)
+    (call_indirect $immutable (type $i32_to_i32) (local.get $x) (i32.const 1)))
+  (func (export "call-immutable-masked") (param $index i32) (param $x i32) (result i32)
+    (call_indirect $immutable (type $i32_to_i32)
+      (local.get $x)
+      (i32.and (local.get $index) (i32.const 3))))
+)
+(register "multi_table" $multi_table)
+
+(assert_return (invoke "call-immutable" (i32.const 0) (i32.const 5)) (i32.const 10))
+(assert_return (invoke "call-immutable" (i32.const 1) (i32.const 5)) (i32.const 25))
+(assert_return (invoke "call-immutable" (i32.const 2) (i32.const 5)) (i32.const 10))
+(assert_trap (invoke "call-immutable" (i32.const 3) (i32.const 5)) "undefined element")
+(assert_trap (invoke "call-immutable" (i32.const -1) (i32.const 5)) "undefined element")
+(assert_return (invoke "call-immutable-1" (i32.const 5)) (i32.const 25))
+(assert_return (invoke "call-immutable-masked" (i32.const 2) (i32.const 5)) (i32.const 10))
+(assert_trap (invoke "call-immutable-masked" (i32.const 3) (i32.const 5)) "undefined element")
+(assert_return (invoke "call-exported" (i32.const 1) (i32.const 5)) (i32.const 6))
+
+;; Another module writes a function of a different type to the exported table.
+(module
+  (type $void (func))
+  (import "multi_table" "table" (table $table 2 2 funcref))
+  (func $nop (type $void))
+  (elem (table $table) (i32.const 1) func $nop)
+)
+
+(assert_return (invoke $multi_table "call-exported" (i32.const 0) (i32.const 5)) (i32.const 6))
+(assert_trap (invoke $multi_table "call-exported" (i32.const 1) (i32.const 5))
+  "indirect call type mismatch")
+(assert_return (invoke $multi_table "call-immutable" (i32.const 1) (i32.const 5)) (i32.const 25))
+
+;; A module whose table at index 0 is mutated by table.set, and whose immutable table at index 2
+;; contains functions of different types.
+(module
+  (type $i32_to_i32 (func (param i32) (result i32)))
+  (type $void (func))
+  (table $mutable 1 1 funcref)
+  (table $empty 0 0 funcref)
+  (table $immutable 2 2 funcref)
+  (elem (table $mutable) (i32.const 0) func $inc)
+  (elem (table $immutable) (i32.const 0) func $double $nop)
+  (elem declare func $nop)
+  (func $inc (type $i32_to_i32) (i32.add (local.get 0) (i32.const 1)))
+  (func $double (type $i32_to_i32) (i32.mul (local.get 0) (i32.const 2)))
+  (func $nop (type $void))
+  (func (export "set-nop") (table.set $mutable (i32.const 0) (ref.func $nop)))
+  (func (export "call-mutable-0") (param $x i32) (result i32)
+    (call_indirect $mutable (type $i32_to_i32) (local.get $x) (i32.const 0)))
+  (func (export "call-empty") (param $index i32) (param $x i32) (result i32)
+    (call_indirect $empty (type $i32_to_i32) (local.get $x) (local.get $index)))
+  (func (export "call-immutable-0") (param $x i32) (result i32)
+    (call_indirect $immutable (type $i32_to_i32) (local.get $x) (i32.const 0)))
+  (func (export "call-immutable-1") (param $x i32) (result i32)
+    (call_indirect $immutable (type $i32_to_i32) (local.get $x) (i32.const 1)))
+)
+
+(assert_return (invoke "call-mutable-0" (i32.const 5)) (i32.const 6))
+(assert_trap (invoke "call-empty" (i32.const 0) (i32.const 5)) "undefined element")
+(assert_return (invoke "call-immutable-0" (i32.const 5)) (i32.const 10))
+(assert_trap (invoke "call-immutable-1" (i32.const 5)) "indirect call type mismatch")
+(invoke "set-nop")
+(assert_trap (invoke "call-mutable-0" (i32.const 5)) "indirect call type mismatch")
+(assert_return (invoke "call-immutable-0" (i32.const 5)) (i32.const 10))
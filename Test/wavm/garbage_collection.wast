@@ -0,0 +1,42 @@
+;; The test script runner collects young garbage before it instantiates each module. A young
+;; garbage collection assumes that objects that survived a previous garbage collection are
+;; referenced, so these tests check that it doesn't free young objects that are only referenced by
+;; old tables and globals.
+
+(module $A
+  (type $i32_to_i32 (func (param i32) (result i32)))
+  (table $table (export "table") 2 funcref)
+  (global $global (export "global") (mut funcref) (ref.null func))
+  (func (export "call-table") (param $x i32) (result i32)
+    (call_indirect (type $i32_to_i32) (local.get $x) (i32.const 0)))
+  (func (export "call-global") (param $x i32) (result i32)
+    (table.set $table (i32.const 1) (global.get $global))
+    (call_indirect (type $i32_to_i32) (local.get $x) (i32.const 1)))
+)
+(register "A" $A)
+
+;; A module whose instance is only referenced by the element that it writes to A's table.
+(module
+  (type $i32_to_i32 (func (param i32) (result i32)))
+  (import "A" "table" (table 2 funcref))
+  (elem (i32.const 0) $inc)
+  (func $inc (type $i32_to_i32) (i32.add (local.get 0) (i32.const 1)))
+)
+
+;; A module whose instance is only referenced by the value that its start function writes to A's
+;; global.
+(module
+  (type $i32_to_i32 (func (param i32) (result i32)))
+  (import "A" "global" (global $global (mut funcref)))
+  (elem declare func $dec)
+  (func $dec (type $i32_to_i32) (i32.sub (local.get 0) (i32.const 1)))
+  (func $start (global.set $global (ref.func $dec)))
+  (start $start)
+)
+
+;; Instantiate another module, so the test script no longer references the previous module's
+;; instance.
+(module)
+
+(assert_return (invoke $A "call-table" (i32.const 5)) (i32.const 6))
+(assert_return (invoke $A "call-global" (i32.const 5)) (i32.const 4))